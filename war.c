@@ -1,499 +1,8985 @@
+#define _GNU_SOURCE // accept4 (modo servidor); deve vir antes de qualquer include.
 #include <stdio.h>   // Inclui a biblioteca padrao de entrada e saida (printf, scanf, fgets, etc.)
 #include <stdlib.h>  // Inclui a biblioteca padrao (malloc, calloc, free, rand, srand) para alocacao dinamica e numeros aleatorios.
 #include <string.h>  // Inclui a biblioteca para manipulacao de strings (strcspn, strcpy, strcmp).
 #include <unistd.h>  // Biblioteca para manipulacao do tempo(sleep), simula tempo de espera.
-#include <time.h>    // Inclui a biblioteca para manipulacao de tempo (time), usada para inicializar o rand().
+#include <time.h>    // Inclui a biblioteca para manipulacao de tempo (time, clock_gettime): semente padrao e medicao da simulacao.
+#include <stdarg.h>  // Lista de argumentos variaveis (va_list), usada pela funcao mensagem().
+#include <pthread.h> // Threads (pthread_create, mutex) para o torneio de simulacao em varios nucleos.
+#include <stdint.h>  // Inteiros de tamanho fixo (uint32_t, uint64_t) usados pelo gerador de dados.
+#include <stddef.h>  // offsetof, usado para conferir o layout do formato binario de mapas.
+#include <fcntl.h>   // open, para ler arquivos de mapa.
+#include <sys/mman.h> // mmap, para ler arquivos de mapa grandes sem copias intermediarias.
+#include <sys/stat.h> // fstat, para saber o tamanho dos arquivos de mapa.
+#include <sys/resource.h> // getrusage, pico de memoria no benchmark (--bench).
+#include <math.h>    // log e sqrt do UCT da IA (MCTS); compilar com -lm.
+#include <limits.h>  // INT_MAX e LLONG_MAX (limites das buscas da IA).
+#include <errno.h>   // errno (EAGAIN, EINTR) no laco de eventos do servidor.
+#include <signal.h>  // sigaction: SIGINT/SIGTERM encerram o servidor.
+#include <sys/epoll.h>  // epoll, o laco de eventos do modo servidor (--servidor).
+#include <sys/socket.h> // Sockets do modo servidor.
+#include <sys/un.h>     // Socket Unix (sockaddr_un).
+#include <netinet/in.h> // Porta TCP local (sockaddr_in, INADDR_LOOPBACK).
+#include <netinet/tcp.h> // TCP_NODELAY.
+#include <strings.h>    // strcasecmp (comandos do servidor).
 
 // ------------------------------------------------------------------------------------------------
 // --- DEFINICOES DE ESTRUTURAS E VARIAVEIS GLOBAIS ---
 // ------------------------------------------------------------------------------------------------
 
+#define TAMANHO_NOME 30 // Tamanho maximo do nome de um territorio (29 caracteres + '\0').
+#define TAMANHO_COR 10  // Tamanho maximo do nome de uma cor (9 caracteres + '\0').
+
 // Define a estrutura de dados que representa um território no jogo.
 typedef struct {
-    char nome[30];  // Nome do território.
-    char cor[10];   // Cor do exército que controla o território (o "dono").
+    char nome[TAMANHO_NOME]; // Nome do território.
+    int dono;       // ID da cor do exército que controla o território (ver RegistroCores).
     int tropas;     // Quantidade de tropas estacionadas no território.
 } Territorio;
 
 // NOVA ESTRUTURA: Define a estrutura de dados que representa um jogador.
 typedef struct {
-    char cor[10];           // Cor do exército do jogador (Ex: "Vermelho").
-    char* missao;           // PONTEIRO para a string da missão, alocada dinamicamente.
+    char cor[TAMANHO_COR];  // Cor do exército do jogador (Ex: "Vermelho").
+    int id_cor;             // ID da cor no registro da partida (comparado com Territorio.dono).
+    int id_missao;          // ID da missão na tabela de missões (g_missoes).
+    int alvo_missao;        // ID da cor medida pela missão (resolvido na atribuição).
     int territorios_conquistados; // Contador para a lógica de vitória da missão.
 } Jogador;
 
+// Gerador de numeros aleatorios PCG32: estado explicito, sem estado global escondido.
+// Cada partida tem o seu, e o "incremento" seleciona um fluxo independente.
+typedef struct {
+    uint64_t estado;
+    uint64_t incremento;
+} GeradorDados;
+
+#define FAIXAS_DADOS 8             // Geradores lado a lado na rolagem em lote (vetorizavel).
+#define BLOCO_DADOS 512            // Dados gerados por bloco na rolagem em lote (multiplo de FAIXAS_DADOS).
+
+// Vetor de FAIXAS_DADOS inteiros de 32 bits (extensao de vetores do GCC/Clang).
+typedef uint32_t VetorDados __attribute__((vector_size(FAIXAS_DADOS * sizeof(uint32_t))));
+typedef unsigned char VetorBytesDados __attribute__((vector_size(FAIXAS_DADOS)));
+#define TAMANHO_RESERVA_DADOS 4096 // Dados rolados de uma vez e consumidos por rolar_dado().
+
+// Registro das cores da partida: cada nome de cor e guardado (internado) uma unica vez e
+// recebe um ID inteiro, de modo que comparar e trocar donos sao operacoes com inteiros.
+typedef struct {
+    char (*nomes)[TAMANHO_COR]; // nomes[id] = nome da cor.
+    int total;                  // Quantidade de cores registradas.
+    int capacidade;             // Capacidade do vetor de nomes.
+    int* tabela;                // Tabela hash (enderecamento aberto): ID + 1, ou 0 se vazia.
+    int capacidade_tabela;      // Tamanho da tabela (potencia de 2).
+} RegistroCores;
+
+#define LIMIAR_TERRITORIO_FORTE 5 // Territorios com MAIS tropas que isso contam como "fortes" (missao 5).
+
+// Totais de um dono (cor), mantidos a cada conquista e mudanca de tropas, para que
+// as missoes sejam verificadas sem percorrer o mapa.
+typedef struct {
+    int territorios;         // Territorios controlados.
+    long long tropas;        // Soma das tropas em todos os territorios controlados.
+    int territorios_fortes;  // Territorios controlados com mais de LIMIAR_TERRITORIO_FORTE tropas.
+    int territorios_fronteira; // Territorios com algum vizinho de outra cor (so em mapas com grafo).
+} AgregadoDono;
+
+// Grafo de vizinhanca do mapa em formato CSR (compressed sparse row): os vizinhos do territorio i
+// sao vizinhos[inicio[i]] .. vizinhos[inicio[i + 1] - 1], em ordem crescente e sem repeticao.
+// Cada aresta aparece nos dois sentidos. Dois vetores contiguos: percorrer os vizinhos e uma
+// leitura sequencial, sem ponteiros por territorio, mesmo com milhoes de territorios.
+typedef struct {
+    uint32_t* inicio;    // num_territorios + 1 posicoes.
+    uint32_t* vizinhos;  // inicio[num_territorios] entradas.
+    int num_territorios;
+} GrafoMapa;
+
+struct Diario;
+struct IndiceSequencias;
+
+// Bloco de memoria de uma arena (os blocos antigos ficam encadeados ate o proximo reinicio).
+typedef struct BlocoArena {
+    struct BlocoArena* anterior;
+    size_t capacidade;
+    unsigned char dados[];
+} BlocoArena;
+
+// Arena de uma sessao de jogo: os vetores da partida e dos jogadores sao reservados avancando um
+// ponteiro e devolvidos todos de uma vez (reiniciar_arena), sem um free por vetor.
+typedef struct Arena {
+    BlocoArena* bloco;  // Bloco atual.
+    size_t usado;       // Bytes usados no bloco atual.
+    size_t total;       // Bytes reservados desde o ultimo reinicio (todos os blocos).
+    size_t pico;        // Maior total ja atingido.
+    struct Arena* proxima_livre; // Encadeamento no pool de arenas livres.
+} Arena;
+
+// Pool de arenas livres, compartilhado pelas threads: uma arena devolvida por uma thread e
+// reaproveitada por qualquer outra, sem devolver os blocos ao sistema.
+typedef struct {
+    pthread_mutex_t trava;
+    Arena* livres;
+    int criadas; // Arenas criadas pelo pool (no maximo uma por sessao simultanea).
+} PoolArenas;
+
+// Estado de uma partida. Cada partida (interativa ou simulada) tem o seu, sem estado global,
+// para que varias partidas possam rodar ao mesmo tempo em threads diferentes.
+typedef struct {
+    Territorio* mapa;     // Array dinamico de territorios.
+    int num_territorios;  // Quantidade de territorios do mapa.
+    RegistroCores cores;  // Cores (donos) da partida.
+    AgregadoDono* agregados;  // agregados[id da cor] = totais daquele dono.
+    int capacidade_agregados; // Tamanho do vetor de agregados.
+    GeradorDados gerador; // Gerador aleatorio da partida.
+    unsigned char reserva_dados[TAMANHO_RESERVA_DADOS]; // Dados ja rolados, ainda nao usados.
+    int posicao_reserva;  // Proximo dado da reserva.
+    int fim_reserva;      // Quantidade de dados validos na reserva.
+    struct Diario* diario; // Diario de batalhas (--diario); NULL = desligado.
+    GrafoMapa* grafo;      // Vizinhanca do mapa; NULL = mapa sem fronteiras (todos atacam todos).
+    int grafo_compartilhado;  // 1 se o grafo pertence a outra partida (mapa modelo da simulacao).
+    unsigned char* fronteira; // fronteira[i] = 1 se o territorio i tem vizinho de outra cor (com grafo).
+    uint32_t* marcas_regiao;  // Busca de regioes: geracao da ultima visita de cada territorio.
+    uint32_t* fila_regiao;    // Busca de regioes: fila da busca em largura.
+    uint32_t geracao_regiao;  // Geracao atual (evita zerar as marcas a cada busca).
+    // Indice de territorios por dono: listas encadeadas dentro de vetores (ver construir_indice_donos).
+    int32_t* primeiro_do_dono; // primeiro_do_dono[cor] = primeiro territorio da cor, ou -1; NULL = sem indice.
+    int capacidade_indice;     // Cores cobertas pelo indice.
+    int territorios_indice;    // Territorios cobertos pelo indice.
+    int32_t* proximo_do_dono;  // proximo_do_dono[i] = proximo territorio do mesmo dono, ou -1.
+    int32_t* anterior_do_dono; // anterior_do_dono[i] = territorio anterior do mesmo dono, ou -1.
+    struct IndiceSequencias* sequencias; // Sequencias contiguas e tropas por intervalo; NULL = sem indice.
+    // Indice de nomes (ver construir_indice_nomes): territorio + 1 (negativo se o nome se repete), ou 0 se vazia.
+    int32_t* tabela_nomes;     // NULL = sem indice (buscar_territorio percorre o mapa).
+    uint32_t capacidade_nomes; // Tamanho da tabela de nomes (potencia de 2).
+    int nomes_repetidos;       // Territorios que repetem o nome de um anterior.
+    struct HistoricoVersoes* versoes; // Versoes do mapa com copia na escrita (desfazer e analise); NULL = desligado.
+    Arena* arena; // Arena da sessao: se nao for NULL, os vetores acima (menos cores e grafo) vem dela.
+} Partida;
+
+// Formato binario de mapas (--map), little-endian:
+//   cabecalho (CabecalhoMapaBinario, 24 bytes)
+//   num_cores nomes de cor com TAMANHO_COR bytes cada (terminados em '\0')
+//   zeros ate o proximo multiplo de 8
+//   num_territorios registros de TAMANHO_REGISTRO_MAPA bytes:
+//     nome[TAMANHO_NOME], 2 bytes zerados, dono (int32, indice na tabela de cores), tropas (int32)
+//   se num_vizinhos > 0, o grafo em CSR (ver GrafoMapa): num_territorios + 1 inicios (uint32)
+//     e num_vizinhos vizinhos (uint32)
+// O registro tem o mesmo layout do Territorio em memoria, entao o bloco pode ser copiado direto.
+#define MAGICA_MAPA_BINARIO "WARM"
+#define VERSAO_MAPA_BINARIO 1
+#define TAMANHO_REGISTRO_MAPA 40
+
+typedef struct {
+    char magica[4];           // MAGICA_MAPA_BINARIO
+    uint32_t versao;          // VERSAO_MAPA_BINARIO
+    uint32_t num_cores;
+    uint32_t num_vizinhos;    // Entradas do grafo (0 = mapa sem grafo; era um campo reservado, zero).
+    uint64_t num_territorios;
+} CabecalhoMapaBinario;
+
+// Arredonda uma posicao do arquivo binario para o proximo multiplo de 8.
+#define alinhar_binario(posicao) (((size_t)(posicao) + 7) & ~(size_t)7)
+
+// Posicao (alinhada em 8 bytes) do primeiro territorio no arquivo binario.
+#define offset_territorios_binario(num_cores) \
+    alinhar_binario(sizeof(CabecalhoMapaBinario) + (size_t)(num_cores) * TAMANHO_COR)
+
+// Formato binario do estado salvo de uma partida (snapshot), little-endian:
+//   cabecalho (CabecalhoEstado, 64 bytes)
+//   fim_reserva - posicao_reserva dados da reserva ainda nao usados (1 byte cada)
+//   tabela de cores (como no mapa binario), zeros ate o proximo multiplo de 8
+//   num_jogadores registros de TAMANHO_REGISTRO_JOGADOR bytes:
+//     cor[TAMANHO_COR], 2 bytes zerados, id_cor, id_missao, alvo_missao, territorios_conquistados (int32)
+//   zeros ate o proximo multiplo de 8, territorios (registros do mapa binario)
+//   grafo (como no mapa binario), se num_vizinhos > 0
+// Com o gerador e a reserva de dados salvos, a partida retomada rola exatamente os mesmos dados.
+#define MAGICA_ESTADO "WARS"
+#define VERSAO_ESTADO 1
+#define TAMANHO_REGISTRO_JOGADOR 28
+#define MAX_JOGADORES_ESTADO 8 // Jogadores guardados em um estado salvo.
+
+typedef struct {
+    char magica[4];           // MAGICA_ESTADO
+    uint32_t versao;          // VERSAO_ESTADO
+    uint32_t num_cores;
+    uint32_t num_jogadores;
+    uint64_t num_territorios;
+    uint64_t rodada;          // Rodadas ja jogadas.
+    uint64_t gerador_estado;  // Estado do GeradorDados.
+    uint64_t gerador_incremento;
+    uint32_t posicao_reserva; // Reserva de dados da partida.
+    uint32_t fim_reserva;
+    uint64_t num_vizinhos;    // Entradas do grafo (0 = mapa sem grafo; era um campo reservado, zero).
+} CabecalhoEstado;
+
+// Jogadores e rodada lidos de um estado salvo (num_jogadores = 0 quando o arquivo e so um mapa).
+typedef struct {
+    Jogador jogadores[MAX_JOGADORES_ESTADO];
+    int num_jogadores;
+    long long rodada;
+} EstadoSalvo;
+
+// Formato do diario de batalhas (--diario), little-endian, so acrescentado:
+//   cabecalho (CabecalhoDiario, 24 bytes)
+//   eventos de TAMANHO_EVENTO_DIARIO bytes:
+//     atacante, defensor (uint32), tipo, dado_ataque, dado_defesa, conquista (uint8),
+//     delta_atacante, delta_defensor, dono_atacante (int32)
+// Cada partida e um trecho EVENTO_INICIO ... EVENTO_FIM. O inicio guarda o indice da partida
+// (atacante = 32 bits baixos, defensor = 32 bits altos) e o fim guarda o hash do mapa final
+// (delta_atacante = 32 bits baixos, delta_defensor = 32 bits altos). Os trechos de partidas
+// diferentes podem aparecer em qualquer ordem (threads da simulacao).
+#define MAGICA_DIARIO "WARJ"
+#define VERSAO_DIARIO 1
+#define TAMANHO_EVENTO_DIARIO 24
+#define LIMITE_BUFFER_DIARIO (1 << 16) // Bytes acumulados antes de gravar no arquivo.
+
+enum { EVENTO_BATALHA = 0, EVENTO_FIM = 1, EVENTO_INICIO = 2 };
+
+typedef struct {
+    char magica[4];           // MAGICA_DIARIO
+    uint32_t versao;          // VERSAO_DIARIO
+    uint64_t num_territorios; // Mapa inicial esperado no replay.
+    uint64_t hash_inicial;    // hash_mapa() do mapa inicial.
+} CabecalhoDiario;
+
+// Diario aberto. Na simulacao cada thread tem o seu buffer e todas gravam no mesmo arquivo,
+// sob a trava, sempre com partidas inteiras.
+typedef struct Diario {
+    FILE* arquivo;
+    pthread_mutex_t* trava;   // NULL quando so uma thread grava.
+    unsigned char* buffer;
+    size_t usados;
+    size_t capacidade;
+    long long eventos;        // Batalhas registradas.
+    int erro;                 // Falha de escrita ou de alocacao.
+} Diario;
+
+// Modo silencioso: quando ligado (simulacao), nao ha impressao passo a passo nem pausas.
+int g_modo_silencioso = 0;
+
+// Metrica medida por uma missao.
+typedef enum {
+    METRICA_CONQUISTAS_SEGUIDAS, // Conquistas seguidas do jogador (sem ataque fracassado no meio).
+    METRICA_TERRITORIOS,         // Territorios controlados pela cor alvo.
+    METRICA_TROPAS,              // Tropas da cor alvo somadas em todo o mapa.
+    METRICA_TERRITORIOS_FORTES,  // Territorios da cor alvo com mais de LIMIAR_TERRITORIO_FORTE tropas.
+    METRICA_MAIOR_SEQUENCIA      // Maior sequencia de territorios seguidos (indices consecutivos) da cor alvo.
+} MetricaMissao;
+
+#define NUM_METRICAS 5
+
+// Nome de cada metrica no arquivo de missoes (--missoes), na ordem de MetricaMissao.
+const char* NOMES_METRICAS[] = { "seguidas", "territorios", "tropas", "fortes", "sequencia" };
+
+// Condicao que compara a metrica com o limiar.
+typedef enum {
+    CONDICAO_MAIOR_IGUAL, // >=
+    CONDICAO_MENOR_IGUAL, // <=
+    CONDICAO_IGUAL        // ==
+} CondicaoMissao;
+
+// Missao como predicado: "metrica(alvo) condicao limiar".
+typedef struct {
+    MetricaMissao tipo;
+    char alvo[TAMANHO_COR];  // Cor alvo; vazio = a cor do proprio jogador.
+    CondicaoMissao condicao;
+    long long limiar;
+    char descricao[64];      // Texto exibido ao jogador.
+} Missao;
+
+#define MAX_MISSOES 64 // Quantidade maxima de missoes em uma tabela.
 
-// Variavel Global para o Numero de Territorios
-int g_num_territorios = 0;
+typedef struct {
+    Missao missoes[MAX_MISSOES];
+    int total;
+} TabelaMissoes;
 
-// Vetor de strings com as missões estratégicas pré-definidas.
-char* MISSOES[] = {
-    "Conquistar 3 territorios seguidos.",
-    "Eliminar todas as tropas da cor Vermelha.",
-    "Controlar pelo menos 5 territorios.",
-    "Ter pelo menos 15 tropas distribuidas.",
-    "Conquistar 2 territorios com mais de 5 tropas."
+// Tabela de missões estratégicas. Começa com as missões pré-definidas e pode ser
+// substituída por um arquivo (--missoes). Só é alterada antes de qualquer partida começar.
+TabelaMissoes g_missoes = {
+    {
+        { METRICA_CONQUISTAS_SEGUIDAS, "",         CONDICAO_MAIOR_IGUAL, 3,  "Conquistar 3 territorios seguidos." },
+        { METRICA_TROPAS,              "Vermelha", CONDICAO_MENOR_IGUAL, 0,  "Eliminar todas as tropas da cor Vermelha." },
+        { METRICA_TERRITORIOS,         "",         CONDICAO_MAIOR_IGUAL, 5,  "Controlar pelo menos 5 territorios." },
+        { METRICA_TROPAS,              "",         CONDICAO_MAIOR_IGUAL, 15, "Ter pelo menos 15 tropas distribuidas." },
+        { METRICA_TERRITORIOS_FORTES,  "",         CONDICAO_MAIOR_IGUAL, 2,  "Conquistar 2 territorios com mais de 5 tropas." }
+    },
+    5
 };
-const int TOTAL_MISSOES = sizeof(MISSOES) / sizeof(MISSOES[0]);
 
 
 // ------------------------------------------------------------------------------------------------
 // --- PROTÓTIPOS DE FUNÇÕES (NOVAS) ---
 // ------------------------------------------------------------------------------------------------
-void atribuirMissao(Jogador* jogador);
-int verificarMissao(Jogador* jogador, Territorio* mapa);
+void atribuirMissao(Jogador* jogador, Partida* partida);
+int verificarMissao(Jogador* jogador, const Partida* partida);
 void exibirMissao(const Jogador* jogador);
+uint32_t gerador_proximo(GeradorDados* gerador);
+int aplicar_batalha(Partida* partida, Territorio* atacante, Territorio* defensor, int dado_ataque, int dado_defesa);
+void atualizar_fronteiras(Partida* partida, uint32_t i, int dono_anterior);
+void mover_no_indice(Partida* partida, int32_t i, int dono_anterior);
+void liberar_indice_sequencias(Partida* partida);
+void atualizar_dono_sequencias(Partida* partida, uint32_t i, int dono_anterior);
+void atualizar_tropas_sequencias(Partida* partida, uint32_t i, long long delta);
+void registrar_mudanca_versao(Partida* partida, uint32_t i);
+void liberar_versoes(Partida* partida);
+void analisar_ataque(Partida* partida, const Jogador* jogador, int atacante, int defensor);
 
 
 // ------------------------------------------------------------------------------------------------
-// --- Funcoes Auxiliares ---
+// --- Instrumentacao (--stats) ---
 // ------------------------------------------------------------------------------------------------
 
+// Fases medidas (tempo e histograma de latencia por chamada).
+typedef enum {
+    FASE_ENTRADA,       // Leitura do teclado nos menus.
+    FASE_RENDERIZACAO,  // Montagem e escrita do mapa (exibir_territorios).
+    FASE_ATAQUE,        // Rolagem dos dados e resolucao da batalha em atacar (sem as pausas).
+    FASE_MISSAO,        // verificarMissao / avaliar_missoes.
+    FASE_ALOCACAO,      // Alocacao do mapa e dos agregados.
+    FASE_IA,            // Escolha de uma jogada pela IA (busca MCTS completa).
+    NUM_FASES
+} FaseExecucao;
+
+const char* NOMES_FASES[NUM_FASES] = { "entrada", "renderizacao", "ataque", "missao", "alocacao", "ia" };
+
+typedef enum {
+    CONTADOR_ATAQUES,           // Batalhas resolvidas.
+    CONTADOR_CONQUISTAS,        // Batalhas vencidas pelo atacante.
+    CONTADOR_VERIFICACOES,      // Missoes avaliadas (uma por jogador por verificacao).
+    CONTADOR_ALOCACOES,         // Blocos alocados (mapa e agregados).
+    CONTADOR_BYTES_ALOCADOS,
+    CONTADOR_QUADROS,           // Quadros escritos no terminal.
+    CONTADOR_ITERACOES_IA,      // Iteracoes (descida + rollout) da busca MCTS.
+    NUM_CONTADORES
+} ContadorExecucao;
+
+const char* NOMES_CONTADORES[NUM_CONTADORES] = {
+    "ataques", "conquistas", "verificacoes_missao", "alocacoes", "bytes_alocados", "quadros", "iteracoes_ia"
+};
+
+#define FAIXAS_HISTOGRAMA 40 // Faixa k = duracoes em [2^k, 2^(k+1)) ns.
+
+typedef struct {
+    long long contadores[NUM_CONTADORES];
+    long long chamadas[NUM_FASES];
+    long long ns_total[NUM_FASES];
+    long long ns_maximo[NUM_FASES];
+    long long histograma[NUM_FASES][FAIXAS_HISTOGRAMA];
+} EstatisticasExecucao;
+
+// Ligada por --stats antes de qualquer partida; desligada, cada ponto de medida custa um desvio.
+int g_estatisticas_ativas = 0;
+int g_estatisticas_json = 0; // --stats json: relatorio em JSON em vez de texto.
+
+// Cada thread acumula nas suas estatisticas, sem travas; no fim elas sao somadas no total.
+__thread EstatisticasExecucao t_estatisticas;
+EstatisticasExecucao g_estatisticas_total;
+pthread_mutex_t g_trava_estatisticas = PTHREAD_MUTEX_INITIALIZER;
+
 /**
- * @brief Limpa o buffer de entrada (stdin) após o uso de scanf.
- * Garante que o próximo fgets não leia uma string vazia.
+ * @brief Relogio monotonico em nanossegundos.
  */
-void limpar_buffer() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF); // Le e descarta caracteres
+static inline uint64_t agora_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
 }
 
 /**
- * @brief Simula a rolagem de um dado de 6 faces.
- * @return int: O valor sorteado do dado (1 a 6).
+ * @brief Inicio de uma medida de fase (0 se a instrumentacao esta desligada).
  */
-int rolar_dado() {
-    return (rand() % 6) + 1; // Gera numero entre 1 e 6.
+static inline uint64_t inicio_fase(void) {
+    return __builtin_expect(g_estatisticas_ativas, 0) ? agora_ns() : 0;
 }
 
-// ------------------------------------------------------------------------------------------------
-// --- Funcoes de Gerenciamento de Memoria ---
-// ------------------------------------------------------------------------------------------------
+/**
+ * @brief Fim de uma medida de fase: soma o tempo e conta a chamada no histograma.
+ */
+static inline void fim_fase(FaseExecucao fase, uint64_t inicio) {
+    if (__builtin_expect(!g_estatisticas_ativas, 1)) return;
+
+    long long duracao = (long long)(agora_ns() - inicio);
+    int faixa = duracao > 0 ? 63 - __builtin_clzll((unsigned long long)duracao) : 0;
+    if (faixa >= FAIXAS_HISTOGRAMA) faixa = FAIXAS_HISTOGRAMA - 1;
+
+    t_estatisticas.chamadas[fase]++;
+    t_estatisticas.ns_total[fase] += duracao;
+    if (duracao > t_estatisticas.ns_maximo[fase]) t_estatisticas.ns_maximo[fase] = duracao;
+    t_estatisticas.histograma[fase][faixa]++;
+}
+
+/**
+ * @brief Soma n a um contador (nada se a instrumentacao esta desligada).
+ */
+static inline void contar(ContadorExecucao contador, long long n) {
+    if (__builtin_expect(g_estatisticas_ativas, 0)) t_estatisticas.contadores[contador] += n;
+}
+
+/**
+ * @brief Guarda as estatisticas da thread atual antes de jogadas simuladas (busca da IA, analise):
+ * com restaurar_estatisticas, o que elas contarem (ataques, conquistas, fases) e descartado.
+ */
+static inline void guardar_estatisticas(EstatisticasExecucao* guardadas) {
+    if (g_estatisticas_ativas) memcpy(guardadas, &t_estatisticas, sizeof(*guardadas));
+}
+
+/**
+ * @brief Volta as estatisticas da thread atual para as guardadas por guardar_estatisticas.
+ */
+static inline void restaurar_estatisticas(const EstatisticasExecucao* guardadas) {
+    if (g_estatisticas_ativas) memcpy(&t_estatisticas, guardadas, sizeof(*guardadas));
+}
 
 /**
- * @brief Libera a memória alocada dinamicamente para os territórios e, agora, para as missões.
- * @param mapa Ponteiro para o bloco de memória dos territórios.
- * @param jogador Ponteiro para a struct do jogador (inclui a missão alocada).
+ * @brief Soma as estatisticas da thread atual no total e as zera. Chamada por cada thread
+ * trabalhadora ao terminar e pela thread principal antes do relatorio.
  */
-void liberar_memoria(Territorio* mapa, Jogador* jogador) {
-    if (mapa != NULL) {
-        printf("\n--- Liberando memoria alocada ---\n");
-        free(mapa); // Libera a memória dos territórios.
-        printf("Memoria dos territorios liberada.\n");
+void juntar_estatisticas_thread(void) {
+    if (!g_estatisticas_ativas) return;
+
+    pthread_mutex_lock(&g_trava_estatisticas);
+    for (int c = 0; c < NUM_CONTADORES; c++) g_estatisticas_total.contadores[c] += t_estatisticas.contadores[c];
+    for (int f = 0; f < NUM_FASES; f++) {
+        g_estatisticas_total.chamadas[f] += t_estatisticas.chamadas[f];
+        g_estatisticas_total.ns_total[f] += t_estatisticas.ns_total[f];
+        if (t_estatisticas.ns_maximo[f] > g_estatisticas_total.ns_maximo[f]) {
+            g_estatisticas_total.ns_maximo[f] = t_estatisticas.ns_maximo[f];
+        }
+        for (int k = 0; k < FAIXAS_HISTOGRAMA; k++) g_estatisticas_total.histograma[f][k] += t_estatisticas.histograma[f][k];
     }
-    
-    // NOVO REQUISITO: Liberar a memória da missão.
-    if (jogador != NULL && jogador->missao != NULL) {
-        free(jogador->missao); // Libera a string da missão alocada com malloc.
-        printf("Memoria da missao do jogador liberada.\n");
+    pthread_mutex_unlock(&g_trava_estatisticas);
+    memset(&t_estatisticas, 0, sizeof(t_estatisticas));
+}
+
+/**
+ * @brief Percentil aproximado de uma fase: limite superior (2^(k+1) ns) da faixa que o contem.
+ */
+long long percentil_fase(const EstatisticasExecucao* e, int fase, double fracao) {
+    long long alvo = (long long)(fracao * e->chamadas[fase]);
+    long long acumulado = 0;
+
+    for (int k = 0; k < FAIXAS_HISTOGRAMA; k++) {
+        acumulado += e->histograma[fase][k];
+        if (acumulado > alvo) return 1LL << (k + 1);
     }
-    
+    return e->ns_maximo[fase];
 }
 
 /**
- * @brief Solicita o número de territórios ao usuário e aloca a memória necessária.
- * @return Territorio*: O ponteiro para o array de territórios alocado, ou NULL em caso de falha.
+ * @brief Relatorio do --stats, impresso na saida do programa (registrado com atexit).
  */
-Territorio* alocar_territorios() {
-    int num;
-    Territorio* mapa = NULL; 
+void imprimir_estatisticas_execucao(void) {
+    const EstatisticasExecucao* e = &g_estatisticas_total;
 
-    printf("\n==========================================\n");
-    printf("             *****JOGO WAR***** \n");
-    printf("             Iniciando o Jogo! \n");
-    printf("==========================================\n");
-    sleep(2); 
+    juntar_estatisticas_thread();
+    if (g_estatisticas_json) {
+        printf("{\"contadores\":{");
+        for (int c = 0; c < NUM_CONTADORES; c++) {
+            printf("%s\"%s\":%lld", c > 0 ? "," : "", NOMES_CONTADORES[c], e->contadores[c]);
+        }
+        printf("},\"fases\":{");
+        for (int f = 0; f < NUM_FASES; f++) {
+            printf("%s\"%s\":{\"chamadas\":%lld,\"total_ns\":%lld,\"media_ns\":%.1f,\"p50_ns\":%lld,"
+                   "\"p90_ns\":%lld,\"p99_ns\":%lld,\"max_ns\":%lld,\"histograma_log2_ns\":[",
+                   f > 0 ? "," : "", NOMES_FASES[f], e->chamadas[f], e->ns_total[f],
+                   e->chamadas[f] > 0 ? (double)e->ns_total[f] / e->chamadas[f] : 0.0,
+                   percentil_fase(e, f, 0.5), percentil_fase(e, f, 0.9), percentil_fase(e, f, 0.99), e->ns_maximo[f]);
+            for (int k = 0; k < FAIXAS_HISTOGRAMA; k++) printf("%s%lld", k > 0 ? "," : "", e->histograma[f][k]);
+            printf("]}");
+        }
+        printf("}}\n");
+        return;
+    }
 
+    printf("\n==========================================\n");
+    printf("         ESTATISTICAS DE EXECUCAO \n");
     printf("==========================================\n");
-    printf("         SISTEMA DE CONFIGURACAO \n");
+    for (int c = 0; c < NUM_CONTADORES; c++) printf("%-20s: %lld\n", NOMES_CONTADORES[c], e->contadores[c]);
+    printf("\n%-13s %12s %12s %10s %10s %10s %10s %12s\n", "fase", "chamadas", "total (ms)", "media(ns)",
+           "p50(ns)", "p90(ns)", "p99(ns)", "max(ns)");
+    for (int f = 0; f < NUM_FASES; f++) {
+        printf("%-13s %12lld %12.3f %10.0f %10lld %10lld %10lld %12lld\n", NOMES_FASES[f], e->chamadas[f],
+               e->ns_total[f] / 1e6, e->chamadas[f] > 0 ? (double)e->ns_total[f] / e->chamadas[f] : 0.0,
+               percentil_fase(e, f, 0.5), percentil_fase(e, f, 0.9), percentil_fase(e, f, 0.99), e->ns_maximo[f]);
+    }
+    printf("(percentis: limite superior da faixa log2 do histograma)\n");
     printf("==========================================\n");
+}
 
-    do {
-        printf("Digite o numero total de territorios a serem cadastrados: ");
-        if (scanf("%d", &num) != 1 || num <= 0) {
-            printf("Erro: Numero invalido. Digite um valor inteiro positivo.\n");
-            limpar_buffer();
-            num = 0;
+
+// ------------------------------------------------------------------------------------------------
+// --- Gerador de Numeros Aleatorios (Dados) ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Inicializa um gerador PCG32 com uma semente e um fluxo.
+ * Geradores com a mesma semente e fluxos diferentes produzem sequencias independentes.
+ * @param gerador Gerador a inicializar.
+ * @param semente Semente (a mesma semente reproduz a mesma sequencia).
+ * @param fluxo Numero do fluxo (ex: indice da partida na simulacao).
+ */
+void gerador_iniciar(GeradorDados* gerador, uint64_t semente, uint64_t fluxo) {
+    gerador->estado = 0;
+    gerador->incremento = (fluxo << 1) | 1u; // O incremento do PCG precisa ser impar.
+    gerador_proximo(gerador);
+    gerador->estado += semente;
+    gerador_proximo(gerador);
+}
+
+/**
+ * @brief Sorteia o proximo numero de 32 bits (PCG32, variante XSH-RR).
+ */
+uint32_t gerador_proximo(GeradorDados* gerador) {
+    uint64_t anterior = gerador->estado;
+    gerador->estado = anterior * 6364136223846793005ULL + gerador->incremento;
+    uint32_t xorshifted = (uint32_t)(((anterior >> 18) ^ anterior) >> 27);
+    uint32_t rotacao = (uint32_t)(anterior >> 59);
+    return (xorshifted >> rotacao) | (xorshifted << ((-rotacao) & 31));
+}
+
+/**
+ * @brief Sorteia um inteiro no intervalo [0, limite) sem vies de modulo (metodo de Lemire).
+ * @param limite Tamanho do intervalo (maior que 0).
+ */
+uint32_t gerador_intervalo(GeradorDados* gerador, uint32_t limite) {
+    uint64_t m = (uint64_t)gerador_proximo(gerador) * limite;
+    uint32_t baixo = (uint32_t)m;
+
+    if (baixo < limite) {
+        uint32_t limiar = (0u - limite) % limite; // 2^32 mod limite.
+        while (baixo < limiar) {
+            m = (uint64_t)gerador_proximo(gerador) * limite;
+            baixo = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+/**
+ * @brief Rola um dado de 6 faces sem vies.
+ * @return int: O valor sorteado (1 a 6).
+ */
+int gerador_d6(GeradorDados* gerador) {
+    return (int)gerador_intervalo(gerador, 6) + 1;
+}
+
+/**
+ * @brief Preenche um buffer com n rolagens de d6 (1 a 6), sem vies, em uma unica chamada.
+ * Usa FAIXAS_DADOS geradores xoshiro128** independentes lado a lado (semeados a partir do gerador
+ * principal) em um vetor do GCC: o compilador usa SSE/AVX/NEON quando a CPU suporta e codigo
+ * escalar quando nao. A sequencia e deterministica para a mesma semente e fluxo.
+ * @param gerador Gerador principal (avanca a cada chamada).
+ * @param destino Buffer de saida com pelo menos n posicoes.
+ * @param n Quantidade de dados a rolar.
+ */
+void gerador_preencher_d6(GeradorDados* gerador, unsigned char* destino, size_t n) {
+    uint32_t sementes[4][FAIXAS_DADOS];
+    VetorDados s0, s1, s2, s3;
+    size_t i = 0;
+
+    for (int k = 0; k < FAIXAS_DADOS; k++) {
+        sementes[0][k] = gerador_proximo(gerador);
+        sementes[1][k] = gerador_proximo(gerador);
+        sementes[2][k] = gerador_proximo(gerador);
+        sementes[3][k] = gerador_proximo(gerador) | 1u; // Estado nunca pode ser todo zero.
+    }
+    // Copia para os vetores (sem indexa-los, para que fiquem em registradores no laco).
+    memcpy(&s0, sementes[0], sizeof(s0));
+    memcpy(&s1, sementes[1], sizeof(s1));
+    memcpy(&s2, sementes[2], sizeof(s2));
+    memcpy(&s3, sementes[3], sizeof(s3));
+
+    while (i < n) {
+        unsigned char bloco[BLOCO_DADOS];
+        VetorDados rejeitados = {0};
+        size_t quantidade = (n - i < BLOCO_DADOS) ? n - i : BLOCO_DADOS;
+
+        for (int j = 0; j < (int)quantidade; j += FAIXAS_DADOS) {
+            // Passo do xoshiro128** em todas as faixas ao mesmo tempo. As multiplicacoes por
+            // constantes viram deslocamentos e somas, disponiveis em qualquer conjunto SIMD.
+            VetorDados x = (s1 << 2) + s1;          // s1 * 5
+            x = (x << 7) | (x >> 25);
+            x = (x << 3) + x;                       // * 9
+            VetorDados t = s1 << 9;
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            s3 = (s3 << 11) | (s3 >> 21);
+
+            // Dado = parte alta de x * 6 / 2^32 (Lemire), calculada so com inteiros de 32 bits.
+            VetorDados a = x >> 16, b = x & 0xFFFF;
+            VetorDados alto = ((a << 2) + (a << 1) + (((b << 2) + (b << 1)) >> 16)) >> 16;
+            // Parte baixa < 2^32 mod 6 = 4 causaria vies: rejeita. O teste "!= 0" e feito com
+            // deslocamentos (t | -t tem o bit de sinal ligado se t != 0) para nao sair do SIMD.
+            VetorDados baixo = ((x << 2) + (x << 1)) >> 2;
+            VetorDados aceito = 0 - ((baixo | (0 - baixo)) >> 31); // Mascara: todos os bits ou nenhum.
+            rejeitados |= ~aceito;
+            VetorBytesDados valores = __builtin_convertvector((alto + 1) & aceito, VetorBytesDados); // 0 = rejeitado.
+            memcpy(bloco + j, &valores, FAIXAS_DADOS);
+        }
+
+        // Caso rarissimo (~1 em 10^6 blocos): troca cada rolagem rejeitada por uma escalar, sem vies.
+        uint32_t houve_rejeicao[FAIXAS_DADOS];
+        memcpy(houve_rejeicao, &rejeitados, sizeof(houve_rejeicao));
+        for (int k = 0; k < FAIXAS_DADOS; k++) {
+            if (houve_rejeicao[k] == 0) continue;
+            for (int j = 0; j < (int)quantidade; j++) {
+                if (bloco[j] == 0) bloco[j] = (unsigned char)gerador_d6(gerador);
+            }
+            break;
+        }
+
+        memcpy(destino + i, bloco, quantidade);
+        i += quantidade;
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// --- Registro de Cores (Donos dos Territorios) ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Calcula o hash (FNV-1a) do nome de uma cor.
+ */
+uint32_t hash_texto(const char* texto) {
+    uint32_t h = 2166136261u;
+    while (*texto != '\0') {
+        h ^= (unsigned char)*texto++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief Procura o ID de uma cor ja registrada.
+ * @param registro Registro de cores da partida.
+ * @param nome Nome da cor.
+ * @return int: O ID da cor, ou -1 se a cor nao foi registrada.
+ */
+int buscar_cor(const RegistroCores* registro, const char* nome) {
+    if (registro->capacidade_tabela == 0) return -1;
+
+    uint32_t mascara = (uint32_t)registro->capacidade_tabela - 1;
+    for (uint32_t pos = hash_texto(nome) & mascara; ; pos = (pos + 1) & mascara) {
+        int id = registro->tabela[pos] - 1; // 0 na tabela = posicao vazia.
+        if (id < 0) return -1;
+        if (strcmp(registro->nomes[id], nome) == 0) return id;
+    }
+}
+
+/**
+ * @brief Registra (interna) uma cor e retorna seu ID. Se a cor ja existe, retorna o mesmo ID.
+ * Um registro zerado ({0}) e um registro vazio valido.
+ * @param registro Registro de cores da partida.
+ * @param nome Nome da cor (ate TAMANHO_COR - 1 caracteres; o excesso e descartado).
+ * @return int: O ID da cor (0, 1, 2, ...), ou -1 em caso de falha de alocacao.
+ */
+int registrar_cor(RegistroCores* registro, const char* nome) {
+    char nome_cortado[TAMANHO_COR];
+    snprintf(nome_cortado, sizeof(nome_cortado), "%s", nome);
+
+    int id = buscar_cor(registro, nome_cortado);
+    if (id >= 0) return id;
+
+    // Aumenta o vetor de nomes quando necessario.
+    if (registro->total == registro->capacidade) {
+        int nova_capacidade = registro->capacidade > 0 ? registro->capacidade * 2 : 8;
+        char (*novos_nomes)[TAMANHO_COR] = realloc(registro->nomes, (size_t)nova_capacidade * TAMANHO_COR);
+        if (novos_nomes == NULL) {
+            perror("Erro ao alocar memoria para o registro de cores");
+            return -1;
+        }
+        registro->nomes = novos_nomes;
+        registro->capacidade = nova_capacidade;
+    }
+
+    // Mantem a tabela hash com no maximo 50% de ocupacao.
+    if ((registro->total + 1) * 2 > registro->capacidade_tabela) {
+        int nova_capacidade = registro->capacidade_tabela > 0 ? registro->capacidade_tabela * 2 : 16;
+        int* nova_tabela = (int*)calloc(nova_capacidade, sizeof(int));
+        if (nova_tabela == NULL) {
+            perror("Erro ao alocar memoria para o registro de cores");
+            return -1;
+        }
+        for (int i = 0; i < registro->total; i++) {
+            uint32_t pos = hash_texto(registro->nomes[i]) & (uint32_t)(nova_capacidade - 1);
+            while (nova_tabela[pos] != 0) pos = (pos + 1) & (uint32_t)(nova_capacidade - 1);
+            nova_tabela[pos] = i + 1;
+        }
+        free(registro->tabela);
+        registro->tabela = nova_tabela;
+        registro->capacidade_tabela = nova_capacidade;
+    }
+
+    id = registro->total++;
+    strcpy(registro->nomes[id], nome_cortado);
+
+    uint32_t pos = hash_texto(nome_cortado) & (uint32_t)(registro->capacidade_tabela - 1);
+    while (registro->tabela[pos] != 0) pos = (pos + 1) & (uint32_t)(registro->capacidade_tabela - 1);
+    registro->tabela[pos] = id + 1;
+    return id;
+}
+
+/**
+ * @brief Retorna o nome de uma cor a partir do seu ID.
+ */
+const char* nome_cor(const RegistroCores* registro, int id) {
+    if (id < 0 || id >= registro->total) return "?";
+    return registro->nomes[id];
+}
+
+/**
+ * @brief Copia um registro de cores (os IDs continuam os mesmos na copia).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int copiar_registro_cores(RegistroCores* destino, const RegistroCores* origem) {
+    RegistroCores copia = *origem;
+
+    copia.nomes = malloc((size_t)origem->capacidade * TAMANHO_COR);
+    copia.tabela = (int*)malloc((size_t)origem->capacidade_tabela * sizeof(int));
+    if ((origem->capacidade > 0 && copia.nomes == NULL) || (origem->capacidade_tabela > 0 && copia.tabela == NULL)) {
+        perror("Erro ao alocar memoria para o registro de cores");
+        free(copia.nomes);
+        free(copia.tabela);
+        return 1;
+    }
+    if (origem->total > 0) memcpy(copia.nomes, origem->nomes, (size_t)origem->total * TAMANHO_COR);
+    if (origem->capacidade_tabela > 0) memcpy(copia.tabela, origem->tabela, (size_t)origem->capacidade_tabela * sizeof(int));
+    *destino = copia;
+    return 0;
+}
+
+/**
+ * @brief Libera a memoria do registro de cores e o deixa vazio.
+ */
+void liberar_registro_cores(RegistroCores* registro) {
+    free(registro->nomes);
+    free(registro->tabela);
+    memset(registro, 0, sizeof(*registro));
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// --- Arena de Sessao (memoria de uma partida) ---
+// ------------------------------------------------------------------------------------------------
+
+#define CAPACIDADE_INICIAL_ARENA (64 * 1024) // Primeiro bloco de uma arena nova.
+#define ALINHAMENTO_ARENA 16
+
+/**
+ * @brief Aloca um bloco de arena com pelo menos 'capacidade' bytes de dados.
+ */
+static BlocoArena* novo_bloco_arena(size_t capacidade, BlocoArena* anterior) {
+    uint64_t inicio = inicio_fase();
+    BlocoArena* bloco = (BlocoArena*)malloc(sizeof(BlocoArena) + capacidade);
+    fim_fase(FASE_ALOCACAO, inicio);
+    if (bloco == NULL) return NULL;
+    contar(CONTADOR_ALOCACOES, 1);
+    contar(CONTADOR_BYTES_ALOCADOS, (long long)(sizeof(BlocoArena) + capacidade));
+    bloco->anterior = anterior;
+    bloco->capacidade = capacidade;
+    return bloco;
+}
+
+/**
+ * @brief Reserva 'bytes' bytes da arena (alinhados a ALINHAMENTO_ARENA), sem zerar. Normalmente so
+ * avanca um ponteiro; quando o bloco atual acaba, encadeia um bloco novo (o dobro do anterior).
+ * @return void*: O espaco reservado, ou NULL em caso de falha de alocacao.
+ */
+void* alocar_na_arena(Arena* arena, size_t bytes) {
+    size_t tamanho = (bytes + ALINHAMENTO_ARENA - 1) & ~(size_t)(ALINHAMENTO_ARENA - 1);
+
+    if (arena->bloco == NULL || arena->usado + tamanho > arena->bloco->capacidade) {
+        size_t capacidade = arena->bloco != NULL ? arena->bloco->capacidade * 2 : CAPACIDADE_INICIAL_ARENA;
+        while (capacidade < tamanho) capacidade *= 2;
+        BlocoArena* bloco = novo_bloco_arena(capacidade, arena->bloco);
+        if (bloco == NULL) return NULL;
+        arena->bloco = bloco;
+        arena->usado = 0;
+    }
+    void* espaco = arena->bloco->dados + arena->usado;
+    arena->usado += tamanho;
+    arena->total += tamanho;
+    if (arena->total > arena->pico) arena->pico = arena->total;
+    return espaco;
+}
+
+/**
+ * @brief Esvazia a arena. Em regime O(1): so volta o ponteiro ao inicio do bloco. Se a sessao
+ * precisou de mais de um bloco, eles sao trocados por um unico bloco do tamanho do pico, para que
+ * as proximas sessoes caibam inteiras nele.
+ * @return int: 0 em caso de sucesso, 1 se o bloco unificado nao pode ser alocado (a arena fica vazia).
+ */
+int reiniciar_arena(Arena* arena) {
+    int falhou = 0;
+
+    if (arena->bloco != NULL && arena->bloco->anterior != NULL) {
+        size_t capacidade = arena->bloco->capacidade;
+        while (capacidade < arena->pico) capacidade *= 2;
+        while (arena->bloco != NULL) {
+            BlocoArena* anterior = arena->bloco->anterior;
+            free(arena->bloco);
+            arena->bloco = anterior;
+        }
+        arena->bloco = novo_bloco_arena(capacidade, NULL);
+        falhou = arena->bloco == NULL;
+    }
+    arena->usado = 0;
+    arena->total = 0;
+    return falhou;
+}
+
+/**
+ * @brief Libera todos os blocos da arena.
+ */
+void liberar_arena(Arena* arena) {
+    while (arena->bloco != NULL) {
+        BlocoArena* anterior = arena->bloco->anterior;
+        free(arena->bloco);
+        arena->bloco = anterior;
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+/**
+ * @brief Retira uma arena vazia do pool (ou cria uma, se o pool esta vazio).
+ * @return Arena*: A arena, ou NULL em caso de falha de alocacao.
+ */
+Arena* pegar_arena(PoolArenas* pool) {
+    pthread_mutex_lock(&pool->trava);
+    Arena* arena = pool->livres;
+    if (arena != NULL) pool->livres = arena->proxima_livre;
+    pthread_mutex_unlock(&pool->trava);
+
+    if (arena == NULL) {
+        arena = (Arena*)calloc(1, sizeof(Arena));
+        if (arena == NULL) return NULL;
+        pthread_mutex_lock(&pool->trava);
+        pool->criadas++;
+        pthread_mutex_unlock(&pool->trava);
+    }
+    arena->proxima_livre = NULL;
+    return arena;
+}
+
+/**
+ * @brief Esvazia a arena e a devolve ao pool, para qualquer thread reaproveitar.
+ */
+void devolver_arena(PoolArenas* pool, Arena* arena) {
+    if (arena == NULL) return;
+    reiniciar_arena(arena);
+    pthread_mutex_lock(&pool->trava);
+    arena->proxima_livre = pool->livres;
+    pool->livres = arena;
+    pthread_mutex_unlock(&pool->trava);
+}
+
+/**
+ * @brief Libera as arenas guardadas no pool (as que estao em uso devem ter sido devolvidas).
+ */
+void liberar_pool_arenas(PoolArenas* pool) {
+    while (pool->livres != NULL) {
+        Arena* arena = pool->livres;
+        pool->livres = arena->proxima_livre;
+        liberar_arena(arena);
+        free(arena);
+    }
+    pthread_mutex_destroy(&pool->trava);
+}
+
+/**
+ * @brief Memoria de um vetor da partida ou da mesa: vem da arena da sessao, se houver, ou do malloc.
+ * @param zerar Se 1, o espaco vem zerado (como calloc).
+ */
+void* alocar_vetor(Arena* arena, size_t bytes, int zerar) {
+    if (arena == NULL) return zerar ? calloc(1, bytes > 0 ? bytes : 1) : malloc(bytes > 0 ? bytes : 1);
+
+    void* espaco = alocar_na_arena(arena, bytes);
+    if (espaco != NULL && zerar) memset(espaco, 0, bytes);
+    return espaco;
+}
+
+/**
+ * @brief Contraparte de alocar_vetor: com arena, nao faz nada (a memoria volta com a arena).
+ */
+void soltar_vetor(Arena* arena, void* espaco) {
+    if (arena == NULL) free(espaco);
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// --- Agregados por Dono (atualizados a cada mudanca no mapa) ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Garante que o vetor de agregados tem posicao para o dono informado.
+ * As posicoes novas comecam zeradas.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int garantir_agregados(Partida* partida, int dono) {
+    if (dono < partida->capacidade_agregados) return 0;
+
+    int nova_capacidade = partida->capacidade_agregados > 0 ? partida->capacidade_agregados : 8;
+    while (nova_capacidade <= dono) nova_capacidade *= 2;
+
+    AgregadoDono* novos;
+    if (partida->arena != NULL) {
+        // Na arena nao ha realloc: o vetor novo recebe uma copia e o antigo volta com a arena.
+        novos = (AgregadoDono*)alocar_na_arena(partida->arena, (size_t)nova_capacidade * sizeof(AgregadoDono));
+        if (novos != NULL && partida->capacidade_agregados > 0) {
+            memcpy(novos, partida->agregados, (size_t)partida->capacidade_agregados * sizeof(AgregadoDono));
+        }
+    } else {
+        uint64_t inicio = inicio_fase();
+        novos = realloc(partida->agregados, (size_t)nova_capacidade * sizeof(AgregadoDono));
+        fim_fase(FASE_ALOCACAO, inicio);
+        contar(CONTADOR_ALOCACOES, 1);
+        contar(CONTADOR_BYTES_ALOCADOS, (long long)(nova_capacidade - partida->capacidade_agregados) * (long long)sizeof(AgregadoDono));
+    }
+    if (novos == NULL) {
+        perror("Erro ao alocar memoria para os agregados dos donos");
+        return 1;
+    }
+    memset(novos + partida->capacidade_agregados, 0,
+           (size_t)(nova_capacidade - partida->capacidade_agregados) * sizeof(AgregadoDono));
+    partida->agregados = novos;
+    partida->capacidade_agregados = nova_capacidade;
+    return 0;
+}
+
+/**
+ * @brief Zera os agregados de todos os donos (antes de recadastrar um mapa).
+ */
+void zerar_agregados(Partida* partida) {
+    if (partida->agregados != NULL) {
+        memset(partida->agregados, 0, (size_t)partida->capacidade_agregados * sizeof(AgregadoDono));
+    }
+}
+
+/**
+ * @brief Soma (sinal = +1) ou subtrai (sinal = -1) a contribuicao de um territorio nos agregados do seu dono.
+ */
+static inline void contabilizar_territorio(Partida* partida, const Territorio* t, int sinal) {
+    AgregadoDono* a = &partida->agregados[t->dono];
+    a->territorios += sinal;
+    a->tropas += sinal * (long long)t->tropas;
+    a->territorios_fortes += sinal * (t->tropas > LIMIAR_TERRITORIO_FORTE);
+}
+
+/**
+ * @brief Cadastra um territorio na partida (dono e tropas) e o soma aos agregados do dono.
+ * O territorio nao pode estar contabilizado ainda (mapa recem-alocado ou agregados zerados).
+ * Um indice de sequencias ou versoes do mapa montados antes ficam desatualizados e sao descartados.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int registrar_territorio(Partida* partida, Territorio* t, int dono, int tropas) {
+    if (garantir_agregados(partida, dono) != 0) return 1;
+    if (partida->sequencias != NULL) liberar_indice_sequencias(partida);
+    if (partida->versoes != NULL) liberar_versoes(partida);
+
+    t->dono = dono;
+    t->tropas = tropas;
+    contabilizar_territorio(partida, t, +1);
+    return 0;
+}
+
+/**
+ * @brief Altera as tropas de um territorio mantendo os agregados do dono atualizados.
+ */
+void alterar_tropas(Partida* partida, Territorio* t, int tropas) {
+    if (partida->sequencias != NULL) atualizar_tropas_sequencias(partida, (uint32_t)(t - partida->mapa), (long long)tropas - t->tropas);
+    contabilizar_territorio(partida, t, -1);
+    t->tropas = tropas;
+    contabilizar_territorio(partida, t, +1);
+    if (partida->versoes != NULL) registrar_mudanca_versao(partida, (uint32_t)(t - partida->mapa));
+}
+
+/**
+ * @brief Transfere um territorio para outro dono (conquista) mantendo os agregados atualizados.
+ * O novo dono ja deve ter agregados (ou seja, ja controla ou controlou algum territorio).
+ */
+void transferir_territorio(Partida* partida, Territorio* t, int novo_dono) {
+    int dono_anterior = t->dono;
+    contabilizar_territorio(partida, t, -1);
+    t->dono = novo_dono;
+    contabilizar_territorio(partida, t, +1);
+    if (partida->grafo != NULL) atualizar_fronteiras(partida, (uint32_t)(t - partida->mapa), dono_anterior);
+    if (partida->primeiro_do_dono != NULL) mover_no_indice(partida, (int32_t)(t - partida->mapa), dono_anterior);
+    if (partida->sequencias != NULL) atualizar_dono_sequencias(partida, (uint32_t)(t - partida->mapa), dono_anterior);
+    if (partida->versoes != NULL) registrar_mudanca_versao(partida, (uint32_t)(t - partida->mapa));
+}
+
+/**
+ * @brief Retorna os agregados de um dono (zerados se o dono nao controla nada).
+ */
+AgregadoDono agregado_dono(const Partida* partida, int dono) {
+    AgregadoDono vazio = {0};
+    if (dono < 0 || dono >= partida->capacidade_agregados) return vazio;
+    return partida->agregados[dono];
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// --- Grafo de Vizinhanca (fronteiras e regioes) ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Libera os vetores de um grafo e o proprio grafo.
+ */
+void liberar_grafo(GrafoMapa* grafo) {
+    if (grafo == NULL) return;
+    free(grafo->inicio);
+    free(grafo->vizinhos);
+    free(grafo);
+}
+
+/**
+ * @brief Monta o grafo CSR a partir de uma lista de arestas (pares de indices base 0).
+ * As arestas viram simetricas, e repeticoes e lacos (i, i) sao descartados.
+ * Contagem por territorio, soma prefixada e preenchimento: O(n + arestas), sem ordenar a lista.
+ * @param arestas num_arestas pares (a, b).
+ * @return GrafoMapa*: O grafo, ou NULL em caso de falha de alocacao.
+ */
+GrafoMapa* construir_grafo(int n, const uint32_t* arestas, size_t num_arestas) {
+    GrafoMapa* grafo = (GrafoMapa*)calloc(1, sizeof(GrafoMapa));
+    uint32_t* posicao = (uint32_t*)calloc((size_t)n + 1, sizeof(uint32_t));
+    if (grafo == NULL || posicao == NULL || num_arestas > UINT32_MAX / 2) goto falha;
+
+    grafo->num_territorios = n;
+    grafo->inicio = (uint32_t*)calloc((size_t)n + 1, sizeof(uint32_t));
+    grafo->vizinhos = (uint32_t*)malloc((2 * num_arestas + 1) * sizeof(uint32_t));
+    if (grafo->inicio == NULL || grafo->vizinhos == NULL) goto falha;
+
+    // 1. Grau de cada territorio (nos dois sentidos) e inicio de cada linha.
+    for (size_t k = 0; k < num_arestas; k++) {
+        uint32_t a = arestas[2 * k], b = arestas[2 * k + 1];
+        if (a == b) continue;
+        grafo->inicio[a + 1]++;
+        grafo->inicio[b + 1]++;
+    }
+    for (int i = 0; i < n; i++) grafo->inicio[i + 1] += grafo->inicio[i];
+
+    // 2. Preenche as linhas.
+    memcpy(posicao, grafo->inicio, (size_t)n * sizeof(uint32_t));
+    for (size_t k = 0; k < num_arestas; k++) {
+        uint32_t a = arestas[2 * k], b = arestas[2 * k + 1];
+        if (a == b) continue;
+        grafo->vizinhos[posicao[a]++] = b;
+        grafo->vizinhos[posicao[b]++] = a;
+    }
+
+    // 3. Ordena cada linha (graus pequenos: insercao) e compacta as repeticoes.
+    uint32_t destino = 0;
+    for (int i = 0; i < n; i++) {
+        uint32_t* linha = grafo->vizinhos + grafo->inicio[i];
+        uint32_t grau = grafo->inicio[i + 1] - grafo->inicio[i];
+        for (uint32_t x = 1; x < grau; x++) {
+            uint32_t v = linha[x], y = x;
+            while (y > 0 && linha[y - 1] > v) {
+                linha[y] = linha[y - 1];
+                y--;
+            }
+            linha[y] = v;
+        }
+        grafo->inicio[i] = destino;
+        for (uint32_t x = 0; x < grau; x++) {
+            if (x == 0 || linha[x] != linha[x - 1]) grafo->vizinhos[destino++] = linha[x];
+        }
+    }
+    grafo->inicio[n] = destino;
+    free(posicao);
+    return grafo;
+
+falha:
+    perror("Erro ao alocar memoria para o grafo do mapa");
+    free(posicao);
+    liberar_grafo(grafo);
+    return NULL;
+}
+
+/**
+ * @brief Indica se o territorio i tem algum vizinho de outra cor (leitura da linha CSR).
+ */
+static inline int calcular_fronteira(const Partida* partida, uint32_t i) {
+    const GrafoMapa* grafo = partida->grafo;
+    int dono = partida->mapa[i].dono;
+    for (uint32_t k = grafo->inicio[i]; k < grafo->inicio[i + 1]; k++) {
+        if (partida->mapa[grafo->vizinhos[k]].dono != dono) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Liga um grafo a partida e calcula as fronteiras iniciais (marcas e agregados).
+ * Os territorios ja devem estar registrados.
+ * @param compartilhado 1 se o grafo continua pertencendo a outra partida (nao e liberado aqui).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int ligar_grafo(Partida* partida, GrafoMapa* grafo, int compartilhado) {
+    partida->fronteira = (unsigned char*)alocar_vetor(partida->arena, (size_t)partida->num_territorios, 0);
+    if (partida->fronteira == NULL) {
+        perror("Erro ao alocar memoria para as fronteiras do mapa");
+        if (!compartilhado) liberar_grafo(grafo);
+        return 1;
+    }
+    partida->grafo = grafo;
+    partida->grafo_compartilhado = compartilhado;
+
+    for (int c = 0; c < partida->capacidade_agregados; c++) partida->agregados[c].territorios_fronteira = 0;
+    for (int i = 0; i < partida->num_territorios; i++) {
+        partida->fronteira[i] = (unsigned char)calcular_fronteira(partida, (uint32_t)i);
+        partida->agregados[partida->mapa[i].dono].territorios_fronteira += partida->fronteira[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief Reavalia a marca de fronteira de um territorio e ajusta o agregado do dono.
+ */
+static inline void reavaliar_fronteira(Partida* partida, uint32_t i) {
+    unsigned char nova = (unsigned char)calcular_fronteira(partida, i);
+    partida->agregados[partida->mapa[i].dono].territorios_fronteira += nova - partida->fronteira[i];
+    partida->fronteira[i] = nova;
+}
+
+/**
+ * @brief Atualiza as fronteiras depois que o territorio i mudou de dono (chamada por
+ * transferir_territorio): so o proprio territorio e os seus vizinhos podem mudar.
+ */
+void atualizar_fronteiras(Partida* partida, uint32_t i, int dono_anterior) {
+    const GrafoMapa* grafo = partida->grafo;
+
+    partida->agregados[dono_anterior].territorios_fronteira -= partida->fronteira[i];
+    partida->fronteira[i] = 0;
+    reavaliar_fronteira(partida, i);
+    for (uint32_t k = grafo->inicio[i]; k < grafo->inicio[i + 1]; k++) reavaliar_fronteira(partida, grafo->vizinhos[k]);
+}
+
+/**
+ * @brief Indica se dois territorios fazem fronteira (busca binaria na linha de a).
+ * Num mapa sem grafo todos fazem fronteira com todos.
+ */
+int sao_vizinhos(const Partida* partida, int a, int b) {
+    const GrafoMapa* grafo = partida->grafo;
+    if (grafo == NULL) return a != b;
+
+    uint32_t baixo = grafo->inicio[a], alto = grafo->inicio[a + 1];
+    while (baixo < alto) {
+        uint32_t meio = baixo + (alto - baixo) / 2;
+        if (grafo->vizinhos[meio] < (uint32_t)b) baixo = meio + 1;
+        else alto = meio;
+    }
+    return baixo < grafo->inicio[a + 1] && grafo->vizinhos[baixo] == (uint32_t)b;
+}
+
+/**
+ * @brief Indica se o territorio i esta na fronteira (tem vizinho de outra cor). O(1): a marca
+ * e mantida a cada conquista. Sem grafo, basta existir um territorio de outra cor.
+ */
+int territorio_na_fronteira(const Partida* partida, int i) {
+    if (partida->grafo != NULL) return partida->fronteira[i];
+    return agregado_dono(partida, partida->mapa[i].dono).territorios < partida->num_territorios;
+}
+
+/**
+ * @brief Quantidade de territorios de um dono na fronteira. O(1) (agregados).
+ */
+int tamanho_fronteira(const Partida* partida, int dono) {
+    AgregadoDono a = agregado_dono(partida, dono);
+    if (partida->grafo != NULL) return a.territorios_fronteira;
+    return a.territorios < partida->num_territorios ? a.territorios : 0;
+}
+
+/**
+ * @brief Conta as regioes conexas (territorios vizinhos do mesmo dono) de um dono, com uma busca
+ * em largura sobre o CSR. As marcas usam uma geracao, entao nao ha O(n) de limpeza por consulta.
+ * Sem grafo, todos os territorios do dono formam uma unica regiao.
+ * @param maior_regiao Saida opcional: tamanho da maior regiao.
+ * @return int: Numero de regioes, ou -1 em caso de falha de alocacao.
+ */
+int regioes_do_dono(Partida* partida, int dono, int* maior_regiao) {
+    const GrafoMapa* grafo = partida->grafo;
+    int regioes = 0, maior = 0;
+
+    if (grafo == NULL) {
+        maior = agregado_dono(partida, dono).territorios;
+        if (maior_regiao != NULL) *maior_regiao = maior;
+        return maior > 0;
+    }
+    if (partida->fila_regiao == NULL) {
+        soltar_vetor(partida->arena, partida->marcas_regiao);
+        partida->marcas_regiao = (uint32_t*)alocar_vetor(partida->arena, (size_t)partida->num_territorios * sizeof(uint32_t), 1);
+        partida->fila_regiao = (uint32_t*)alocar_vetor(partida->arena, (size_t)partida->num_territorios * sizeof(uint32_t), 0);
+        if (partida->marcas_regiao == NULL || partida->fila_regiao == NULL) {
+            perror("Erro ao alocar memoria para a busca de regioes");
+            soltar_vetor(partida->arena, partida->fila_regiao);
+            partida->fila_regiao = NULL;
+            return -1;
+        }
+        partida->geracao_regiao = 0;
+    }
+    if (++partida->geracao_regiao == 0) {
+        memset(partida->marcas_regiao, 0, (size_t)partida->num_territorios * sizeof(uint32_t));
+        partida->geracao_regiao = 1;
+    }
+    uint32_t geracao = partida->geracao_regiao;
+    uint32_t* marcas = partida->marcas_regiao;
+    uint32_t* fila = partida->fila_regiao;
+
+    for (int i = 0; i < partida->num_territorios; i++) {
+        if (partida->mapa[i].dono != dono || marcas[i] == geracao) continue;
+
+        int tamanho = 0, fim = 0;
+        marcas[i] = geracao;
+        fila[fim++] = (uint32_t)i;
+        while (tamanho < fim) {
+            uint32_t atual = fila[tamanho++];
+            for (uint32_t k = grafo->inicio[atual]; k < grafo->inicio[atual + 1]; k++) {
+                uint32_t v = grafo->vizinhos[k];
+                if (marcas[v] != geracao && partida->mapa[v].dono == dono) {
+                    marcas[v] = geracao;
+                    fila[fim++] = v;
+                }
+            }
+        }
+        regioes++;
+        if (tamanho > maior) maior = tamanho;
+    }
+    if (maior_regiao != NULL) *maior_regiao = maior;
+    return regioes;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Indice de Territorios por Dono ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Libera o indice de territorios por dono.
+ */
+void liberar_indice_donos(Partida* partida) {
+    soltar_vetor(partida->arena, partida->primeiro_do_dono);
+    soltar_vetor(partida->arena, partida->proximo_do_dono);
+    soltar_vetor(partida->arena, partida->anterior_do_dono);
+    partida->primeiro_do_dono = NULL;
+    partida->proximo_do_dono = NULL;
+    partida->anterior_do_dono = NULL;
+    partida->capacidade_indice = 0;
+    partida->territorios_indice = 0;
+}
+
+/**
+ * @brief Insere o territorio i no inicio da lista do dono.
+ */
+static inline void inserir_no_indice(Partida* partida, int32_t i, int dono) {
+    int32_t primeiro = partida->primeiro_do_dono[dono];
+    partida->anterior_do_dono[i] = -1;
+    partida->proximo_do_dono[i] = primeiro;
+    if (primeiro >= 0) partida->anterior_do_dono[primeiro] = i;
+    partida->primeiro_do_dono[dono] = i;
+}
+
+/**
+ * @brief Monta o indice de territorios por dono: cada cor tem uma lista com os seus territorios,
+ * guardada em tres vetores (primeiro de cada cor, proximo e anterior de cada territorio). Percorrer
+ * os territorios de um jogador custa o tamanho da lista, nao o tamanho do mapa, e uma conquista
+ * troca o territorio de lista em O(1), sem alocar nada durante a partida. Os vetores sao
+ * reaproveitados entre partidas; deve ser chamada depois do cadastro dos territorios.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int construir_indice_donos(Partida* partida) {
+    int n = partida->num_territorios;
+
+    if (partida->capacidade_indice < partida->capacidade_agregados || partida->territorios_indice != n) {
+        liberar_indice_donos(partida);
+        partida->primeiro_do_dono = (int32_t*)alocar_vetor(partida->arena, (size_t)partida->capacidade_agregados * sizeof(int32_t), 0);
+        partida->proximo_do_dono = (int32_t*)alocar_vetor(partida->arena, (size_t)n * sizeof(int32_t), 0);
+        partida->anterior_do_dono = (int32_t*)alocar_vetor(partida->arena, (size_t)n * sizeof(int32_t), 0);
+        if (partida->primeiro_do_dono == NULL || partida->proximo_do_dono == NULL || partida->anterior_do_dono == NULL) {
+            perror("Erro ao alocar memoria para o indice de territorios por dono");
+            liberar_indice_donos(partida);
+            return 1;
+        }
+        partida->capacidade_indice = partida->capacidade_agregados;
+        partida->territorios_indice = n;
+    }
+
+    memset(partida->primeiro_do_dono, 0xff, (size_t)partida->capacidade_indice * sizeof(int32_t));
+    for (int32_t i = n - 1; i >= 0; i--) inserir_no_indice(partida, i, partida->mapa[i].dono);
+    return 0;
+}
+
+/**
+ * @brief Move o territorio i da lista do dono anterior para a do dono atual (chamada por
+ * transferir_territorio).
+ */
+void mover_no_indice(Partida* partida, int32_t i, int dono_anterior) {
+    int32_t anterior = partida->anterior_do_dono[i];
+    int32_t proximo = partida->proximo_do_dono[i];
+
+    if (anterior >= 0) partida->proximo_do_dono[anterior] = proximo;
+    else partida->primeiro_do_dono[dono_anterior] = proximo;
+    if (proximo >= 0) partida->anterior_do_dono[proximo] = anterior;
+    inserir_no_indice(partida, i, partida->mapa[i].dono);
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Indice de Sequencias (territorios seguidos e tropas por intervalo) ---
+// ------------------------------------------------------------------------------------------------
+
+// Sequencia de territorios seguidos (indices consecutivos) de um mesmo dono, no heap do dono.
+typedef struct {
+    uint32_t tamanho; // Territorios na sequencia.
+    uint32_t inicio;  // Primeiro territorio da sequencia.
+    uint32_t versao;  // versao[inicio] do indice quando a sequencia foi criada.
+} EntradaSequencia;
+
+// Heap de maximo (por tamanho) das sequencias de um dono. Uma sequencia desfeita nao e procurada no
+// heap: a entrada fica velha (a versao do seu inicio mudou) e sai quando chega ao topo, ou quando o
+// heap lota com mais entradas velhas do que vivas e e compactado.
+typedef struct {
+    EntradaSequencia* itens;
+    int total;      // Entradas no heap (vivas e velhas).
+    int capacidade;
+    int vivas;      // Sequencias do dono no mapa.
+} HeapSequencias;
+
+// Indice do mapa visto como uma sequencia de territorios (ver construir_indice_sequencias).
+typedef struct IndiceSequencias {
+    int num_territorios;
+    uint32_t folhas;         // Folhas da arvore de segmentos (potencia de 2 >= num_territorios).
+    unsigned char* uniforme; // Arvore de segmentos (raiz = 1): 1 se todo o intervalo do no tem um so dono.
+    long long* tropas;       // Arvore de Fenwick (base 1) das tropas dos territorios.
+    uint32_t* versao;        // versao[i] muda a cada sequencia criada ou desfeita com inicio em i.
+    HeapSequencias* heaps;   // heaps[cor] = sequencias da cor.
+    int num_heaps;
+} IndiceSequencias;
+
+/**
+ * @brief Libera o indice de sequencias (com arena, so o esquece).
+ */
+void liberar_indice_sequencias(Partida* partida) {
+    IndiceSequencias* indice = partida->sequencias;
+    if (indice == NULL) return;
+
+    if (indice->heaps != NULL) {
+        for (int c = 0; c < indice->num_heaps; c++) soltar_vetor(partida->arena, indice->heaps[c].itens);
+    }
+    soltar_vetor(partida->arena, indice->heaps);
+    soltar_vetor(partida->arena, indice->uniforme);
+    soltar_vetor(partida->arena, indice->tropas);
+    soltar_vetor(partida->arena, indice->versao);
+    soltar_vetor(partida->arena, indice);
+    partida->sequencias = NULL;
+}
+
+/**
+ * @brief Indica se os territorios a e b (b pode passar do fim do mapa) tem o mesmo dono.
+ */
+static inline int mesmo_dono(const Partida* partida, uint32_t a, uint32_t b) {
+    return b < (uint32_t)partida->num_territorios && partida->mapa[a].dono == partida->mapa[b].dono;
+}
+
+/**
+ * @brief Recalcula a marca de um no da arvore a partir dos filhos (meio = primeiro territorio do
+ * filho da direita).
+ */
+static inline void recalcular_no_sequencias(const Partida* partida, uint32_t no, uint32_t meio) {
+    unsigned char* uniforme = partida->sequencias->uniforme;
+    uniforme[no] = (unsigned char)(uniforme[2 * no] && uniforme[2 * no + 1] && mesmo_dono(partida, meio - 1, meio));
+}
+
+/**
+ * @brief Reacerta os nos da arvore acima do territorio i (depois de uma troca de dono). O(log n);
+ * para no primeiro no que era e continua misto, porque todos os acima dele tambem sao.
+ */
+static void atualizar_arvore_sequencias(const Partida* partida, uint32_t i) {
+    const unsigned char* uniforme = partida->sequencias->uniforme;
+    uint32_t no = partida->sequencias->folhas + i, tamanho = 1;
+    while (no > 1) {
+        no >>= 1;
+        tamanho <<= 1;
+        unsigned char antes = uniforme[no];
+        recalcular_no_sequencias(partida, no, (i & ~(tamanho - 1)) + (tamanho >> 1));
+        if (!antes && !uniforme[no]) break;
+    }
+}
+
+/**
+ * @brief Dentro de um no nao uniforme que termina com um territorio do dono, conta os territorios
+ * do dono no fim do intervalo, descendo pela arvore.
+ * @param no No da arvore; inicio e tamanho: o intervalo que ele cobre.
+ */
+static uint32_t sufixo_do_no(const Partida* partida, uint32_t no, uint32_t inicio, uint32_t tamanho, int dono) {
+    const unsigned char* uniforme = partida->sequencias->uniforme;
+    uint32_t total = 0;
+
+    while (tamanho > 1) {
+        uint32_t metade = tamanho >> 1;
+        if (uniforme[2 * no + 1]) {
+            // A metade da direita e toda do dono: a sequencia continua (ou termina) na da esquerda.
+            total += metade;
+            if (partida->mapa[inicio + metade - 1].dono != dono) return total;
+            no = 2 * no;
+        } else {
+            no = 2 * no + 1;
+            inicio += metade;
+        }
+        tamanho = metade;
+    }
+    return total;
+}
+
+/**
+ * @brief Espelho de sufixo_do_no: conta os territorios do dono no comeco do intervalo do no.
+ */
+static uint32_t prefixo_do_no(const Partida* partida, uint32_t no, uint32_t inicio, uint32_t tamanho, int dono) {
+    const unsigned char* uniforme = partida->sequencias->uniforme;
+    uint32_t total = 0;
+
+    while (tamanho > 1) {
+        uint32_t metade = tamanho >> 1;
+        if (uniforme[2 * no]) {
+            total += metade;
+            uint32_t proximo = inicio + metade;
+            if (proximo >= (uint32_t)partida->num_territorios || partida->mapa[proximo].dono != dono) return total;
+            no = 2 * no + 1;
+            inicio += metade;
+        } else {
+            no = 2 * no;
+        }
+        tamanho = metade;
+    }
+    return total;
+}
+
+/**
+ * @brief Territorios seguidos do dono logo antes de i (i - 1, i - 2, ...), sem contar i. O(log n):
+ * sobe pela arvore enquanto os blocos a esquerda sao inteiros do dono e desce no primeiro que nao e.
+ */
+static uint32_t sequencia_antes(const Partida* partida, uint32_t i, int dono) {
+    const IndiceSequencias* indice = partida->sequencias;
+    uint32_t inicio = i, total = 0;
+
+    for (uint32_t no = indice->folhas + i, tamanho = 1; no > 1; no >>= 1, tamanho <<= 1) {
+        if ((no & 1) == 0) continue;
+        // Filho da direita: o irmao cobre [inicio - tamanho, inicio - 1].
+        if (partida->mapa[inicio - 1].dono != dono) return total;
+        if (!indice->uniforme[no - 1]) return total + sufixo_do_no(partida, no - 1, inicio - tamanho, tamanho, dono);
+        total += tamanho;
+        inicio -= tamanho;
+    }
+    return total;
+}
+
+/**
+ * @brief Espelho de sequencia_antes: territorios seguidos do dono logo depois de i.
+ */
+static uint32_t sequencia_depois(const Partida* partida, uint32_t i, int dono) {
+    const IndiceSequencias* indice = partida->sequencias;
+    uint32_t fim = i, total = 0;
+
+    for (uint32_t no = indice->folhas + i, tamanho = 1; no > 1; no >>= 1, tamanho <<= 1) {
+        if (no & 1) continue;
+        // Filho da esquerda: o irmao cobre [fim + 1, fim + tamanho] (pode passar do fim do mapa).
+        if (fim + 1 >= (uint32_t)partida->num_territorios || partida->mapa[fim + 1].dono != dono) return total;
+        if (!indice->uniforme[no + 1]) return total + prefixo_do_no(partida, no + 1, fim + 1, tamanho, dono);
+        total += tamanho;
+        fim += tamanho;
+    }
+    return total;
+}
+
+/**
+ * @brief Desce a entrada k do heap ate a sua posicao.
+ */
+static void descer_no_heap(HeapSequencias* heap, int k) {
+    EntradaSequencia entrada = heap->itens[k];
+    for (;;) {
+        int filho = 2 * k + 1;
+        if (filho >= heap->total) break;
+        if (filho + 1 < heap->total && heap->itens[filho + 1].tamanho > heap->itens[filho].tamanho) filho++;
+        if (heap->itens[filho].tamanho <= entrada.tamanho) break;
+        heap->itens[k] = heap->itens[filho];
+        k = filho;
+    }
+    heap->itens[k] = entrada;
+}
+
+/**
+ * @brief Tira do topo do heap as entradas de sequencias que ja foram desfeitas.
+ */
+static void limpar_topo_heap(const IndiceSequencias* indice, HeapSequencias* heap) {
+    while (heap->total > 0 && indice->versao[heap->itens[0].inicio] != heap->itens[0].versao) {
+        heap->itens[0] = heap->itens[--heap->total];
+        if (heap->total > 0) descer_no_heap(heap, 0);
+    }
+}
+
+/**
+ * @brief Marca como desfeita a sequencia do dono que comeca em inicio (a entrada fica velha).
+ */
+static inline void desfazer_sequencia(IndiceSequencias* indice, int dono, uint32_t inicio) {
+    indice->versao[inicio]++;
+    indice->heaps[dono].vivas--;
+}
+
+/**
+ * @brief Registra uma sequencia nova do dono no seu heap. Com o heap lotado, as entradas velhas sao
+ * descartadas se forem mais da metade; senao o heap dobra (com arena, o vetor novo recebe uma copia).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+static int criar_sequencia(Partida* partida, int dono, uint32_t inicio, uint32_t tamanho) {
+    IndiceSequencias* indice = partida->sequencias;
+    HeapSequencias* heap = &indice->heaps[dono];
+
+    if (heap->total == heap->capacidade && heap->total > 2 * heap->vivas) {
+        int vivas = 0;
+        for (int k = 0; k < heap->total; k++) {
+            if (indice->versao[heap->itens[k].inicio] == heap->itens[k].versao) heap->itens[vivas++] = heap->itens[k];
+        }
+        heap->total = vivas;
+        for (int k = vivas / 2 - 1; k >= 0; k--) descer_no_heap(heap, k);
+    }
+    if (heap->total == heap->capacidade) {
+        int nova_capacidade = heap->capacidade > 0 ? 2 * heap->capacidade : 16;
+        EntradaSequencia* novos = (EntradaSequencia*)alocar_vetor(partida->arena, (size_t)nova_capacidade * sizeof(EntradaSequencia), 0);
+        if (novos == NULL) return 1;
+        if (heap->total > 0) memcpy(novos, heap->itens, (size_t)heap->total * sizeof(EntradaSequencia));
+        soltar_vetor(partida->arena, heap->itens);
+        heap->itens = novos;
+        heap->capacidade = nova_capacidade;
+    }
+
+    EntradaSequencia entrada = { tamanho, inicio, ++indice->versao[inicio] };
+    int k = heap->total++;
+    while (k > 0 && heap->itens[(k - 1) / 2].tamanho < tamanho) {
+        heap->itens[k] = heap->itens[(k - 1) / 2];
+        k = (k - 1) / 2;
+    }
+    heap->itens[k] = entrada;
+    heap->vivas++;
+    return 0;
+}
+
+/**
+ * @brief Garante um heap para o dono informado (cores registradas depois da montagem do indice).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+static int garantir_heaps_sequencias(Partida* partida, int dono) {
+    IndiceSequencias* indice = partida->sequencias;
+    int nova_capacidade = indice->num_heaps > 0 ? indice->num_heaps : 8;
+    while (nova_capacidade <= dono) nova_capacidade *= 2;
+
+    HeapSequencias* novos = (HeapSequencias*)alocar_vetor(partida->arena, (size_t)nova_capacidade * sizeof(HeapSequencias), 1);
+    if (novos == NULL) return 1;
+    if (indice->num_heaps > 0) memcpy(novos, indice->heaps, (size_t)indice->num_heaps * sizeof(HeapSequencias));
+    soltar_vetor(partida->arena, indice->heaps);
+    indice->heaps = novos;
+    indice->num_heaps = nova_capacidade;
+    return 0;
+}
+
+/**
+ * @brief Monta o indice de sequencias: o mapa visto como uma fila de territorios (na ordem dos
+ * indices), com uma arvore de segmentos que marca os intervalos de um so dono, um heap por cor com
+ * as suas sequencias de territorios seguidos e uma arvore de Fenwick das tropas. Depois de montado,
+ * cada conquista (transferir_territorio) e cada mudanca de tropas (alterar_tropas) o atualiza em
+ * O(log n); "maior sequencia da cor" custa O(1) e "tropas em [a, b]", O(log n), sem percorrer o
+ * mapa. Os vetores sao reaproveitados entre partidas do mesmo tamanho; deve ser chamada depois do
+ * cadastro dos territorios (registrar_territorio descarta um indice ja montado).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int construir_indice_sequencias(Partida* partida) {
+    int n = partida->num_territorios;
+    IndiceSequencias* indice = partida->sequencias;
+
+    if (indice == NULL || indice->num_territorios != n || indice->num_heaps < partida->capacidade_agregados) {
+        uint32_t folhas = 1;
+        while (folhas < (uint32_t)n) folhas <<= 1;
+
+        liberar_indice_sequencias(partida);
+        indice = (IndiceSequencias*)alocar_vetor(partida->arena, sizeof(IndiceSequencias), 1);
+        if (indice == NULL) goto falha;
+        partida->sequencias = indice;
+        indice->num_territorios = n;
+        indice->folhas = folhas;
+        indice->uniforme = (unsigned char*)alocar_vetor(partida->arena, 2 * (size_t)folhas, 0);
+        indice->tropas = (long long*)alocar_vetor(partida->arena, ((size_t)n + 1) * sizeof(long long), 0);
+        indice->versao = (uint32_t*)alocar_vetor(partida->arena, (size_t)n * sizeof(uint32_t), 1);
+        indice->heaps = (HeapSequencias*)alocar_vetor(partida->arena, (size_t)partida->capacidade_agregados * sizeof(HeapSequencias), 1);
+        if (indice->uniforme == NULL || indice->tropas == NULL || indice->versao == NULL || indice->heaps == NULL) goto falha;
+        indice->num_heaps = partida->capacidade_agregados;
+    }
+
+    // 1. Arvore de segmentos: folhas (inclusive as que sobram alem do mapa) e niveis de baixo para cima.
+    memset(indice->uniforme + indice->folhas, 1, indice->folhas);
+    for (uint32_t primeiro = indice->folhas >> 1, tamanho = 2; primeiro >= 1; primeiro >>= 1, tamanho <<= 1) {
+        for (uint32_t no = primeiro; no < 2 * primeiro; no++) {
+            recalcular_no_sequencias(partida, no, (no - primeiro) * tamanho + (tamanho >> 1));
+        }
+    }
+
+    // 2. Arvore de Fenwick das tropas, em O(n).
+    indice->tropas[0] = 0;
+    for (int i = 0; i < n; i++) indice->tropas[i + 1] = partida->mapa[i].tropas;
+    for (uint32_t k = 1; k <= (uint32_t)n; k++) {
+        uint32_t pai = k + (k & (0u - k));
+        if (pai <= (uint32_t)n) indice->tropas[pai] += indice->tropas[k];
+    }
+
+    // 3. Sequencias de cada cor.
+    for (int c = 0; c < indice->num_heaps; c++) {
+        indice->heaps[c].total = 0;
+        indice->heaps[c].vivas = 0;
+    }
+    for (int i = 0; i < n;) {
+        int fim = i + 1;
+        while (fim < n && partida->mapa[fim].dono == partida->mapa[i].dono) fim++;
+        if (criar_sequencia(partida, partida->mapa[i].dono, (uint32_t)i, (uint32_t)(fim - i)) != 0) goto falha;
+        i = fim;
+    }
+    return 0;
+
+falha:
+    perror("Erro ao alocar memoria para o indice de sequencias");
+    liberar_indice_sequencias(partida);
+    return 1;
+}
+
+/**
+ * @brief Atualiza o indice depois que o territorio i mudou de dono (chamada por
+ * transferir_territorio): a sequencia antiga que passava por i se parte em ate duas e i emenda as
+ * sequencias do novo dono que encostam nele. Se faltar memoria, o indice e descartado e as consultas
+ * voltam a percorrer o mapa.
+ */
+void atualizar_dono_sequencias(Partida* partida, uint32_t i, int dono_anterior) {
+    IndiceSequencias* indice = partida->sequencias;
+    int dono = partida->mapa[i].dono;
+    if (dono == dono_anterior) return;
+    if (dono >= indice->num_heaps && garantir_heaps_sequencias(partida, dono) != 0) goto falha;
+
+    uint32_t antes = sequencia_antes(partida, i, dono_anterior);
+    uint32_t depois = sequencia_depois(partida, i, dono_anterior);
+    desfazer_sequencia(indice, dono_anterior, i - antes);
+    if (antes > 0 && criar_sequencia(partida, dono_anterior, i - antes, antes) != 0) goto falha;
+    if (depois > 0 && criar_sequencia(partida, dono_anterior, i + 1, depois) != 0) goto falha;
+
+    atualizar_arvore_sequencias(partida, i);
+    antes = sequencia_antes(partida, i, dono);
+    depois = sequencia_depois(partida, i, dono);
+    if (antes > 0) desfazer_sequencia(indice, dono, i - antes);
+    if (depois > 0) desfazer_sequencia(indice, dono, i + 1);
+    if (criar_sequencia(partida, dono, i - antes, antes + 1 + depois) != 0) goto falha;
+
+    limpar_topo_heap(indice, &indice->heaps[dono_anterior]);
+    limpar_topo_heap(indice, &indice->heaps[dono]);
+    return;
+
+falha:
+    perror("Erro ao alocar memoria para o indice de sequencias");
+    liberar_indice_sequencias(partida);
+}
+
+/**
+ * @brief Soma delta as tropas do territorio i na arvore de Fenwick (chamada por alterar_tropas).
+ */
+void atualizar_tropas_sequencias(Partida* partida, uint32_t i, long long delta) {
+    IndiceSequencias* indice = partida->sequencias;
+    for (uint32_t k = i + 1; k <= (uint32_t)indice->num_territorios; k += k & (0u - k)) indice->tropas[k] += delta;
+}
+
+/**
+ * @brief Maior sequencia de territorios seguidos (indices consecutivos) de um dono. O(1) com o
+ * indice de sequencias (topo do heap da cor); sem ele, percorre o mapa.
+ */
+int maior_sequencia(const Partida* partida, int dono) {
+    const IndiceSequencias* indice = partida->sequencias;
+    int maior = 0, atual = 0;
+
+    if (indice != NULL) {
+        if (dono < 0 || dono >= indice->num_heaps || indice->heaps[dono].total == 0) return 0;
+        return (int)indice->heaps[dono].itens[0].tamanho;
+    }
+    for (int i = 0; i < partida->num_territorios; i++) {
+        atual = partida->mapa[i].dono == dono ? atual + 1 : 0;
+        if (atual > maior) maior = atual;
+    }
+    return maior;
+}
+
+/**
+ * @brief Tamanho da sequencia de territorios seguidos do mesmo dono que passa pelo territorio i.
+ * O(log n) com o indice de sequencias; sem ele, custa o tamanho da sequencia.
+ */
+int sequencia_do_territorio(const Partida* partida, int i) {
+    int dono = partida->mapa[i].dono;
+    int inicio = i, fim = i;
+
+    if (partida->sequencias != NULL) {
+        return 1 + (int)sequencia_antes(partida, (uint32_t)i, dono) + (int)sequencia_depois(partida, (uint32_t)i, dono);
+    }
+    while (inicio > 0 && partida->mapa[inicio - 1].dono == dono) inicio--;
+    while (fim + 1 < partida->num_territorios && partida->mapa[fim + 1].dono == dono) fim++;
+    return fim - inicio + 1;
+}
+
+/**
+ * @brief Soma das tropas dos territorios a..b (inclusive; limitados ao mapa). O(log n) com o indice
+ * de sequencias (duas somas prefixadas na arvore de Fenwick); sem ele, percorre o intervalo.
+ */
+long long tropas_no_intervalo(const Partida* partida, int a, int b) {
+    const IndiceSequencias* indice = partida->sequencias;
+    long long soma = 0;
+
+    if (a < 0) a = 0;
+    if (b >= partida->num_territorios) b = partida->num_territorios - 1;
+    if (a > b) return 0;
+    if (indice == NULL) {
+        for (int i = a; i <= b; i++) soma += partida->mapa[i].tropas;
+        return soma;
+    }
+    for (uint32_t k = (uint32_t)b + 1; k > 0; k &= k - 1) soma += indice->tropas[k];
+    for (uint32_t k = (uint32_t)a; k > 0; k &= k - 1) soma -= indice->tropas[k];
+    return soma;
+}
+
+/**
+ * @brief Indica se alguma missao da tabela mede sequencias (so entao o indice e montado nas partidas).
+ */
+int missoes_usam_sequencias(void) {
+    for (int m = 0; m < g_missoes.total; m++) {
+        if (g_missoes.missoes[m].tipo == METRICA_MAIOR_SEQUENCIA) return 1;
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Indice de Nomes (territorios pelo nome) ---
+// ------------------------------------------------------------------------------------------------
+
+#define TERRITORIO_INEXISTENTE -1 // Nenhum territorio com esse nome (ou numero fora do mapa).
+#define TERRITORIO_AMBIGUO -2     // Mais de um territorio com esse nome.
+
+/**
+ * @brief Libera o indice de nomes da partida (com arena, so o esquece).
+ */
+void liberar_indice_nomes(Partida* partida) {
+    soltar_vetor(partida->arena, partida->tabela_nomes);
+    partida->tabela_nomes = NULL;
+    partida->capacidade_nomes = 0;
+    partida->nomes_repetidos = 0;
+}
+
+/**
+ * @brief Monta o indice de nomes: tabela hash com enderecamento aberto (como a das cores) sobre os
+ * nomes ja gravados no mapa, com no maximo 50% de ocupacao. Cada nome aponta para o primeiro
+ * territorio que o usa; um nome repetido fica marcado (negativo) e conta em nomes_repetidos.
+ * Deve ser chamada depois que os nomes do mapa sao gravados (carregamento e cadastro).
+ * @param repetido Saida opcional: um territorio cujo nome repete o de outro, ou -1.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int construir_indice_nomes(Partida* partida, int* repetido) {
+    int n = partida->num_territorios;
+    uint32_t capacidade = 16;
+    while (capacidade < 2 * (uint32_t)n) capacidade <<= 1;
+
+    if (repetido != NULL) *repetido = -1;
+    if (partida->capacidade_nomes != capacidade) {
+        liberar_indice_nomes(partida);
+        partida->tabela_nomes = (int32_t*)alocar_vetor(partida->arena, (size_t)capacidade * sizeof(int32_t), 1);
+        if (partida->tabela_nomes == NULL) {
+            perror("Erro ao alocar memoria para o indice de nomes");
+            return 1;
+        }
+        partida->capacidade_nomes = capacidade;
+    } else {
+        memset(partida->tabela_nomes, 0, (size_t)capacidade * sizeof(int32_t));
+    }
+
+    uint32_t mascara = capacidade - 1;
+    partida->nomes_repetidos = 0;
+    for (int i = 0; i < n; i++) {
+        const char* nome = partida->mapa[i].nome;
+        for (uint32_t pos = hash_texto(nome) & mascara; ; pos = (pos + 1) & mascara) {
+            int32_t entrada = partida->tabela_nomes[pos];
+            if (entrada == 0) {
+                partida->tabela_nomes[pos] = i + 1;
+                break;
+            }
+            int32_t primeiro = (entrada > 0 ? entrada : -entrada) - 1;
+            if (strcmp(partida->mapa[primeiro].nome, nome) == 0) {
+                partida->tabela_nomes[pos] = -(primeiro + 1);
+                if (partida->nomes_repetidos++ == 0 && repetido != NULL) *repetido = i;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Monta o indice de nomes de um mapa recem-carregado ou cadastrado e avisa se ha nomes
+ * repetidos (esses territorios so podem ser escolhidos pelo numero).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int indexar_nomes_do_mapa(Partida* partida) {
+    int repetido;
+    if (construir_indice_nomes(partida, &repetido) != 0) return 1;
+    if (partida->nomes_repetidos > 0) {
+        printf("Aviso: %d territorio(s) do mapa repetem o nome de outro (ex: %d, '%s'); escolha-os pelo numero.\n",
+               partida->nomes_repetidos, repetido + 1, partida->mapa[repetido].nome);
+    }
+    return 0;
+}
+
+/**
+ * @brief Procura um territorio pelo nome. O(1) com o indice de nomes; sem ele, percorre o mapa.
+ * @return int: Indice do territorio (base 0), TERRITORIO_INEXISTENTE ou TERRITORIO_AMBIGUO.
+ */
+int buscar_territorio(const Partida* partida, const char* nome) {
+    if (partida->tabela_nomes != NULL) {
+        uint32_t mascara = partida->capacidade_nomes - 1;
+        for (uint32_t pos = hash_texto(nome) & mascara; ; pos = (pos + 1) & mascara) {
+            int32_t entrada = partida->tabela_nomes[pos];
+            if (entrada == 0) return TERRITORIO_INEXISTENTE;
+            int32_t i = (entrada > 0 ? entrada : -entrada) - 1;
+            if (strcmp(partida->mapa[i].nome, nome) == 0) return entrada > 0 ? i : TERRITORIO_AMBIGUO;
+        }
+    }
+
+    int encontrado = TERRITORIO_INEXISTENTE;
+    for (int i = 0; i < partida->num_territorios; i++) {
+        if (strcmp(partida->mapa[i].nome, nome) != 0) continue;
+        if (encontrado >= 0) return TERRITORIO_AMBIGUO;
+        encontrado = i;
+    }
+    return encontrado;
+}
+
+/**
+ * @brief Resolve um territorio escrito pelo numero (1 a n, como nos menus) ou pelo nome. Um texto
+ * so com digitos e sempre lido como numero.
+ * @return int: Indice do territorio (base 0), TERRITORIO_INEXISTENTE ou TERRITORIO_AMBIGUO.
+ */
+int resolver_territorio(const Partida* partida, const char* texto) {
+    char* fim;
+    long numero = strtol(texto, &fim, 10);
+
+    if (fim != texto && *fim == '\0') {
+        return numero >= 1 && numero <= partida->num_territorios ? (int)numero - 1 : TERRITORIO_INEXISTENTE;
+    }
+    return buscar_territorio(partida, texto);
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Funcoes Auxiliares ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Limpa o buffer de entrada (stdin) após o uso de scanf.
+ * Garante que o próximo fgets não leia uma string vazia.
+ */
+void limpar_buffer() {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF); // Le e descarta caracteres
+}
+
+/**
+ * @brief scanf("%d") dos menus, medido como fase de entrada no --stats.
+ * @return int: O retorno do scanf (1 se um inteiro foi lido).
+ */
+int ler_inteiro_teclado(int* valor) {
+    uint64_t inicio = inicio_fase();
+    int lidos = scanf("%d", valor);
+    fim_fase(FASE_ENTRADA, inicio);
+    return lidos;
+}
+
+/**
+ * @brief Inicializa o gerador aleatorio de uma partida e esvazia a reserva de dados.
+ * @param partida Partida a inicializar.
+ * @param semente Semente (--seed).
+ * @param fluxo Fluxo independente (ex: indice da partida no torneio).
+ */
+void iniciar_dados_partida(Partida* partida, uint64_t semente, uint64_t fluxo) {
+    gerador_iniciar(&partida->gerador, semente, fluxo);
+    partida->posicao_reserva = 0;
+    partida->fim_reserva = 0;
+}
+
+/**
+ * @brief Simula a rolagem de um dado de 6 faces.
+ * Os dados sao rolados em lote na reserva da partida e consumidos um a um. O lote comeca pequeno
+ * e dobra a cada recarga, para que partidas curtas nao rolem milhares de dados a toa.
+ * @param partida Partida dona do gerador aleatorio.
+ * @return int: O valor sorteado do dado (1 a 6).
+ */
+int rolar_dado(Partida* partida) {
+    if (partida->posicao_reserva >= partida->fim_reserva) {
+        int lote = partida->fim_reserva * 2;
+        if (lote < FAIXAS_DADOS * 8) lote = FAIXAS_DADOS * 8;
+        if (lote > TAMANHO_RESERVA_DADOS) lote = TAMANHO_RESERVA_DADOS;
+
+        gerador_preencher_d6(&partida->gerador, partida->reserva_dados, (size_t)lote);
+        partida->posicao_reserva = 0;
+        partida->fim_reserva = lote;
+    }
+    return partida->reserva_dados[partida->posicao_reserva++]; // Valor entre 1 e 6.
+}
+
+/**
+ * @brief Pausa a execucao por alguns segundos, exceto no modo silencioso.
+ * @param segundos Tempo de espera (mesma semantica de sleep()).
+ */
+void pausar(unsigned int segundos) {
+    if (!g_modo_silencioso) {
+        sleep(segundos);
+    }
+}
+
+/**
+ * @brief printf que nao imprime nada no modo silencioso.
+ * Usada nas funcoes de logica do jogo que tambem rodam na simulacao.
+ */
+void mensagem(const char* formato, ...) {
+    if (g_modo_silencioso) return;
+
+    va_list args;
+    va_start(args, formato);
+    vprintf(formato, args);
+    va_end(args);
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Funcoes de Gerenciamento de Memoria ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Libera a memória da partida (territórios, cores e agregados) sem imprimir nada.
+ * Usada nos carregamentos que falham e nas partidas internas da simulação.
+ */
+void descartar_partida(Partida* partida) {
+    if (partida == NULL) return;
+    soltar_vetor(partida->arena, partida->mapa); // Libera a memória dos territórios (com arena, ela volta com a arena).
+    partida->mapa = NULL;
+    partida->num_territorios = 0;
+    liberar_registro_cores(&partida->cores);
+    soltar_vetor(partida->arena, partida->agregados);
+    partida->agregados = NULL;
+    partida->capacidade_agregados = 0;
+    if (!partida->grafo_compartilhado) liberar_grafo(partida->grafo);
+    partida->grafo = NULL;
+    partida->grafo_compartilhado = 0;
+    soltar_vetor(partida->arena, partida->fronteira);
+    soltar_vetor(partida->arena, partida->marcas_regiao);
+    soltar_vetor(partida->arena, partida->fila_regiao);
+    partida->fronteira = NULL;
+    partida->marcas_regiao = NULL;
+    partida->fila_regiao = NULL;
+    liberar_indice_donos(partida);
+    liberar_indice_sequencias(partida);
+    liberar_indice_nomes(partida);
+    liberar_versoes(partida);
+}
+
+/**
+ * @brief Esquece os vetores de uma partida que vivem na arena da sessao (depois de reiniciar a
+ * arena eles nao valem mais). Cores e grafo nao vem da arena e sao mantidos.
+ */
+void esquecer_vetores_da_arena(Partida* partida) {
+    partida->mapa = NULL;
+    partida->num_territorios = 0;
+    partida->agregados = NULL;
+    partida->capacidade_agregados = 0;
+    partida->fronteira = NULL;
+    partida->marcas_regiao = NULL;
+    partida->fila_regiao = NULL;
+    partida->primeiro_do_dono = NULL;
+    partida->proximo_do_dono = NULL;
+    partida->anterior_do_dono = NULL;
+    partida->capacidade_indice = 0;
+    partida->territorios_indice = 0;
+    partida->sequencias = NULL;
+    partida->tabela_nomes = NULL;
+    partida->capacidade_nomes = 0;
+    partida->nomes_repetidos = 0;
+}
+
+/**
+ * @brief Libera a memória alocada dinamicamente para a partida (territórios, cores e agregados).
+ * @param partida Ponteiro para a partida (contém o bloco de memória dos territórios).
+ */
+void liberar_memoria(Partida* partida) {
+    if (partida == NULL) return;
+
+    int tinha_mapa = partida->mapa != NULL;
+    if (tinha_mapa) printf("\n--- Liberando memoria alocada ---\n");
+    descartar_partida(partida); // Mesmo sem mapa: cores, indices e versoes.
+    if (tinha_mapa) printf("Memoria dos territorios liberada.\n");
+}
+
+/**
+ * @brief Aloca (zerado) o mapa da partida com n territórios.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocação.
+ */
+int alocar_mapa(Partida* partida, int n) {
+    // Zerado, como o calloc (na arena da sessao, se houver).
+    uint64_t inicio = inicio_fase();
+    partida->mapa = (Territorio*)alocar_vetor(partida->arena, (size_t)n * sizeof(Territorio), 1);
+    fim_fase(FASE_ALOCACAO, inicio);
+    if (partida->arena == NULL) {
+        contar(CONTADOR_ALOCACOES, 1);
+        contar(CONTADOR_BYTES_ALOCADOS, (long long)n * (long long)sizeof(Territorio));
+    }
+    if (partida->mapa == NULL) {
+        perror("Erro ao alocar memoria para o mapa de territorios");
+        partida->num_territorios = 0;
+        return 1;
+    }
+    partida->num_territorios = n;
+    return 0;
+}
+
+/**
+ * @brief Solicita o número de territórios ao usuário e aloca a memória necessária.
+ * @param partida Partida que recebe o mapa e o número de territórios.
+ * @return Territorio*: O ponteiro para o array de territórios alocado, ou NULL em caso de falha.
+ */
+Territorio* alocar_territorios(Partida* partida) {
+    int num;
+    Territorio* mapa = NULL; 
+
+    printf("\n==========================================\n");
+    printf("             *****JOGO WAR***** \n");
+    printf("             Iniciando o Jogo! \n");
+    printf("==========================================\n");
+    sleep(2); 
+
+    printf("==========================================\n");
+    printf("         SISTEMA DE CONFIGURACAO \n");
+    printf("==========================================\n");
+
+    do {
+        printf("Digite o numero total de territorios a serem cadastrados: ");
+        if (scanf("%d", &num) != 1 || num <= 0) {
+            printf("Erro: Numero invalido. Digite um valor inteiro positivo.\n");
+            limpar_buffer();
+            num = 0;
+        }
+    } while (num <= 0);
+    
+    limpar_buffer();
+
+    if (alocar_mapa(partida, num) != 0) {
+        return NULL;
+    }
+
+    mapa = partida->mapa;
+    printf("Memoria alocada com sucesso para %d territorios.\n\n", partida->num_territorios);
+    return mapa; 
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Mapa Compacto (estrutura de arrays e pool de nomes) ---
+// ------------------------------------------------------------------------------------------------
+// Armazenamento alternativo para mapas enormes. Em vez de um vetor de Territorio (40 bytes, dos
+// quais 30 de nome), tropas e donos ficam em vetores densos separados: uma varredura do mapa le
+// 8 bytes por territorio. Os nomes ficam num pool sem repeticao, referenciados por deslocamento,
+// e os nomes gerados ("Territorio-N") nem entram no pool.
+
+#define NOME_GERADO UINT32_MAX              // Deslocamento de um nome implicito: "Territorio-<i + 1>".
+#define LIMIAR_PAGINAS_ENORMES (2u << 20)   // Tamanho de uma pagina enorme (x86-64); alocacoes menores nao as usam.
+
+int g_paginas_enormes = 0; // --paginas-enormes: vetores grandes do mapa compacto em paginas enormes.
+
+// Pool de nomes: cada nome distinto e guardado uma vez, terminado em '\0'.
+typedef struct {
+    char* texto;              // Nomes, um apos o outro.
+    size_t usado;
+    size_t capacidade;
+    uint32_t* tabela;         // Tabela hash (enderecamento aberto): deslocamento + 1, ou 0 se vazia.
+    size_t capacidade_tabela; // Potencia de 2.
+    size_t num_nomes;         // Nomes distintos no pool.
+} PoolNomes;
+
+// Mapa em estrutura de arrays (SoA): o territorio i e (tropas[i], dono[i], nome[i]).
+typedef struct {
+    int32_t* tropas;
+    int32_t* dono;            // ID da cor (ver RegistroCores).
+    uint32_t* nome;           // Deslocamento do nome no pool, ou NOME_GERADO.
+    int num_territorios;
+    PoolNomes nomes;
+} MapaCompacto;
+
+/**
+ * @brief Tamanho realmente mapeado para uma alocacao grande: com --paginas-enormes, as regioes a
+ * partir de LIMIAR_PAGINAS_ENORMES sao arredondadas para paginas enormes inteiras.
+ */
+static size_t tamanho_alocacao_grande(size_t bytes) {
+    if (bytes == 0) bytes = 1;
+    if (!g_paginas_enormes || bytes < LIMIAR_PAGINAS_ENORMES) return bytes;
+    return (bytes + LIMIAR_PAGINAS_ENORMES - 1) & ~(size_t)(LIMIAR_PAGINAS_ENORMES - 1);
+}
+
+/**
+ * @brief Aloca uma regiao grande e zerada direto do sistema (mmap). Com --paginas-enormes tenta
+ * paginas enormes reservadas (MAP_HUGETLB); se o sistema nao tiver nenhuma, pede paginas enormes
+ * transparentes (madvise). Liberar com liberar_grande e o mesmo tamanho.
+ * @return void*: A regiao, ou NULL em caso de falha.
+ */
+void* alocar_grande(size_t bytes) {
+    size_t tamanho = tamanho_alocacao_grande(bytes);
+    void* regiao = MAP_FAILED;
+
+    uint64_t inicio = inicio_fase();
+    if (g_paginas_enormes && tamanho >= LIMIAR_PAGINAS_ENORMES) {
+        regiao = mmap(NULL, tamanho, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (regiao == MAP_FAILED) {
+        regiao = mmap(NULL, tamanho, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (regiao != MAP_FAILED && g_paginas_enormes && tamanho >= LIMIAR_PAGINAS_ENORMES) {
+            madvise(regiao, tamanho, MADV_HUGEPAGE);
+        }
+    }
+    fim_fase(FASE_ALOCACAO, inicio);
+    if (regiao == MAP_FAILED) return NULL;
+    contar(CONTADOR_ALOCACOES, 1);
+    contar(CONTADOR_BYTES_ALOCADOS, (long long)tamanho);
+    return regiao;
+}
+
+/**
+ * @brief Libera uma regiao de alocar_grande (bytes = o tamanho pedido na alocacao).
+ */
+void liberar_grande(void* regiao, size_t bytes) {
+    if (regiao != NULL) munmap(regiao, tamanho_alocacao_grande(bytes));
+}
+
+/**
+ * @brief Procura um nome no pool.
+ * @return uint32_t: O deslocamento do nome, ou NOME_GERADO se ele nao esta no pool.
+ */
+uint32_t buscar_nome_pool(const PoolNomes* pool, const char* nome) {
+    if (pool->capacidade_tabela == 0) return NOME_GERADO;
+
+    size_t mascara = pool->capacidade_tabela - 1;
+    for (size_t pos = hash_texto(nome) & mascara; ; pos = (pos + 1) & mascara) {
+        uint32_t entrada = pool->tabela[pos];
+        if (entrada == 0) return NOME_GERADO;
+        if (strcmp(pool->texto + entrada - 1, nome) == 0) return entrada - 1;
+    }
+}
+
+/**
+ * @brief Guarda (interna) um nome no pool; um nome repetido devolve o deslocamento do primeiro.
+ * @param deslocamento Recebe o deslocamento do nome no pool.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao ou pool cheio (4 GB).
+ */
+int internar_nome(PoolNomes* pool, const char* nome, uint32_t* deslocamento) {
+    uint32_t existente = buscar_nome_pool(pool, nome);
+    if (existente != NOME_GERADO) {
+        *deslocamento = existente;
+        return 0;
+    }
+
+    size_t tamanho = strlen(nome) + 1;
+    if (pool->usado + tamanho >= NOME_GERADO) return 1;
+    if (pool->usado + tamanho > pool->capacidade) {
+        size_t capacidade = pool->capacidade > 0 ? pool->capacidade * 2 : 4096;
+        while (capacidade < pool->usado + tamanho) capacidade *= 2;
+        char* novo = (char*)realloc(pool->texto, capacidade);
+        if (novo == NULL) return 1;
+        pool->texto = novo;
+        pool->capacidade = capacidade;
+    }
+
+    // Tabela com no maximo 50% de ocupacao, como no registro de cores.
+    if ((pool->num_nomes + 1) * 2 > pool->capacidade_tabela) {
+        size_t capacidade = pool->capacidade_tabela > 0 ? pool->capacidade_tabela * 2 : 1024;
+        uint32_t* tabela = (uint32_t*)calloc(capacidade, sizeof(uint32_t));
+        if (tabela == NULL) return 1;
+        for (size_t p = 0; p < pool->usado; p += strlen(pool->texto + p) + 1) {
+            size_t pos = hash_texto(pool->texto + p) & (capacidade - 1);
+            while (tabela[pos] != 0) pos = (pos + 1) & (capacidade - 1);
+            tabela[pos] = (uint32_t)p + 1;
+        }
+        free(pool->tabela);
+        pool->tabela = tabela;
+        pool->capacidade_tabela = capacidade;
+    }
+
+    *deslocamento = (uint32_t)pool->usado;
+    memcpy(pool->texto + pool->usado, nome, tamanho);
+    pool->usado += tamanho;
+    pool->num_nomes++;
+
+    size_t pos = hash_texto(nome) & (pool->capacidade_tabela - 1);
+    while (pool->tabela[pos] != 0) pos = (pos + 1) & (pool->capacidade_tabela - 1);
+    pool->tabela[pos] = *deslocamento + 1;
+    return 0;
+}
+
+/**
+ * @brief Libera o pool de nomes.
+ */
+void liberar_pool_nomes(PoolNomes* pool) {
+    free(pool->texto);
+    free(pool->tabela);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * @brief Libera os vetores e o pool de nomes de um mapa compacto.
+ */
+void liberar_mapa_compacto(MapaCompacto* mapa) {
+    size_t n = (size_t)mapa->num_territorios;
+    liberar_grande(mapa->tropas, n * sizeof(int32_t));
+    liberar_grande(mapa->dono, n * sizeof(int32_t));
+    liberar_grande(mapa->nome, n * sizeof(uint32_t));
+    liberar_pool_nomes(&mapa->nomes);
+    memset(mapa, 0, sizeof(*mapa));
+}
+
+/**
+ * @brief Aloca (zerados) os vetores de um mapa compacto com n territorios.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int reservar_mapa_compacto(MapaCompacto* mapa, int n) {
+    memset(mapa, 0, sizeof(*mapa));
+    mapa->num_territorios = n;
+    mapa->tropas = (int32_t*)alocar_grande((size_t)n * sizeof(int32_t));
+    mapa->dono = (int32_t*)alocar_grande((size_t)n * sizeof(int32_t));
+    mapa->nome = (uint32_t*)alocar_grande((size_t)n * sizeof(uint32_t));
+    if (mapa->tropas == NULL || mapa->dono == NULL || mapa->nome == NULL) {
+        perror("Erro ao alocar memoria para o mapa compacto");
+        liberar_mapa_compacto(mapa);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Bytes ocupados por um mapa compacto (vetores e pool de nomes).
+ */
+size_t bytes_mapa_compacto(const MapaCompacto* mapa) {
+    return (size_t)mapa->num_territorios * (2 * sizeof(int32_t) + sizeof(uint32_t)) + mapa->nomes.usado +
+           mapa->nomes.capacidade_tabela * sizeof(uint32_t);
+}
+
+/**
+ * @brief Nome do territorio i de um mapa compacto.
+ * @param buffer Espaco para um nome gerado, com TAMANHO_NOME bytes.
+ */
+const char* nome_territorio_compacto(const MapaCompacto* mapa, int i, char* buffer) {
+    uint32_t deslocamento = mapa->nome[i];
+    if (deslocamento != NOME_GERADO) return mapa->nomes.texto + deslocamento;
+    snprintf(buffer, TAMANHO_NOME, "Territorio-%d", i + 1);
+    return buffer;
+}
+
+/**
+ * @brief Gera direto no formato compacto o mesmo mapa de gerar_mapa_simulacao (mesmo gerador,
+ * mesmas tropas e donos), sem passar por um vetor de Territorio.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int gerar_mapa_compacto(MapaCompacto* mapa, int n, int num_lados, GeradorDados* gerador) {
+    if (reservar_mapa_compacto(mapa, n) != 0) return 1;
+    for (int i = 0; i < n; i++) {
+        mapa->tropas[i] = (int32_t)gerador_intervalo(gerador, 5) + 1; // Entre 1 e 5 tropas.
+        mapa->dono[i] = i % num_lados;
+        mapa->nome[i] = NOME_GERADO;
+    }
+    return 0;
+}
+
+/**
+ * @brief Verifica se um nome e o nome gerado do territorio i ("Territorio-<i + 1>"), sem formatar.
+ */
+static int e_nome_gerado(const char* nome, int i) {
+    static const char PREFIXO[] = "Territorio-";
+    if (strncmp(nome, PREFIXO, sizeof(PREFIXO) - 1) != 0) return 0;
+
+    const char* p = nome + sizeof(PREFIXO) - 1;
+    long long valor = 0;
+    if (*p < '1' || *p > '9') return 0; // Sem zeros a esquerda: so a forma canonica.
+    for (; *p >= '0' && *p <= '9' && valor <= INT_MAX; p++) valor = valor * 10 + (*p - '0');
+    return *p == '\0' && valor == (long long)i + 1;
+}
+
+/**
+ * @brief Converte o mapa de uma partida para o formato compacto. Nomes iguais ocupam o pool uma
+ * unica vez; nomes no padrao gerado ("Territorio-<i + 1>") nao ocupam o pool.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int compactar_mapa(const Partida* partida, MapaCompacto* mapa) {
+    if (reservar_mapa_compacto(mapa, partida->num_territorios) != 0) return 1;
+    for (int i = 0; i < partida->num_territorios; i++) {
+        const Territorio* t = partida->mapa + i;
+        mapa->tropas[i] = t->tropas;
+        mapa->dono[i] = t->dono;
+        if (e_nome_gerado(t->nome, i)) {
+            mapa->nome[i] = NOME_GERADO;
+        } else if (internar_nome(&mapa->nomes, t->nome, &mapa->nome[i]) != 0) {
+            perror("Erro ao alocar memoria para o pool de nomes");
+            liberar_mapa_compacto(mapa);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Escreve o mapa compacto num vetor de Territorio ja alocado (com mapa->num_territorios
+ * posicoes). Os agregados nao sao tocados: quem chama os copia ou recalcula.
+ */
+void expandir_mapa_compacto(const MapaCompacto* mapa, Territorio* destino) {
+    char buffer[TAMANHO_NOME];
+
+    for (int i = 0; i < mapa->num_territorios; i++) {
+        Territorio* t = destino + i;
+        snprintf(t->nome, sizeof(t->nome), "%s", nome_territorio_compacto(mapa, i, buffer));
+        t->dono = mapa->dono[i];
+        t->tropas = mapa->tropas[i];
+    }
+}
+
+/**
+ * @brief Recalcula os totais de cada dono (territorios, tropas e fortes) numa unica passada que le
+ * so os vetores de tropas e donos: 8 bytes por territorio.
+ * @param agregados Vetor com num_cores posicoes (zerado aqui).
+ */
+void recontar_donos_compacto(const MapaCompacto* mapa, AgregadoDono* agregados, int num_cores) {
+    const int32_t* restrict tropas = mapa->tropas;
+    const int32_t* restrict dono = mapa->dono;
+
+    memset(agregados, 0, (size_t)num_cores * sizeof(AgregadoDono));
+    for (int i = 0; i < mapa->num_territorios; i++) {
+        AgregadoDono* a = &agregados[dono[i]];
+        a->territorios++;
+        a->tropas += tropas[i];
+        a->territorios_fortes += tropas[i] > LIMIAR_TERRITORIO_FORTE;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Funcoes de Missao e Jogador ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Valor atual da metrica de uma missao (conquistas seguidas, territorios, tropas, fortes ou
+ * maior sequencia de territorios seguidos).
+ * @param missao Missao avaliada.
+ * @param jogador Dono da missao (usado nas conquistas seguidas).
+ * @param alvo ID da cor medida (ja resolvido na atribuicao da missao).
+ * @param partida Partida com os agregados por dono.
+ */
+long long valor_metrica_missao(const Missao* missao, const Jogador* jogador, int alvo, const Partida* partida) {
+    switch (missao->tipo) {
+        case METRICA_CONQUISTAS_SEGUIDAS: return jogador->territorios_conquistados;
+        case METRICA_TERRITORIOS:         return agregado_dono(partida, alvo).territorios;
+        case METRICA_TROPAS:              return agregado_dono(partida, alvo).tropas;
+        case METRICA_TERRITORIOS_FORTES:  return agregado_dono(partida, alvo).territorios_fortes;
+        case METRICA_MAIOR_SEQUENCIA:     return maior_sequencia(partida, alvo);
+    }
+    return 0;
+}
+
+/**
+ * @brief Avalia o predicado de uma missao (metrica, condicao e limiar) para um jogador.
+ * @return int: 1 se a missao foi cumprida, 0 caso contrario.
+ */
+static inline int missao_cumprida(const Jogador* jogador, const Partida* partida) {
+    contar(CONTADOR_VERIFICACOES, 1);
+    const Missao* missao = &g_missoes.missoes[jogador->id_missao];
+    long long valor = valor_metrica_missao(missao, jogador, jogador->alvo_missao, partida);
+
+    switch (missao->condicao) {
+        case CONDICAO_MAIOR_IGUAL: return valor >= missao->limiar;
+        case CONDICAO_MENOR_IGUAL: return valor <= missao->limiar;
+        case CONDICAO_IGUAL:       return valor == missao->limiar;
+    }
+    return 0;
+}
+
+/**
+ * @brief Verifica as missoes de todos os jogadores em uma unica passada sobre os agregados.
+ * @param partida Partida em andamento.
+ * @param jogadores Vetor de jogadores.
+ * @param num_jogadores Quantidade de jogadores.
+ * @param primeiro Jogador avaliado primeiro (ex: quem acabou de jogar); os demais seguem em ordem circular.
+ * @return int: Indice do primeiro jogador que cumpriu a missao, ou -1 se nenhum cumpriu.
+ */
+int avaliar_missoes(const Partida* partida, const Jogador* jogadores, int num_jogadores, int primeiro) {
+    uint64_t inicio = inicio_fase();
+    int vencedor = -1;
+
+    for (int k = 0; k < num_jogadores && vencedor < 0; k++) {
+        int j = (primeiro + k) % num_jogadores;
+        if (missao_cumprida(&jogadores[j], partida)) vencedor = j;
+    }
+    fim_fase(FASE_MISSAO, inicio);
+    return vencedor;
+}
+
+/**
+ * @brief Sorteia uma missão da tabela de missões e guarda o seu ID no jogador.
+ * O alvo da missão (a própria cor ou uma cor nomeada) é resolvido aqui, uma única vez.
+ * @param jogador Ponteiro para a struct do Jogador (passagem por referência).
+ * @param partida Partida dona do gerador aleatorio usado no sorteio.
+ */
+void atribuirMissao(Jogador* jogador, Partida* partida) {
+    // Sorteia um índice no intervalo [0, total de missões - 1].
+    jogador->id_missao = (int)gerador_intervalo(&partida->gerador, (uint32_t)g_missoes.total);
+
+    const Missao* missao = &g_missoes.missoes[jogador->id_missao];
+    jogador->alvo_missao = missao->alvo[0] == '\0' ? jogador->id_cor : buscar_cor(&partida->cores, missao->alvo);
+}
+
+/**
+ * @brief Exibe a missão do jogador (apenas uma vez, no início).
+ * @param jogador Ponteiro constante para a struct do Jogador (passagem por valor conceitual).
+ */
+void exibirMissao(const Jogador* jogador) {
+    printf("\n==========================================\n");
+    printf("             SUA MISSAO  \n");
+    printf("==========================================\n");
+    printf("Cor do Exercito: %s\n", jogador->cor);
+    printf("Objetivo: %s\n", g_missoes.missoes[jogador->id_missao].descricao);
+    printf("==========================================\n");
+    sleep(3);
+}
+
+/**
+ * @brief Verifica se a missão do jogador foi cumprida.
+ * @param jogador Ponteiro para a struct do Jogador (passagem por referência).
+ * @param partida Ponteiro para a partida (agregados por dono).
+ * @return int: 1 se a missão foi cumprida, 0 caso contrário.
+ */
+int verificarMissao(Jogador* jogador, const Partida* partida) {
+    uint64_t inicio = inicio_fase();
+    int cumprida = missao_cumprida(jogador, partida);
+    fim_fase(FASE_MISSAO, inicio);
+
+    if (cumprida) {
+        mensagem("\nPARABENS! O jogador %s cumpriu sua missao de '%s'!\n",
+                 jogador->cor, g_missoes.missoes[jogador->id_missao].descricao);
+        return 1;
+    }
+    return 0; // Missão não cumprida.
+}
+
+/**
+ * @brief Carrega a tabela de missões de um arquivo texto, uma missão por linha:
+ *   metrica;alvo;condicao;limiar;descricao
+ * metrica: seguidas | territorios | tropas | fortes | sequencia
+ * alvo: nome de uma cor, ou vazio/"-" para a cor do próprio jogador
+ * condicao: >= | <= | ==
+ * Linhas vazias e iniciadas por '#' são ignoradas.
+ * Exemplo: tropas;Vermelha;<=;0;Eliminar todas as tropas da cor Vermelha.
+ * Exemplo: sequencia;;>=;3;Controlar 3 territorios seguidos no mapa.
+ * @param caminho Caminho do arquivo.
+ * @param tabela Tabela que recebe as missões (só é alterada se o arquivo for válido).
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem já impressa).
+ */
+int carregar_missoes(const char* caminho, TabelaMissoes* tabela) {
+    static const char* NOMES_CONDICOES[] = { ">=", "<=", "==" };
+    TabelaMissoes nova = {0};
+    char linha[256];
+    int num_linha = 0;
+
+    FILE* arquivo = fopen(caminho, "r");
+    if (arquivo == NULL) {
+        perror("Erro ao abrir o arquivo de missoes");
+        return 1;
+    }
+
+    while (fgets(linha, sizeof(linha), arquivo) != NULL) {
+        char* campos[5];
+        int num_campos = 0;
+        char* p = linha;
+
+        num_linha++;
+        linha[strcspn(linha, "\r\n")] = '\0';
+        if (linha[0] == '\0' || linha[0] == '#') continue;
+
+        // Separa os 4 primeiros campos; a descricao e o resto da linha.
+        campos[num_campos++] = p;
+        while (num_campos < 5 && (p = strchr(p, ';')) != NULL) {
+            *p++ = '\0';
+            campos[num_campos++] = p;
+        }
+
+        Missao m = {0};
+        int metrica = -1, condicao = -1;
+        char* fim_numero;
+
+        for (int i = 0; num_campos == 5 && i < NUM_METRICAS; i++) {
+            if (strcmp(campos[0], NOMES_METRICAS[i]) == 0) metrica = i;
+        }
+        for (int i = 0; num_campos == 5 && i < 3; i++) {
+            if (strcmp(campos[2], NOMES_CONDICOES[i]) == 0) condicao = i;
+        }
+        m.limiar = num_campos == 5 ? strtoll(campos[3], &fim_numero, 10) : 0;
+
+        if (num_campos != 5 || metrica < 0 || condicao < 0 || fim_numero == campos[3] || *fim_numero != '\0' ||
+            strlen(campos[1]) >= TAMANHO_COR || strlen(campos[4]) >= sizeof(m.descricao) || campos[4][0] == '\0' ||
+            (metrica == METRICA_CONQUISTAS_SEGUIDAS && campos[1][0] != '\0' && strcmp(campos[1], "-") != 0)) {
+            printf("Erro: linha %d invalida no arquivo de missoes %s.\n", num_linha, caminho);
+            fclose(arquivo);
+            return 1;
+        }
+        if (nova.total == MAX_MISSOES) {
+            printf("Erro: o arquivo de missoes %s tem mais de %d missoes.\n", caminho, MAX_MISSOES);
+            fclose(arquivo);
+            return 1;
+        }
+
+        m.tipo = (MetricaMissao)metrica;
+        m.condicao = (CondicaoMissao)condicao;
+        if (strcmp(campos[1], "-") != 0) strcpy(m.alvo, campos[1]);
+        strcpy(m.descricao, campos[4]);
+        nova.missoes[nova.total++] = m;
+    }
+    fclose(arquivo);
+
+    if (nova.total == 0) {
+        printf("Erro: o arquivo de missoes %s nao tem nenhuma missao.\n", caminho);
+        return 1;
+    }
+    *tabela = nova;
+    return 0;
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// --- Jogadores e Turnos (N jogadores) ---
+// ------------------------------------------------------------------------------------------------
+
+// Mesa de uma partida com N jogadores. Todo o estado por jogador fica em vetores contiguos
+// indexados pelo numero do jogador (ou da cor), sem alocacao durante a partida.
+typedef struct {
+    Jogador* jogadores;       // Os N jogadores, na ordem dos turnos.
+    int num_jogadores;
+    int capacidade_jogadores;
+    int* proximo;             // Roda de turnos: lista circular so com os jogadores vivos.
+    int* anterior;
+    int primeiro_vivo;        // Vivo de menor numero (inicio de cada rodada), ou -1.
+    int vivos;
+    int* jogador_da_cor;      // jogador_da_cor[cor] = jogador dono da cor, ou -1 (cor neutra).
+    int* inicio_interessados; // Jogadores cuja missao mede a cor c:
+    int* interessados;        //   interessados[inicio_interessados[c] .. inicio_interessados[c + 1] - 1].
+    int num_cores;
+    int capacidade_cores;
+    Arena* arena; // Arena da sessao (os vetores vem dela), ou NULL.
+} MesaJogadores;
+
+/**
+ * @brief Libera os vetores da mesa.
+ */
+void liberar_mesa(MesaJogadores* mesa) {
+    Arena* arena = mesa->arena;
+    soltar_vetor(arena, mesa->jogadores);
+    soltar_vetor(arena, mesa->proximo);
+    soltar_vetor(arena, mesa->anterior);
+    soltar_vetor(arena, mesa->jogador_da_cor);
+    soltar_vetor(arena, mesa->inicio_interessados);
+    soltar_vetor(arena, mesa->interessados);
+    memset(mesa, 0, sizeof(*mesa));
+    mesa->arena = arena;
+}
+
+/**
+ * @brief Garante espaco na mesa para num_jogadores jogadores e num_cores cores (os vetores sao
+ * reaproveitados de uma partida para outra).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int reservar_mesa(MesaJogadores* mesa, int num_jogadores, int num_cores) {
+    Arena* arena = mesa->arena;
+
+    if (num_jogadores > mesa->capacidade_jogadores) {
+        soltar_vetor(arena, mesa->jogadores);
+        soltar_vetor(arena, mesa->proximo);
+        soltar_vetor(arena, mesa->anterior);
+        soltar_vetor(arena, mesa->interessados);
+        mesa->jogadores = (Jogador*)alocar_vetor(arena, (size_t)num_jogadores * sizeof(Jogador), 1);
+        mesa->proximo = (int*)alocar_vetor(arena, (size_t)num_jogadores * sizeof(int), 0);
+        mesa->anterior = (int*)alocar_vetor(arena, (size_t)num_jogadores * sizeof(int), 0);
+        mesa->interessados = (int*)alocar_vetor(arena, (size_t)num_jogadores * sizeof(int), 0);
+        mesa->capacidade_jogadores = num_jogadores;
+    }
+    if (num_cores > mesa->capacidade_cores) {
+        soltar_vetor(arena, mesa->jogador_da_cor);
+        soltar_vetor(arena, mesa->inicio_interessados);
+        mesa->jogador_da_cor = (int*)alocar_vetor(arena, (size_t)num_cores * sizeof(int), 0);
+        mesa->inicio_interessados = (int*)alocar_vetor(arena, ((size_t)num_cores + 1) * sizeof(int), 0);
+        mesa->capacidade_cores = num_cores;
+    }
+    if (mesa->jogadores == NULL || mesa->proximo == NULL || mesa->anterior == NULL || mesa->interessados == NULL ||
+        mesa->jogador_da_cor == NULL || mesa->inicio_interessados == NULL) {
+        perror("Erro ao alocar memoria para os jogadores da partida");
+        liberar_mesa(mesa);
+        return 1;
+    }
+    mesa->num_jogadores = num_jogadores;
+    return 0;
+}
+
+/**
+ * @brief Prepara os turnos depois que os jogadores e as missoes estao definidos: dono de cada cor,
+ * interessados de cada cor (contagem por cor, como no CSR do grafo) e a roda de turnos, que comeca
+ * so com os jogadores que tem territorios.
+ * @param num_cores Cores da partida (no maximo a capacidade reservada).
+ */
+void preparar_turnos(MesaJogadores* mesa, const Partida* partida, int num_cores) {
+    int n = mesa->num_jogadores;
+
+    mesa->num_cores = num_cores;
+    memset(mesa->jogador_da_cor, 0xff, (size_t)num_cores * sizeof(int));
+    memset(mesa->inicio_interessados, 0, ((size_t)num_cores + 1) * sizeof(int));
+    for (int j = 0; j < n; j++) {
+        mesa->jogador_da_cor[mesa->jogadores[j].id_cor] = j;
+        int alvo = mesa->jogadores[j].alvo_missao;
+        if (alvo >= 0 && alvo < num_cores) mesa->inicio_interessados[alvo]++;
+    }
+    for (int c = 1; c <= num_cores; c++) mesa->inicio_interessados[c] += mesa->inicio_interessados[c - 1];
+    for (int j = n - 1; j >= 0; j--) {
+        // Preenche cada cor de tras para frente: no fim, inicio_interessados[c] aponta para o
+        // comeco da cor c e os interessados ficam em ordem crescente.
+        int alvo = mesa->jogadores[j].alvo_missao;
+        if (alvo >= 0 && alvo < num_cores) mesa->interessados[--mesa->inicio_interessados[alvo]] = j;
+    }
+
+    // Roda de turnos em ordem crescente de jogador.
+    int ultimo = -1;
+    mesa->primeiro_vivo = -1;
+    mesa->vivos = 0;
+    for (int j = 0; j < n; j++) {
+        mesa->anterior[j] = -1; // -1 = fora da roda (sem territorios).
+        if (agregado_dono(partida, mesa->jogadores[j].id_cor).territorios == 0) continue;
+        if (ultimo < 0) mesa->primeiro_vivo = j;
+        else mesa->proximo[ultimo] = j;
+        mesa->anterior[j] = ultimo;
+        ultimo = j;
+        mesa->vivos++;
+    }
+    if (ultimo >= 0) {
+        mesa->proximo[ultimo] = mesa->primeiro_vivo;
+        mesa->anterior[mesa->primeiro_vivo] = ultimo;
+    }
+}
+
+/**
+ * @brief Tira um jogador sem territorios da roda de turnos. O(1).
+ */
+void eliminar_jogador(MesaJogadores* mesa, int j) {
+    int proximo = mesa->proximo[j];
+    int anterior = mesa->anterior[j];
+
+    mesa->anterior[j] = -1; // Fora da roda.
+    mesa->vivos--;
+    if (mesa->vivos == 0) {
+        mesa->primeiro_vivo = -1;
+        return;
+    }
+    mesa->proximo[anterior] = proximo;
+    mesa->anterior[proximo] = anterior;
+    if (mesa->primeiro_vivo == j) mesa->primeiro_vivo = proximo;
+}
+
+/**
+ * @brief Registra o efeito de um ataque na mesa: se o defensor ficou sem territorios, o seu
+ * jogador sai da roda de turnos.
+ */
+void registrar_ataque_mesa(MesaJogadores* mesa, const Partida* partida, int cor_defensor) {
+    int j = cor_defensor >= 0 && cor_defensor < mesa->num_cores ? mesa->jogador_da_cor[cor_defensor] : -1;
+    if (j >= 0 && mesa->anterior[j] >= 0 && agregado_dono(partida, cor_defensor).territorios == 0) {
+        eliminar_jogador(mesa, j);
+    }
+}
+
+/**
+ * @brief Verifica so as missoes que um ataque pode ter mudado: as dos jogadores que medem a cor do
+ * atacante ou a do defensor (o contador de conquistas do atacante entra pela sua propria cor).
+ * Como a partida termina na primeira missao cumprida, nenhuma outra pode ter passado a valer.
+ * O custo nao depende do numero de jogadores.
+ * @param primeiro Jogador que acabou de jogar: em caso de empate vence o primeiro em ordem circular.
+ * @return int: Jogador vencedor, ou -1.
+ */
+int avaliar_missoes_afetadas(const Partida* partida, const MesaJogadores* mesa, int primeiro, int cor_atacante,
+                             int cor_defensor) {
+    uint64_t inicio = inicio_fase();
+    int vencedor = -1, melhor_distancia = mesa->num_jogadores;
+    int cores[2] = { cor_atacante, cor_defensor };
+
+    for (int k = 0; k < 2; k++) {
+        int c = cores[k];
+        if (c < 0 || c >= mesa->num_cores || (k == 1 && c == cor_atacante)) continue;
+        for (int x = mesa->inicio_interessados[c]; x < mesa->inicio_interessados[c + 1]; x++) {
+            int j = mesa->interessados[x];
+            int distancia = (j - primeiro + mesa->num_jogadores) % mesa->num_jogadores;
+            if (distancia < melhor_distancia && missao_cumprida(&mesa->jogadores[j], partida)) {
+                vencedor = j;
+                melhor_distancia = distancia;
+            }
+        }
+    }
+    fim_fase(FASE_MISSAO, inicio);
+    return vencedor;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Funcoes de Manipulacao de Dados (Exibir, Cadastrar) ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Realiza o cadastro de todos os territórios.
+ * @param partida Ponteiro para a partida (array dinâmico de territórios).
+ */
+void cadastrar_territorios(Partida* partida) {
+    Territorio* mapa = partida->mapa;
+    char cor[TAMANHO_COR];
+    int dono, tropas;
+    int i;
+    
+    printf("==========================================\n");
+    printf("  SISTEMA DE CADASTRO DE TERRITORIOS \n");
+    printf("==========================================\n");
+    sleep(1); 
+    printf("Iniciando o cadastro de %d territorios.\n\n", partida->num_territorios);
+
+    for (i = 0; i < partida->num_territorios; i++) {
+        Territorio* t = mapa + i; 
+
+        printf("--- Cadastro do Territorio %d de %d ---\n", i + 1, partida->num_territorios);
+
+        // 1. Leitura do NOME
+        printf("Digite o nome do territorio (max 29 caracteres): ");
+        if (fgets(t->nome, sizeof(t->nome), stdin) == NULL) return; 
+        t->nome[strcspn(t->nome, "\n")] = '\0'; 
+
+        // 2. Leitura da COR
+        printf("Digite a cor do exercito (max 9 caracteres): ");
+        if (fgets(cor, sizeof(cor), stdin) == NULL) return; 
+        cor[strcspn(cor, "\n")] = '\0'; 
+        dono = registrar_cor(&partida->cores, cor); // A cor vira um ID inteiro.
+
+        // 3. Leitura da QUANTIDADE DE TROPAS
+        do {
+            printf("Digite a quantidade de tropas (minimo 1): ");
+            if (scanf("%d", &tropas) != 1 || tropas <= 0) {
+                printf("Erro: Entrada invalida. A quantidade de tropas deve ser um inteiro maior que 0.\n");
+                limpar_buffer(); 
+                tropas = 0; 
+            }
+        } while (tropas <= 0);
+
+        limpar_buffer(); 
+        if (dono < 0 || registrar_territorio(partida, t, dono, tropas) != 0) return;
+        printf("\n");
+    }
+    indexar_nomes_do_mapa(partida); // Sem memoria, os nomes sao procurados percorrendo o mapa.
+}
+
+#define TERRITORIOS_POR_PAGINA 20 // Linhas de territorio por pagina (e limite de alteracoes listadas).
+
+// Estado da tela do modo interativo. O quadro e montado em um buffer e vai para o terminal
+// de uma vez; a copia do que foi exibido permite mostrar so o que mudou desde o ultimo quadro.
+typedef struct {
+    char* texto;              // Quadro em montagem.
+    size_t usados;
+    size_t capacidade;
+    const Territorio* mapa_exibido; // Mapa do ultimo quadro (outro mapa = quadro completo).
+    int num_exibidos;
+    int* dono_exibido;        // Dono e tropas de cada territorio no ultimo quadro.
+    int* tropas_exibidas;
+    int pagina;               // Pagina atual (0 = primeira), contada sobre os territorios filtrados.
+    int filtro_dono;          // ID da cor exibida, ou -1 para todas.
+    int filtro_tropas;        // Minimo de tropas exibido (0 = sem filtro).
+} Visualizacao;
+
+/**
+ * @brief Acrescenta texto formatado ao quadro (o buffer cresce quando precisa).
+ */
+void quadro_printf(Visualizacao* vis, const char* formato, ...) {
+    for (;;) {
+        size_t livre = vis->capacidade - vis->usados;
+        va_list args;
+        va_start(args, formato);
+        int escrito = vsnprintf(vis->texto != NULL ? vis->texto + vis->usados : NULL, livre, formato, args);
+        va_end(args);
+        if (escrito < 0) return;
+        if ((size_t)escrito < livre) {
+            vis->usados += (size_t)escrito;
+            return;
+        }
+
+        size_t capacidade = vis->capacidade > 0 ? vis->capacidade * 2 : 4096;
+        while (capacidade - vis->usados <= (size_t)escrito) capacidade *= 2;
+        char* novo = (char*)realloc(vis->texto, capacidade);
+        if (novo == NULL) return; // Sem memoria: o texto e descartado, o jogo continua.
+        vis->texto = novo;
+        vis->capacidade = capacidade;
+    }
+}
+
+/**
+ * @brief Envia o quadro montado ao terminal com uma unica escrita.
+ */
+void quadro_descarregar(Visualizacao* vis) {
+    contar(CONTADOR_QUADROS, 1);
+    fwrite(vis->texto, 1, vis->usados, stdout);
+    fflush(stdout);
+    vis->usados = 0;
+}
+
+/**
+ * @brief Indica se o territorio passa pelos filtros de dono e de tropas.
+ */
+int territorio_visivel(const Visualizacao* vis, const Territorio* t) {
+    return (vis->filtro_dono < 0 || t->dono == vis->filtro_dono) && t->tropas >= vis->filtro_tropas;
+}
+
+/**
+ * @brief Cabecalho do quadro, com os filtros ativos.
+ */
+void quadro_cabecalho(Visualizacao* vis, const Partida* partida, const char* titulo) {
+    quadro_printf(vis, "\n==========================================\n");
+    quadro_printf(vis, "  %s \n", titulo);
+    quadro_printf(vis, "==========================================\n");
+    if (vis->filtro_dono >= 0 || vis->filtro_tropas > 0) {
+        quadro_printf(vis, "Filtros: cor %s | tropas >= %d\n",
+                      vis->filtro_dono >= 0 ? nome_cor(&partida->cores, vis->filtro_dono) : "(todas)", vis->filtro_tropas);
+    }
+    quadro_printf(vis, "%7s  %-29s  %-9s  %6s\n", "Num", "Nome", "Cor", "Tropas");
+}
+
+/**
+ * @brief Guarda o dono e as tropas de todos os territorios como "ja exibidos".
+ */
+void lembrar_territorios(Visualizacao* vis, const Partida* partida) {
+    if (vis->mapa_exibido != partida->mapa || vis->num_exibidos != partida->num_territorios) {
+        free(vis->dono_exibido);
+        free(vis->tropas_exibidas);
+        vis->dono_exibido = (int*)malloc((size_t)partida->num_territorios * sizeof(int));
+        vis->tropas_exibidas = (int*)malloc((size_t)partida->num_territorios * sizeof(int));
+        if (vis->dono_exibido == NULL || vis->tropas_exibidas == NULL) {
+            // Sem memoria para a copia: todo quadro sera completo.
+            free(vis->dono_exibido);
+            free(vis->tropas_exibidas);
+            vis->dono_exibido = vis->tropas_exibidas = NULL;
+            vis->mapa_exibido = NULL;
+            return;
+        }
+        vis->mapa_exibido = partida->mapa;
+        vis->num_exibidos = partida->num_territorios;
+    }
+    for (int i = 0; i < partida->num_territorios; i++) {
+        vis->dono_exibido[i] = partida->mapa[i].dono;
+        vis->tropas_exibidas[i] = partida->mapa[i].tropas;
+    }
+}
+
+/**
+ * @brief Exibe a pagina atual dos territorios filtrados (quadro completo).
+ * @param partida Ponteiro constante para a partida (apenas leitura).
+ * @param vis Estado da tela (pagina e filtros).
+ */
+void exibir_pagina_territorios(const Partida* partida, Visualizacao* vis) {
+    uint64_t inicio = inicio_fase();
+    int visiveis = 0;
+    int primeiro = vis->pagina * TERRITORIOS_POR_PAGINA;
+
+    quadro_cabecalho(vis, partida, "DADOS DOS TERRITORIOS ATUAIS");
+    for (int i = 0; i < partida->num_territorios; i++) {
+        const Territorio* t = partida->mapa + i;
+        if (!territorio_visivel(vis, t)) continue;
+        if (visiveis >= primeiro && visiveis < primeiro + TERRITORIOS_POR_PAGINA) {
+            quadro_printf(vis, "%7d  %-29s  %-9s  %6d\n", i + 1, t->nome, nome_cor(&partida->cores, t->dono), t->tropas);
+        }
+        visiveis++;
+    }
+
+    int paginas = (visiveis + TERRITORIOS_POR_PAGINA - 1) / TERRITORIOS_POR_PAGINA;
+    if (visiveis == 0) quadro_printf(vis, "(nenhum territorio com esses filtros)\n");
+    quadro_printf(vis, "--- Pagina %d de %d (%d de %d territorios) ---\n",
+                  paginas > 0 ? vis->pagina + 1 : 0, paginas, visiveis, partida->num_territorios);
+
+    quadro_descarregar(vis);
+    lembrar_territorios(vis, partida);
+    fim_fase(FASE_RENDERIZACAO, inicio);
+}
+
+/**
+ * @brief Exibe o mapa: no primeiro quadro (ou depois de trocar de mapa), a pagina atual;
+ * nos seguintes, so os territorios (filtrados) cujo dono ou tropas mudaram desde o ultimo quadro.
+ * @param partida Ponteiro constante para a partida (apenas leitura).
+ * @param vis Estado da tela.
+ */
+void exibir_territorios(const Partida* partida, Visualizacao* vis) {
+    int alterados = 0;
+
+    if (vis->mapa_exibido != partida->mapa || vis->num_exibidos != partida->num_territorios) {
+        exibir_pagina_territorios(partida, vis);
+        return;
+    }
+
+    uint64_t inicio = inicio_fase();
+    for (int i = 0; i < partida->num_territorios; i++) {
+        const Territorio* t = partida->mapa + i;
+        if ((t->dono == vis->dono_exibido[i] && t->tropas == vis->tropas_exibidas[i]) || !territorio_visivel(vis, t)) {
+            continue;
+        }
+        if (alterados == 0) quadro_cabecalho(vis, partida, "TERRITORIOS ALTERADOS");
+        if (alterados < TERRITORIOS_POR_PAGINA) {
+            quadro_printf(vis, "%7d  %-29s  %-9s  %6d   (antes: %s, %d)\n", i + 1, t->nome,
+                          nome_cor(&partida->cores, t->dono), t->tropas,
+                          nome_cor(&partida->cores, vis->dono_exibido[i]), vis->tropas_exibidas[i]);
+        }
+        alterados++;
+    }
+
+    if (alterados == 0) {
+        quadro_printf(vis, "\n(Mapa sem alteracoes desde a ultima exibicao; use 'Ver o mapa' para navegar.)\n");
+    } else if (alterados > TERRITORIOS_POR_PAGINA) {
+        quadro_printf(vis, "... e mais %d territorios alterados.\n", alterados - TERRITORIOS_POR_PAGINA);
+    }
+    quadro_descarregar(vis);
+    lembrar_territorios(vis, partida);
+    fim_fase(FASE_RENDERIZACAO, inicio);
+}
+
+/**
+ * @brief Exibe, por cor, os territorios na fronteira e as regioes conexas (grafo do mapa).
+ */
+void exibir_fronteiras(Partida* partida) {
+    printf("\n%-10s | %11s | %9s | %7s | %12s\n", "Cor", "Territorios", "Fronteira", "Regioes", "Maior regiao");
+    for (int c = 0; c < partida->cores.total; c++) {
+        int maior;
+        int territorios = agregado_dono(partida, c).territorios;
+        if (territorios == 0) continue;
+        int regioes = regioes_do_dono(partida, c, &maior);
+        if (regioes < 0) return;
+        printf("%-10s | %11d | %9d | %7d | %12d\n", nome_cor(&partida->cores, c), territorios,
+               tamanho_fronteira(partida, c), regioes, maior);
+    }
+    if (partida->grafo == NULL) printf("(Mapa sem grafo: todos os territorios fazem fronteira entre si.)\n");
+    printf("\n");
+}
+
+/**
+ * @brief Navegacao pelo mapa: paginas e filtros por cor e por tropas.
+ * Comandos: n (proxima), p (anterior), g N (ir para a pagina N), c COR (filtrar cor),
+ * t N (tropas >= N), l (limpar filtros), f (fronteiras e regioes por cor), s (sair).
+ */
+void menu_visualizar_mapa(Partida* partida, Visualizacao* vis) {
+    char linha[64];
+
+    for (;;) {
+        exibir_pagina_territorios(partida, vis);
+        printf("[n] proxima  [p] anterior  [g N] pagina  [c COR] cor  [t N] tropas minimas  [l] limpar"
+               "  [f] fronteiras  [s] sair: ");
+        uint64_t inicio = inicio_fase();
+        char* lida = fgets(linha, sizeof(linha), stdin);
+        fim_fase(FASE_ENTRADA, inicio);
+        if (lida == NULL) return;
+        linha[strcspn(linha, "\r\n")] = '\0';
+
+        char* argumento = linha + 1;
+        while (*argumento == ' ') argumento++;
+
+        switch (linha[0]) {
+            case 'n': vis->pagina++; break;
+            case 'p': if (vis->pagina > 0) vis->pagina--; break;
+            case 'g': vis->pagina = atoi(argumento) > 0 ? atoi(argumento) - 1 : 0; break;
+            case 't': vis->filtro_tropas = atoi(argumento) > 0 ? atoi(argumento) : 0; vis->pagina = 0; break;
+            case 'l': vis->filtro_dono = -1; vis->filtro_tropas = 0; vis->pagina = 0; break;
+            case 'c':
+                vis->filtro_dono = buscar_cor(&partida->cores, argumento);
+                if (vis->filtro_dono < 0) printf("Cor '%s' nao encontrada; filtro de cor removido.\n", argumento);
+                vis->pagina = 0;
+                break;
+            case 'f': exibir_fronteiras(partida); break;
+            case 's': return;
+            default: printf("Comando invalido.\n"); break;
+        }
+
+        // Nao passa da ultima pagina dos territorios filtrados.
+        int visiveis = 0;
+        for (int i = 0; i < partida->num_territorios; i++) visiveis += territorio_visivel(vis, partida->mapa + i);
+        int ultima = visiveis > 0 ? (visiveis - 1) / TERRITORIOS_POR_PAGINA : 0;
+        if (vis->pagina > ultima) vis->pagina = ultima;
+    }
+}
+
+/**
+ * @brief Libera os buffers da tela.
+ */
+void liberar_visualizacao(Visualizacao* vis) {
+    free(vis->texto);
+    free(vis->dono_exibido);
+    free(vis->tropas_exibidas);
+    memset(vis, 0, sizeof(*vis));
+    vis->filtro_dono = -1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Carregamento de Mapas e Estados Salvos (--map: texto, binario ou snapshot) ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Converte um campo numerico (so digitos) em inteiro positivo.
+ * @return int: O valor, ou -1 se o campo nao e um inteiro valido entre 1 e INT_MAX.
+ */
+int ler_inteiro_campo(const char* inicio, const char* fim) {
+    long long valor = 0;
+
+    if (inicio == fim) return -1;
+    for (const char* p = inicio; p < fim; p++) {
+        if (*p < '0' || *p > '9') return -1;
+        valor = valor * 10 + (*p - '0');
+        if (valor > 2147483647LL) return -1;
+    }
+    return (int)valor;
+}
+
+/**
+ * @brief Remove espacos do inicio e do fim de um campo [*inicio, *fim).
+ */
+void aparar_campo(const char** inicio, const char** fim) {
+    while (*inicio < *fim && (**inicio == ' ' || **inicio == '\t')) (*inicio)++;
+    while (*fim > *inicio && ((*fim)[-1] == ' ' || (*fim)[-1] == '\t' || (*fim)[-1] == '\r')) (*fim)--;
+}
+
+/**
+ * @brief Carrega um mapa em formato texto: uma linha por territorio, "nome;cor;tropas"
+ * (tambem aceita ',' como separador). Linhas vazias e iniciadas por '#' sao ignoradas.
+ * Um quarto campo opcional lista os vizinhos pelo numero do territorio (ordem no arquivo,
+ * a partir de 1), separados por espacos: "Brasil;Vermelha;3;2 4". Basta listar cada fronteira
+ * de um dos lados. Se nenhuma linha tiver o quarto campo, o mapa fica sem grafo.
+ * O texto e percorrido direto na memoria (sem scanf), com uma passada para contar as linhas.
+ * @param partida Partida vazia que recebe o mapa.
+ * @param dados Conteudo do arquivo.
+ * @param tamanho Tamanho do conteudo em bytes.
+ * @param caminho Nome do arquivo (para as mensagens de erro).
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int carregar_mapa_texto(Partida* partida, const char* dados, size_t tamanho, const char* caminho) {
+    const char* fim_dados = dados + tamanho;
+    long long linhas = 1;
+    int num_linha = 0;
+    int n = 0;
+
+    // 1. Conta as linhas para alocar o mapa de uma vez (limite superior de territorios).
+    for (const char* p = dados; (p = memchr(p, '\n', (size_t)(fim_dados - p))) != NULL; p++) linhas++;
+    if (linhas > 2147483647LL || alocar_mapa(partida, (int)linhas) != 0) return 1;
+
+    // Cache da ultima cor lida: mapas costumam ter cores repetidas em sequencia.
+    char ultima_cor[TAMANHO_COR] = "";
+    int ultimo_dono = -1;
+
+    // Arestas do quarto campo (pares de numeros de territorio, base 1), validadas no final.
+    uint32_t* arestas = NULL;
+    size_t num_arestas = 0, capacidade_arestas = 0;
+    int tem_grafo = 0;
+
+    // 2. Le cada linha em tres campos.
+    for (const char* linha = dados; linha < fim_dados; ) {
+        const char* fim_linha = memchr(linha, '\n', (size_t)(fim_dados - linha));
+        if (fim_linha == NULL) fim_linha = fim_dados;
+        num_linha++;
+
+        const char* inicio = linha;
+        const char* fim = fim_linha;
+        aparar_campo(&inicio, &fim);
+        linha = fim_linha + 1;
+        if (inicio == fim || *inicio == '#') continue;
+
+        const char* campos[4][2];
+        int num_campos = 0;
+        for (const char* p = inicio; ; ) {
+            const char* separador = p;
+            while (separador < fim && *separador != ';' && *separador != ',') separador++;
+            if (num_campos == 4) {
+                num_campos++; // Campo a mais: linha invalida.
+                break;
+            }
+            campos[num_campos][0] = p;
+            campos[num_campos][1] = separador;
+            aparar_campo(&campos[num_campos][0], &campos[num_campos][1]);
+            num_campos++;
+            if (separador == fim) break;
+            p = separador + 1;
+        }
+
+        size_t tam_nome = (size_t)(campos[0][1] - campos[0][0]);
+        size_t tam_cor = num_campos >= 2 ? (size_t)(campos[1][1] - campos[1][0]) : 0;
+        int tropas = num_campos >= 3 ? ler_inteiro_campo(campos[2][0], campos[2][1]) : -1;
+
+        if (num_campos != 3 && num_campos != 4) {
+            printf("Erro: %s linha %d: esperado 'nome;cor;tropas' ou 'nome;cor;tropas;vizinhos'.\n", caminho, num_linha);
+            free(arestas);
+            return 1;
+        }
+        if (tam_nome == 0 || tam_nome >= TAMANHO_NOME) {
+            printf("Erro: %s linha %d: o nome deve ter de 1 a %d caracteres.\n", caminho, num_linha, TAMANHO_NOME - 1);
+            free(arestas);
+            return 1;
+        }
+        if (tam_cor == 0 || tam_cor >= TAMANHO_COR) {
+            printf("Erro: %s linha %d: a cor deve ter de 1 a %d caracteres.\n", caminho, num_linha, TAMANHO_COR - 1);
+            free(arestas);
+            return 1;
+        }
+        if (tropas <= 0) {
+            printf("Erro: %s linha %d: a quantidade de tropas deve ser um inteiro maior que 0.\n", caminho, num_linha);
+            free(arestas);
+            return 1;
+        }
+
+        // Vizinhos: numeros separados por espacos (ou tabs).
+        const char* v = num_campos == 4 ? campos[3][0] : NULL;
+        while (v != NULL && v < campos[3][1]) {
+            const char* fim_numero = v;
+            while (fim_numero < campos[3][1] && *fim_numero != ' ' && *fim_numero != '\t') fim_numero++;
+            int vizinho = ler_inteiro_campo(v, fim_numero);
+            if (vizinho <= 0) {
+                printf("Erro: %s linha %d: vizinho invalido (use os numeros dos territorios, a partir de 1).\n",
+                       caminho, num_linha);
+                free(arestas);
+                return 1;
+            }
+            if (num_arestas == capacidade_arestas) {
+                capacidade_arestas = capacidade_arestas > 0 ? 2 * capacidade_arestas : 1024;
+                uint32_t* novas = (uint32_t*)realloc(arestas, 2 * capacidade_arestas * sizeof(uint32_t));
+                if (novas == NULL) {
+                    perror("Erro ao alocar memoria para os vizinhos do mapa");
+                    free(arestas);
+                    return 1;
+                }
+                arestas = novas;
+            }
+            arestas[2 * num_arestas] = (uint32_t)n;
+            arestas[2 * num_arestas + 1] = (uint32_t)(vizinho - 1);
+            num_arestas++;
+            v = fim_numero;
+            while (v < campos[3][1] && (*v == ' ' || *v == '\t')) v++;
+        }
+        tem_grafo |= num_campos == 4;
+
+        if (strncmp(ultima_cor, campos[1][0], tam_cor) != 0 || ultima_cor[tam_cor] != '\0') {
+            memcpy(ultima_cor, campos[1][0], tam_cor);
+            ultima_cor[tam_cor] = '\0';
+            ultimo_dono = registrar_cor(&partida->cores, ultima_cor);
+            if (ultimo_dono < 0) {
+                free(arestas);
+                return 1;
+            }
+        }
+
+        Territorio* t = partida->mapa + n++;
+        memcpy(t->nome, campos[0][0], tam_nome);
+        t->nome[tam_nome] = '\0';
+        if (registrar_territorio(partida, t, ultimo_dono, tropas) != 0) {
+            free(arestas);
+            return 1;
+        }
+    }
+
+    if (n == 0) {
+        printf("Erro: o mapa %s nao tem nenhum territorio.\n", caminho);
+        free(arestas);
+        return 1;
+    }
+    partida->num_territorios = n;
+
+    // 3. Grafo: os numeros de vizinho so podem ser conferidos depois de contar os territorios.
+    if (!tem_grafo) return 0;
+    for (size_t k = 0; k < num_arestas; k++) {
+        if (arestas[2 * k + 1] >= (uint32_t)n) {
+            printf("Erro: %s: o territorio %u lista o vizinho %u, mas o mapa tem %d territorios.\n",
+                   caminho, arestas[2 * k] + 1, arestas[2 * k + 1] + 1, n);
+            free(arestas);
+            return 1;
+        }
+    }
+    GrafoMapa* grafo = construir_grafo(n, arestas, num_arestas);
+    free(arestas);
+    return grafo == NULL || ligar_grafo(partida, grafo, 0) != 0;
+}
+
+/**
+ * @brief Indica se o Territorio em memoria tem exatamente o layout do registro binario,
+ * permitindo copiar o bloco de territorios do arquivo com um unico memcpy.
+ */
+int layout_binario_nativo() {
+    const uint16_t teste = 1;
+    return sizeof(Territorio) == TAMANHO_REGISTRO_MAPA && offsetof(Territorio, dono) == TAMANHO_NOME + 2 &&
+           offsetof(Territorio, tropas) == TAMANHO_NOME + 6 && *(const unsigned char*)&teste == 1;
+}
+
+/**
+ * @brief Le um inteiro de 32 bits little-endian.
+ */
+uint32_t ler_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * @brief Escreve um inteiro de 32 bits little-endian.
+ */
+void escrever_u32(unsigned char* p, uint32_t valor) {
+    for (int b = 0; b < 4; b++) p[b] = (unsigned char)(valor >> (8 * b));
+}
+
+/**
+ * @brief Registra as cores e copia os territorios de um arquivo binario (mapa ou estado salvo).
+ * Com o layout nativo, os territorios sao copiados do arquivo mapeado em um unico bloco e
+ * depois validados (nome, dono e tropas) em uma passada que tambem monta os agregados.
+ * @param partida Partida vazia que recebe as cores, o mapa e os agregados.
+ * @param cores Tabela de cores do arquivo (num_cores nomes de TAMANHO_COR bytes).
+ * @param registros Territorios do arquivo (n registros de TAMANHO_REGISTRO_MAPA bytes).
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int carregar_corpo_binario(Partida* partida, const unsigned char* cores, uint32_t num_cores,
+                           const unsigned char* registros, int n, const char* caminho) {
+    // 1. Cores: cada uma ocupa TAMANHO_COR bytes e precisa terminar em '\0'.
+    int* ids = (int*)malloc(num_cores * sizeof(int));
+    if (ids == NULL) {
+        perror("Erro ao alocar memoria para as cores do mapa");
+        return 1;
+    }
+    int ids_iguais = 1;
+    for (uint32_t c = 0; c < num_cores; c++) {
+        const char* cor = (const char*)cores + (size_t)c * TAMANHO_COR;
+        if (memchr(cor, '\0', TAMANHO_COR) == NULL || cor[0] == '\0') {
+            printf("Erro: %s: a cor %u nao tem de 1 a %d caracteres.\n", caminho, c, TAMANHO_COR - 1);
+            free(ids);
+            return 1;
+        }
+        ids[c] = registrar_cor(&partida->cores, cor);
+        if (ids[c] < 0) {
+            free(ids);
+            return 1;
+        }
+        ids_iguais &= (ids[c] == (int)c);
+    }
+
+    // 2. Territorios.
+    int erro = alocar_mapa(partida, n);
+
+    if (!erro && layout_binario_nativo()) {
+        memcpy(partida->mapa, registros, (size_t)n * TAMANHO_REGISTRO_MAPA);
+    } else if (!erro) {
+        for (int i = 0; i < n; i++) {
+            const unsigned char* r = registros + (size_t)i * TAMANHO_REGISTRO_MAPA;
+            memcpy(partida->mapa[i].nome, r, TAMANHO_NOME);
+            partida->mapa[i].dono = (int)ler_u32(r + TAMANHO_NOME + 2);
+            partida->mapa[i].tropas = (int)ler_u32(r + TAMANHO_NOME + 6);
+        }
+    }
+
+    for (int i = 0; i < n && !erro; i++) {
+        Territorio* t = partida->mapa + i;
+        int dono = t->dono;
+
+        if (memchr(t->nome, '\0', TAMANHO_NOME) == NULL || t->nome[0] == '\0' ||
+            dono < 0 || (uint32_t)dono >= num_cores || t->tropas <= 0) {
+            printf("Erro: %s: territorio %d invalido (nome, cor ou tropas fora dos limites).\n", caminho, i + 1);
+            erro = 1;
+            break;
+        }
+        erro = registrar_territorio(partida, t, ids_iguais ? dono : ids[dono], t->tropas);
+    }
+
+    free(ids);
+    return erro;
+}
+
+/**
+ * @brief Confere, em O(n + arestas), se toda aresta (u, v) do grafo tem a volta (v, u). As listas
+ * de vizinhos ja devem estar ordenadas e dentro dos limites.
+ * @param territorio Recebe, se o grafo for assimetrico, o territorio que lista o vizinho sem volta.
+ * @param vizinho Recebe esse vizinho.
+ * @return int: 1 se o grafo e simetrico, 0 se nao e, -1 em caso de falha de alocacao.
+ */
+int grafo_simetrico(const GrafoMapa* grafo, int* territorio, int* vizinho) {
+    int n = grafo->num_territorios;
+    uint32_t* cursor = (uint32_t*)malloc(((size_t)n + 1) * sizeof(uint32_t));
+    if (cursor == NULL) {
+        perror("Erro ao alocar memoria para conferir o grafo do mapa");
+        return -1;
+    }
+    memcpy(cursor, grafo->inicio, ((size_t)n + 1) * sizeof(uint32_t));
+
+    // Percorrendo os territorios em ordem crescente, cada v recebe de volta os seus vizinhos
+    // tambem em ordem crescente: basta comparar com a proxima posicao da lista de v.
+    int simetrico = 1;
+    for (int u = 0; u < n && simetrico; u++) {
+        for (uint32_t k = grafo->inicio[u]; simetrico && k < grafo->inicio[u + 1]; k++) {
+            uint32_t v = grafo->vizinhos[k];
+            simetrico = cursor[v] < grafo->inicio[v + 1] && grafo->vizinhos[cursor[v]] == (uint32_t)u;
+            if (simetrico) {
+                cursor[v]++;
+            } else {
+                *territorio = u;
+                *vizinho = (int)v;
+            }
+        }
+    }
+    // Sobrou algum vizinho sem a volta: v lista u, mas u nao lista v.
+    for (int v = 0; v < n && simetrico; v++) {
+        simetrico = cursor[v] == grafo->inicio[v + 1];
+        if (!simetrico) {
+            *territorio = v;
+            *vizinho = (int)grafo->vizinhos[cursor[v]];
+        }
+    }
+    free(cursor);
+    return simetrico;
+}
+
+/**
+ * @brief Le o grafo CSR gravado depois dos territorios (mapa binario ou estado salvo), confere
+ * os limites (inicios crescentes, vizinhos validos, ordenados e sem lacos) e a simetria (a
+ * fronteira de um territorio so e recalculada pelos vizinhos que o listam) e o liga a partida.
+ * @param dados Inicio do bloco do grafo; o chamador ja conferiu que o bloco cabe no arquivo.
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int carregar_grafo_binario(Partida* partida, const unsigned char* dados, uint64_t num_vizinhos, const char* caminho) {
+    int n = partida->num_territorios;
+    GrafoMapa* grafo = (GrafoMapa*)calloc(1, sizeof(GrafoMapa));
+    if (grafo != NULL) {
+        grafo->num_territorios = n;
+        grafo->inicio = (uint32_t*)malloc(((size_t)n + 1) * sizeof(uint32_t));
+        grafo->vizinhos = (uint32_t*)malloc((size_t)num_vizinhos * sizeof(uint32_t));
+    }
+    if (grafo == NULL || grafo->inicio == NULL || grafo->vizinhos == NULL) {
+        perror("Erro ao alocar memoria para o grafo do mapa");
+        liberar_grafo(grafo);
+        return 1;
+    }
+
+    const unsigned char* vizinhos = dados + ((size_t)n + 1) * sizeof(uint32_t);
+    for (int i = 0; i <= n; i++) grafo->inicio[i] = ler_u32(dados + (size_t)i * 4);
+    for (uint64_t k = 0; k < num_vizinhos; k++) grafo->vizinhos[k] = ler_u32(vizinhos + k * 4);
+
+    int valido = grafo->inicio[0] == 0 && grafo->inicio[n] == num_vizinhos;
+    for (int i = 0; i < n && valido; i++) {
+        valido = grafo->inicio[i] <= grafo->inicio[i + 1] && grafo->inicio[i + 1] <= num_vizinhos;
+        for (uint32_t k = grafo->inicio[i]; valido && k < grafo->inicio[i + 1]; k++) {
+            uint32_t v = grafo->vizinhos[k];
+            valido = v < (uint32_t)n && v != (uint32_t)i && (k == grafo->inicio[i] || grafo->vizinhos[k - 1] < v);
+        }
+    }
+    if (!valido) {
+        printf("Erro: %s: grafo de vizinhanca invalido.\n", caminho);
+        liberar_grafo(grafo);
+        return 1;
+    }
+    int territorio = 0, vizinho = 0;
+    int simetrico = grafo_simetrico(grafo, &territorio, &vizinho);
+    if (simetrico != 1) {
+        if (simetrico == 0) {
+            printf("Erro: %s: grafo de vizinhanca assimetrico (%d lista %d como vizinho, mas nao o contrario).\n",
+                   caminho, territorio + 1, vizinho + 1);
+        }
+        liberar_grafo(grafo);
+        return 1;
+    }
+    return ligar_grafo(partida, grafo, 0);
+}
+
+/**
+ * @brief Indica se o bloco do grafo (inicios e vizinhos) cabe nos bytes restantes do arquivo.
+ */
+int grafo_cabe(int n, uint64_t num_vizinhos, size_t restante) {
+    return num_vizinhos <= UINT32_MAX && ((uint64_t)n + 1 + num_vizinhos) * 4 <= restante;
+}
+
+/**
+ * @brief Carrega um mapa no formato binario (ver CabecalhoMapaBinario).
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int carregar_mapa_binario(Partida* partida, const unsigned char* dados, size_t tamanho, const char* caminho) {
+    CabecalhoMapaBinario cab;
+
+    if (tamanho < sizeof(cab)) {
+        printf("Erro: o mapa binario %s esta truncado.\n", caminho);
+        return 1;
+    }
+    memcpy(&cab, dados, sizeof(cab));
+    if (cab.versao != VERSAO_MAPA_BINARIO) {
+        printf("Erro: o mapa binario %s tem versao %u (esperada %u).\n", caminho, cab.versao, VERSAO_MAPA_BINARIO);
+        return 1;
+    }
+
+    size_t inicio_territorios = offset_territorios_binario(cab.num_cores);
+    if (cab.num_territorios == 0 || cab.num_territorios > 2147483647ULL || cab.num_cores == 0 ||
+        inicio_territorios > tamanho ||
+        (tamanho - inicio_territorios) / TAMANHO_REGISTRO_MAPA < cab.num_territorios) {
+        printf("Erro: o mapa binario %s esta truncado ou com cabecalho invalido.\n", caminho);
+        return 1;
+    }
+    size_t inicio_grafo = inicio_territorios + (size_t)cab.num_territorios * TAMANHO_REGISTRO_MAPA;
+    if (cab.num_vizinhos > 0 && !grafo_cabe((int)cab.num_territorios, cab.num_vizinhos, tamanho - inicio_grafo)) {
+        printf("Erro: o mapa binario %s esta truncado (grafo de vizinhanca).\n", caminho);
+        return 1;
+    }
+
+    if (carregar_corpo_binario(partida, dados + sizeof(cab), cab.num_cores, dados + inicio_territorios,
+                               (int)cab.num_territorios, caminho) != 0) {
+        return 1;
+    }
+    if (cab.num_vizinhos == 0) return 0;
+    return carregar_grafo_binario(partida, dados + inicio_grafo, cab.num_vizinhos, caminho);
+}
+
+/**
+ * @brief Carrega um estado salvo (ver CabecalhoEstado): mapa, jogadores, rodada e dados.
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int carregar_estado_binario(Partida* partida, EstadoSalvo* estado, const unsigned char* dados, size_t tamanho,
+                            const char* caminho) {
+    CabecalhoEstado cab;
+
+    if (tamanho < sizeof(cab)) {
+        printf("Erro: o estado salvo %s esta truncado.\n", caminho);
+        return 1;
+    }
+    memcpy(&cab, dados, sizeof(cab));
+    if (cab.versao != VERSAO_ESTADO) {
+        printf("Erro: o estado salvo %s tem versao %u (esperada %u).\n", caminho, cab.versao, VERSAO_ESTADO);
+        return 1;
+    }
+    if (cab.num_cores == 0 || cab.num_cores > 2147483647U || cab.num_jogadores == 0 ||
+        cab.num_jogadores > MAX_JOGADORES_ESTADO || cab.num_territorios == 0 ||
+        cab.num_territorios > 2147483647ULL || cab.rodada > 9223372036854775807ULL ||
+        cab.fim_reserva > TAMANHO_RESERVA_DADOS || cab.posicao_reserva > cab.fim_reserva) {
+        printf("Erro: o estado salvo %s tem cabecalho invalido.\n", caminho);
+        return 1;
+    }
+
+    size_t dados_reserva = cab.fim_reserva - cab.posicao_reserva;
+    size_t inicio_cores = sizeof(cab) + dados_reserva;
+    size_t inicio_jogadores = alinhar_binario(inicio_cores + (size_t)cab.num_cores * TAMANHO_COR);
+    size_t inicio_territorios = alinhar_binario(inicio_jogadores + (size_t)cab.num_jogadores * TAMANHO_REGISTRO_JOGADOR);
+    size_t inicio_grafo = inicio_territorios + (size_t)cab.num_territorios * TAMANHO_REGISTRO_MAPA;
+    if (inicio_territorios > tamanho || (tamanho - inicio_territorios) / TAMANHO_REGISTRO_MAPA < cab.num_territorios ||
+        (cab.num_vizinhos > 0 && !grafo_cabe((int)cab.num_territorios, cab.num_vizinhos, tamanho - inicio_grafo))) {
+        printf("Erro: o estado salvo %s esta truncado.\n", caminho);
+        return 1;
+    }
+
+    // 1. Mapa e cores (as cores do estado sao unicas, entao mantem os mesmos IDs).
+    if (carregar_corpo_binario(partida, dados + inicio_cores, cab.num_cores, dados + inicio_territorios,
+                               (int)cab.num_territorios, caminho) != 0) {
+        return 1;
+    }
+    if (partida->cores.total != (int)cab.num_cores) {
+        printf("Erro: o estado salvo %s tem cores repetidas.\n", caminho);
+        return 1;
+    }
+    if (cab.num_vizinhos > 0 && carregar_grafo_binario(partida, dados + inicio_grafo, cab.num_vizinhos, caminho) != 0) {
+        return 1;
+    }
+
+    // 2. Jogadores.
+    for (uint32_t j = 0; j < cab.num_jogadores; j++) {
+        const unsigned char* r = dados + inicio_jogadores + (size_t)j * TAMANHO_REGISTRO_JOGADOR;
+        Jogador* jogador = &estado->jogadores[j];
+
+        memset(jogador, 0, sizeof(*jogador));
+        memcpy(jogador->cor, r, TAMANHO_COR);
+        jogador->id_cor = (int)ler_u32(r + TAMANHO_COR + 2);
+        jogador->id_missao = (int)ler_u32(r + TAMANHO_COR + 6);
+        jogador->alvo_missao = (int)ler_u32(r + TAMANHO_COR + 10);
+        jogador->territorios_conquistados = (int)ler_u32(r + TAMANHO_COR + 14);
+
+        if (memchr(jogador->cor, '\0', TAMANHO_COR) == NULL || jogador->id_cor < 0 ||
+            jogador->id_cor >= partida->cores.total || strcmp(jogador->cor, nome_cor(&partida->cores, jogador->id_cor)) != 0 ||
+            jogador->alvo_missao < -1 || jogador->alvo_missao >= partida->cores.total ||
+            jogador->territorios_conquistados < 0) {
+            printf("Erro: %s: jogador %u invalido.\n", caminho, j + 1);
+            return 1;
+        }
+        if (jogador->id_missao < 0 || jogador->id_missao >= g_missoes.total) {
+            printf("Erro: %s: o jogador %s tem a missao %d, que nao existe na tabela de missoes atual.\n",
+                   caminho, jogador->cor, jogador->id_missao);
+            return 1;
+        }
+    }
+    estado->num_jogadores = (int)cab.num_jogadores;
+    estado->rodada = (long long)cab.rodada;
+
+    // 3. Gerador e reserva: os dados nao usados voltam para as mesmas posicoes.
+    partida->gerador.estado = cab.gerador_estado;
+    partida->gerador.incremento = cab.gerador_incremento | 1u;
+    partida->posicao_reserva = (int)cab.posicao_reserva;
+    partida->fim_reserva = (int)cab.fim_reserva;
+    memcpy(partida->reserva_dados + cab.posicao_reserva, dados + sizeof(cab), dados_reserva);
+    for (size_t k = 0; k < dados_reserva; k++) {
+        unsigned char d = partida->reserva_dados[cab.posicao_reserva + k];
+        if (d < 1 || d > 6) {
+            printf("Erro: %s: reserva de dados invalida.\n", caminho);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Carrega um arquivo de jogo: mapa texto, mapa binario ou estado salvo. O formato e
+ * detectado pelo cabecalho (MAGICA_MAPA_BINARIO, MAGICA_ESTADO ou texto). O arquivo e mapeado
+ * em memoria (mmap), sem leitura linha a linha. No fim, o indice de nomes e montado (com aviso se
+ * houver nomes repetidos).
+ * @param partida Partida vazia (sem mapa) que recebe os territorios, as cores e os agregados
+ * (e, no estado salvo, tambem o gerador de dados).
+ * @param estado Recebe os jogadores e a rodada do estado salvo (num_jogadores = 0 para um mapa).
+ * @param caminho Caminho do arquivo.
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int carregar_estado(Partida* partida, EstadoSalvo* estado, const char* caminho) {
+    struct stat info;
+    int erro;
+
+    estado->num_jogadores = 0;
+    estado->rodada = 0;
+
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) {
+        perror("Erro ao abrir o arquivo do mapa");
+        return 1;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        printf("Erro: o mapa %s esta vazio ou nao pode ser lido.\n", caminho);
+        close(fd);
+        return 1;
+    }
+
+    size_t tamanho = (size_t)info.st_size;
+    void* dados = mmap(NULL, tamanho, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (dados == MAP_FAILED) {
+        perror("Erro ao mapear o arquivo do mapa");
+        return 1;
+    }
+    madvise(dados, tamanho, MADV_SEQUENTIAL);
+
+    if (tamanho >= 4 && memcmp(dados, MAGICA_MAPA_BINARIO, 4) == 0) {
+        erro = carregar_mapa_binario(partida, (const unsigned char*)dados, tamanho, caminho);
+    } else if (tamanho >= 4 && memcmp(dados, MAGICA_ESTADO, 4) == 0) {
+        erro = carregar_estado_binario(partida, estado, (const unsigned char*)dados, tamanho, caminho);
+    } else {
+        erro = carregar_mapa_texto(partida, (const char*)dados, tamanho, caminho);
+    }
+    munmap(dados, tamanho);
+    if (!erro) erro = indexar_nomes_do_mapa(partida);
+
+    if (erro) descartar_partida(partida); // Descarta o que ja foi carregado.
+    return erro;
+}
+
+/**
+ * @brief Carrega so o mapa de um arquivo (--map); de um estado salvo, ignora jogadores e rodada.
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int carregar_mapa(Partida* partida, const char* caminho) {
+    EstadoSalvo estado;
+    return carregar_estado(partida, &estado, caminho);
+}
+
+/**
+ * @brief Grava a tabela de cores e os zeros de alinhamento que a seguem.
+ * @param usado Posicao do arquivo onde a tabela comeca.
+ * @return int: 0 em caso de sucesso, 1 em caso de erro de escrita.
+ */
+int gravar_cores_binario(FILE* arquivo, const RegistroCores* cores, size_t usado) {
+    char preenchimento[8] = {0};
+    int erro = 0;
+
+    for (int c = 0; c < cores->total; c++) {
+        char cor[TAMANHO_COR] = {0};
+        strcpy(cor, cores->nomes[c]);
+        erro |= fwrite(cor, TAMANHO_COR, 1, arquivo) != 1;
+    }
+    usado += (size_t)cores->total * TAMANHO_COR;
+    size_t zeros = alinhar_binario(usado) - usado;
+    erro |= fwrite(preenchimento, 1, zeros, arquivo) != zeros;
+    return erro;
+}
+
+/**
+ * @brief Grava os territorios da partida em registros de TAMANHO_REGISTRO_MAPA bytes.
+ * @return int: 0 em caso de sucesso, 1 em caso de erro de escrita.
+ */
+int gravar_territorios_binario(FILE* arquivo, const Partida* partida) {
+    int erro = 0;
+
+    if (layout_binario_nativo()) {
+        return fwrite(partida->mapa, TAMANHO_REGISTRO_MAPA, (size_t)partida->num_territorios, arquivo) !=
+               (size_t)partida->num_territorios;
+    }
+    for (int i = 0; i < partida->num_territorios && !erro; i++) {
+        unsigned char r[TAMANHO_REGISTRO_MAPA] = {0};
+        const Territorio* t = partida->mapa + i;
+        memcpy(r, t->nome, TAMANHO_NOME);
+        escrever_u32(r + TAMANHO_NOME + 2, (uint32_t)t->dono);
+        escrever_u32(r + TAMANHO_NOME + 6, (uint32_t)t->tropas);
+        erro |= fwrite(r, sizeof(r), 1, arquivo) != 1;
+    }
+    return erro;
+}
+
+/**
+ * @brief Grava o grafo da partida em CSR (inicios e vizinhos), se houver.
+ * @return int: 0 em caso de sucesso, 1 em caso de erro de escrita.
+ */
+int gravar_grafo_binario(FILE* arquivo, const Partida* partida) {
+    const GrafoMapa* grafo = partida->grafo;
+    unsigned char bloco[4096];
+    size_t usados = 0;
+    int erro = 0;
+
+    if (grafo == NULL) return 0;
+    size_t total = (size_t)grafo->num_territorios + 1 + grafo->inicio[grafo->num_territorios];
+    for (size_t k = 0; k < total && !erro; k++) {
+        uint32_t valor = k <= (size_t)grafo->num_territorios ? grafo->inicio[k]
+                                                              : grafo->vizinhos[k - grafo->num_territorios - 1];
+        escrever_u32(bloco + usados, valor);
+        usados += 4;
+        if (usados == sizeof(bloco) || k + 1 == total) {
+            erro |= fwrite(bloco, 1, usados, arquivo) != usados;
+            usados = 0;
+        }
+    }
+    return erro;
+}
+
+/**
+ * @brief Numero de entradas do grafo gravado no cabecalho (0 = mapa sem grafo).
+ */
+uint32_t num_vizinhos_grafo(const Partida* partida) {
+    return partida->grafo != NULL ? partida->grafo->inicio[partida->grafo->num_territorios] : 0;
+}
+
+/**
+ * @brief Salva o mapa da partida no formato binario (cabecalho, tabela de cores, territorios e grafo).
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int salvar_mapa_binario(const Partida* partida, const char* caminho) {
+    CabecalhoMapaBinario cab = {0};
+    int erro = 0;
+
+    memcpy(cab.magica, MAGICA_MAPA_BINARIO, 4);
+    cab.versao = VERSAO_MAPA_BINARIO;
+    cab.num_cores = (uint32_t)partida->cores.total;
+    cab.num_vizinhos = num_vizinhos_grafo(partida);
+    cab.num_territorios = (uint64_t)partida->num_territorios;
+
+    FILE* arquivo = fopen(caminho, "wb");
+    if (arquivo == NULL) {
+        perror("Erro ao criar o arquivo do mapa");
+        return 1;
+    }
+
+    erro |= fwrite(&cab, sizeof(cab), 1, arquivo) != 1;
+    erro |= gravar_cores_binario(arquivo, &partida->cores, sizeof(cab));
+    erro |= gravar_territorios_binario(arquivo, partida);
+    erro |= gravar_grafo_binario(arquivo, partida);
+
+    if (fclose(arquivo) != 0) erro = 1;
+    if (erro) {
+        printf("Erro ao gravar o mapa binario %s.\n", caminho);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Salva o estado completo da partida (mapa, jogadores, rodada e dados) no formato binario.
+ * O arquivo e gravado com outro nome e renomeado no final, entao um checkpoint interrompido
+ * nunca destroi o anterior.
+ * @param partida Partida em andamento.
+ * @param jogadores Jogadores da partida.
+ * @param num_jogadores Quantidade de jogadores (1 a MAX_JOGADORES_ESTADO).
+ * @param rodada Rodadas ja jogadas.
+ * @param caminho Caminho do arquivo.
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int salvar_estado(const Partida* partida, const Jogador* jogadores, int num_jogadores, long long rodada,
+                  const char* caminho) {
+    CabecalhoEstado cab = {0};
+    char temporario[4096];
+    int erro = 0;
+
+    if (num_jogadores < 1 || num_jogadores > MAX_JOGADORES_ESTADO ||
+        snprintf(temporario, sizeof(temporario), "%s.tmp", caminho) >= (int)sizeof(temporario)) {
+        printf("Erro: nao e possivel salvar o estado em %s.\n", caminho);
+        return 1;
+    }
+
+    memcpy(cab.magica, MAGICA_ESTADO, 4);
+    cab.versao = VERSAO_ESTADO;
+    cab.num_cores = (uint32_t)partida->cores.total;
+    cab.num_jogadores = (uint32_t)num_jogadores;
+    cab.num_territorios = (uint64_t)partida->num_territorios;
+    cab.rodada = (uint64_t)rodada;
+    cab.gerador_estado = partida->gerador.estado;
+    cab.gerador_incremento = partida->gerador.incremento;
+    cab.posicao_reserva = (uint32_t)partida->posicao_reserva;
+    cab.fim_reserva = (uint32_t)partida->fim_reserva;
+    cab.num_vizinhos = num_vizinhos_grafo(partida);
+
+    FILE* arquivo = fopen(temporario, "wb");
+    if (arquivo == NULL) {
+        perror("Erro ao criar o arquivo do estado");
+        return 1;
+    }
+
+    size_t dados_reserva = cab.fim_reserva - cab.posicao_reserva;
+    erro |= fwrite(&cab, sizeof(cab), 1, arquivo) != 1;
+    erro |= fwrite(partida->reserva_dados + cab.posicao_reserva, 1, dados_reserva, arquivo) != dados_reserva;
+    erro |= gravar_cores_binario(arquivo, &partida->cores, sizeof(cab) + dados_reserva);
+
+    for (int j = 0; j < num_jogadores; j++) {
+        unsigned char r[TAMANHO_REGISTRO_JOGADOR] = {0};
+        memcpy(r, jogadores[j].cor, TAMANHO_COR);
+        escrever_u32(r + TAMANHO_COR + 2, (uint32_t)jogadores[j].id_cor);
+        escrever_u32(r + TAMANHO_COR + 6, (uint32_t)jogadores[j].id_missao);
+        escrever_u32(r + TAMANHO_COR + 10, (uint32_t)jogadores[j].alvo_missao);
+        escrever_u32(r + TAMANHO_COR + 14, (uint32_t)jogadores[j].territorios_conquistados);
+        erro |= fwrite(r, sizeof(r), 1, arquivo) != 1;
+    }
+    char preenchimento[8] = {0};
+    size_t zeros = alinhar_binario(num_jogadores * TAMANHO_REGISTRO_JOGADOR) - (size_t)num_jogadores * TAMANHO_REGISTRO_JOGADOR;
+    erro |= fwrite(preenchimento, 1, zeros, arquivo) != zeros;
+    erro |= gravar_territorios_binario(arquivo, partida);
+    erro |= gravar_grafo_binario(arquivo, partida);
+
+    if (fclose(arquivo) != 0) erro = 1;
+    if (!erro && rename(temporario, caminho) != 0) erro = 1;
+    if (erro) {
+        printf("Erro ao gravar o estado salvo %s.\n", caminho);
+        remove(temporario);
+        return 1;
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Diario de Batalhas (--diario) e Replay (--replay) ---
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Hash (FNV-1a de 64 bits) do dono e das tropas de todos os territorios.
+ * Usado para conferir o mapa inicial e o mapa final de cada partida no replay.
+ */
+uint64_t hash_mapa(const Partida* partida) {
+    uint64_t hash = 1469598103934665603ULL;
+
+    for (int i = 0; i < partida->num_territorios; i++) {
+        uint32_t valores[2] = { (uint32_t)partida->mapa[i].dono, (uint32_t)partida->mapa[i].tropas };
+        for (int v = 0; v < 2; v++) {
+            for (int b = 0; b < 4; b++) {
+                hash ^= (valores[v] >> (8 * b)) & 0xFF;
+                hash *= 1099511628211ULL;
+            }
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief Acrescenta um evento ao buffer do diario (o buffer cresce se a partida nao couber).
+ */
+void diario_escrever_evento(Diario* diario, int tipo, uint32_t atacante, uint32_t defensor, int dado_ataque,
+                            int dado_defesa, int conquista, int32_t delta_atacante, int32_t delta_defensor,
+                            int32_t dono_atacante) {
+    if (diario->usados + TAMANHO_EVENTO_DIARIO > diario->capacidade) {
+        size_t capacidade = diario->capacidade * 2;
+        unsigned char* novo = (unsigned char*)realloc(diario->buffer, capacidade);
+        if (novo == NULL) {
+            diario->erro = 1;
+            return;
+        }
+        diario->buffer = novo;
+        diario->capacidade = capacidade;
+    }
+
+    unsigned char* r = diario->buffer + diario->usados;
+    escrever_u32(r, atacante);
+    escrever_u32(r + 4, defensor);
+    r[8] = (unsigned char)tipo;
+    r[9] = (unsigned char)dado_ataque;
+    r[10] = (unsigned char)dado_defesa;
+    r[11] = (unsigned char)conquista;
+    escrever_u32(r + 12, (uint32_t)delta_atacante);
+    escrever_u32(r + 16, (uint32_t)delta_defensor);
+    escrever_u32(r + 20, (uint32_t)dono_atacante);
+    diario->usados += TAMANHO_EVENTO_DIARIO;
+}
+
+/**
+ * @brief Registra uma batalha (chamada por aplicar_batalha).
+ */
+void diario_registrar_batalha(Diario* diario, uint32_t atacante, uint32_t defensor, int dado_ataque, int dado_defesa,
+                              int conquista, int delta_atacante, int delta_defensor, int dono_atacante) {
+    diario_escrever_evento(diario, EVENTO_BATALHA, atacante, defensor, dado_ataque, dado_defesa, conquista,
+                           delta_atacante, delta_defensor, dono_atacante);
+    diario->eventos++;
+}
+
+/**
+ * @brief Grava no arquivo o que esta no buffer do diario.
+ */
+void descarregar_diario(Diario* diario) {
+    if (diario->usados == 0) return;
+    if (diario->trava != NULL) pthread_mutex_lock(diario->trava);
+    // fflush: o que foi descarregado ja esta no arquivo, mesmo se o processo morrer em seguida.
+    if (fwrite(diario->buffer, 1, diario->usados, diario->arquivo) != diario->usados) diario->erro = 1;
+    if (fflush(diario->arquivo) != 0) diario->erro = 1;
+    if (diario->trava != NULL) pthread_mutex_unlock(diario->trava);
+    diario->usados = 0;
+}
+
+/**
+ * @brief Marca o inicio de uma partida no diario.
+ * @param indice Indice da partida (no torneio) ou 0 no modo interativo.
+ */
+void diario_iniciar_partida(Diario* diario, uint64_t indice) {
+    diario_escrever_evento(diario, EVENTO_INICIO, (uint32_t)indice, (uint32_t)(indice >> 32), 0, 0, 0, 0, 0, 0);
+}
+
+/**
+ * @brief Marca o fim de uma partida com o hash do mapa final. As partidas so vao para o arquivo
+ * inteiras, entao os trechos de threads diferentes nunca se misturam.
+ * @param hash hash_mapa() do mapa no fim da partida.
+ */
+void diario_finalizar_partida(Diario* diario, uint64_t hash) {
+    diario_escrever_evento(diario, EVENTO_FIM, 0, 0, 0, 0, 0, (int32_t)(uint32_t)hash, (int32_t)(uint32_t)(hash >> 32), 0);
+    if (diario->usados >= LIMITE_BUFFER_DIARIO) descarregar_diario(diario);
+}
+
+/**
+ * @brief Inicia um buffer de diario que grava em um arquivo ja aberto.
+ * @param trava Trava do arquivo compartilhado, ou NULL se so uma thread grava.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int iniciar_buffer_diario(Diario* diario, FILE* arquivo, pthread_mutex_t* trava) {
+    memset(diario, 0, sizeof(*diario));
+    diario->arquivo = arquivo;
+    diario->trava = trava;
+    diario->capacidade = LIMITE_BUFFER_DIARIO + 64 * TAMANHO_EVENTO_DIARIO;
+    diario->buffer = (unsigned char*)malloc(diario->capacidade);
+    if (diario->buffer == NULL) {
+        perror("Erro ao alocar memoria para o diario");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Cria o arquivo do diario e grava o cabecalho com o mapa inicial.
+ * @param inicio Partida na posicao inicial (antes da primeira batalha).
+ * @return int: 0 em caso de sucesso, 1 em caso de erro (mensagem ja impressa).
+ */
+int abrir_diario(Diario* diario, const char* caminho, const Partida* inicio) {
+    CabecalhoDiario cab = {0};
+
+    memcpy(cab.magica, MAGICA_DIARIO, 4);
+    cab.versao = VERSAO_DIARIO;
+    cab.num_territorios = (uint64_t)inicio->num_territorios;
+    cab.hash_inicial = hash_mapa(inicio);
+
+    FILE* arquivo = fopen(caminho, "wb");
+    if (arquivo == NULL) {
+        perror("Erro ao criar o arquivo do diario");
+        return 1;
+    }
+    if (fwrite(&cab, sizeof(cab), 1, arquivo) != 1 || fflush(arquivo) != 0 ||
+        iniciar_buffer_diario(diario, arquivo, NULL) != 0) {
+        printf("Erro ao gravar o diario %s.\n", caminho);
+        fclose(arquivo);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Grava o que falta, fecha o arquivo e libera o buffer do diario.
+ * @return int: 0 em caso de sucesso, 1 se alguma escrita falhou.
+ */
+int fechar_diario(Diario* diario) {
+    descarregar_diario(diario);
+    if (diario->arquivo != NULL && fclose(diario->arquivo) != 0) diario->erro = 1;
+    diario->arquivo = NULL;
+    free(diario->buffer);
+    diario->buffer = NULL;
+    if (diario->erro) printf("Erro ao gravar o diario de batalhas.\n");
+    return diario->erro;
+}
+
+/**
+ * @brief Reaplica um diario sobre o mapa inicial, sem mensagens nem pausas, conferindo cada
+ * batalha (regras, tropas e donos) e o hash do mapa no fim de cada partida.
+ * @param arquivo_diario Diario gravado com --diario.
+ * @param arquivo_mapa Mapa inicial (--map) usado na gravacao.
+ * @return int: 0 se todas as partidas conferem, 1 caso contrario.
+ */
+int reproduzir_diario(const char* arquivo_diario, const char* arquivo_mapa) {
+    Partida modelo = {0};
+    Partida atual = {0};
+    CabecalhoDiario cab;
+    struct stat info;
+    struct timespec inicio, fim;
+    long long eventos = 0, partidas = 0, divergencias = 0;
+    int em_partida = 0, divergente = 0, erro = 0;
+
+    if (carregar_mapa(&modelo, arquivo_mapa) != 0) return 1;
+
+    int fd = open(arquivo_diario, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(cab)) {
+        printf("Erro: nao foi possivel ler o diario %s.\n", arquivo_diario);
+        if (fd >= 0) close(fd);
+        descartar_partida(&modelo);
+        return 1;
+    }
+    size_t tamanho = (size_t)info.st_size;
+    const unsigned char* dados = (const unsigned char*)mmap(NULL, tamanho, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (dados == MAP_FAILED) {
+        perror("Erro ao mapear o diario");
+        descartar_partida(&modelo);
+        return 1;
+    }
+    madvise((void*)dados, tamanho, MADV_SEQUENTIAL);
+
+    memcpy(&cab, dados, sizeof(cab));
+    if (memcmp(cab.magica, MAGICA_DIARIO, 4) != 0 || cab.versao != VERSAO_DIARIO ||
+        (tamanho - sizeof(cab)) % TAMANHO_EVENTO_DIARIO != 0) {
+        printf("Erro: %s nao e um diario valido (versao %u).\n", arquivo_diario, VERSAO_DIARIO);
+        erro = 1;
+    } else if (cab.num_territorios != (uint64_t)modelo.num_territorios || cab.hash_inicial != hash_mapa(&modelo)) {
+        printf("Erro: o mapa %s nao e o mapa inicial do diario %s.\n", arquivo_mapa, arquivo_diario);
+        erro = 1;
+    } else if (alocar_mapa(&atual, modelo.num_territorios) != 0 ||
+               copiar_registro_cores(&atual.cores, &modelo.cores) != 0 ||
+               garantir_agregados(&atual, modelo.capacidade_agregados - 1) != 0) {
+        erro = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (size_t pos = sizeof(cab); pos < tamanho && !erro; pos += TAMANHO_EVENTO_DIARIO) {
+        const unsigned char* r = dados + pos;
+        uint32_t a = ler_u32(r), d = ler_u32(r + 4);
+        int tipo = r[8], dado_ataque = r[9], dado_defesa = r[10], conquista = r[11];
+
+        if (tipo == EVENTO_INICIO) {
+            // Cada partida recomeca do mapa inicial.
+            if (em_partida) divergencias++; // Partida anterior sem EVENTO_FIM.
+            memcpy(atual.mapa, modelo.mapa, (size_t)modelo.num_territorios * sizeof(Territorio));
+            memcpy(atual.agregados, modelo.agregados, (size_t)modelo.capacidade_agregados * sizeof(AgregadoDono));
+            em_partida = 1;
+            divergente = 0;
+        } else if (tipo == EVENTO_FIM && em_partida) {
+            uint64_t hash = (uint64_t)ler_u32(r + 12) | (uint64_t)ler_u32(r + 16) << 32;
+            partidas++;
+            if (divergente || hash != hash_mapa(&atual)) divergencias++;
+            em_partida = 0;
+        } else if (tipo == EVENTO_BATALHA && em_partida) {
+            eventos++;
+            if (divergente) continue;
+
+            // A batalha precisa ser valida na posicao atual e produzir o mesmo resultado.
+            if (a >= (uint32_t)atual.num_territorios || d >= (uint32_t)atual.num_territorios || a == d ||
+                dado_ataque < 1 || dado_ataque > 6 || dado_defesa < 1 || dado_defesa > 6) {
+                divergente = 1;
+                continue;
+            }
+            Territorio* atacante = atual.mapa + a;
+            Territorio* defensor = atual.mapa + d;
+            int tropas_atacante = atacante->tropas, tropas_defensor = defensor->tropas;
+
+            if (atacante->dono != (int)ler_u32(r + 20) || atacante->dono == defensor->dono || atacante->tropas < 2) {
+                divergente = 1;
+                continue;
+            }
+            if (aplicar_batalha(&atual, atacante, defensor, dado_ataque, dado_defesa) != conquista ||
+                atacante->tropas - tropas_atacante != (int)ler_u32(r + 12) ||
+                defensor->tropas - tropas_defensor != (int)ler_u32(r + 16)) {
+                divergente = 1;
+            }
+        } else {
+            printf("Erro: %s: evento invalido na posicao %zu.\n", arquivo_diario, pos);
+            erro = 1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    if (em_partida) divergencias++; // Diario interrompido no meio de uma partida.
+
+    munmap((void*)dados, tamanho);
+    descartar_partida(&atual);
+    descartar_partida(&modelo);
+    if (erro) return 1;
+
+    double segundos = (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+    printf("==========================================\n");
+    printf("         REPLAY DO DIARIO \n");
+    printf("==========================================\n");
+    printf("Diario: %s | Mapa inicial: %s\n", arquivo_diario, arquivo_mapa);
+    printf("Partidas: %lld | Batalhas: %lld | Divergencias: %lld\n", partidas, eventos, divergencias);
+    printf("Tempo: %.3f s | %.0f eventos/s\n", segundos, segundos > 0 ? eventos / segundos : 0.0);
+    printf("Resultado: %s\n", divergencias == 0 ? "estado final confere" : "DIVERGENCIA encontrada");
+    printf("==========================================\n");
+    return divergencias != 0;
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// --- Funcao de Batalha/Ataque ---
+// ------------------------------------------------------------------------------------------------
+
+// Resultado de uma batalha isolada, sem efeitos colaterais no mapa.
+typedef struct {
+    int conquista;      // 1 se o ataque venceu (dado do ataque estritamente maior).
+    int delta_atacante; // Variacao das tropas do atacante (0, -1 ou -metade).
+    int delta_defensor; // Variacao das tropas do defensor (+metade na conquista, senao 0).
+} ResultadoBatalha;
+
+/**
+ * @brief Nucleo puro do combate: aplica as regras de uma batalha sobre numeros, sem tocar no mapa,
+ * sem mensagens e sem pausas (pode ser chamado num laco apertado).
+ * Vitoria do ataque (dado maior): o defensor recebe metade das tropas do atacante.
+ * Vitoria da defesa: o atacante perde 1 tropa, se tiver mais de uma.
+ */
+static inline ResultadoBatalha resolver_batalha(int tropas_atacante, int tropas_defensor, int dado_ataque, int dado_defesa) {
+    ResultadoBatalha r;
+    (void)tropas_defensor; // As regras atuais nao dependem das tropas da defesa.
+
+    r.conquista = dado_ataque > dado_defesa;
+    r.delta_defensor = r.conquista ? tropas_atacante / 2 : 0;
+    r.delta_atacante = r.conquista ? -r.delta_defensor : -(tropas_atacante > 1);
+    return r;
+}
+
+// Lote de batalhas independentes em estrutura de arrays (SoA): entradas e saidas em vetores
+// separados, para que o lote seja resolvido com comparacoes vetoriais.
+typedef struct {
+    const int32_t* tropas_atacante;
+    const int32_t* tropas_defensor;
+    const int32_t* dado_ataque;
+    const int32_t* dado_defesa;
+    int32_t* conquista;      // Saida: 1 ou 0.
+    int32_t* delta_atacante; // Saida.
+    int32_t* delta_defensor; // Saida.
+} LoteBatalhas;
+
+// Vetor de 4 inteiros de 32 bits (extensao vetorial do GCC: SSE2 no x86-64, NEON no ARM).
+typedef int32_t VetorBatalha __attribute__((vector_size(16)));
+#define LARGURA_VETOR_BATALHA 4
+
+/**
+ * @brief Resolve n batalhas independentes de uma vez (mesmas regras de resolver_batalha).
+ * O corpo e sem desvios: as comparacoes geram mascaras (-1/0) que selecionam os deltas,
+ * 4 batalhas por iteracao; o resto (n % 4) passa pelo nucleo escalar.
+ * @return long long: numero de conquistas no lote.
+ */
+long long resolver_lote_batalhas(const LoteBatalhas* lote, size_t n) {
+    VetorBatalha total = {0};
+    size_t i = 0;
+
+    for (; i + LARGURA_VETOR_BATALHA <= n; i += LARGURA_VETOR_BATALHA) {
+        VetorBatalha tropas, ataque, defesa;
+        memcpy(&tropas, lote->tropas_atacante + i, sizeof(tropas));
+        memcpy(&ataque, lote->dado_ataque + i, sizeof(ataque));
+        memcpy(&defesa, lote->dado_defesa + i, sizeof(defesa));
+
+        VetorBatalha venceu = ataque > defesa;   // Mascara: -1 na conquista.
+        VetorBatalha pode_perder = tropas > 1;   // Mascara: -1 se o atacante tem tropa a perder.
+        VetorBatalha metade = tropas >> 1;
+        VetorBatalha delta_defensor = venceu & metade;
+        VetorBatalha delta_atacante = (venceu & -metade) | (~venceu & pode_perder);
+        VetorBatalha conquista = venceu & 1;
+
+        memcpy(lote->conquista + i, &conquista, sizeof(conquista));
+        memcpy(lote->delta_atacante + i, &delta_atacante, sizeof(delta_atacante));
+        memcpy(lote->delta_defensor + i, &delta_defensor, sizeof(delta_defensor));
+        total -= venceu;
+    }
+
+    long long conquistas = 0;
+    for (int k = 0; k < LARGURA_VETOR_BATALHA; k++) conquistas += total[k];
+    for (; i < n; i++) {
+        ResultadoBatalha r = resolver_batalha(lote->tropas_atacante[i], lote->tropas_defensor[i],
+                                              lote->dado_ataque[i], lote->dado_defesa[i]);
+        lote->conquista[i] = r.conquista;
+        lote->delta_atacante[i] = r.delta_atacante;
+        lote->delta_defensor[i] = r.delta_defensor;
+        conquistas += r.conquista;
+    }
+    return conquistas;
+}
+
+#define FACES_DADO 6 // Faces do dado usado pelo ataque e pela defesa.
+
+// Probabilidades exatas de um ataque (uma batalha e a sequencia "atacar ate conquistar ou esgotar").
+typedef struct {
+    double p_conquista;                // Uma batalha: probabilidade de conquista.
+    double delta_atacante_esperado;    // Uma batalha: variacao esperada das tropas do atacante.
+    double delta_defensor_esperado;    // Uma batalha: variacao esperada das tropas do defensor.
+    double p_conquista_sequencia;      // Sequencia: probabilidade de conquistar antes de ficar com 1 tropa.
+    double tropas_atacante_esperadas;  // Sequencia: tropas esperadas do atacante ao final.
+    double tropas_defensor_esperadas;  // Sequencia: tropas esperadas no territorio defensor ao final.
+    double batalhas_esperadas;         // Sequencia: numero esperado de batalhas.
+} ProbabilidadesAtaque;
+
+// Linha da tabela memorizada, indexada pelas tropas do atacante. As tropas da defesa entram de
+// forma linear (a defesa so ganha a metade transferida), entao nao precisam de outra dimensao.
+typedef struct {
+    double p_conquista;
+    double delta_atacante;
+    double transferencia;        // Uma batalha: tropas esperadas transferidas para o defensor.
+    double p_conquista_sequencia;
+    double tropas_atacante;
+    double transferencia_sequencia;
+    double batalhas;
+} LinhaProbabilidades;
+
+// Linhas memorizadas (tropas do atacante de 0 a LINHAS_TABELA_PROBABILIDADES - 1); acima delas a
+// sequencia sai da formula fechada, sem memoria proporcional as tropas.
+#define LINHAS_TABELA_PROBABILIDADES 4096
+
+// Tabela por thread (como t_estatisticas): consultas repetidas sao leituras, sem travas.
+typedef struct {
+    LinhaProbabilidades* linhas;
+    int calculadas;  // Linhas validas: tropas do atacante de 0 a calculadas - 1.
+    int capacidade;
+} TabelaProbabilidades;
+
+static __thread TabelaProbabilidades t_probabilidades;
+
+/**
+ * @brief Calcula a linha de 'tropas' enumerando os 36 pares de dados com resolver_batalha
+ * (as regras vem do nucleo de combate) e resolvendo a cadeia de Markov da sequencia de ataques:
+ * cada derrota leva ao estado com menos tropas, ja calculado, e a sequencia para com 1 tropa.
+ */
+static void calcular_linha_probabilidades(TabelaProbabilidades* tabela, int tropas) {
+    LinhaProbabilidades* linha = &tabela->linhas[tropas];
+    memset(linha, 0, sizeof(*linha));
+    if (tropas < 2) {
+        // Sem tropas para atacar: a sequencia termina sem batalhas.
+        linha->tropas_atacante = tropas;
+        return;
+    }
+
+    for (int a = 1; a <= FACES_DADO; a++) {
+        for (int d = 1; d <= FACES_DADO; d++) {
+            ResultadoBatalha r = resolver_batalha(tropas, 0, a, d);
+            double peso = 1.0 / (FACES_DADO * FACES_DADO);
+            int restantes = tropas + r.delta_atacante;
+
+            linha->p_conquista += peso * r.conquista;
+            linha->delta_atacante += peso * r.delta_atacante;
+            linha->transferencia += peso * r.delta_defensor;
+            linha->batalhas += peso;
+            if (r.conquista) {
+                linha->p_conquista_sequencia += peso;
+                linha->tropas_atacante += peso * restantes;
+                linha->transferencia_sequencia += peso * r.delta_defensor;
+            } else {
+                const LinhaProbabilidades* seguinte = &tabela->linhas[restantes];
+                linha->p_conquista_sequencia += peso * seguinte->p_conquista_sequencia;
+                linha->tropas_atacante += peso * seguinte->tropas_atacante;
+                linha->transferencia_sequencia += peso * seguinte->transferencia_sequencia;
+                linha->batalhas += peso * seguinte->batalhas;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Calcula a linha de 'tropas' (2 ou mais) sem a tabela. A batalha isolada vem dos 36 pares
+ * de dados, como em calcular_linha_probabilidades. A sequencia usa formula fechada: a cadeia so
+ * desce de t para t - 1 e, nas regras atuais, a chance p de conquista nao depende das tropas. Com
+ * q = 1 - p e n = t - 1, a conquista acontece no estado t - k com chance p * q^k (k = 0..n-1) e a
+ * sequencia para com 1 tropa com chance q^n. Entao a conquista tem chance 1 - q^n, as batalhas
+ * esperadas sao (1 - q^n) / p, e as tropas somam p * q^k * (t - k), das quais floor((t - k) / 2)
+ * vao para o defensor.
+ */
+static void calcular_linha_fechada(LinhaProbabilidades* linha, int tropas) {
+    memset(linha, 0, sizeof(*linha));
+    for (int a = 1; a <= FACES_DADO; a++) {
+        for (int d = 1; d <= FACES_DADO; d++) {
+            ResultadoBatalha r = resolver_batalha(tropas, 0, a, d);
+            double peso = 1.0 / (FACES_DADO * FACES_DADO);
+            linha->p_conquista += peso * r.conquista;
+            linha->delta_atacante += peso * r.delta_atacante;
+            linha->transferencia += peso * r.delta_defensor;
+        }
+    }
+
+    double p = linha->p_conquista, q = 1.0 - p;
+    double n = (double)tropas - 1.0;
+    double q_n = pow(q, n);
+    double soma = (1.0 - q_n) / p;                              // Soma de q^k, k = 0..n-1.
+    double soma_k = (q - n * q_n + (n - 1.0) * q_n * q) / (p * p); // Soma de k * q^k.
+    // Soma de q^k nos k em que t - k e impar (a metade arredonda para baixo): k0, k0 + 2, ...
+    int k0 = (tropas & 1) ? 0 : 1;
+    double soma_impares = 0.0;
+    if (k0 <= tropas - 2) {
+        double termos = (double)((tropas - 2 - k0) / 2 + 1);
+        soma_impares = pow(q, k0) * (1.0 - pow(q, 2.0 * termos)) / (1.0 - q * q);
+    }
+    double tropas_conquista = p * ((double)tropas * soma - soma_k);
+
+    linha->p_conquista_sequencia = 1.0 - q_n;
+    linha->batalhas = soma;
+    linha->transferencia_sequencia = 0.5 * (tropas_conquista - p * soma_impares);
+    linha->tropas_atacante = tropas_conquista - linha->transferencia_sequencia + q_n;
+}
+
+/**
+ * @brief Probabilidades exatas de um ataque com as tropas informadas. A primeira consulta
+ * de um numero de tropas estende a tabela (cada linha usa as anteriores); as demais sao leituras.
+ * Acima de LINHAS_TABELA_PROBABILIDADES tropas, a linha sai de calcular_linha_fechada.
+ * @return int: 0 em caso de sucesso, 1 se faltar memoria para a tabela.
+ */
+int calcular_probabilidades(int tropas_atacante, int tropas_defensor, ProbabilidadesAtaque* resultado) {
+    TabelaProbabilidades* tabela = &t_probabilidades;
+    LinhaProbabilidades fechada;
+    const LinhaProbabilidades* linha = &fechada;
+    if (tropas_atacante < 0) tropas_atacante = 0;
+
+    if (tropas_atacante >= LINHAS_TABELA_PROBABILIDADES) {
+        calcular_linha_fechada(&fechada, tropas_atacante);
+    } else {
+        if (tropas_atacante >= tabela->calculadas) {
+            if (tropas_atacante >= tabela->capacidade) {
+                size_t capacidade = tabela->capacidade > 0 ? (size_t)tabela->capacidade : 64;
+                while (capacidade <= (size_t)tropas_atacante) capacidade *= 2;
+                if (capacidade > LINHAS_TABELA_PROBABILIDADES) capacidade = LINHAS_TABELA_PROBABILIDADES;
+                if (capacidade > SIZE_MAX / sizeof(LinhaProbabilidades)) return 1;
+                LinhaProbabilidades* linhas = (LinhaProbabilidades*)realloc(tabela->linhas, capacidade * sizeof(LinhaProbabilidades));
+                if (linhas == NULL) return 1;
+                tabela->linhas = linhas;
+                tabela->capacidade = (int)capacidade;
+            }
+            for (int t = tabela->calculadas; t <= tropas_atacante; t++) calcular_linha_probabilidades(tabela, t);
+            tabela->calculadas = tropas_atacante + 1;
+        }
+        linha = &tabela->linhas[tropas_atacante];
+    }
+    resultado->p_conquista = linha->p_conquista;
+    resultado->delta_atacante_esperado = linha->delta_atacante;
+    resultado->delta_defensor_esperado = linha->transferencia;
+    resultado->p_conquista_sequencia = linha->p_conquista_sequencia;
+    resultado->tropas_atacante_esperadas = linha->tropas_atacante;
+    resultado->tropas_defensor_esperadas = tropas_defensor + linha->transferencia_sequencia;
+    resultado->batalhas_esperadas = linha->batalhas;
+    return 0;
+}
+
+/**
+ * @brief Libera a tabela de probabilidades da thread atual.
+ */
+void liberar_tabela_probabilidades(void) {
+    free(t_probabilidades.linhas);
+    memset(&t_probabilidades, 0, sizeof(t_probabilidades));
+}
+
+/**
+ * @brief Aplica o resultado de uma batalha com os dados ja rolados (sem mensagens nem pausas)
+ * e registra o evento no diario da partida, se houver. As regras vem de resolver_batalha.
+ * @return int: 1 se houve conquista, 0 caso contrário.
+ */
+int aplicar_batalha(Partida* partida, Territorio* atacante, Territorio* defensor, int dado_ataque, int dado_defesa) {
+    int tropas_atacante = atacante->tropas;
+    int tropas_defensor = defensor->tropas;
+    ResultadoBatalha r = resolver_batalha(tropas_atacante, tropas_defensor, dado_ataque, dado_defesa);
+    int conquista = r.conquista;
+
+    contar(CONTADOR_ATAQUES, 1);
+    contar(CONTADOR_CONQUISTAS, conquista);
+    if (conquista) transferir_territorio(partida, defensor, atacante->dono);
+    if (r.delta_defensor != 0) alterar_tropas(partida, defensor, tropas_defensor + r.delta_defensor);
+    if (r.delta_atacante != 0) alterar_tropas(partida, atacante, tropas_atacante + r.delta_atacante);
+
+    if (partida->diario != NULL) {
+        diario_registrar_batalha(partida->diario, (uint32_t)(atacante - partida->mapa), (uint32_t)(defensor - partida->mapa),
+                                 dado_ataque, dado_defesa, conquista, atacante->tropas - tropas_atacante,
+                                 defensor->tropas - tropas_defensor, atacante->dono);
+    }
+    return conquista;
+}
+
+/**
+ * @brief Simula um ataque entre dois territórios.
+ * @param partida Partida em andamento (fornece o gerador dos dados).
+ * @param atacante Ponteiro para a struct do território atacante.
+ * @param defensor Ponteiro para a struct do território defensor.
+ * @param jogador Ponteiro para a struct do jogador (para atualizar o contador de conquistas).
+ * @return int: 1 se o ataque resultou em uma CONQUISTA, 0 caso contrário.
+ */
+int atacar(Partida* partida, Territorio* atacante, Territorio* defensor, Jogador* jogador) {
+    int dado_ataque, dado_defesa;
+    int houve_conquista = 0;
+    
+    mensagem("\n--- SIMULACAO DE ATAQUE ---\n");
+    mensagem("Atacante: %s (%s) vs Defensor: %s (%s)\n", 
+           atacante->nome, nome_cor(&partida->cores, atacante->dono),
+           defensor->nome, nome_cor(&partida->cores, defensor->dono));
+
+    mensagem("Rodando os dados...");
+    if (!g_modo_silencioso) fflush(stdout); 
+    pausar(1); 
+
+    // 1. Rolagem dos Dados e resolucao do combate (as mensagens e pausas vem depois,
+    // para que a medida da fase de ataque no --stats nao inclua as pausas).
+    uint64_t inicio = inicio_fase();
+    dado_ataque = rolar_dado(partida); 
+    dado_defesa = rolar_dado(partida); 
+
+    int tropas_antes = atacante->tropas;
+    houve_conquista = aplicar_batalha(partida, atacante, defensor, dado_ataque, dado_defesa);
+    fim_fase(FASE_ATAQUE, inicio);
+
+    mensagem("\nRolagem de Dados:\n");
+    mensagem("  Dado do Ataque: %d\n", dado_ataque);
+    mensagem("  Dado da Defesa: %d\n", dado_defesa);
+    
+    pausar(2); 
+
+    // 2. Resultado do Combate
+    if (houve_conquista) {
+        // ATACANTE VENCEU!
+        
+        mensagem("\nRESULTADO: O ataque foi VITORIOSO! %s conquistou %s!\n", atacante->nome, defensor->nome);
+        
+        // Conquista: o defensor mudou de cor e recebeu metade das tropas (agregados atualizados).
+        int tropas_transferidas = tropas_antes / 2;
+        
+        // Atualiza o contador de conquistas do jogador.
+        jogador->territorios_conquistados++;
+        
+        mensagem("  > %s mudou de cor para %s.\n", defensor->nome, nome_cor(&partida->cores, defensor->dono));
+        mensagem("  > %d tropas foram transferidas de %s para %s.\n", 
+               tropas_transferidas, atacante->nome, defensor->nome);
+        
+    } else { // DEFENSOR VENCEU!
+        
+        mensagem("\nRESULTADO: A defesa foi bem-sucedida! %s manteve o controle de %s.\n", defensor->nome, defensor->nome);
+        
+        // Zera o contador de conquistas seguidas se o atacante falhar.
+        if (jogador->territorios_conquistados > 0) {
+            mensagem("  > Sequencia de conquistas reiniciada para 0.\n");
+            jogador->territorios_conquistados = 0;
+        }
+
+        // Penalidade: Atacante perde 1 tropa (se tiver mais de uma).
+        if (tropas_antes > 1) { 
+            mensagem("  > %s perdeu 1 tropa no ataque.\n", atacante->nome);
+        } else {
+            mensagem("  > %s ficou com tropas insuficientes para perder mais tropas (1 tropa restante).\n", atacante->nome);
+        }
+    }
+    pausar(1.5); 
+    return houve_conquista;
+}
+
+// Ataque relampago (blitz): o resultado final de "atacar ate conquistar ou restar 1 tropa" e
+// sorteado de uma vez. Nas regras atuais a chance de conquista de cada batalha nao depende das
+// tropas, entao o numero K de derrotas antes da primeira vitoria tem distribuicao geometrica e a
+// sequencia termina sem conquista exatamente quando K >= tropas - 1.
+#define FAIXAS_BLITZ 64 // Valores de K na tabela alias; a ultima faixa e a cauda K >= FAIXAS_BLITZ - 1.
+
+typedef struct {
+    uint64_t limiar[FAIXAS_BLITZ]; // Chance (escala 2^32) de ficar com a propria faixa.
+    uint8_t alias[FAIXAS_BLITZ];   // Faixa sorteada no lugar da propria.
+} TabelaBlitz;
+
+static TabelaBlitz g_tabela_blitz;
+static pthread_once_t g_tabela_blitz_iniciada = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Monta a tabela alias (metodo de Vose) da distribuicao de K, a partir da chance de
+ * conquista de uma batalha obtida do nucleo de combate (36 pares de dados).
+ */
+static void construir_tabela_blitz(void) {
+    double p = 0.0, escala[FAIXAS_BLITZ];
+    int pequenas[FAIXAS_BLITZ], grandes[FAIXAS_BLITZ];
+    int num_pequenas = 0, num_grandes = 0;
+
+    for (int a = 1; a <= FACES_DADO; a++) {
+        for (int d = 1; d <= FACES_DADO; d++) p += resolver_batalha(2, 0, a, d).conquista;
+    }
+    p /= FACES_DADO * FACES_DADO;
+
+    double q_k = 1.0; // (1 - p)^k
+    for (int k = 0; k < FAIXAS_BLITZ; k++) {
+        double chance = k < FAIXAS_BLITZ - 1 ? q_k * p : q_k; // A ultima faixa acumula a cauda.
+        escala[k] = chance * FAIXAS_BLITZ;
+        if (escala[k] < 1.0) pequenas[num_pequenas++] = k;
+        else grandes[num_grandes++] = k;
+        q_k *= 1.0 - p;
+    }
+    while (num_pequenas > 0 && num_grandes > 0) {
+        int menor = pequenas[--num_pequenas];
+        int maior = grandes[--num_grandes];
+        g_tabela_blitz.limiar[menor] = (uint64_t)(escala[menor] * 4294967296.0);
+        g_tabela_blitz.alias[menor] = (uint8_t)maior;
+        escala[maior] -= 1.0 - escala[menor];
+        if (escala[maior] < 1.0) pequenas[num_pequenas++] = maior;
+        else grandes[num_grandes++] = maior;
+    }
+    // Sobras (erros de arredondamento) ficam sempre com a propria faixa.
+    while (num_grandes > 0) g_tabela_blitz.limiar[grandes[--num_grandes]] = UINT64_C(1) << 32;
+    while (num_pequenas > 0) g_tabela_blitz.limiar[pequenas[--num_pequenas]] = UINT64_C(1) << 32;
+}
+
+/**
+ * @brief Sorteia K (derrotas antes da primeira vitoria) em O(1): uma faixa uniforme e uma
+ * comparacao. A cauda e geometrica de novo (sem memoria), entao basta somar e sortear outra vez.
+ */
+static inline int sortear_derrotas_blitz(GeradorDados* gerador) {
+    int base = 0;
+    for (;;) {
+        uint32_t faixa = gerador_intervalo(gerador, FAIXAS_BLITZ);
+        int k = gerador_proximo(gerador) < g_tabela_blitz.limiar[faixa] ? (int)faixa : g_tabela_blitz.alias[faixa];
+        if (k < FAIXAS_BLITZ - 1) return base + k;
+        base += FAIXAS_BLITZ - 1;
+    }
+}
+
+/**
+ * @brief Ataque relampago: resolve "atacar ate conquistar ou restar 1 tropa" em um passo, com o
+ * mesmo resultado estatistico de encadear atacar(). Com o diario ligado as batalhas sao roladas
+ * uma a uma (o diario guarda os dados de cada batalha para o --replay).
+ * @param batalhas Saida opcional: quantas batalhas a sequencia teve.
+ * @return int: 1 se houve conquista, 0 se o atacante ficou com 1 tropa.
+ */
+int atacar_blitz(Partida* partida, Territorio* atacante, Territorio* defensor, Jogador* jogador, int* batalhas) {
+    int tropas = atacante->tropas;
+    int conquista, num_batalhas;
+
+    if (tropas < 2) {
+        if (batalhas != NULL) *batalhas = 0;
+        return 0;
+    }
+
+    uint64_t inicio = inicio_fase();
+    if (partida->diario != NULL) {
+        conquista = 0;
+        for (num_batalhas = 0; !conquista && atacante->tropas > 1; num_batalhas++) {
+            int dado_ataque = rolar_dado(partida);
+            int dado_defesa = rolar_dado(partida);
+            conquista = aplicar_batalha(partida, atacante, defensor, dado_ataque, dado_defesa);
+        }
+    } else {
+        pthread_once(&g_tabela_blitz_iniciada, construir_tabela_blitz);
+        int derrotas = sortear_derrotas_blitz(&partida->gerador);
+        conquista = derrotas < tropas - 1;
+        num_batalhas = conquista ? derrotas + 1 : tropas - 1;
+
+        contar(CONTADOR_ATAQUES, num_batalhas);
+        contar(CONTADOR_CONQUISTAS, conquista);
+        if (conquista) {
+            // Cada derrota custou 1 tropa; a batalha vencedora segue as regras do nucleo.
+            int restantes = tropas - derrotas;
+            ResultadoBatalha r = resolver_batalha(restantes, defensor->tropas, 2, 1);
+            transferir_territorio(partida, defensor, atacante->dono);
+            alterar_tropas(partida, defensor, defensor->tropas + r.delta_defensor);
+            alterar_tropas(partida, atacante, restantes + r.delta_atacante);
+        } else {
+            alterar_tropas(partida, atacante, 1);
+        }
+    }
+    fim_fase(FASE_ATAQUE, inicio);
+
+    // Mesmo efeito de atacar() no contador: cada derrota zera a sequencia, cada vitoria soma 1.
+    if (num_batalhas > 1 || !conquista) jogador->territorios_conquistados = 0;
+    jogador->territorios_conquistados += conquista;
+    if (batalhas != NULL) *batalhas = num_batalhas;
+    return conquista;
+}
+
+/**
+ * @brief Le do teclado um territorio pelo numero ou pelo nome (resolver_territorio).
+ * @param numero Recebe o numero do territorio (1 a n), ou 0 se o usuario digitou 0 ou a entrada acabou.
+ * @return int: 1 se a entrada foi reconhecida, 0 caso contrario (mensagem ja impressa).
+ */
+int ler_territorio_teclado(const Partida* partida, int* numero) {
+    char linha[TAMANHO_NOME + 16];
+    uint64_t inicio = inicio_fase();
+    char* lida = fgets(linha, sizeof(linha), stdin);
+    fim_fase(FASE_ENTRADA, inicio);
+
+    *numero = 0;
+    if (lida == NULL) return 1;
+    if (strchr(linha, '\n') == NULL) limpar_buffer(); // Linha longa demais: descarta o resto.
+    linha[strcspn(linha, "\r\n")] = '\0';
+    if (strcmp(linha, "0") == 0) return 1;
+
+    int i = resolver_territorio(partida, linha);
+    if (i == TERRITORIO_AMBIGUO) {
+        printf("Erro: ha mais de um territorio chamado '%s'; escolha pelo numero.\n", linha);
+        return 0;
+    }
+    if (i == TERRITORIO_INEXISTENTE) {
+        printf("Erro: territorio '%s' nao encontrado.\n", linha);
+        return 0;
+    }
+    *numero = i + 1;
+    return 1;
+}
+
+/**
+ * @brief Gerencia a seleção dos territórios e executa o ataque.
+ * @param partida Ponteiro para a partida (array dinâmico de territórios).
+ * @param jogador Ponteiro para o jogador atual.
+ * @param vis Estado da tela (a cada tentativa so os territorios alterados sao reexibidos).
+ */
+void menu_ataque_rodada(Partida* partida, Jogador* jogador, Visualizacao* vis) {
+    Territorio* mapa = partida->mapa;
+    int id_atacante, id_defensor;
+    Territorio *p_atacante, *p_defensor; 
+    int ataque_bem_sucedido = 0; 
+
+    sleep(1.5); 
+    printf("\n==========================================\n");
+    printf("              MENU DE ATAQUE \n");
+    printf("==========================================\n");
+    sleep(1.5); 
+    
+    while (!ataque_bem_sucedido) {
+        exibir_territorios(partida, vis);
+        
+        // 1. Escolha do Atacante
+        printf("\nEscolha o numero ou o nome do TERRITORIO ATACANTE (1 a %d, ou 0 para CANCELAR): ", partida->num_territorios);
+        if (ler_territorio_teclado(partida, &id_atacante) != 1) continue;
+        
+        if (id_atacante == 0) return; 
+        
+        if (id_atacante < 1 || id_atacante > partida->num_territorios) {
+            printf("ID de territorio atacante invalido.\n");
+            continue;
+        }
+
+        p_atacante = mapa + (id_atacante - 1); 
+        
+        // VALIDACAO: O atacante DEVE ser da cor do jogador.
+        if (p_atacante->dono != jogador->id_cor) {
+             printf("Erro: O territorio selecionado (%s) nao pertence ao seu exercito (%s).\n", 
+                    nome_cor(&partida->cores, p_atacante->dono), jogador->cor);
+             continue;
+        }
+
+        // Validacao: Tropas mínimas.
+        if (p_atacante->tropas < 2) {
+             printf("Erro: E necessario no minimo 2 tropas para atacar. Tente novamente.\n");
+             continue;
+        }
+
+        // Mapa com grafo: lista os vizinhos inimigos (os unicos alvos possiveis).
+        if (partida->grafo != NULL) {
+            const GrafoMapa* grafo = partida->grafo;
+            int listados = 0;
+            if (!territorio_na_fronteira(partida, id_atacante - 1)) {
+                printf("Erro: %s nao faz fronteira com nenhum territorio inimigo.\n", p_atacante->nome);
+                continue;
+            }
+            printf("Vizinhos inimigos de %s:", p_atacante->nome);
+            for (uint32_t k = grafo->inicio[id_atacante - 1]; k < grafo->inicio[id_atacante]; k++) {
+                const Territorio* v = mapa + grafo->vizinhos[k];
+                if (v->dono == p_atacante->dono) continue;
+                if (listados++ == TERRITORIOS_POR_PAGINA) {
+                    printf(" ...");
+                    break;
+                }
+                printf(" %u (%s)", grafo->vizinhos[k] + 1, v->nome);
+            }
+            printf("\n");
+        }
+        
+        // 2. Escolha do Defensor
+        printf("Escolha o numero ou o nome do TERRITORIO DEFENSOR (1 a %d): ", partida->num_territorios);
+        if (ler_territorio_teclado(partida, &id_defensor) != 1) continue;
+        
+        if (id_defensor < 1 || id_defensor > partida->num_territorios) {
+            printf("ID de territorio defensor invalido.\n");
+            continue;
+        }
+        
+        p_defensor = mapa + (id_defensor - 1); 
+        
+        // 3. Validacoes de Regras do Jogo
+        
+        // Regra 1: Não pode atacar a si mesmo.
+        if (p_atacante == p_defensor) {
+            printf("Erro: Um territorio nao pode atacar a si mesmo.\n");
+            continue;
+        }
+        
+        // Regra 2: Não pode atacar territórios da mesma cor.
+        if (p_atacante->dono == p_defensor->dono) {
+            printf("Erro: Nao e possivel atacar um territorio da mesma cor (%s).\n", nome_cor(&partida->cores, p_atacante->dono));
+            continue;
+        }
+
+        // Regra 3: So se ataca um territorio vizinho (mapas com grafo).
+        if (!sao_vizinhos(partida, id_atacante - 1, id_defensor - 1)) {
+            printf("Erro: %s nao faz fronteira com %s.\n", p_atacante->nome, p_defensor->nome);
+            continue;
+        }
+
+        // 4. Probabilidades exatas do ataque, antes da confirmacao.
+        ProbabilidadesAtaque prob;
+        if (calcular_probabilidades(p_atacante->tropas, p_defensor->tropas, &prob) == 0) {
+            printf("\nProbabilidades (%s com %d tropas vs %s com %d tropas):\n",
+                   p_atacante->nome, p_atacante->tropas, p_defensor->nome, p_defensor->tropas);
+            printf("  Esta batalha: %.1f%% de conquista | tropas esperadas depois: atacante %.2f, defensor %.2f\n",
+                   100.0 * prob.p_conquista, p_atacante->tropas + prob.delta_atacante_esperado,
+                   p_defensor->tropas + prob.delta_defensor_esperado);
+            printf("  Atacando ate conquistar ou restar 1 tropa: %.1f%% de conquista em %.2f batalhas esperadas"
+                   " | tropas esperadas ao final: atacante %.2f, defensor %.2f\n",
+                   100.0 * prob.p_conquista_sequencia, prob.batalhas_esperadas,
+                   prob.tropas_atacante_esperadas, prob.tropas_defensor_esperadas);
+        }
+        char resposta[16];
+        do {
+            printf("Confirmar o ataque? (s = uma batalha, b = blitz ate conquistar ou restar 1 tropa,"
+                   " a = analisar as jogadas seguintes, n = cancelar): ");
+            uint64_t inicio = inicio_fase();
+            if (fgets(resposta, sizeof(resposta), stdin) == NULL) return;
+            fim_fase(FASE_ENTRADA, inicio);
+            if (resposta[0] == 'a' || resposta[0] == 'A') analisar_ataque(partida, jogador, id_atacante - 1, id_defensor - 1);
+        } while (resposta[0] == 'a' || resposta[0] == 'A');
+        if (resposta[0] == 'b' || resposta[0] == 'B') {
+            // 5b. Blitz: a sequencia inteira em um passo.
+            int batalhas;
+            int tropas_antes = p_atacante->tropas;
+            if (atacar_blitz(partida, p_atacante, p_defensor, jogador, &batalhas)) {
+                printf("\nBLITZ: %s conquistou %s em %d batalha(s) e ficou com %d tropa(s); %s recebeu %d.\n",
+                       p_atacante->nome, p_defensor->nome, batalhas, p_atacante->tropas, p_defensor->nome,
+                       tropas_antes - (batalhas - 1) - p_atacante->tropas);
+            } else {
+                printf("\nBLITZ: %s nao conquistou %s em %d batalha(s) e ficou com 1 tropa.\n",
+                       p_atacante->nome, p_defensor->nome, batalhas);
+            }
+            pausar(1);
+            ataque_bem_sucedido = 1;
+            continue;
+        }
+        if (resposta[0] != 's' && resposta[0] != 'S') {
+            printf("Ataque cancelado.\n");
+            continue;
+        }
+
+        // 5. Execucao do Ataque
+        atacar(partida, p_atacante, p_defensor, jogador);
+        ataque_bem_sucedido = 1; 
+    }
+}
+
+/**
+ * @brief Le o nome de um arquivo digitado pelo jogador (linha vazia = nome padrao).
+ */
+void ler_nome_arquivo(char* destino, size_t tamanho, const char* padrao) {
+    printf("Nome do arquivo (ENTER para '%s'): ", padrao);
+    uint64_t inicio = inicio_fase();
+    if (fgets(destino, (int)tamanho, stdin) == NULL) destino[0] = '\0';
+    fim_fase(FASE_ENTRADA, inicio);
+    destino[strcspn(destino, "\n")] = '\0';
+    if (destino[0] == '\0') snprintf(destino, tamanho, "%s", padrao);
+}
+
+/**
+ * @brief Salva a partida interativa (opcao "Salvar jogo").
+ * @param jogadores Jogadores da partida (o humano primeiro), no maximo MAX_JOGADORES_ESTADO.
+ * @param padrao Arquivo usado se o jogador nao digitar outro (--arquivo-estado).
+ */
+void menu_salvar_jogo(const Partida* partida, const Jogador* jogadores, int num_jogadores, long long rodada,
+                      const char* padrao) {
+    char caminho[256];
+
+    ler_nome_arquivo(caminho, sizeof(caminho), padrao);
+    if (salvar_estado(partida, jogadores, num_jogadores, rodada, caminho) == 0) {
+        printf("Jogo salvo em '%s' (rodada %lld).\n", caminho, rodada);
+    }
+    sleep(1);
+}
+
+/**
+ * @brief Substitui a partida interativa por um jogo salvo (opcao "Carregar jogo").
+ * Em caso de erro, a partida atual continua intacta.
+ * @param estado Recebe os jogadores do jogo carregado (o humano e estado->jogadores[0]).
+ * @return int: 1 se um jogo foi carregado, 0 caso contrario.
+ */
+int menu_carregar_jogo(Partida* partida, Jogador* jogador, EstadoSalvo* estado, long long* rodada, const char* padrao) {
+    char caminho[256];
+    Partida nova = {0};
+
+    ler_nome_arquivo(caminho, sizeof(caminho), padrao);
+    if (carregar_estado(&nova, estado, caminho) != 0) {
+        sleep(1);
+        return 0;
+    }
+    if (estado->num_jogadores == 0) {
+        printf("Erro: '%s' e um mapa, nao um jogo salvo.\n", caminho);
+        descartar_partida(&nova);
+        sleep(1);
+        return 0;
+    }
+
+    descartar_partida(partida);
+    *partida = nova;
+    *jogador = estado->jogadores[0];
+    *rodada = estado->rodada;
+    printf("Jogo '%s' carregado (rodada %lld).\n", caminho, *rodada);
+    exibirMissao(jogador);
+    return 1;
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// --- Modo de Simulacao (sem interface) ---
+// ------------------------------------------------------------------------------------------------
+
+// Cores dos lados na simulacao. O primeiro lado e o "jogador principal" (Vermelha); alem das
+// cores nomeadas, os lados se chamam "Cor-N".
+const char* CORES_SIMULACAO[] = { "Vermelha", "Azul", "Verde", "Amarela", "Preta", "Branca" };
+#define NUM_CORES_NOMEADAS (int)(sizeof(CORES_SIMULACAO) / sizeof(CORES_SIMULACAO[0]))
+#define NUM_LADOS_SIMULACAO 2        // Lados padrao (--jogadores).
+#define MAX_JOGADORES_SIMULACAO 4096 // Limite de --jogadores.
+
+#define MAX_MAPAS_SIMULACAO 16 // Quantidade maxima de mapas diferentes em um torneio.
+#define LOTE_PARTIDAS 64       // Partidas por lote: unidade de trabalho distribuida entre as threads.
+
+// Parametros de linha de comando (modo interativo e --simulate).
+typedef struct {
+    int num_partidas;     // Quantidade de partidas completas a jogar.
+    int num_threads;      // Quantidade de threads trabalhadoras.
+    int max_rodadas;      // Limite de rodadas; ao atingir, a partida termina sem vencedor.
+    uint64_t semente;     // Semente base (--seed): a mesma semente gera sempre o mesmo resultado.
+    int num_mapas;        // Quantidade de mapas do torneio (as partidas se alternam entre eles).
+    int tamanhos_mapa[MAX_MAPAS_SIMULACAO]; // Numero de territorios de cada mapa gerado.
+    const char* arquivos_mapa[MAX_MAPAS_SIMULACAO]; // Arquivo de cada mapa (--map); NULL = mapa gerado.
+    const char* exportar_mapa; // --exportar-mapa: grava o mapa carregado em formato binario e sai.
+    const char* arquivo_missoes; // Tabela de missoes (--missoes); NULL = missoes pre-definidas.
+    int intervalo_checkpoint;  // --checkpoint K: salva o estado a cada K rodadas (0 = desligado).
+    const char* arquivo_estado; // Arquivo dos checkpoints e do "Salvar jogo" (--arquivo-estado).
+    const char* arquivo_diario; // --diario: grava todas as batalhas neste arquivo.
+    const char* arquivo_replay; // --replay: reaplica este diario sobre o mapa de --map e sai.
+    const char* arquivo_script; // --script: executa os comandos deste arquivo (sem menus nem pausas) e sai.
+    int benchmark;              // --bench: mede as operacoes principais e sai.
+    int autoteste;              // --autoteste: confere os caminhos rapidos contra os diretos e sai.
+    int tamanhos_informados;    // --territorios foi usado (no --bench, substitui a varredura padrao).
+    int estatisticas;           // --stats: contadores e tempos por fase, impressos ao sair.
+    int estatisticas_json;      // --stats json: relatorio em JSON.
+    int blitz;                  // --blitz: na simulacao, cada ataque vai ate conquistar ou restar 1 tropa.
+    int num_jogadores;          // --jogadores: lados da simulacao (no modo interativo, 1 humano + IAs).
+    int jogadores_informados;   // --jogadores foi usado (sem ele, o modo interativo e so do humano).
+    int ia_mcts;                // --ia mcts: o lado 1 da simulacao (ou os oponentes no modo interativo) joga com MCTS.
+    int ia_ms;                  // --ia-ms: orcamento de tempo da IA por jogada.
+    int ia_threads;             // --ia-threads: threads de rollouts por jogada (0 = padrao do modo).
+    int ia_iteracoes;           // --ia-iteracoes: limite de iteracoes por jogada (0 = so o tempo).
+    const char* endereco_servidor; // --servidor: porta TCP local ou caminho de socket Unix; NULL = desligado.
+    int mapa_compacto;          // --mapa-compacto: no --bench, so o mapa compacto (sem o vetor de Territorio);
+                                // no --simulate, os mapas de arquivo ficam no formato compacto.
+    int paginas_enormes;        // --paginas-enormes: vetores grandes do mapa compacto em paginas enormes.
+} Configuracao;
+
+// Estatisticas acumuladas de um mapa. So contem somas inteiras, entao a juncao dos resultados
+// das threads nao depende da ordem em que as partidas foram jogadas.
+typedef struct {
+    long long partidas;
+    long long vitorias_lado[MAX_JOGADORES_SIMULACAO];
+    long long empates;
+    long long rodadas;
+    long long vitorias_missao[MAX_MISSOES];
+    long long sorteios_missao[MAX_MISSOES];
+    long long jogadas_ia;   // Jogadas escolhidas pela IA (--ia mcts).
+    long long iteracoes_ia; // Iteracoes MCTS somadas dessas jogadas.
+    long long bytes_arena;  // Bytes de arena usados pelas partidas (mapa, agregados, indice, jogadores).
+} EstatisticasMapa;
+
+// Faixa de lotes ainda nao jogados de uma thread. A dona consome pelo inicio e as threads
+// ociosas roubam metade do que resta pelo fim.
+typedef struct {
+    pthread_mutex_t trava;
+    int inicio;
+    int fim;
+} FilaLotes;
+
+struct Torneio;
+struct BuscaMCTS;
+
+// Contexto de uma thread trabalhadora: fila propria, partidas proprias e estatisticas proprias.
+typedef struct {
+    int id;
+    struct Torneio* torneio;
+    FilaLotes fila;
+    Partida partidas[MAX_MAPAS_SIMULACAO]; // Um contexto de partida por mapa, reaproveitado.
+    EstatisticasMapa estatisticas[MAX_MAPAS_SIMULACAO];
+    Diario diario; // Buffer proprio do diario de batalhas (--diario).
+    MesaJogadores mesa; // Jogadores e roda de turnos (na arena).
+    Arena* arena;       // Arena do lote em andamento (pool do torneio): guarda os vetores da partida.
+    struct BuscaMCTS* busca; // IA do lado 1 (--ia mcts); NULL = politica scriptada.
+    int falhou;
+} Trabalhador;
+
+typedef struct Torneio {
+    const Configuracao* config;
+    int num_lotes;
+    Trabalhador* trabalhadores;
+    Partida modelos[MAX_MAPAS_SIMULACAO]; // Mapas carregados de arquivo (num_territorios 0 = mapa gerado).
+    MapaCompacto compactos[MAX_MAPAS_SIMULACAO]; // --mapa-compacto: territorios dos modelos (o mapa do modelo e solto).
+    Jogador* lados[MAX_MAPAS_SIMULACAO]; // config->num_jogadores lados por mapa (id_missao -1 = sortear).
+    Diario diario;               // Arquivo do diario (--diario), compartilhado pelas threads.
+    pthread_mutex_t trava_diario;
+    PoolArenas arenas;           // Arenas das sessoes, recicladas entre as threads a cada lote.
+} Torneio;
+
+/**
+ * @brief Nome da cor do lado j da simulacao.
+ * @param buffer Espaco para o nome gerado ("Cor-N"), com TAMANHO_COR bytes.
+ */
+const char* nome_cor_simulacao(int j, char* buffer) {
+    if (j < NUM_CORES_NOMEADAS) return CORES_SIMULACAO[j];
+    snprintf(buffer, TAMANHO_COR, "Cor-%d", (j + 1) % 100000); // j < MAX_JOGADORES_SIMULACAO.
+    return buffer;
+}
+
+/**
+ * @brief Registra as cores dos num_lados lados da simulacao, na ordem (o lado j recebe o ID j
+ * num registro vazio).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int registrar_cores_simulacao(RegistroCores* cores, int num_lados) {
+    char buffer[TAMANHO_COR];
+
+    for (int j = 0; j < num_lados; j++) {
+        if (registrar_cor(cores, nome_cor_simulacao(j, buffer)) < 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Preenche o mapa com territorios gerados, divididos entre os lados da simulacao
+ * (o territorio i fica com o lado i % num_lados).
+ * @param partida Partida com o mapa ja alocado (num_territorios posicoes) e as cores dos lados registradas.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int gerar_mapa_simulacao(Partida* partida, int num_lados) {
+    zerar_agregados(partida); // O mapa e regerado a cada partida.
+
+    for (int i = 0; i < partida->num_territorios; i++) {
+        Territorio* t = partida->mapa + i;
+        snprintf(t->nome, sizeof(t->nome), "Territorio-%d", i + 1);
+        int tropas = (int)gerador_intervalo(&partida->gerador, 5) + 1; // Entre 1 e 5 tropas.
+        if (registrar_territorio(partida, t, i % num_lados, tropas) != 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Territorio mais forte de uma cor (em caso de empate, o de menor indice), percorrendo so
+ * a lista da cor no indice de donos.
+ * @param so_fronteira Se 1, so considera territorios na fronteira (mapa com grafo).
+ * @param minimo Tropas minimas para ser escolhido.
+ * @return int: Indice do territorio, ou -1 se nenhum serve.
+ */
+int territorio_mais_forte(const Partida* partida, int cor, int so_fronteira, int minimo) {
+    int melhor = -1;
+
+    for (int32_t i = partida->primeiro_do_dono[cor]; i >= 0; i = partida->proximo_do_dono[i]) {
+        int tropas = partida->mapa[i].tropas;
+        if (tropas < minimo || (so_fronteira && !partida->fronteira[i])) continue;
+        if (melhor < 0 || tropas > partida->mapa[melhor].tropas ||
+            (tropas == partida->mapa[melhor].tropas && i < melhor)) {
+            melhor = i;
+        }
+    }
+    return melhor;
+}
+
+/**
+ * @brief Territorio mais fraco de uma cor (em caso de empate, o de menor indice).
+ * @return int: Indice do territorio, ou -1 se a cor nao tem territorios.
+ */
+int territorio_mais_fraco(const Partida* partida, int cor) {
+    int melhor = -1;
+
+    for (int32_t i = partida->primeiro_do_dono[cor]; i >= 0; i = partida->proximo_do_dono[i]) {
+        int tropas = partida->mapa[i].tropas;
+        if (melhor < 0 || tropas < partida->mapa[melhor].tropas ||
+            (tropas == partida->mapa[melhor].tropas && i < melhor)) {
+            melhor = i;
+        }
+    }
+    return melhor;
+}
+
+/**
+ * @brief Politica scriptada: ataca com o territorio mais forte contra o inimigo mais fraco.
+ * Sem grafo, o alvo e o territorio mais fraco da cor rival (o proximo jogador vivo); num mapa com
+ * grafo, o atacante e o territorio mais forte na fronteira e o alvo e o seu vizinho inimigo mais
+ * fraco. Usa o indice de donos (construir_indice_donos): o custo e o dos territorios do jogador
+ * e do rival, nao o do mapa inteiro.
+ * @param partida Partida em andamento.
+ * @param jogador Jogador que faz a jogada.
+ * @param blitz Se 1, o ataque e um blitz (ate conquistar ou restar 1 tropa) em vez de uma batalha.
+ * @param cor_rival Cor atacada quando o mapa nao tem grafo (-1 = nenhuma).
+ * @param cor_defensor Recebe a cor do territorio atacado (pode ser NULL).
+ * @return int: 1 se um ataque foi realizado, 0 se o jogador nao tem ataque possivel.
+ */
+int jogar_politica_scriptada(Partida* partida, Jogador* jogador, int blitz, int cor_rival, int* cor_defensor) {
+    int atacante, defensor = -1;
+
+    if (partida->grafo != NULL) {
+        const GrafoMapa* grafo = partida->grafo;
+        atacante = territorio_mais_forte(partida, jogador->id_cor, 1, 2);
+        if (atacante < 0) return 0;
+        for (uint32_t k = grafo->inicio[atacante]; k < grafo->inicio[atacante + 1]; k++) {
+            int v = (int)grafo->vizinhos[k];
+            if (partida->mapa[v].dono != jogador->id_cor &&
+                (defensor < 0 || partida->mapa[v].tropas < partida->mapa[defensor].tropas)) {
+                defensor = v;
+            }
+        }
+    } else {
+        if (cor_rival < 0 || cor_rival == jogador->id_cor) return 0;
+        atacante = territorio_mais_forte(partida, jogador->id_cor, 0, 2);
+        if (atacante < 0) return 0;
+        defensor = territorio_mais_fraco(partida, cor_rival);
+        if (defensor < 0) return 0;
+    }
+
+    if (cor_defensor != NULL) *cor_defensor = partida->mapa[defensor].dono;
+    if (blitz) atacar_blitz(partida, partida->mapa + atacante, partida->mapa + defensor, jogador, NULL);
+    else atacar(partida, partida->mapa + atacante, partida->mapa + defensor, jogador);
+    return 1;
+}
+
+/**
+ * @brief Prepara o contexto de partida de uma thread para um mapa carregado de arquivo:
+ * aloca o mapa e copia as cores do modelo (os agregados e territorios sao copiados a cada partida).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int preparar_partida_modelo(Partida* partida, const Partida* modelo) {
+    if (alocar_mapa(partida, modelo->num_territorios) != 0) return 1;
+    if (copiar_registro_cores(&partida->cores, &modelo->cores) != 0) return 1;
+    if (garantir_agregados(partida, modelo->capacidade_agregados - 1) != 0) return 1;
+    // O grafo e so lido durante as partidas: todas as threads usam o do modelo.
+    if (modelo->grafo != NULL) {
+        memcpy(partida->mapa, modelo->mapa, (size_t)modelo->num_territorios * sizeof(Territorio));
+        return ligar_grafo(partida, modelo->grafo, 1);
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- IA com Busca em Arvore Monte Carlo (MCTS) ---
+// ------------------------------------------------------------------------------------------------
+
+#define MAX_ACOES_MCTS 24           // Ataques candidatos por decisao (os de melhor heuristica).
+#define MAX_RIVAIS_MCTS 8           // Sem grafo: cores atacaveis (os proximos jogadores vivos na roda).
+#define PROFUNDIDADE_ARVORE_MCTS 32 // Jogadas da IA descidas na arvore por iteracao.
+#define RODADAS_ROLLOUT_MCTS 20     // Rodadas jogadas pela politica scriptada no fim de cada iteracao.
+#define MAX_NOS_MCTS (1 << 20)      // Nos por thread; com a arvore cheia, as iteracoes so fazem rollouts.
+#define EXPLORACAO_MCTS 1.4         // Constante de exploracao do UCT.
+#define BONUS_ALVO_MCTS 1000        // Prioridade dos ataques contra a cor alvo da missao.
+
+// Parametros da IA (--ia mcts).
+typedef struct {
+    int tempo_ms;      // Orcamento de tempo por jogada (--ia-ms).
+    int num_threads;   // Threads de rollouts por jogada (--ia-threads).
+    int max_iteracoes; // Limite de iteracoes por jogada (--ia-iteracoes; 0 = so o tempo). Com 1 thread
+                       // e sem limite de tempo, a jogada depende so da semente.
+    int blitz;         // Ataques em blitz, como os dos outros jogadores.
+} ParametrosMCTS;
+
+typedef struct {
+    int32_t atacante;
+    int32_t defensor;
+} AcaoAtaque;
+
+// No da arvore. A busca e "open loop": o no guarda a sequencia de ataques da IA ate ele, nao o
+// estado (os dados mudam a cada iteracao), e cada iteracao refaz o estado a partir da raiz.
+typedef struct {
+    AcaoAtaque acao;
+    int32_t primeiro_filho;
+    int32_t proximo_irmao;
+    uint32_t visitas;
+    double recompensa; // Soma das recompensas (0 a 1) das iteracoes que passaram pelo no.
+} NoMCTS;
+
+struct BuscaMCTS;
+
+// Contexto de uma thread da busca: copia propria da partida e dos jogadores e arvore propria
+// (paralelismo na raiz: as arvores so sao somadas no fim, sem travas durante a busca).
+typedef struct {
+    struct BuscaMCTS* busca;
+    int id;
+    Partida partida;
+    MesaJogadores mesa;
+    NoMCTS* nos;
+    int num_nos;
+    int capacidade_nos;
+    long long iteracoes;
+} ThreadMCTS;
+
+// Estado da IA de um jogador ou de uma thread da simulacao, reaproveitado entre jogadas.
+typedef struct BuscaMCTS {
+    ParametrosMCTS parametros;
+    ThreadMCTS* threads;
+    // Jogada em andamento (so leitura durante a busca).
+    const Partida* raiz;
+    const MesaJogadores* mesa_raiz;
+    int jogador;
+    long long valor_inicial; // Metrica da missao na raiz (base do progresso das missoes "<=" e "==").
+    uint64_t prazo;          // Fim da busca (agora_ns).
+    long long iteracoes;     // Iteracoes da ultima jogada, somadas as threads.
+} BuscaMCTS;
+
+/**
+ * @brief Libera as copias e as arvores das threads da busca.
+ */
+void liberar_busca_mcts(BuscaMCTS* busca) {
+    if (busca->threads != NULL) {
+        for (int t = 0; t < busca->parametros.num_threads; t++) {
+            descartar_partida(&busca->threads[t].partida);
+            liberar_mesa(&busca->threads[t].mesa);
+            free(busca->threads[t].nos);
+        }
+        free(busca->threads);
+    }
+    memset(busca, 0, sizeof(*busca));
+}
+
+/**
+ * @brief Prepara a IA; as copias da partida sao alocadas na primeira jogada.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int iniciar_busca_mcts(BuscaMCTS* busca, const ParametrosMCTS* parametros) {
+    memset(busca, 0, sizeof(*busca));
+    busca->parametros = *parametros;
+    if (busca->parametros.num_threads < 1) busca->parametros.num_threads = 1;
+    busca->threads = (ThreadMCTS*)calloc((size_t)busca->parametros.num_threads, sizeof(ThreadMCTS));
+    if (busca->threads == NULL) {
+        perror("Erro ao alocar memoria para a IA");
+        return 1;
+    }
+    for (int t = 0; t < busca->parametros.num_threads; t++) {
+        busca->threads[t].busca = busca;
+        busca->threads[t].id = t;
+    }
+    return 0;
+}
+
+/**
+ * @brief Ajusta a copia da thread a partida da raiz: so realoca quando o mapa ou as cores mudaram
+ * desde a ultima jogada. Copia tambem a parte da mesa que nao muda durante a partida.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int preparar_thread_mcts(ThreadMCTS* t, const Partida* raiz, const MesaJogadores* mesa) {
+    Partida* copia = &t->partida;
+
+    if (copia->mapa == NULL || copia->num_territorios != raiz->num_territorios ||
+        copia->cores.total != raiz->cores.total || copia->capacidade_agregados < raiz->capacidade_agregados ||
+        copia->grafo != raiz->grafo) {
+        descartar_partida(copia);
+        if (preparar_partida_modelo(copia, raiz) != 0) return 1;
+        memcpy(copia->mapa, raiz->mapa, (size_t)raiz->num_territorios * sizeof(Territorio));
+        if (construir_indice_donos(copia) != 0) return 1;
+    }
+    if (t->nos == NULL) {
+        t->capacidade_nos = 4096;
+        t->nos = (NoMCTS*)malloc((size_t)t->capacidade_nos * sizeof(NoMCTS));
+        if (t->nos == NULL) return 1;
+    }
+
+    if (reservar_mesa(&t->mesa, mesa->num_jogadores, mesa->num_cores) != 0) return 1;
+    t->mesa.num_cores = mesa->num_cores;
+    memcpy(t->mesa.jogador_da_cor, mesa->jogador_da_cor, (size_t)mesa->num_cores * sizeof(int));
+    memcpy(t->mesa.inicio_interessados, mesa->inicio_interessados, ((size_t)mesa->num_cores + 1) * sizeof(int));
+    memcpy(t->mesa.interessados, mesa->interessados, (size_t)mesa->num_jogadores * sizeof(int));
+    return 0;
+}
+
+/**
+ * @brief Volta a copia da thread ao estado da raiz: territorios, agregados, fronteiras, indice de
+ * donos e jogadores (com a roda de turnos). Sao so copias de vetores, sem alocacao.
+ */
+static void restaurar_estado_mcts(ThreadMCTS* t) {
+    const Partida* raiz = t->busca->raiz;
+    const MesaJogadores* mesa = t->busca->mesa_raiz;
+    Partida* copia = &t->partida;
+    size_t n = (size_t)raiz->num_territorios;
+
+    memcpy(copia->mapa, raiz->mapa, n * sizeof(Territorio));
+    memcpy(copia->agregados, raiz->agregados, (size_t)raiz->capacidade_agregados * sizeof(AgregadoDono));
+    if (raiz->grafo != NULL) memcpy(copia->fronteira, raiz->fronteira, n);
+    memcpy(copia->primeiro_do_dono, raiz->primeiro_do_dono, (size_t)raiz->capacidade_indice * sizeof(int32_t));
+    memcpy(copia->proximo_do_dono, raiz->proximo_do_dono, n * sizeof(int32_t));
+    memcpy(copia->anterior_do_dono, raiz->anterior_do_dono, n * sizeof(int32_t));
+
+    memcpy(t->mesa.jogadores, mesa->jogadores, (size_t)mesa->num_jogadores * sizeof(Jogador));
+    memcpy(t->mesa.proximo, mesa->proximo, (size_t)mesa->num_jogadores * sizeof(int));
+    memcpy(t->mesa.anterior, mesa->anterior, (size_t)mesa->num_jogadores * sizeof(int));
+    t->mesa.primeiro_vivo = mesa->primeiro_vivo;
+    t->mesa.vivos = mesa->vivos;
+}
+
+/**
+ * @brief Ataques candidatos do jogador, do melhor para o pior pela heuristica (tropas do atacante
+ * menos as do defensor, com prioridade para a cor alvo da missao). Com grafo, os alvos sao os
+ * vizinhos inimigos dos territorios na fronteira; sem grafo, o territorio mais fraco de cada um
+ * dos MAX_RIVAIS_MCTS proximos jogadores vivos.
+ * @param acoes Vetor com MAX_ACOES_MCTS posicoes.
+ * @return int: Quantidade de acoes (0 = nenhum ataque possivel).
+ */
+int gerar_acoes_mcts(const Partida* partida, const MesaJogadores* mesa, int jogador, AcaoAtaque* acoes) {
+    const Jogador* eu = &mesa->jogadores[jogador];
+    int alvo_missao = eu->alvo_missao != eu->id_cor ? eu->alvo_missao : -1;
+    int alvos[MAX_RIVAIS_MCTS];
+    int pontos[MAX_ACOES_MCTS];
+    int num_alvos = 0, num_acoes = 0;
+
+    if (mesa->anterior[jogador] < 0) return 0; // Eliminado.
+    if (partida->grafo == NULL) {
+        for (int j = mesa->proximo[jogador]; j != jogador && num_alvos < MAX_RIVAIS_MCTS; j = mesa->proximo[j]) {
+            int t = territorio_mais_fraco(partida, mesa->jogadores[j].id_cor);
+            if (t >= 0) alvos[num_alvos++] = t;
+        }
+    }
+
+    for (int32_t a = partida->primeiro_do_dono[eu->id_cor]; a >= 0; a = partida->proximo_do_dono[a]) {
+        int tropas = partida->mapa[a].tropas;
+        const uint32_t* vizinhos = NULL;
+        int num_candidatos = num_alvos;
+
+        if (tropas < 2) continue;
+        if (partida->grafo != NULL) {
+            if (!partida->fronteira[a]) continue;
+            vizinhos = partida->grafo->vizinhos + partida->grafo->inicio[a];
+            num_candidatos = (int)(partida->grafo->inicio[a + 1] - partida->grafo->inicio[a]);
+        }
+        for (int k = 0; k < num_candidatos; k++) {
+            int d = vizinhos != NULL ? (int)vizinhos[k] : alvos[k];
+            if (partida->mapa[d].dono == eu->id_cor) continue;
+            int p = tropas - partida->mapa[d].tropas + (partida->mapa[d].dono == alvo_missao ? BONUS_ALVO_MCTS : 0);
+
+            // Insercao ordenada, mantendo so as MAX_ACOES_MCTS melhores (empate: a que apareceu antes).
+            int pos = num_acoes;
+            while (pos > 0 && p > pontos[pos - 1]) pos--;
+            if (pos >= MAX_ACOES_MCTS) continue;
+            if (num_acoes < MAX_ACOES_MCTS) num_acoes++;
+            memmove(acoes + pos + 1, acoes + pos, (size_t)(num_acoes - 1 - pos) * sizeof(AcaoAtaque));
+            memmove(pontos + pos + 1, pontos + pos, (size_t)(num_acoes - 1 - pos) * sizeof(int));
+            acoes[pos].atacante = a;
+            acoes[pos].defensor = d;
+            pontos[pos] = p;
+        }
+    }
+    return num_acoes;
+}
+
+/**
+ * @brief Progresso da missao do jogador, de 0 (nada) a 1 (cumprida), usado como recompensa das
+ * iteracoes que terminam sem vencedor. As missoes "<=" e "==" medem o quanto a metrica andou
+ * desde a raiz em direcao ao limiar.
+ */
+static double progresso_missao(const Jogador* jogador, const Partida* partida, long long valor_inicial) {
+    const Missao* missao = &g_missoes.missoes[jogador->id_missao];
+    long long valor = valor_metrica_missao(missao, jogador, jogador->alvo_missao, partida);
+    long long limiar = missao->limiar;
+    double progresso;
+
+    switch (missao->condicao) {
+        case CONDICAO_MAIOR_IGUAL:
+            progresso = limiar > 0 ? (double)valor / (double)limiar : 1.0;
+            break;
+        case CONDICAO_MENOR_IGUAL:
+            progresso = valor_inicial > limiar ? (double)(valor_inicial - valor) / (double)(valor_inicial - limiar) : 1.0;
+            break;
+        default: {
+            long long distancia_inicial = llabs(valor_inicial - limiar);
+            progresso = distancia_inicial > 0 ? 1.0 - (double)llabs(valor - limiar) / (double)distancia_inicial
+                                              : (valor == limiar);
+            break;
+        }
+    }
+    return progresso < 0.0 ? 0.0 : (progresso > 1.0 ? 1.0 : progresso);
+}
+
+/**
+ * @brief Executa um ataque na copia da thread e verifica as missoes afetadas.
+ * @return int: Jogador vencedor, ou -1.
+ */
+static int aplicar_ataque_mcts(ThreadMCTS* t, int jogador, AcaoAtaque acao) {
+    Partida* partida = &t->partida;
+    Jogador* atacante = &t->mesa.jogadores[jogador];
+    int cor_defensor = partida->mapa[acao.defensor].dono;
+
+    if (t->busca->parametros.blitz) atacar_blitz(partida, partida->mapa + acao.atacante, partida->mapa + acao.defensor, atacante, NULL);
+    else atacar(partida, partida->mapa + acao.atacante, partida->mapa + acao.defensor, atacante);
+    registrar_ataque_mesa(&t->mesa, partida, cor_defensor);
+    return avaliar_missoes_afetadas(partida, &t->mesa, jogador, atacante->id_cor, cor_defensor);
+}
+
+/**
+ * @brief Turnos dos outros jogadores (politica scriptada) a partir do jogador j, ate a vez do
+ * jogador da IA, ate um vencedor, ou por no maximo max_turnos turnos.
+ * @return int: Jogador vencedor, ou -1.
+ */
+static int jogar_turnos_mcts(ThreadMCTS* t, int j, int max_turnos) {
+    MesaJogadores* mesa = &t->mesa;
+    int eu = t->busca->jogador;
+    int sem_ataque = 0;
+
+    for (int turno = 0; turno < max_turnos && mesa->vivos > 0; turno++) {
+        if (mesa->anterior[j] < 0) j = mesa->primeiro_vivo; // O jogador da vez foi eliminado.
+        if (max_turnos == INT_MAX && j == eu) break;         // Vez da IA: volta para a arvore.
+
+        int rival = mesa->proximo[j];
+        int cor_defensor = -1;
+        if (jogar_politica_scriptada(&t->partida, &mesa->jogadores[j], t->busca->parametros.blitz,
+                                     rival != j ? mesa->jogadores[rival].id_cor : -1, &cor_defensor)) {
+            registrar_ataque_mesa(mesa, &t->partida, cor_defensor);
+            int vencedor = avaliar_missoes_afetadas(&t->partida, mesa, j, mesa->jogadores[j].id_cor, cor_defensor);
+            if (vencedor >= 0) return vencedor;
+            sem_ataque = 0;
+        } else if (++sem_ataque >= mesa->vivos) {
+            break; // Uma volta inteira sem ataques: a partida travou.
+        }
+        j = mesa->proximo[j];
+    }
+    return -1;
+}
+
+/**
+ * @brief Escolhe o filho do no para a iteracao: a primeira acao candidata ainda sem filho e
+ * expandida (as candidatas vem em ordem de heuristica); se todas ja tem filho, vence o maior UCT.
+ * @param filho Recebe o no escolhido, ou -1 se a arvore esta cheia e a acao nao tem no.
+ * @return int: Indice da acao escolhida em acoes.
+ */
+static int selecionar_filho_mcts(ThreadMCTS* t, int no, const AcaoAtaque* acoes, int num_acoes, int* filho) {
+    int filhos[MAX_ACOES_MCTS];
+    int melhor = -1;
+    double melhor_uct = -1.0;
+    double log_visitas = log((double)t->nos[no].visitas + 1.0);
+
+    for (int k = 0; k < num_acoes; k++) {
+        filhos[k] = -1;
+        for (int32_t f = t->nos[no].primeiro_filho; f >= 0; f = t->nos[f].proximo_irmao) {
+            if (t->nos[f].acao.atacante == acoes[k].atacante && t->nos[f].acao.defensor == acoes[k].defensor) {
+                filhos[k] = f;
+                break;
+            }
+        }
+        if (filhos[k] < 0) {
+            // Acao nova nesta amostra do estado: expande (se houver espaco na arvore).
+            if (t->num_nos == t->capacidade_nos && t->capacidade_nos < MAX_NOS_MCTS) {
+                NoMCTS* novos = (NoMCTS*)realloc(t->nos, (size_t)t->capacidade_nos * 2 * sizeof(NoMCTS));
+                if (novos != NULL) {
+                    t->nos = novos;
+                    t->capacidade_nos *= 2;
+                }
+            }
+            *filho = -1;
+            if (t->num_nos < t->capacidade_nos) {
+                NoMCTS* novo = &t->nos[t->num_nos];
+                novo->acao = acoes[k];
+                novo->primeiro_filho = -1;
+                novo->proximo_irmao = t->nos[no].primeiro_filho;
+                novo->visitas = 0;
+                novo->recompensa = 0.0;
+                t->nos[no].primeiro_filho = t->num_nos;
+                *filho = t->num_nos++;
+            }
+            return k;
+        }
+        const NoMCTS* f = &t->nos[filhos[k]];
+        double uct = f->recompensa / f->visitas + EXPLORACAO_MCTS * sqrt(log_visitas / f->visitas);
+        if (uct > melhor_uct) {
+            melhor_uct = uct;
+            melhor = k;
+        }
+    }
+    *filho = filhos[melhor];
+    return melhor;
+}
+
+/**
+ * @brief Uma iteracao da busca: restaura a raiz, desce pela arvore (UCT) jogando os ataques da IA
+ * e os turnos dos outros jogadores, expande um no, joga um rollout e propaga a recompensa.
+ */
+static void iterar_mcts(ThreadMCTS* t) {
+    const BuscaMCTS* busca = t->busca;
+    int eu = busca->jogador;
+    int caminho[PROFUNDIDADE_ARVORE_MCTS + 1];
+    int tamanho = 0;
+    int no = 0, vencedor = -1;
+    AcaoAtaque acoes[MAX_ACOES_MCTS];
+
+    restaurar_estado_mcts(t);
+    caminho[tamanho++] = 0;
+
+    while (tamanho <= PROFUNDIDADE_ARVORE_MCTS) {
+        int num_acoes = gerar_acoes_mcts(&t->partida, &t->mesa, eu, acoes);
+        if (num_acoes == 0) break;
+
+        int filho;
+        int expandido = t->nos[no].visitas > 0 ? 0 : 1;
+        int k = selecionar_filho_mcts(t, no, acoes, num_acoes, &filho);
+        expandido |= (filho < 0 || t->nos[filho].visitas == 0);
+
+        vencedor = aplicar_ataque_mcts(t, eu, acoes[k]);
+        if (vencedor < 0) vencedor = jogar_turnos_mcts(t, t->mesa.proximo[eu], INT_MAX);
+        if (filho >= 0) caminho[tamanho++] = no = filho;
+        if (vencedor >= 0 || t->mesa.anterior[eu] < 0 || expandido) break;
+    }
+
+    // Rollout: todos (inclusive a IA) jogam com a politica scriptada.
+    if (vencedor < 0 && t->mesa.anterior[eu] >= 0) {
+        vencedor = jogar_turnos_mcts(t, eu, RODADAS_ROLLOUT_MCTS * t->mesa.vivos);
+    }
+
+    double recompensa;
+    if (vencedor >= 0) recompensa = vencedor == eu ? 1.0 : 0.0;
+    else if (t->mesa.anterior[eu] < 0) recompensa = 0.0;
+    else recompensa = 0.5 * progresso_missao(&t->mesa.jogadores[eu], &t->partida, busca->valor_inicial);
+
+    for (int k = 0; k < tamanho; k++) {
+        t->nos[caminho[k]].visitas++;
+        t->nos[caminho[k]].recompensa += recompensa;
+    }
+}
+
+/**
+ * @brief Laco de uma thread da busca: itera ate o prazo ou o limite de iteracoes (sem pausas e
+ * sem E/S; as mensagens do jogo estao silenciadas durante a busca). Com --stats, os ataques dos
+ * rollouts nao entram nos contadores da partida: da busca so ficam as iteracoes.
+ */
+static void* executar_thread_mcts(void* arg) {
+    ThreadMCTS* t = (ThreadMCTS*)arg;
+    const BuscaMCTS* busca = t->busca;
+    int num_threads = busca->parametros.num_threads;
+    long long limite = LLONG_MAX;
+
+    if (busca->parametros.max_iteracoes > 0) {
+        limite = (busca->parametros.max_iteracoes + num_threads - 1 - t->id) / num_threads;
+    }
+    t->iteracoes = 0;
+    t->num_nos = 1;
+    memset(&t->nos[0], 0, sizeof(NoMCTS));
+    t->nos[0].primeiro_filho = -1;
+    t->nos[0].proximo_irmao = -1;
+
+    EstatisticasExecucao guardadas;
+    guardar_estatisticas(&guardadas);
+    while (t->iteracoes < limite && (t->iteracoes == 0 || busca->parametros.tempo_ms <= 0 || agora_ns() < busca->prazo)) {
+        iterar_mcts(t);
+        t->iteracoes++;
+    }
+    restaurar_estatisticas(&guardadas);
+    contar(CONTADOR_ITERACOES_IA, t->iteracoes);
+    if (t->id > 0) {
+        juntar_estatisticas_thread();
+        liberar_tabela_probabilidades();
+    }
+    return NULL;
+}
+
+/**
+ * @brief Escolhe o ataque do jogador com MCTS. Cada thread joga sobre a sua copia do estado e
+ * monta a sua arvore; no fim, as visitas das acoes da raiz sao somadas e vence a mais visitada.
+ * A recompensa e 1 quando a missao do jogador e cumprida, 0 quando outro vence ou ele e eliminado
+ * e, sem vencedor, o progresso da missao (ate 0,5).
+ * @param partida Partida na vez do jogador (com o indice de donos montado).
+ * @param mesa Jogadores e roda de turnos da partida.
+ * @param semente Semente dos dados das copias (cada thread usa um fluxo).
+ * @param acao Recebe o ataque escolhido.
+ * @return int: 1 se ha ataque, 0 se o jogador nao tem ataque possivel, -1 em caso de falha de alocacao.
+ */
+int escolher_ataque_mcts(BuscaMCTS* busca, const Partida* partida, const MesaJogadores* mesa, int jogador,
+                         uint64_t semente, AcaoAtaque* acao) {
+    AcaoAtaque acoes[MAX_ACOES_MCTS];
+    int num_acoes = gerar_acoes_mcts(partida, mesa, jogador, acoes);
+    int num_threads = busca->parametros.num_threads;
+    pthread_t* threads;
+
+    busca->iteracoes = 0;
+    if (num_acoes <= 1) {
+        if (num_acoes == 1) *acao = acoes[0];
+        return num_acoes;
+    }
+
+    uint64_t inicio = inicio_fase();
+    for (int t = 0; t < num_threads; t++) {
+        if (preparar_thread_mcts(&busca->threads[t], partida, mesa) != 0) {
+            perror("Erro ao alocar memoria para a IA");
+            return -1;
+        }
+        iniciar_dados_partida(&busca->threads[t].partida, semente, (uint64_t)t);
+    }
+    const Jogador* eu = &mesa->jogadores[jogador];
+    busca->raiz = partida;
+    busca->mesa_raiz = mesa;
+    busca->jogador = jogador;
+    busca->valor_inicial = valor_metrica_missao(&g_missoes.missoes[eu->id_missao], eu, eu->alvo_missao, partida);
+    busca->prazo = agora_ns() + (uint64_t)(busca->parametros.tempo_ms > 0 ? busca->parametros.tempo_ms : 0) * 1000000ULL;
+
+    // As partidas copiadas chamam atacar: as mensagens ficam desligadas ate o fim da busca.
+    int silencioso = g_modo_silencioso;
+    g_modo_silencioso = 1;
+    threads = num_threads > 1 ? (pthread_t*)malloc((size_t)(num_threads - 1) * sizeof(pthread_t)) : NULL;
+    int iniciadas = 0;
+    if (threads != NULL) {
+        for (int t = 1; t < num_threads; t++) {
+            if (pthread_create(&threads[t - 1], NULL, executar_thread_mcts, &busca->threads[t]) != 0) break;
+            iniciadas++;
+        }
+    }
+    executar_thread_mcts(&busca->threads[0]);
+    for (int t = 0; t < iniciadas; t++) pthread_join(threads[t], NULL);
+    free(threads);
+    g_modo_silencioso = silencioso;
+
+    // Soma das visitas de cada acao da raiz em todas as arvores (empate: a de melhor heuristica).
+    long long melhores_visitas = -1;
+    for (int k = 0; k < num_acoes; k++) {
+        long long visitas = 0;
+        for (int t = 0; t <= iniciadas; t++) {
+            const ThreadMCTS* th = &busca->threads[t];
+            for (int32_t f = th->nos[0].primeiro_filho; f >= 0; f = th->nos[f].proximo_irmao) {
+                if (th->nos[f].acao.atacante == acoes[k].atacante && th->nos[f].acao.defensor == acoes[k].defensor) {
+                    visitas += th->nos[f].visitas;
+                    break;
+                }
+            }
+        }
+        if (visitas > melhores_visitas) {
+            melhores_visitas = visitas;
+            *acao = acoes[k];
+        }
+    }
+    for (int t = 0; t <= iniciadas; t++) busca->iteracoes += busca->threads[t].iteracoes;
+    fim_fase(FASE_IA, inicio);
+    return 1;
+}
+
+/**
+ * @brief Jogada da IA: escolhe o ataque com MCTS e o executa na partida real.
+ * @param cor_defensor Recebe a cor do territorio atacado.
+ * @return int: 1 se um ataque foi realizado, 0 se nao ha ataque possivel, -1 em caso de falha.
+ */
+int jogar_politica_mcts(Partida* partida, MesaJogadores* mesa, int jogador, BuscaMCTS* busca, int* cor_defensor) {
+    AcaoAtaque acao;
+    // A semente das copias sai do gerador da partida: com limite de iteracoes e 1 thread,
+    // a mesma semente de partida gera as mesmas jogadas.
+    uint64_t semente = ((uint64_t)gerador_proximo(&partida->gerador) << 32) | gerador_proximo(&partida->gerador);
+    int resultado = escolher_ataque_mcts(busca, partida, mesa, jogador, semente, &acao);
+
+    if (resultado <= 0) return resultado;
+    *cor_defensor = partida->mapa[acao.defensor].dono;
+    if (busca->parametros.blitz) {
+        atacar_blitz(partida, partida->mapa + acao.atacante, partida->mapa + acao.defensor, &mesa->jogadores[jogador], NULL);
+    } else {
+        atacar(partida, partida->mapa + acao.atacante, partida->mapa + acao.defensor, &mesa->jogadores[jogador]);
+    }
+    return 1;
+}
+
+/**
+ * @brief Monta a mesa do modo interativo com --jogadores N: o jogador humano e o jogador 0 e a IA
+ * controla outras N - 1 cores do mapa (as de um jogo salvo, se houver, e depois as primeiras cores
+ * livres), cada uma com a sua missao.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int preparar_oponentes(Partida* partida, MesaJogadores* mesa, const Jogador* humano, int num_jogadores,
+                       const EstadoSalvo* estado) {
+    int num_cores = partida->cores.total;
+    int proxima_cor = 0;
+
+    if (num_jogadores > num_cores) {
+        printf("Aviso: o mapa tem %d cores; a partida tera %d jogadores.\n", num_cores, num_cores);
+        num_jogadores = num_cores;
+    }
+    if (num_jogadores < 2) {
+        mesa->num_jogadores = 0;
+        return 0;
+    }
+
+    unsigned char* usada = (unsigned char*)calloc((size_t)num_cores, 1);
+    if (usada == NULL || reservar_mesa(mesa, num_jogadores, num_cores) != 0) {
+        if (usada == NULL) perror("Erro ao alocar memoria para os oponentes");
+        free(usada);
+        return 1;
+    }
+    mesa->jogadores[0] = *humano;
+    usada[humano->id_cor] = 1;
+    for (int j = 1; j < estado->num_jogadores && j < num_jogadores; j++) usada[estado->jogadores[j].id_cor] = 1;
+
+    for (int j = 1; j < num_jogadores; j++) {
+        Jogador* ia = &mesa->jogadores[j];
+        if (j < estado->num_jogadores) {
+            *ia = estado->jogadores[j];
+            continue;
+        }
+        while (usada[proxima_cor]) proxima_cor++;
+        memset(ia, 0, sizeof(*ia));
+        ia->id_cor = proxima_cor;
+        strcpy(ia->cor, nome_cor(&partida->cores, proxima_cor));
+        atribuirMissao(ia, partida);
+        usada[proxima_cor] = 1;
+    }
+    free(usada);
+
+    printf("Oponentes controlados pela IA: %d", num_jogadores - 1);
+    for (int j = 1; j < num_jogadores && j <= MAX_JOGADORES_ESTADO; j++) {
+        printf("%s%s", j == 1 ? " (" : ", ", mesa->jogadores[j].cor);
+    }
+    printf("%s\n", num_jogadores - 1 > MAX_JOGADORES_ESTADO ? ", ...)" : ")");
+    return 0;
+}
+
+/**
+ * @brief Turno da IA no modo interativo: cada oponente vivo, na ordem da roda de turnos, ataca o
+ * proximo jogador vivo com a politica scriptada, ou escolhe o ataque com MCTS (--ia mcts). O indice
+ * de donos (e o de sequencias, se alguma missao o usa) e remontado antes (o mapa pode ter sido
+ * cadastrado ou carregado desde o ultimo turno).
+ * @param busca IA MCTS, ou NULL para a politica scriptada.
+ */
+void jogar_turno_oponentes(Partida* partida, MesaJogadores* mesa, const Jogador* humano, int blitz, BuscaMCTS* busca) {
+    mesa->jogadores[0] = *humano;
+    if (construir_indice_donos(partida) != 0) return;
+    if (missoes_usam_sequencias() && construir_indice_sequencias(partida) != 0) return;
+    preparar_turnos(mesa, partida, partida->cores.total);
+    if (mesa->vivos == 0) return;
+
+    int j = mesa->primeiro_vivo;
+    for (;;) {
+        if (j != 0) {
+            int rival = mesa->proximo[j];
+            int cor_defensor = -1;
+            int atacou;
+            mensagem("\n--- Turno da IA: %s ---\n", mesa->jogadores[j].cor);
+            if (busca != NULL) {
+                atacou = jogar_politica_mcts(partida, mesa, j, busca, &cor_defensor);
+                if (atacou > 0 && busca->iteracoes > 0) mensagem("(MCTS: %lld iteracoes)\n", busca->iteracoes);
+            } else {
+                atacou = jogar_politica_scriptada(partida, &mesa->jogadores[j], blitz,
+                                                  rival != j ? mesa->jogadores[rival].id_cor : -1, &cor_defensor);
+            }
+            if (atacou > 0) {
+                int vivos = mesa->vivos;
+                registrar_ataque_mesa(mesa, partida, cor_defensor);
+                if (mesa->vivos < vivos) mensagem("O exercito %s foi eliminado!\n", nome_cor(&partida->cores, cor_defensor));
+            } else {
+                mensagem("%s nao tem ataque possivel.\n", mesa->jogadores[j].cor);
+            }
+        }
+        int proximo = mesa->proximo[j];
+        if (mesa->vivos == 0 || proximo <= j) break;
+        j = proximo;
+    }
+    pausar(2);
+}
+
+/**
+ * @brief Libera os recursos compartilhados do torneio: mapas modelo (carregados de arquivo),
+ * cores dos lados e o diario, se ainda estiver aberto.
+ */
+void liberar_torneio(Torneio* torneio) {
+    for (int m = 0; m < MAX_MAPAS_SIMULACAO; m++) {
+        descartar_partida(&torneio->modelos[m]);
+        liberar_mapa_compacto(&torneio->compactos[m]);
+        free(torneio->lados[m]);
+    }
+    if (torneio->diario.arquivo != NULL) fechar_diario(&torneio->diario);
+    pthread_mutex_destroy(&torneio->trava_diario);
+    liberar_pool_arenas(&torneio->arenas);
+}
+
+/**
+ * @brief Define os lados do mapa m. Um estado salvo (--map com snapshot) fornece os jogadores e
+ * as missoes, e todas as partidas do mapa partem dessa posicao; os lados que faltam (e os dos
+ * mapas comuns) sao as primeiras cores livres do mapa, com missao sorteada a cada partida.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int definir_lados(Torneio* torneio, int m, const EstadoSalvo* estado) {
+    const RegistroCores* cores = &torneio->modelos[m].cores;
+    int num_lados = torneio->config->num_jogadores;
+    int proxima_cor = 0;
+
+    torneio->lados[m] = (Jogador*)calloc((size_t)num_lados, sizeof(Jogador));
+    unsigned char* usada = (unsigned char*)calloc((size_t)cores->total, 1);
+    if (torneio->lados[m] == NULL || usada == NULL) {
+        perror("Erro ao alocar memoria para os lados da simulacao");
+        free(usada);
+        return 1;
+    }
+    for (int j = 0; j < num_lados && j < estado->num_jogadores; j++) usada[estado->jogadores[j].id_cor] = 1;
+
+    for (int j = 0; j < num_lados; j++) {
+        Jogador* lado = &torneio->lados[m][j];
+
+        if (j < estado->num_jogadores) {
+            *lado = estado->jogadores[j];
+            continue;
+        }
+        // Proxima cor que ainda nao e de nenhum lado.
+        while (usada[proxima_cor]) proxima_cor++;
+        lado->id_cor = proxima_cor;
+        strcpy(lado->cor, nome_cor(cores, proxima_cor));
+        lado->id_missao = -1;
+        usada[proxima_cor] = 1;
+    }
+    free(usada);
+    return 0;
+}
+
+/**
+ * @brief Modelo do mapa m do torneio, ou NULL se o mapa e gerado a cada partida.
+ */
+const Partida* modelo_simulacao(const Torneio* torneio, int m) {
+    return torneio->modelos[m].num_territorios > 0 ? &torneio->modelos[m] : NULL;
+}
+
+/**
+ * @brief Numero de territorios do mapa m do torneio (carregado de arquivo ou gerado).
+ */
+int tamanho_mapa_simulacao(const Torneio* torneio, int m) {
+    if (modelo_simulacao(torneio, m) != NULL) return torneio->modelos[m].num_territorios;
+    return torneio->config->tamanhos_mapa[m];
+}
+
+/**
+ * @brief Joga uma partida completa, sem interacao, ate uma vitoria por missao ou o limite de rodadas.
+ * Cada rodada percorre a roda de turnos (so os jogadores vivos), e cada jogador ataca o proximo
+ * jogador vivo. Depois de cada ataque so as missoes que dependem das duas cores envolvidas sao
+ * verificadas, entao o custo de um turno nao cresce com o numero de jogadores.
+ * @param partida Contexto da partida (mapa ja alocado e semente ja definida).
+ * @param modelo Mapa inicial carregado de arquivo, ou NULL para gerar um mapa aleatorio.
+ * @param compacto Territorios do modelo no formato compacto (--mapa-compacto), ou NULL para copiar
+ * os do proprio modelo.
+ * @param mesa Mesa com espaco para os lados (reservar_mesa).
+ * @param lados Jogadores iniciais (mesa->num_jogadores); os que tem id_missao -1 recebem uma missao sorteada.
+ * @param max_rodadas Limite de rodadas.
+ * @param blitz Ataques em blitz (--blitz).
+ * @param busca IA do lado 1 (--ia mcts), ou NULL para a politica scriptada em todos os lados.
+ * @param estatisticas Estatisticas do mapa onde o resultado e acumulado.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int jogar_partida_simulada(Partida* partida, const Partida* modelo, const MapaCompacto* compacto, MesaJogadores* mesa,
+                           const Jogador* lados, int max_rodadas, int blitz, BuscaMCTS* busca,
+                           EstatisticasMapa* estatisticas) {
+    Jogador* jogadores = mesa->jogadores;
+    int num_jogadores = mesa->num_jogadores;
+    int vencedor = -1;
+    int verificou = 0; // A primeira verificacao e completa; as seguintes, so das cores do ataque.
+    int rodada;
+
+    if (modelo != NULL) {
+        // Posicao inicial do arquivo: copia os territorios e os agregados ja calculados.
+        if (compacto != NULL) expandir_mapa_compacto(compacto, partida->mapa);
+        else memcpy(partida->mapa, modelo->mapa, (size_t)modelo->num_territorios * sizeof(Territorio));
+        memcpy(partida->agregados, modelo->agregados, (size_t)modelo->capacidade_agregados * sizeof(AgregadoDono));
+        if (modelo->grafo != NULL) memcpy(partida->fronteira, modelo->fronteira, (size_t)modelo->num_territorios);
+    } else if (gerar_mapa_simulacao(partida, num_jogadores) != 0) {
+        return 1;
+    }
+    if (construir_indice_donos(partida) != 0) return 1;
+    if (missoes_usam_sequencias() && construir_indice_sequencias(partida) != 0) return 1;
+
+    for (int j = 0; j < num_jogadores; j++) {
+        jogadores[j] = lados[j];
+        if (jogadores[j].id_missao < 0) atribuirMissao(&jogadores[j], partida);
+        estatisticas->sorteios_missao[jogadores[j].id_missao]++;
+    }
+    preparar_turnos(mesa, partida, partida->cores.total);
+
+    for (rodada = 0; rodada < max_rodadas && vencedor < 0 && mesa->vivos > 0; rodada++) {
+        int houve_ataque = 0;
+        int j = mesa->primeiro_vivo;
+
+        // Cada jogador vivo faz um ataque por rodada, em ordem crescente; a rodada termina
+        // quando a roda volta para um jogador de numero menor ou igual.
+        for (;;) {
+            int rival = mesa->proximo[j];
+            int cor_defensor = -1;
+            int atacou;
+            if (busca != NULL && j == 0) {
+                atacou = jogar_politica_mcts(partida, mesa, j, busca, &cor_defensor);
+                if (atacou < 0) return 1;
+                estatisticas->jogadas_ia++;
+                estatisticas->iteracoes_ia += busca->iteracoes;
+            } else {
+                atacou = jogar_politica_scriptada(partida, &jogadores[j], blitz,
+                                                  rival != j ? jogadores[rival].id_cor : -1, &cor_defensor);
+            }
+            houve_ataque |= atacou;
+            if (atacou) registrar_ataque_mesa(mesa, partida, cor_defensor);
+
+            if (!verificou) {
+                vencedor = avaliar_missoes(partida, jogadores, num_jogadores, j);
+                verificou = 1;
+            } else if (atacou) {
+                vencedor = avaliar_missoes_afetadas(partida, mesa, j, jogadores[j].id_cor, cor_defensor);
+            }
+            if (vencedor >= 0) break;
+
+            int proximo = mesa->proximo[j];
+            if (proximo <= j) break;
+            j = proximo;
+        }
+
+        // Nenhum lado consegue atacar: a partida travou.
+        if (!houve_ataque) break;
+    }
+
+    estatisticas->partidas++;
+    estatisticas->rodadas += rodada;
+    if (vencedor >= 0) {
+        estatisticas->vitorias_lado[vencedor]++;
+        estatisticas->vitorias_missao[jogadores[vencedor].id_missao]++;
+    } else {
+        estatisticas->empates++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Retira o proximo lote da fila da propria thread.
+ * @return int: O indice do lote, ou -1 se a fila esta vazia.
+ */
+int pegar_lote(FilaLotes* fila) {
+    int lote = -1;
+
+    pthread_mutex_lock(&fila->trava);
+    if (fila->inicio < fila->fim) {
+        lote = fila->inicio++;
+    }
+    pthread_mutex_unlock(&fila->trava);
+    return lote;
+}
+
+/**
+ * @brief Rouba metade dos lotes pendentes de outra thread para a fila da thread ociosa.
+ * @return int: Quantidade de lotes roubados (0 se a vitima nao tinha trabalho).
+ */
+int roubar_lotes(FilaLotes* vitima, FilaLotes* destino) {
+    int inicio, quantidade;
+
+    pthread_mutex_lock(&vitima->trava);
+    quantidade = (vitima->fim - vitima->inicio + 1) / 2;
+    vitima->fim -= quantidade;
+    inicio = vitima->fim;
+    pthread_mutex_unlock(&vitima->trava);
+
+    if (quantidade > 0) {
+        pthread_mutex_lock(&destino->trava);
+        destino->inicio = inicio;
+        destino->fim = inicio + quantidade;
+        pthread_mutex_unlock(&destino->trava);
+    }
+    return quantidade;
+}
+
+/**
+ * @brief Abre a sessao de uma partida simulada: a arena da thread e esvaziada (O(1)) e os vetores
+ * da partida (mapa, agregados, fronteiras) e dos jogadores sao reservados nela de novo. O indice de
+ * donos entra na mesma arena quando a partida o monta. Cores e grafo ficam fora da arena.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int abrir_sessao_simulada(Trabalhador* eu, int m) {
+    const Torneio* torneio = eu->torneio;
+    const Partida* modelo = modelo_simulacao(torneio, m);
+    Partida* partida = &eu->partidas[m];
+    int n = tamanho_mapa_simulacao(torneio, m);
+
+    if (reiniciar_arena(eu->arena) != 0) return 1;
+    esquecer_vetores_da_arena(partida);
+    partida->arena = eu->arena;
+    eu->mesa.arena = eu->arena;
+    liberar_mesa(&eu->mesa); // Com arena, so esquece os vetores.
+
+    if (alocar_mapa(partida, n) != 0) return 1;
+    if (garantir_agregados(partida, (modelo != NULL ? modelo->capacidade_agregados : partida->cores.total) - 1) != 0) return 1;
+    if (partida->grafo != NULL) {
+        partida->fronteira = (unsigned char*)alocar_na_arena(eu->arena, (size_t)n);
+        if (partida->fronteira == NULL) return 1;
+    }
+    return reservar_mesa(&eu->mesa, torneio->config->num_jogadores, partida->cores.total);
+}
+
+/**
+ * @brief Funcao de cada thread: joga os lotes da propria fila e, quando ela esvazia,
+ * rouba lotes das outras threads ate nao haver mais trabalho.
+ */
+void* executar_trabalhador(void* arg) {
+    Trabalhador* eu = (Trabalhador*)arg;
+    Torneio* torneio = eu->torneio;
+    const Configuracao* config = torneio->config;
+    int num_threads = config->num_threads;
+
+    for (;;) {
+        int lote = pegar_lote(&eu->fila);
+
+        if (lote < 0) {
+            int roubou = 0;
+            for (int k = 1; k < num_threads && !roubou; k++) {
+                Trabalhador* vitima = &torneio->trabalhadores[(eu->id + k) % num_threads];
+                roubou = roubar_lotes(&vitima->fila, &eu->fila) > 0;
+            }
+            if (!roubou) break; // Todas as filas estao vazias.
+            continue;
+        }
+
+        int primeira = lote * LOTE_PARTIDAS;
+        int ultima = primeira + LOTE_PARTIDAS;
+        if (ultima > config->num_partidas) ultima = config->num_partidas;
+
+        // Uma arena do pool por lote: ao devolve-la, qualquer thread pode reaproveita-la.
+        eu->arena = pegar_arena(&torneio->arenas);
+        if (eu->arena == NULL) eu->falhou = 1;
+
+        for (int i = primeira; i < ultima && !eu->falhou; i++) {
+            int m = i % config->num_mapas;
+            Partida* partida = &eu->partidas[m];
+            const Partida* modelo = modelo_simulacao(torneio, m);
+            const MapaCompacto* compacto = torneio->compactos[m].num_territorios > 0 ? &torneio->compactos[m] : NULL;
+
+            if (abrir_sessao_simulada(eu, m) != 0) {
+                eu->falhou = 1;
+                break;
+            }
+            iniciar_dados_partida(partida, config->semente, (uint64_t)i); // Um fluxo por partida.
+            if (partida->diario != NULL) diario_iniciar_partida(partida->diario, (uint64_t)i);
+            eu->falhou = jogar_partida_simulada(partida, modelo, compacto, &eu->mesa, torneio->lados[m],
+                                                config->max_rodadas, config->blitz, eu->busca, &eu->estatisticas[m]);
+            if (partida->diario != NULL) diario_finalizar_partida(partida->diario, hash_mapa(partida));
+            eu->estatisticas[m].bytes_arena += (long long)eu->arena->total;
+        }
+        for (int m = 0; m < config->num_mapas; m++) {
+            esquecer_vetores_da_arena(&eu->partidas[m]);
+            eu->partidas[m].arena = NULL;
+        }
+        liberar_mesa(&eu->mesa);
+        eu->mesa.arena = NULL;
+        if (eu->arena != NULL) devolver_arena(&torneio->arenas, eu->arena);
+        eu->arena = NULL;
+        if (eu->falhou) break;
+    }
+    juntar_estatisticas_thread(); // --stats: contadores desta thread entram no total.
+    liberar_tabela_probabilidades();
+    return NULL;
+}
+
+/**
+ * @brief Soma as estatisticas de origem nas de destino.
+ */
+void somar_estatisticas(EstatisticasMapa* destino, const EstatisticasMapa* origem) {
+    destino->partidas += origem->partidas;
+    destino->empates += origem->empates;
+    destino->rodadas += origem->rodadas;
+    destino->jogadas_ia += origem->jogadas_ia;
+    destino->iteracoes_ia += origem->iteracoes_ia;
+    destino->bytes_arena += origem->bytes_arena;
+    for (int j = 0; j < MAX_JOGADORES_SIMULACAO; j++) {
+        destino->vitorias_lado[j] += origem->vitorias_lado[j];
+    }
+    for (int m = 0; m < g_missoes.total; m++) {
+        destino->vitorias_missao[m] += origem->vitorias_missao[m];
+        destino->sorteios_missao[m] += origem->sorteios_missao[m];
+    }
+}
+
+#define MAX_LADOS_LISTADOS 8 // Com mais lados, so os que mais venceram sao listados.
+
+/**
+ * @brief Imprime as taxas de vitoria de um conjunto de estatisticas.
+ * @param e Estatisticas.
+ * @param lados Lados do mapa (para os nomes), ou NULL para nomes genericos.
+ * @param num_lados Quantidade de lados.
+ */
+void imprimir_estatisticas(const EstatisticasMapa* e, const Jogador* lados, int num_lados) {
+    double n = e->partidas > 0 ? (double)e->partidas : 1.0;
+    int listados[MAX_LADOS_LISTADOS];
+    int num_listados = 0;
+
+    // Os MAX_LADOS_LISTADOS lados com mais vitorias (todos, se couberem), em ordem de lado.
+    for (int j = 0; j < num_lados; j++) {
+        int pos = num_listados;
+        while (pos > 0 && e->vitorias_lado[j] > e->vitorias_lado[listados[pos - 1]]) pos--;
+        if (pos >= MAX_LADOS_LISTADOS) continue;
+        if (num_listados < MAX_LADOS_LISTADOS) num_listados++;
+        memmove(listados + pos + 1, listados + pos, (size_t)(num_listados - 1 - pos) * sizeof(int));
+        listados[pos] = j;
+    }
+    if (num_lados <= MAX_LADOS_LISTADOS) {
+        for (int k = 0; k < num_lados; k++) listados[k] = k;
+    }
+
+    for (int k = 0; k < num_listados; k++) {
+        int j = listados[k];
+        printf("  Vitorias lado %d %-9s: %10lld (%6.2f%%)\n", j + 1, lados != NULL ? lados[j].cor : "",
+               e->vitorias_lado[j], 100.0 * e->vitorias_lado[j] / n);
+    }
+    if (num_lados > num_listados) {
+        printf("  (mais %d lados, %d listados por numero de vitorias)\n", num_lados - num_listados, num_listados);
+    }
+    printf("  Sem vencedor            : %10lld (%6.2f%%)\n", e->empates, 100.0 * e->empates / n);
+    printf("  Rodadas por partida (media): %.2f\n", e->rodadas / n);
+    if (e->jogadas_ia > 0) {
+        printf("  IA MCTS (lado 1): %lld jogadas, %.1f iteracoes por jogada\n", e->jogadas_ia,
+               (double)e->iteracoes_ia / e->jogadas_ia);
+    }
+    printf("  Taxa de vitoria por missao (vitorias / vezes sorteada):\n");
+    for (int m = 0; m < g_missoes.total; m++) {
+        double taxa = e->sorteios_missao[m] > 0 ? 100.0 * e->vitorias_missao[m] / e->sorteios_missao[m] : 0.0;
+        printf("    [%d] %-48s %6.2f%% (%lld/%lld)\n", m, g_missoes.missoes[m].descricao, taxa, e->vitorias_missao[m], e->sorteios_missao[m]);
+    }
+}
+
+/**
+ * @brief Joga N partidas completas em varias threads, sem interacao, sem pausas e sem impressao
+ * passo a passo. Ao final imprime as taxas de vitoria (por mapa, por lado e por missao) e
+ * partidas por segundo. Para uma mesma semente o resultado e identico com qualquer numero de threads.
+ * @param config Parametros da simulacao.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha.
+ */
+int simular_partidas(const Configuracao* config) {
+    Torneio torneio;
+    EstatisticasMapa* por_mapa; // MAX_MAPAS_SIMULACAO estatisticas por mapa e, no fim, o total.
+    EstatisticasMapa* total;
+    pthread_t* threads;
+    struct timespec inicio, fim;
+    int num_threads = config->num_threads;
+    int falhou = 0;
+
+    memset(&torneio, 0, sizeof(torneio));
+    pthread_mutex_init(&torneio.trava_diario, NULL);
+    pthread_mutex_init(&torneio.arenas.trava, NULL);
+    torneio.config = config;
+    por_mapa = (EstatisticasMapa*)calloc(MAX_MAPAS_SIMULACAO + 1, sizeof(EstatisticasMapa));
+    if (por_mapa == NULL) {
+        perror("Erro ao alocar memoria para as estatisticas da simulacao");
+        liberar_torneio(&torneio);
+        return 1;
+    }
+    total = por_mapa + MAX_MAPAS_SIMULACAO;
+
+    // Mapas de arquivo sao carregados uma unica vez e copiados a cada partida;
+    // os mapas gerados so registram as cores dos lados.
+    for (int m = 0; m < config->num_mapas && !falhou; m++) {
+        Partida* modelo = &torneio.modelos[m];
+        EstadoSalvo estado = {0};
+        if (config->arquivos_mapa[m] == NULL) {
+            if (registrar_cores_simulacao(&modelo->cores, config->num_jogadores) != 0) falhou = 1;
+        } else if (carregar_estado(modelo, &estado, config->arquivos_mapa[m]) != 0) {
+            falhou = 1;
+        } else if (modelo->cores.total < config->num_jogadores) {
+            fprintf(stderr, "Erro: o mapa '%s' precisa de pelo menos %d cores para a simulacao.\n",
+                    config->arquivos_mapa[m], config->num_jogadores);
+            falhou = 1;
+        }
+        if (!falhou && definir_lados(&torneio, m, &estado) != 0) falhou = 1;
+    }
+    if (!falhou && config->arquivo_diario != NULL) {
+        // O diario guarda um unico mapa inicial, entao so vale para um mapa carregado de arquivo.
+        if (config->num_mapas != 1 || config->arquivos_mapa[0] == NULL) {
+            printf("Erro: --diario na simulacao exige exatamente um mapa de arquivo (--map).\n");
+            falhou = 1;
+        } else if (abrir_diario(&torneio.diario, config->arquivo_diario, &torneio.modelos[0]) != 0) {
+            falhou = 1;
+        }
+    }
+    // --mapa-compacto: o modelo guarda so tropas, donos e nomes distintos (o diario ja gravou o
+    // mapa inicial); cada partida expande o seu mapa a partir dele.
+    for (int m = 0; m < config->num_mapas && !falhou && config->mapa_compacto; m++) {
+        Partida* modelo = &torneio.modelos[m];
+        if (modelo->mapa == NULL) continue;
+        if (compactar_mapa(modelo, &torneio.compactos[m]) != 0) {
+            falhou = 1;
+        } else {
+            liberar_indice_nomes(modelo);
+            soltar_vetor(modelo->arena, modelo->mapa);
+            modelo->mapa = NULL;
+        }
+    }
+    if (falhou) {
+        free(por_mapa);
+        liberar_torneio(&torneio);
+        return 1;
+    }
+
+    g_modo_silencioso = 1;
+
+    torneio.num_lotes = (config->num_partidas + LOTE_PARTIDAS - 1) / LOTE_PARTIDAS;
+    torneio.trabalhadores = (Trabalhador*)calloc(num_threads, sizeof(Trabalhador));
+    threads = (pthread_t*)calloc(num_threads, sizeof(pthread_t));
+    if (torneio.trabalhadores == NULL || threads == NULL) {
+        perror("Erro ao alocar memoria para as threads da simulacao");
+        free(torneio.trabalhadores);
+        free(threads);
+        free(por_mapa);
+        liberar_torneio(&torneio);
+        return 1;
+    }
+
+    // Cada thread recebe uma faixa contigua de lotes e seus proprios mapas.
+    for (int t = 0; t < num_threads; t++) {
+        Trabalhador* w = &torneio.trabalhadores[t];
+        w->id = t;
+        w->torneio = &torneio;
+        pthread_mutex_init(&w->fila.trava, NULL);
+        w->fila.inicio = (int)((long long)torneio.num_lotes * t / num_threads);
+        w->fila.fim = (int)((long long)torneio.num_lotes * (t + 1) / num_threads);
+
+        // Fora da arena ficam so as cores e o grafo (do modelo); os vetores de cada partida sao
+        // reservados na arena do lote (abrir_sessao_simulada).
+        for (int m = 0; m < config->num_mapas; m++) {
+            Partida* partida = &w->partidas[m];
+            if (modelo_simulacao(&torneio, m) != NULL) {
+                if (copiar_registro_cores(&partida->cores, &torneio.modelos[m].cores) != 0) falhou = 1;
+                partida->grafo = torneio.modelos[m].grafo;
+                partida->grafo_compartilhado = 1;
+            } else if (registrar_cores_simulacao(&partida->cores, config->num_jogadores) != 0) {
+                falhou = 1;
+            }
+        }
+        if (config->ia_mcts) {
+            // Na simulacao as partidas ja ocupam os nucleos: por padrao, uma thread de rollouts por partida.
+            ParametrosMCTS parametros = { config->ia_ms, config->ia_threads > 0 ? config->ia_threads : 1,
+                                          config->ia_iteracoes, config->blitz };
+            w->busca = (BuscaMCTS*)malloc(sizeof(BuscaMCTS));
+            if (w->busca == NULL || iniciar_busca_mcts(w->busca, &parametros) != 0) falhou = 1;
+        }
+        if (torneio.diario.arquivo != NULL) {
+            if (iniciar_buffer_diario(&w->diario, torneio.diario.arquivo, &torneio.trava_diario) != 0) falhou = 1;
+            w->partidas[0].diario = &w->diario;
+        }
+    }
+
+    if (falhou) {
+        perror("Erro ao alocar memoria para os mapas da simulacao");
+    } else {
+        // Se uma thread nao puder ser criada, as que ja rodam roubam os lotes das que faltaram.
+        int iniciadas = 0, erro = 0;
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        for (int t = 0; t < num_threads && erro == 0; t++) {
+            erro = pthread_create(&threads[t], NULL, executar_trabalhador, &torneio.trabalhadores[t]);
+            if (erro == 0) iniciadas++;
+        }
+        for (int t = 0; t < iniciadas; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &fim);
+        if (iniciadas == 0) {
+            fprintf(stderr, "Erro ao criar as threads da simulacao: %s\n", strerror(erro));
+            falhou = 1;
+        }
+    }
+
+    for (int t = 0; t < num_threads; t++) {
+        Trabalhador* w = &torneio.trabalhadores[t];
+        if (w->falhou) falhou = 1;
+        for (int m = 0; m < config->num_mapas; m++) {
+            somar_estatisticas(&por_mapa[m], &w->estatisticas[m]);
+            descartar_partida(&w->partidas[m]);
+        }
+        liberar_mesa(&w->mesa);
+        if (w->busca != NULL) {
+            liberar_busca_mcts(w->busca);
+            free(w->busca);
+        }
+        if (w->diario.buffer != NULL) {
+            // Partidas restantes no buffer da thread; os eventos entram no total do diario.
+            descarregar_diario(&w->diario);
+            torneio.diario.eventos += w->diario.eventos;
+            torneio.diario.erro |= w->diario.erro;
+            free(w->diario.buffer);
+        }
+        pthread_mutex_destroy(&w->fila.trava);
+    }
+    free(torneio.trabalhadores);
+    free(threads);
+    g_modo_silencioso = 0;
+    if (torneio.diario.arquivo != NULL && fechar_diario(&torneio.diario) != 0) falhou = 1;
+
+    if (falhou) {
+        free(por_mapa);
+        liberar_torneio(&torneio);
+        return 1;
+    }
+
+    for (int m = 0; m < config->num_mapas; m++) {
+        somar_estatisticas(total, &por_mapa[m]);
+    }
+
+    double segundos = (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+
+    printf("==========================================\n");
+    printf("         RESULTADO DA SIMULACAO \n");
+    printf("==========================================\n");
+    printf("Partidas: %d | Threads: %d | Semente: %llu | Limite de rodadas: %d | Jogadores: %d\n",
+           config->num_partidas, num_threads, (unsigned long long)config->semente, config->max_rodadas,
+           config->num_jogadores);
+    if (config->num_mapas > 1) {
+        for (int m = 0; m < config->num_mapas; m++) {
+            printf("\nMapa %d (%s, %d territorios): %lld partidas\n", m + 1,
+                   config->arquivos_mapa[m] != NULL ? config->arquivos_mapa[m] : "gerado",
+                   tamanho_mapa_simulacao(&torneio, m), por_mapa[m].partidas);
+            imprimir_estatisticas(&por_mapa[m], torneio.lados[m], config->num_jogadores);
+        }
+        printf("\nTodos os mapas:\n");
+        imprimir_estatisticas(total, NULL, config->num_jogadores);
+    } else {
+        printf("\nMapa com %d territorios:\n", tamanho_mapa_simulacao(&torneio, 0));
+        imprimir_estatisticas(total, torneio.lados[0], config->num_jogadores);
+    }
+    printf("\nTempo: %.3f s | %.0f partidas/s | Arena: %.0f bytes por partida (%d arenas no pool)\n", segundos,
+           segundos > 0 ? config->num_partidas / segundos : 0.0,
+           total->partidas > 0 ? (double)total->bytes_arena / total->partidas : 0.0, torneio.arenas.criadas);
+    if (config->arquivo_diario != NULL) {
+        printf("Diario: %lld batalhas gravadas em '%s'\n", torneio.diario.eventos, config->arquivo_diario);
+    }
+    printf("==========================================\n");
+
+    free(por_mapa);
+    liberar_torneio(&torneio);
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Versoes do Mapa (copia na escrita): desfazer e analise de jogadas ---
+// ------------------------------------------------------------------------------------------------
+// O dono e as tropas de cada territorio ficam tambem numa arvore persistente: paginas de
+// RAMOS_VERSAO territorios nas folhas e nos internos com RAMOS_VERSAO filhos. Uma versao e so um
+// ponteiro para a raiz, com contagem de referencias, entao bifurcar e O(1). Mudar um territorio copia
+// so o caminho da raiz ate a sua pagina, e so os nos ainda compartilhados com outra versao; os demais
+// continuam compartilhados. O mapa da partida segue sendo o estado usado pelo jogo: voltar para uma
+// versao compara as duas arvores, pula as subarvores iguais (mesmo ponteiro) e reaplica so os
+// territorios diferentes com transferir_territorio e alterar_tropas (agregados, fronteiras e indices
+// continuam certos). Bifurcar, atacar e descartar custam o tamanho da mudanca, nao o do mapa.
+
+#define BITS_VERSAO 6
+#define RAMOS_VERSAO (1 << BITS_VERSAO) // Territorios por pagina e filhos por no interno.
+#define NOS_POR_BLOCO_VERSAO 1024       // Nos alocados de uma vez; os soltos voltam para a lista livre.
+#define MAX_DESFAZER 64                 // Rodadas guardadas para o "Desfazer" (as mais antigas saem).
+
+typedef struct {
+    int32_t dono;
+    int32_t tropas;
+} EstadoTerritorio;
+
+// No da arvore de versoes: no interno (filhos) ou pagina de territorios (folha).
+typedef struct NoVersao {
+    uint32_t referencias; // Versoes e nos pais que apontam para o no.
+    union {
+        struct NoVersao* filhos[RAMOS_VERSAO];      // NULL = alem do fim do mapa.
+        EstadoTerritorio territorios[RAMOS_VERSAO];
+        struct NoVersao* proximo_livre;             // No na lista livre.
+    };
+} NoVersao;
+
+typedef struct BlocoVersoes {
+    struct BlocoVersoes* anterior;
+    NoVersao nos[NOS_POR_BLOCO_VERSAO];
+} BlocoVersoes;
+
+// Uma rodada guardada para o "Desfazer": a versao do mapa e os jogadores de antes dela.
+typedef struct {
+    NoVersao* versao;
+    Jogador* jogadores;
+    int num_jogadores;
+    long long rodada;
+} EntradaDesfazer;
+
+typedef struct HistoricoVersoes {
+    NoVersao* atual;       // Versao igual ao mapa da partida.
+    int altura;            // Niveis de nos internos acima das paginas.
+    int gravando;          // 0 enquanto voltar_para_versao reaplica uma versao que ja existe.
+    int sem_memoria;       // Uma copia falhou: as versoes nao acompanham mais o mapa.
+    NoVersao* livres;
+    BlocoVersoes* blocos;
+    long long nos_em_uso;
+    long long nos_alocados;
+    EntradaDesfazer desfazer[MAX_DESFAZER]; // Pilha circular (a entrada mais antiga e sobrescrita).
+    int inicio_desfazer;
+    int num_desfazer;
+} HistoricoVersoes;
+
+/**
+ * @brief Pega um no da lista livre (alocando um bloco novo se ela estiver vazia), com uma referencia.
+ * @return NoVersao*: O no, ou NULL se faltou memoria.
+ */
+static NoVersao* novo_no_versao(HistoricoVersoes* h) {
+    if (h->livres == NULL) {
+        BlocoVersoes* bloco = (BlocoVersoes*)malloc(sizeof(BlocoVersoes));
+        if (bloco == NULL) return NULL;
+        bloco->anterior = h->blocos;
+        h->blocos = bloco;
+        for (int k = NOS_POR_BLOCO_VERSAO - 1; k >= 0; k--) {
+            bloco->nos[k].proximo_livre = h->livres;
+            h->livres = &bloco->nos[k];
+        }
+        h->nos_alocados += NOS_POR_BLOCO_VERSAO;
+    }
+    NoVersao* no = h->livres;
+    h->livres = no->proximo_livre;
+    no->referencias = 1;
+    h->nos_em_uso++;
+    return no;
+}
+
+/**
+ * @brief Solta uma referencia a um no; o no que fica sem referencias volta para a lista livre e
+ * solta os filhos. So os nos exclusivos da versao descartada sao percorridos.
+ * @param altura Altura do no (0 = pagina).
+ */
+static void soltar_no_versao(HistoricoVersoes* h, NoVersao* no, int altura) {
+    if (no == NULL || --no->referencias > 0) return;
+    if (altura > 0) {
+        for (int k = 0; k < RAMOS_VERSAO; k++) soltar_no_versao(h, no->filhos[k], altura - 1);
+    }
+    no->proximo_livre = h->livres;
+    h->livres = no;
+    h->nos_em_uso--;
+}
+
+/**
+ * @brief Monta a subarvore dos territorios a partir de inicio (a versao inicial, copiada do mapa).
+ * @return NoVersao*: A raiz da subarvore, ou NULL se faltou memoria.
+ */
+static NoVersao* montar_no_versao(HistoricoVersoes* h, const Partida* partida, int altura, long long inicio) {
+    NoVersao* no = novo_no_versao(h);
+    if (no == NULL) return NULL;
+
+    if (altura == 0) {
+        for (int k = 0; k < RAMOS_VERSAO; k++) {
+            long long i = inicio + k;
+            no->territorios[k].dono = i < partida->num_territorios ? partida->mapa[i].dono : -1;
+            no->territorios[k].tropas = i < partida->num_territorios ? partida->mapa[i].tropas : 0;
+        }
+        return no;
+    }
+    long long passo = 1LL << (BITS_VERSAO * altura);
+    memset(no->filhos, 0, sizeof(no->filhos));
+    for (int k = 0; k < RAMOS_VERSAO && inicio + k * passo < partida->num_territorios; k++) {
+        no->filhos[k] = montar_no_versao(h, partida, altura - 1, inicio + k * passo);
+        if (no->filhos[k] == NULL) {
+            soltar_no_versao(h, no, altura);
+            return NULL;
+        }
+    }
+    return no;
+}
+
+/**
+ * @brief Libera as versoes do mapa (e as rodadas guardadas para o desfazer) de uma vez, bloco a bloco.
+ */
+void liberar_versoes(Partida* partida) {
+    HistoricoVersoes* h = partida->versoes;
+    if (h == NULL) return;
+
+    for (int k = 0; k < h->num_desfazer; k++) free(h->desfazer[(h->inicio_desfazer + k) % MAX_DESFAZER].jogadores);
+    while (h->blocos != NULL) {
+        BlocoVersoes* anterior = h->blocos->anterior;
+        free(h->blocos);
+        h->blocos = anterior;
+    }
+    free(h);
+    partida->versoes = NULL;
+}
+
+/**
+ * @brief Liga as versoes do mapa: monta a versao inicial (O(n), uma vez). Depois disso cada
+ * transferir_territorio e alterar_tropas tambem grava a mudanca na versao atual.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int iniciar_versoes(Partida* partida) {
+    HistoricoVersoes* h = (HistoricoVersoes*)calloc(1, sizeof(HistoricoVersoes));
+    if (h == NULL) return 1;
+
+    for (long long capacidade = RAMOS_VERSAO; capacidade < partida->num_territorios; capacidade *= RAMOS_VERSAO) {
+        h->altura++;
+    }
+    partida->versoes = h;
+    h->atual = montar_no_versao(h, partida, h->altura, 0);
+    if (h->atual == NULL) {
+        perror("Erro ao alocar memoria para as versoes do mapa");
+        liberar_versoes(partida);
+        return 1;
+    }
+    h->gravando = 1;
+    return 0;
+}
+
+/**
+ * @brief Grava o dono e as tropas atuais do territorio i na versao atual (chamada por
+ * transferir_territorio e alterar_tropas). Os nos do caminho ainda compartilhados com outra versao
+ * sao copiados antes; os outros sao alterados no lugar. O(altura), sem depender do mapa.
+ */
+void registrar_mudanca_versao(Partida* partida, uint32_t i) {
+    HistoricoVersoes* h = partida->versoes;
+    NoVersao** lugar = &h->atual;
+
+    if (!h->gravando) return;
+    for (int altura = h->altura;; altura--) {
+        NoVersao* no = *lugar;
+        if (no->referencias > 1) {
+            NoVersao* copia = novo_no_versao(h);
+            if (copia == NULL) {
+                // Sem memoria: o mapa segue certo, mas as versoes deixam de valer (ver versoes_validas).
+                h->sem_memoria = 1;
+                h->gravando = 0;
+                return;
+            }
+            *copia = *no;
+            copia->referencias = 1;
+            if (altura > 0) {
+                for (int k = 0; k < RAMOS_VERSAO; k++) {
+                    if (no->filhos[k] != NULL) no->filhos[k]->referencias++;
+                }
+            }
+            no->referencias--;
+            *lugar = no = copia;
+        }
+        if (altura == 0) {
+            no->territorios[i & (RAMOS_VERSAO - 1)].dono = partida->mapa[i].dono;
+            no->territorios[i & (RAMOS_VERSAO - 1)].tropas = partida->mapa[i].tropas;
+            return;
+        }
+        lugar = &no->filhos[(i >> (BITS_VERSAO * altura)) & (RAMOS_VERSAO - 1)];
+    }
+}
+
+/**
+ * @brief Garante nos livres para as copias de ate quantidade territorios alterados (um ataque muda
+ * dois), para que registrar_mudanca_versao nao falhe no meio de uma analise.
+ * @return int: 0 em caso de sucesso, 1 se faltou memoria.
+ */
+static int reservar_nos_versao(HistoricoVersoes* h, int quantidade) {
+    NoVersao* reservados = NULL;
+    int erro = 0;
+
+    // Pega e devolve os nos: o que importa sao os blocos alocados no caminho.
+    for (int k = 0; k < quantidade * (h->altura + 1); k++) {
+        NoVersao* no = novo_no_versao(h);
+        if (no == NULL) {
+            erro = 1;
+            break;
+        }
+        no->proximo_livre = reservados;
+        reservados = no;
+    }
+    while (reservados != NULL) {
+        NoVersao* proximo = reservados->proximo_livre;
+        reservados->proximo_livre = h->livres;
+        h->livres = reservados;
+        h->nos_em_uso--;
+        reservados = proximo;
+    }
+    return erro;
+}
+
+/**
+ * @brief Diz se as versoes estao ligadas e acompanham o mapa.
+ */
+static inline int versoes_validas(const Partida* partida) {
+    return partida->versoes != NULL && !partida->versoes->sem_memoria;
+}
+
+/**
+ * @brief Bifurca a versao atual: a versao devolvida nao muda mais, por mais que a partida siga. O(1).
+ * Deve ser solta com soltar_versao.
+ */
+NoVersao* bifurcar_versao(Partida* partida) {
+    partida->versoes->atual->referencias++;
+    return partida->versoes->atual;
+}
+
+/**
+ * @brief Descarta uma versao bifurcada: so os nos exclusivos dela voltam para a lista livre.
+ */
+void soltar_versao(Partida* partida, NoVersao* versao) {
+    soltar_no_versao(partida->versoes, versao, partida->versoes->altura);
+}
+
+/**
+ * @brief Reaplica no mapa os territorios que diferem entre duas subarvores (as iguais sao puladas).
+ */
+static void aplicar_diferencas_versao(Partida* partida, const NoVersao* de, const NoVersao* para, int altura,
+                                      long long inicio, int* mudancas) {
+    if (de == para) return;
+    if (altura == 0) {
+        for (int k = 0; k < RAMOS_VERSAO && inicio + k < partida->num_territorios; k++) {
+            const EstadoTerritorio* e = &para->territorios[k];
+            Territorio* t = partida->mapa + inicio + k;
+            if (t->dono == e->dono && t->tropas == e->tropas) continue;
+            if (t->dono != e->dono) transferir_territorio(partida, t, e->dono);
+            if (t->tropas != e->tropas) alterar_tropas(partida, t, e->tropas);
+            (*mudancas)++;
+        }
+        return;
+    }
+    long long passo = 1LL << (BITS_VERSAO * altura);
+    for (int k = 0; k < RAMOS_VERSAO && para->filhos[k] != NULL; k++) {
+        aplicar_diferencas_versao(partida, de->filhos[k], para->filhos[k], altura - 1, inicio + k * passo, mudancas);
+    }
+}
+
+/**
+ * @brief Volta o mapa da partida para uma versao bifurcada antes (que continua valendo). O custo e o
+ * dos territorios diferentes entre a versao atual e a pedida, mais o caminho ate eles.
+ * @return int: Quantidade de territorios alterados no mapa.
+ */
+int voltar_para_versao(Partida* partida, NoVersao* versao) {
+    HistoricoVersoes* h = partida->versoes;
+    int mudancas = 0;
+
+    h->gravando = 0;
+    aplicar_diferencas_versao(partida, h->atual, versao, h->altura, 0, &mudancas);
+    h->gravando = 1;
+    versao->referencias++;
+    soltar_no_versao(h, h->atual, h->altura);
+    h->atual = versao;
+    return mudancas;
+}
+
+/**
+ * @brief Guarda o inicio de uma rodada para o "Desfazer": bifurca o mapa e copia os jogadores.
+ * Liga as versoes na primeira chamada (e de novo se uma copia ficou sem memoria).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao (a rodada nao podera ser desfeita).
+ */
+int guardar_rodada_desfazer(Partida* partida, const Jogador* jogadores, int num_jogadores, long long rodada) {
+    if (partida->versoes != NULL && partida->versoes->sem_memoria) liberar_versoes(partida);
+    if (partida->versoes == NULL && iniciar_versoes(partida) != 0) return 1;
+    HistoricoVersoes* h = partida->versoes;
+
+    Jogador* copia = (Jogador*)malloc((size_t)num_jogadores * sizeof(Jogador));
+    if (copia == NULL) return 1;
+    memcpy(copia, jogadores, (size_t)num_jogadores * sizeof(Jogador));
+    if (h->num_desfazer == MAX_DESFAZER) {
+        // Pilha cheia: a rodada mais antiga sai.
+        EntradaDesfazer* antiga = &h->desfazer[h->inicio_desfazer];
+        soltar_versao(partida, antiga->versao);
+        free(antiga->jogadores);
+        h->inicio_desfazer = (h->inicio_desfazer + 1) % MAX_DESFAZER;
+        h->num_desfazer--;
+    }
+    EntradaDesfazer* entrada = &h->desfazer[(h->inicio_desfazer + h->num_desfazer) % MAX_DESFAZER];
+    entrada->versao = bifurcar_versao(partida);
+    entrada->jogadores = copia;
+    entrada->num_jogadores = num_jogadores;
+    entrada->rodada = rodada;
+    h->num_desfazer++;
+    return 0;
+}
+
+/**
+ * @brief Desfaz a ultima rodada guardada: o mapa volta a versao do inicio dela (so os territorios
+ * que mudaram sao reescritos) e os jogadores e o numero da rodada voltam aos de entao.
+ * @return int: Territorios restaurados, ou -1 se nao ha rodada para desfazer.
+ */
+int desfazer_rodada(Partida* partida, Jogador* jogadores, int num_jogadores, long long* rodada) {
+    HistoricoVersoes* h = partida->versoes;
+    if (!versoes_validas(partida) || h->num_desfazer == 0) return -1;
+
+    EntradaDesfazer* entrada = &h->desfazer[(h->inicio_desfazer + h->num_desfazer - 1) % MAX_DESFAZER];
+    int mudancas = voltar_para_versao(partida, entrada->versao);
+    memcpy(jogadores, entrada->jogadores,
+           (size_t)(num_jogadores < entrada->num_jogadores ? num_jogadores : entrada->num_jogadores) * sizeof(Jogador));
+    *rodada = entrada->rodada;
+    soltar_versao(partida, entrada->versao);
+    free(entrada->jogadores);
+    h->num_desfazer--;
+    return mudancas;
+}
+
+// Analise de jogadas (opcao "a" do menu de ataque): o ataque escolhido e sorteado AMOSTRAS_ANALISE
+// vezes e cada resultado vira um ramo; a partir de cada ramo vivo, os CONTINUACOES_ANALISE melhores
+// ataques seguintes do jogador viram ramos novos (uma bifurcacao cada). A cada nivel ficam os
+// LARGURA_ANALISE ramos de maior nota (progresso da missao); os outros sao descartados. Todos os
+// ramos sao versoes do mesmo mapa e so guardam as paginas que mudaram.
+#define AMOSTRAS_ANALISE 64            // Resultados sorteados para o ataque escolhido.
+#define PROFUNDIDADE_ANALISE 3         // Ataques seguintes explorados depois do escolhido.
+#define CONTINUACOES_ANALISE 8         // Ataques seguintes tentados a partir de cada ramo.
+#define LARGURA_ANALISE 256            // Ramos mantidos de um nivel para o proximo.
+#define LIMITE_NOS_ANALISE (1 << 16)   // Nos novos da analise (~33 MiB); no limite, os ramos param de crescer.
+#define TERRITORIOS_CANDIDATOS_ANALISE 4096 // Territorios do jogador (e de cada rival) olhados por ramo.
+
+typedef struct {
+    NoVersao* versao;
+    Jogador jogador;   // Jogador no ramo (o contador de conquistas muda com os ataques).
+    double progresso;  // Progresso da missao no ramo (0 a 1).
+    double nota;       // Progresso com desempate pela fracao do mapa do jogador.
+    int amostra;       // Resultado do ataque escolhido de onde o ramo saiu.
+    int num_acoes;
+    AcaoAtaque acoes[PROFUNDIDADE_ANALISE]; // Ataques seguintes do ramo.
+} RamoAnalise;
+
+// Resultado da analise de um modo de ataque (uma batalha ou blitz).
+typedef struct {
+    int amostras;
+    int conquistas;            // Amostras em que o defensor foi conquistado ja no ataque escolhido.
+    int missoes_cumpridas;     // Amostras com alguma continuacao que cumpre a missao.
+    double progresso_medio;    // Media, por amostra, do progresso da melhor continuacao.
+    RamoAnalise melhor;        // Melhor ramo encontrado (a versao ja foi solta).
+    long long ramos;           // Ramos criados.
+    int pico_ramos;            // Maior numero de ramos vivos ao mesmo tempo.
+    long long pico_nos;        // Maior numero de nos novos (paginas e nos internos copiados).
+    int truncada;              // O limite de nos parou a exploracao.
+} ResultadoAnalise;
+
+/**
+ * @brief Territorio mais fraco de uma cor entre os TERRITORIOS_CANDIDATOS_ANALISE primeiros da sua
+ * lista no indice de donos (os conquistados por ultimo ficam no inicio).
+ * @return int: Indice do territorio, ou -1 se a cor nao tem territorios.
+ */
+static int territorio_fraco_analise(const Partida* partida, int cor) {
+    int melhor = -1, olhados = 0;
+
+    for (int32_t i = partida->primeiro_do_dono[cor]; i >= 0 && olhados < TERRITORIOS_CANDIDATOS_ANALISE;
+         i = partida->proximo_do_dono[i], olhados++) {
+        if (melhor < 0 || partida->mapa[i].tropas < partida->mapa[melhor].tropas) melhor = i;
+    }
+    return melhor;
+}
+
+/**
+ * @brief Ataques seguintes do jogador num ramo, do melhor para o pior pela heuristica da IA (tropas
+ * do atacante menos as do defensor, com prioridade para a cor alvo da missao). Com grafo, os alvos
+ * sao os vizinhos inimigos; sem grafo, o territorio mais fraco da cor alvo e das MAX_RIVAIS_MCTS
+ * cores seguintes com territorios.
+ * @param acoes Vetor com CONTINUACOES_ANALISE posicoes.
+ * @return int: Quantidade de ataques (0 = nenhum possivel).
+ */
+static int gerar_ataques_analise(const Partida* partida, const Jogador* jogador, AcaoAtaque* acoes) {
+    int alvo_missao = jogador->alvo_missao != jogador->id_cor ? jogador->alvo_missao : -1;
+    int alvos[MAX_RIVAIS_MCTS + 1];
+    int pontos[CONTINUACOES_ANALISE];
+    int num_alvos = 0, num_acoes = 0, olhados = 0;
+
+    if (partida->grafo == NULL) {
+        int num_cores = partida->cores.total;
+        if (alvo_missao >= 0 && agregado_dono(partida, alvo_missao).territorios > 0) {
+            alvos[num_alvos++] = territorio_fraco_analise(partida, alvo_missao);
+        }
+        for (int k = 1; k < num_cores && k <= 8 * MAX_RIVAIS_MCTS && num_alvos <= MAX_RIVAIS_MCTS; k++) {
+            int cor = (jogador->id_cor + k) % num_cores;
+            if (cor != alvo_missao && agregado_dono(partida, cor).territorios > 0) {
+                alvos[num_alvos++] = territorio_fraco_analise(partida, cor);
+            }
+        }
+    }
+
+    for (int32_t a = partida->primeiro_do_dono[jogador->id_cor]; a >= 0 && olhados < TERRITORIOS_CANDIDATOS_ANALISE;
+         a = partida->proximo_do_dono[a], olhados++) {
+        int tropas = partida->mapa[a].tropas;
+        const uint32_t* vizinhos = NULL;
+        int num_candidatos = num_alvos;
+
+        if (tropas < 2) continue;
+        if (partida->grafo != NULL) {
+            if (!partida->fronteira[a]) continue;
+            vizinhos = partida->grafo->vizinhos + partida->grafo->inicio[a];
+            num_candidatos = (int)(partida->grafo->inicio[a + 1] - partida->grafo->inicio[a]);
+        }
+        for (int k = 0; k < num_candidatos; k++) {
+            int d = vizinhos != NULL ? (int)vizinhos[k] : alvos[k];
+            if (partida->mapa[d].dono == jogador->id_cor) continue;
+            int p = tropas - partida->mapa[d].tropas + (partida->mapa[d].dono == alvo_missao ? BONUS_ALVO_MCTS : 0);
+
+            // Insercao ordenada, mantendo so as CONTINUACOES_ANALISE melhores.
+            int pos = num_acoes;
+            while (pos > 0 && p > pontos[pos - 1]) pos--;
+            if (pos >= CONTINUACOES_ANALISE) continue;
+            if (num_acoes < CONTINUACOES_ANALISE) num_acoes++;
+            memmove(acoes + pos + 1, acoes + pos, (size_t)(num_acoes - 1 - pos) * sizeof(AcaoAtaque));
+            memmove(pontos + pos + 1, pontos + pos, (size_t)(num_acoes - 1 - pos) * sizeof(int));
+            acoes[pos].atacante = a;
+            acoes[pos].defensor = d;
+            pontos[pos] = p;
+        }
+    }
+    return num_acoes;
+}
+
+/**
+ * @brief Ordena os ramos da maior para a menor nota (qsort).
+ */
+static int comparar_ramos(const void* a, const void* b) {
+    double x = ((const RamoAnalise*)a)->nota, y = ((const RamoAnalise*)b)->nota;
+    return (x < y) - (x > y);
+}
+
+/**
+ * @brief Ataca no ramo atual (sem mensagens) e cria o ramo filho: uma bifurcacao da versao
+ * resultante, com o progresso da missao do jogador.
+ */
+static void criar_ramo_analise(Partida* partida, RamoAnalise* filho, int atacante, int defensor, int blitz,
+                               long long valor_inicial) {
+    if (blitz) atacar_blitz(partida, partida->mapa + atacante, partida->mapa + defensor, &filho->jogador, NULL);
+    else atacar(partida, partida->mapa + atacante, partida->mapa + defensor, &filho->jogador);
+
+    filho->versao = bifurcar_versao(partida);
+    if (missao_cumprida(&filho->jogador, partida)) filho->progresso = 1.0;
+    else filho->progresso = fmin(progresso_missao(&filho->jogador, partida, valor_inicial), 0.999);
+    filho->nota = filho->progresso + 1e-3 * agregado_dono(partida, filho->jogador.id_cor).territorios /
+                                         (partida->num_territorios > 0 ? partida->num_territorios : 1);
+}
+
+/**
+ * @brief Explora o ataque escolhido em um modo (uma batalha ou blitz) e as continuacoes do jogador
+ * a partir da versao atual, que e restaurada no fim.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+static int explorar_ataque(Partida* partida, const Jogador* jogador, int atacante, int defensor, int blitz,
+                           ResultadoAnalise* r) {
+    HistoricoVersoes* h = partida->versoes;
+    const Missao* missao = &g_missoes.missoes[jogador->id_missao];
+    long long valor_inicial = valor_metrica_missao(missao, jogador, jogador->alvo_missao, partida);
+    size_t capacidade = (size_t)LARGURA_ANALISE * CONTINUACOES_ANALISE + AMOSTRAS_ANALISE;
+    RamoAnalise* ramos = (RamoAnalise*)malloc(capacidade * sizeof(RamoAnalise));
+    RamoAnalise* proximos = (RamoAnalise*)malloc(capacidade * sizeof(RamoAnalise));
+    double melhor_progresso[AMOSTRAS_ANALISE];
+    int num_ramos = 0;
+
+    memset(r, 0, sizeof(*r));
+    if (ramos == NULL || proximos == NULL) {
+        free(ramos);
+        free(proximos);
+        return 1;
+    }
+    NoVersao* raiz = bifurcar_versao(partida);
+    long long nos_iniciais = h->nos_em_uso;
+
+    // 1. O ataque escolhido: cada amostra sorteia um resultado.
+    for (int s = 0; s < AMOSTRAS_ANALISE; s++) {
+        RamoAnalise* ramo = &ramos[num_ramos];
+        voltar_para_versao(partida, raiz);
+        if (reservar_nos_versao(h, 2) != 0) break;
+        memset(ramo, 0, sizeof(*ramo));
+        ramo->jogador = *jogador;
+        ramo->amostra = s;
+        criar_ramo_analise(partida, ramo, atacante, defensor, blitz, valor_inicial);
+        r->conquistas += partida->mapa[defensor].dono == jogador->id_cor;
+        melhor_progresso[s] = ramo->progresso;
+        num_ramos++;
+    }
+    r->amostras = num_ramos;
+    r->ramos = num_ramos;
+
+    // 2. Ataques seguintes: cada ramo vivo gera ate CONTINUACOES_ANALISE filhos.
+    for (int nivel = 0; nivel < PROFUNDIDADE_ANALISE; nivel++) {
+        int num_proximos = 0;
+        for (int k = 0; k < num_ramos; k++) {
+            RamoAnalise* ramo = &ramos[k];
+            AcaoAtaque acoes[CONTINUACOES_ANALISE];
+            int filhos = 0, num_acoes = 0;
+
+            if (ramo->progresso < 1.0) {
+                voltar_para_versao(partida, ramo->versao);
+                num_acoes = gerar_ataques_analise(partida, &ramo->jogador, acoes);
+            }
+            for (int c = 0; c < num_acoes; c++) {
+                if (h->nos_em_uso - nos_iniciais >= LIMITE_NOS_ANALISE || reservar_nos_versao(h, 2) != 0) {
+                    r->truncada = 1;
+                    break;
+                }
+                RamoAnalise* filho = &proximos[num_proximos];
+                voltar_para_versao(partida, ramo->versao);
+                *filho = *ramo;
+                filho->acoes[filho->num_acoes++] = acoes[c];
+                criar_ramo_analise(partida, filho, acoes[c].atacante, acoes[c].defensor, blitz, valor_inicial);
+                if (filho->progresso > melhor_progresso[filho->amostra]) melhor_progresso[filho->amostra] = filho->progresso;
+                num_proximos++;
+                filhos++;
+                r->ramos++;
+            }
+            if (filhos == 0) proximos[num_proximos++] = *ramo; // Sem continuacao: o ramo segue como esta.
+            else soltar_versao(partida, ramo->versao);
+            if (num_proximos + num_ramos - k - 1 > r->pico_ramos) r->pico_ramos = num_proximos + num_ramos - k - 1;
+            if (h->nos_em_uso - nos_iniciais > r->pico_nos) r->pico_nos = h->nos_em_uso - nos_iniciais;
+        }
+
+        // So os LARGURA_ANALISE melhores ramos continuam.
+        qsort(proximos, (size_t)num_proximos, sizeof(RamoAnalise), comparar_ramos);
+        for (int k = LARGURA_ANALISE; k < num_proximos; k++) soltar_versao(partida, proximos[k].versao);
+        num_ramos = num_proximos < LARGURA_ANALISE ? num_proximos : LARGURA_ANALISE;
+        RamoAnalise* troca = ramos;
+        ramos = proximos;
+        proximos = troca;
+    }
+
+    qsort(ramos, (size_t)num_ramos, sizeof(RamoAnalise), comparar_ramos);
+    if (num_ramos > 0) r->melhor = ramos[0];
+    for (int s = 0; s < r->amostras; s++) {
+        r->progresso_medio += melhor_progresso[s] / r->amostras;
+        r->missoes_cumpridas += melhor_progresso[s] >= 1.0;
+    }
+
+    // 3. A partida volta para a versao de antes da analise e todos os ramos sao descartados.
+    voltar_para_versao(partida, raiz);
+    for (int k = 0; k < num_ramos; k++) soltar_versao(partida, ramos[k].versao);
+    soltar_versao(partida, raiz);
+    r->melhor.versao = NULL;
+    free(ramos);
+    free(proximos);
+    return 0;
+}
+
+/**
+ * @brief Analise de jogadas do menu de ataque: explora o ataque escolhido (uma batalha e blitz) e
+ * os ataques seguintes do jogador em ramos com copia na escrita, e mostra a chance de conquista, a
+ * chance de cumprir a missao em ate 1 + PROFUNDIDADE_ANALISE ataques e a melhor sequencia achada.
+ * A partida (mapa, dados, diario) fica exatamente como estava.
+ * @param atacante Indice do territorio atacante (base 0).
+ * @param defensor Indice do territorio defensor (base 0).
+ */
+void analisar_ataque(Partida* partida, const Jogador* jogador, int atacante, int defensor) {
+    static const char* NOMES_MODOS[2] = { "Uma batalha", "Blitz" };
+    GeradorDados gerador = partida->gerador;
+    unsigned char reserva[TAMANHO_RESERVA_DADOS];
+    int posicao_reserva = partida->posicao_reserva, fim_reserva = partida->fim_reserva;
+    struct Diario* diario = partida->diario;
+    int silencioso = g_modo_silencioso;
+    EstatisticasExecucao guardadas;
+    struct timespec inicio, fim;
+
+    if (partida->versoes != NULL && partida->versoes->sem_memoria) liberar_versoes(partida);
+    if ((partida->versoes == NULL && iniciar_versoes(partida) != 0) ||
+        (partida->primeiro_do_dono == NULL && construir_indice_donos(partida) != 0)) {
+        printf("Erro: sem memoria para a analise.\n");
+        return;
+    }
+
+    // Os dados da analise vem de um fluxo proprio; os da partida e o diario nao sao tocados.
+    memcpy(reserva, partida->reserva_dados, sizeof(reserva));
+    gerador_iniciar(&partida->gerador, gerador.estado, 0x616e616c69736521ULL);
+    partida->posicao_reserva = partida->fim_reserva = 0;
+    partida->diario = NULL;
+    g_modo_silencioso = 1;
+    guardar_estatisticas(&guardadas); // Os ataques dos ramos nao contam no --stats.
+
+    printf("\nAnalise: %s -> %s, %d resultado(s) sorteado(s) e ate %d ataque(s) seguinte(s) por ramo:\n",
+           partida->mapa[atacante].nome, partida->mapa[defensor].nome, AMOSTRAS_ANALISE, PROFUNDIDADE_ANALISE);
+    for (int blitz = 0; blitz < 2; blitz++) {
+        ResultadoAnalise r;
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        int erro = explorar_ataque(partida, jogador, atacante, defensor, blitz, &r);
+        clock_gettime(CLOCK_MONOTONIC, &fim);
+        if (erro || r.amostras == 0) {
+            printf("  %s: sem memoria para a analise.\n", NOMES_MODOS[blitz]);
+            continue;
+        }
+        printf("  %s: conquista em %.0f%% | missao cumprida em ate %d ataques: %.0f%% | progresso medio da missao: %.0f%%\n",
+               NOMES_MODOS[blitz], 100.0 * r.conquistas / r.amostras, 1 + PROFUNDIDADE_ANALISE,
+               100.0 * r.missoes_cumpridas / r.amostras, 100.0 * r.progresso_medio);
+        printf("    Melhor sequencia achada (%.0f%% da missao): %s -> %s", 100.0 * r.melhor.progresso,
+               partida->mapa[atacante].nome, partida->mapa[defensor].nome);
+        for (int k = 0; k < r.melhor.num_acoes; k++) {
+            printf(", %s -> %s", partida->mapa[r.melhor.acoes[k].atacante].nome, partida->mapa[r.melhor.acoes[k].defensor].nome);
+        }
+        printf("\n    %lld ramos (pico de %d vivos), %lld paginas/nos copiados (%.1f KiB)%s, %.0f ms\n", r.ramos,
+               r.pico_ramos, r.pico_nos, r.pico_nos * (double)sizeof(NoVersao) / 1024.0,
+               r.truncada ? ", limite de memoria atingido" : "",
+               ((fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9) * 1000.0);
+    }
+
+    restaurar_estatisticas(&guardadas);
+    g_modo_silencioso = silencioso;
+    partida->diario = diario;
+    partida->gerador = gerador;
+    memcpy(partida->reserva_dados, reserva, sizeof(reserva));
+    partida->posicao_reserva = posicao_reserva;
+    partida->fim_reserva = fim_reserva;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Modo Servidor (--servidor): muitas partidas por um socket local ---
+// ------------------------------------------------------------------------------------------------
+// Um unico laco de eventos (epoll), sem threads e sem pausas, atende todas as conexoes. As partidas
+// (sessoes) pertencem ao servidor, nao a conexao: um bot pode criar uma partida, desconectar e
+// continuar depois com o mesmo ID. Protocolo de linhas; cada comando recebe uma linha de resposta
+// que comeca com "OK" ou "ERRO". Territorios e jogadores sao numerados a partir de 1, como nos menus;
+// um territorio tambem pode ser dado pelo nome (sem espacos), resolvido pelo indice de nomes.
+//   NOVA [territorios] [jogadores]             -> OK <id>  (mapa gerado, como na simulacao)
+//   MAPA <id> <arquivo> [jogadores]            -> OK <territorios> <cores> <jogadores>  (texto, binario ou jogo salvo)
+//   ATACAR <id> <atacante> <defensor> [blitz]  -> OK conquista=<0|1> atacante=<tropas> defensor=<tropas> vencedor=<jogador|0>
+//   ESTADO <id> [inicio] [quantidade]          -> OK territorios=<n> ... | <i>;<nome>;<cor>;<tropas> | ...
+//   TERRITORIO <id> <territorio>               -> OK <i>;<nome>;<cor>;<tropas>;<seguidos>  (seguidos: sequencia do mesmo dono)
+//   MISSAO <id> <jogador>                      -> OK cumprida=<0|1> cor=<cor> vivo=<0|1> missao=<descricao>
+//   FIM <id>                                   -> OK  (encerra a partida)
+//   SAIR                                       -> OK  (fecha a conexao)
+
+#define TAMANHO_LINHA_SERVIDOR 1024      // Maior comando aceito, com o '\n'.
+#define MAX_EVENTOS_SERVIDOR 256         // Eventos tratados por chamada a epoll_wait.
+#define LIMITE_SAIDA_SERVIDOR (1 << 20)  // Com mais respostas pendentes, a conexao so volta a ler depois de envia-las.
+#define MAX_ARGUMENTOS_SERVIDOR 6
+#define MAX_TERRITORIOS_ESTADO 256       // Territorios por resposta do ESTADO (o resto em outras paginas).
+#define MAX_TERRITORIOS_SESSAO 1000000   // Maior mapa gerado pelo NOVA.
+
+// Uma partida hospedada no servidor.
+typedef struct {
+    Partida partida;
+    MesaJogadores mesa; // Jogadores da partida; jogador_da_cor diz quem ataca com cada territorio.
+    Arena* arena;       // Arena do pool do servidor: mapa, agregados e mesa.
+    int vencedor;       // Jogador que cumpriu a missao (a partida termina), ou -1.
+} SessaoServidor;
+
+// Uma conexao de cliente: comandos lidos ate o '\n' e respostas ainda nao enviadas.
+typedef struct ConexaoServidor {
+    int fd;
+    char entrada[TAMANHO_LINHA_SERVIDOR];
+    size_t usado_entrada;
+    char* saida;
+    size_t tamanho_saida;   // Bytes de resposta no buffer.
+    size_t enviado_saida;   // Bytes ja enviados.
+    size_t capacidade_saida;
+    uint32_t eventos;       // Eventos pedidos ao epoll (EPOLLIN e/ou EPOLLOUT).
+    int fechar;             // SAIR, fim da leitura ou erro: fecha depois de enviar as respostas.
+    struct ConexaoServidor* anterior; // Lista das conexoes abertas (liberadas no encerramento).
+    struct ConexaoServidor* proxima;
+} ConexaoServidor;
+
+typedef struct {
+    const Configuracao* config;
+    int epoll;
+    int escuta;
+    int tcp;                  // 1 = porta TCP local, 0 = socket Unix.
+    SessaoServidor** sessoes; // sessoes[id - 1]; NULL = partida encerrada.
+    int num_sessoes;          // IDs ja distribuidos.
+    int capacidade_sessoes;
+    int sessoes_ativas;
+    PoolArenas arenas;        // Arenas das partidas, recicladas quando uma partida termina.
+    ConexaoServidor* conexoes;
+    long long total_conexoes;
+    long long comandos;
+} Servidor;
+
+static volatile sig_atomic_t g_encerrar_servidor = 0;
+
+/**
+ * @brief SIGINT/SIGTERM: o laco de eventos termina e libera as partidas e conexoes.
+ */
+static void sinal_encerrar_servidor(int sinal) {
+    (void)sinal;
+    g_encerrar_servidor = 1;
+}
+
+/**
+ * @brief Acrescenta texto formatado as respostas pendentes da conexao (o '\n' vem no formato).
+ */
+void responder(ConexaoServidor* conexao, const char* formato, ...) {
+    va_list args;
+
+    for (;;) {
+        size_t livre = conexao->capacidade_saida - conexao->tamanho_saida;
+        va_start(args, formato);
+        int n = vsnprintf(conexao->saida != NULL ? conexao->saida + conexao->tamanho_saida : NULL, livre, formato, args);
+        va_end(args);
+        if (n < 0) return;
+        if ((size_t)n < livre) {
+            conexao->tamanho_saida += (size_t)n;
+            return;
+        }
+        size_t capacidade = conexao->capacidade_saida > 0 ? conexao->capacidade_saida : 4096;
+        while (capacidade - conexao->tamanho_saida <= (size_t)n) capacidade *= 2;
+        char* nova = (char*)realloc(conexao->saida, capacidade);
+        if (nova == NULL) {
+            conexao->fechar = 1; // Sem memoria para a resposta: desiste da conexao.
+            return;
+        }
+        conexao->saida = nova;
+        conexao->capacidade_saida = capacidade;
+    }
+}
+
+/**
+ * @brief Le um numero inteiro de um argumento (o texto inteiro precisa ser o numero).
+ * @return int: 1 se o argumento e um inteiro valido, 0 caso contrario.
+ */
+int ler_inteiro_argumento(const char* texto, int* valor) {
+    char* fim;
+    long n = strtol(texto, &fim, 10);
+    if (fim == texto || *fim != '\0' || n < INT_MIN || n > INT_MAX) return 0;
+    *valor = (int)n;
+    return 1;
+}
+
+/**
+ * @brief Partida de um ID recebido no protocolo.
+ * @param id Recebe o ID lido (pode ser NULL).
+ * @return SessaoServidor*: A partida, ou NULL se o ID nao existe ou a partida foi encerrada.
+ */
+SessaoServidor* buscar_sessao(const Servidor* servidor, const char* texto_id, int* id) {
+    int lido;
+    if (!ler_inteiro_argumento(texto_id, &lido) || lido < 1 || lido > servidor->num_sessoes) return NULL;
+    if (id != NULL) *id = lido;
+    return servidor->sessoes[lido - 1];
+}
+
+/**
+ * @brief Endereco do --servidor: so digitos = porta TCP local; qualquer outro texto = socket Unix.
+ */
+int endereco_tcp(const char* endereco) {
+    return endereco[0] != '\0' && strspn(endereco, "0123456789") == strlen(endereco);
+}
+
+/**
+ * @brief Encerra a partida id: devolve a arena ao pool e libera as cores.
+ */
+void encerrar_sessao(Servidor* servidor, int id) {
+    SessaoServidor* sessao = servidor->sessoes[id - 1];
+    if (sessao == NULL) return;
+    descartar_partida(&sessao->partida);
+    liberar_mesa(&sessao->mesa);
+    if (sessao->arena != NULL) devolver_arena(&servidor->arenas, sessao->arena);
+    free(sessao);
+    servidor->sessoes[id - 1] = NULL;
+    servidor->sessoes_ativas--;
+}
+
+/**
+ * @brief Cria uma partida vazia com uma arena do pool.
+ * @return int: ID da partida, ou 0 em caso de falha de alocacao.
+ */
+int criar_sessao(Servidor* servidor) {
+    if (servidor->num_sessoes == servidor->capacidade_sessoes) {
+        if (servidor->capacidade_sessoes >= INT_MAX / 2) return 0;
+        int capacidade = servidor->capacidade_sessoes > 0 ? servidor->capacidade_sessoes * 2 : 1024;
+        SessaoServidor** novas = (SessaoServidor**)realloc(servidor->sessoes, (size_t)capacidade * sizeof(SessaoServidor*));
+        if (novas == NULL) return 0;
+        servidor->sessoes = novas;
+        servidor->capacidade_sessoes = capacidade;
+    }
+    SessaoServidor* sessao = (SessaoServidor*)calloc(1, sizeof(SessaoServidor));
+    Arena* arena = sessao != NULL ? pegar_arena(&servidor->arenas) : NULL;
+    if (arena == NULL) {
+        free(sessao);
+        return 0;
+    }
+    sessao->arena = arena;
+    sessao->partida.arena = arena;
+    sessao->mesa.arena = arena;
+    sessao->vencedor = -1;
+    servidor->sessoes[servidor->num_sessoes++] = sessao;
+    servidor->sessoes_ativas++;
+    return servidor->num_sessoes;
+}
+
+/**
+ * @brief Define os jogadores da partida: os de um jogo salvo e depois as primeiras cores livres,
+ * cada uma com a sua missao (no maximo um jogador por cor).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int preparar_jogadores_sessao(SessaoServidor* sessao, const EstadoSalvo* estado, int num_jogadores) {
+    Partida* partida = &sessao->partida;
+    MesaJogadores* mesa = &sessao->mesa;
+    int num_cores = partida->cores.total;
+    int proxima_cor = 0;
+
+    if (num_jogadores > num_cores) num_jogadores = num_cores;
+    if (reservar_mesa(mesa, num_jogadores, num_cores) != 0) return 1;
+
+    // jogador_da_cor marca as cores ja usadas; preparar_turnos o refaz no fim.
+    memset(mesa->jogador_da_cor, 0xff, (size_t)num_cores * sizeof(int));
+    for (int j = 0; j < estado->num_jogadores && j < num_jogadores; j++) {
+        mesa->jogadores[j] = estado->jogadores[j];
+        mesa->jogador_da_cor[estado->jogadores[j].id_cor] = j;
+    }
+    for (int j = estado->num_jogadores; j < num_jogadores; j++) {
+        Jogador* jogador = &mesa->jogadores[j];
+        while (mesa->jogador_da_cor[proxima_cor] >= 0) proxima_cor++;
+        memset(jogador, 0, sizeof(*jogador));
+        jogador->id_cor = proxima_cor;
+        strcpy(jogador->cor, nome_cor(&partida->cores, proxima_cor));
+        atribuirMissao(jogador, partida);
+        mesa->jogador_da_cor[proxima_cor] = j;
+    }
+    if (missoes_usam_sequencias() && construir_indice_sequencias(partida) != 0) return 1;
+    preparar_turnos(mesa, partida, num_cores);
+    sessao->vencedor = -1;
+    return 0;
+}
+
+/**
+ * @brief NOVA [territorios] [jogadores]: partida com mapa gerado (padroes: --territorios e --jogadores).
+ */
+void comando_nova(Servidor* servidor, ConexaoServidor* conexao, char** args, int num_args) {
+    const Configuracao* config = servidor->config;
+    int territorios = config->tamanhos_mapa[0];
+    int num_jogadores = config->num_jogadores;
+    EstadoSalvo sem_estado = {0};
+
+    if ((num_args > 1 && !ler_inteiro_argumento(args[1], &territorios)) ||
+        (num_args > 2 && !ler_inteiro_argumento(args[2], &num_jogadores)) ||
+        territorios < 2 || territorios > MAX_TERRITORIOS_SESSAO ||
+        num_jogadores < 1 || num_jogadores > MAX_JOGADORES_SIMULACAO) {
+        responder(conexao, "ERRO uso: NOVA [territorios 2..%d] [jogadores 1..%d]\n", MAX_TERRITORIOS_SESSAO,
+                  MAX_JOGADORES_SIMULACAO);
+        return;
+    }
+    int id = criar_sessao(servidor);
+    if (id == 0) {
+        responder(conexao, "ERRO memoria insuficiente\n");
+        return;
+    }
+    SessaoServidor* sessao = servidor->sessoes[id - 1];
+    Partida* partida = &sessao->partida;
+    iniciar_dados_partida(partida, config->semente, (uint64_t)id); // Um fluxo por partida.
+    if (registrar_cores_simulacao(&partida->cores, num_jogadores) != 0 || alocar_mapa(partida, territorios) != 0 ||
+        garantir_agregados(partida, num_jogadores - 1) != 0 || gerar_mapa_simulacao(partida, num_jogadores) != 0 ||
+        construir_indice_nomes(partida, NULL) != 0 || preparar_jogadores_sessao(sessao, &sem_estado, num_jogadores) != 0) {
+        encerrar_sessao(servidor, id);
+        responder(conexao, "ERRO memoria insuficiente\n");
+        return;
+    }
+    responder(conexao, "OK %d\n", id);
+}
+
+/**
+ * @brief MAPA <id> <arquivo> [jogadores]: troca o mapa da partida por um arquivo do servidor.
+ * O arquivo e carregado numa arena nova; se falhar, a partida continua intacta.
+ */
+void comando_mapa(Servidor* servidor, ConexaoServidor* conexao, char** args, int num_args) {
+    int id = 0;
+    SessaoServidor* sessao = num_args > 2 ? buscar_sessao(servidor, args[1], &id) : NULL;
+    int num_jogadores;
+
+    if (num_args < 3 || (num_args > 3 && (!ler_inteiro_argumento(args[3], &num_jogadores) || num_jogadores < 1 ||
+                                           num_jogadores > MAX_JOGADORES_SIMULACAO))) {
+        responder(conexao, "ERRO uso: MAPA <id> <arquivo> [jogadores 1..%d]\n", MAX_JOGADORES_SIMULACAO);
+        return;
+    }
+    if (sessao == NULL) {
+        responder(conexao, "ERRO partida inexistente\n");
+        return;
+    }
+    Partida nova = {0};
+    EstadoSalvo estado = {0};
+    nova.arena = pegar_arena(&servidor->arenas);
+    if (nova.arena == NULL) {
+        responder(conexao, "ERRO memoria insuficiente\n");
+        return;
+    }
+    nova.gerador = sessao->partida.gerador; // Um jogo salvo traz o proprio gerador.
+    if (carregar_estado(&nova, &estado, args[2]) != 0) {
+        devolver_arena(&servidor->arenas, nova.arena);
+        responder(conexao, "ERRO nao foi possivel carregar '%s'\n", args[2]);
+        return;
+    }
+    if (num_args <= 3) num_jogadores = estado.num_jogadores > 0 ? estado.num_jogadores : sessao->mesa.num_jogadores;
+    if (num_jogadores < estado.num_jogadores) num_jogadores = estado.num_jogadores;
+
+    descartar_partida(&sessao->partida);
+    liberar_mesa(&sessao->mesa);
+    devolver_arena(&servidor->arenas, sessao->arena);
+    sessao->partida = nova;
+    sessao->arena = nova.arena;
+    sessao->mesa.arena = nova.arena;
+    if (preparar_jogadores_sessao(sessao, &estado, num_jogadores) != 0) {
+        encerrar_sessao(servidor, id);
+        responder(conexao, "ERRO memoria insuficiente (partida encerrada)\n");
+        return;
+    }
+    responder(conexao, "OK %d %d %d\n", nova.num_territorios, nova.cores.total, sessao->mesa.num_jogadores);
+}
+
+/**
+ * @brief Resolve um territorio de um comando (numero ou nome) e responde o erro, se houver.
+ * @return int: Indice do territorio (base 0), ou negativo (erro ja respondido).
+ */
+int resolver_territorio_sessao(ConexaoServidor* conexao, const Partida* partida, const char* texto) {
+    int i = resolver_territorio(partida, texto);
+    if (i == TERRITORIO_AMBIGUO) {
+        responder(conexao, "ERRO nome repetido no mapa: %s (use o numero)\n", texto);
+    } else if (i == TERRITORIO_INEXISTENTE) {
+        responder(conexao, "ERRO territorio invalido: %s (1 a %d ou um nome do mapa)\n", texto, partida->num_territorios);
+    }
+    return i;
+}
+
+/**
+ * @brief Ataque numa sessao (ATACAR do servidor e do --script): as mesmas regras do menu de ataque;
+ * quem ataca e o jogador dono do territorio atacante. Depois do ataque, verificarMissao confere a
+ * missao do atacante e as missoes que medem as duas cores envolvidas.
+ * @param id_atacante Numero do territorio atacante (1 a n, ja resolvido).
+ * @param id_defensor Numero do territorio defensor (1 a n, ja resolvido).
+ * @param blitz Se 1, ataca ate conquistar ou restar 1 tropa.
+ */
+void atacar_na_sessao(SessaoServidor* sessao, ConexaoServidor* conexao, int id_atacante, int id_defensor, int blitz) {
+    Partida* partida = &sessao->partida;
+    MesaJogadores* mesa = &sessao->mesa;
+    Territorio* atacante = partida->mapa + (id_atacante - 1);
+    Territorio* defensor = partida->mapa + (id_defensor - 1);
+    int j = atacante->dono < mesa->num_cores ? mesa->jogador_da_cor[atacante->dono] : -1;
+    if (j < 0) {
+        responder(conexao, "ERRO a cor %s nao tem jogador\n", nome_cor(&partida->cores, atacante->dono));
+        return;
+    }
+    if (atacante->tropas < 2) {
+        responder(conexao, "ERRO sao necessarias no minimo 2 tropas para atacar\n");
+        return;
+    }
+    if (atacante->dono == defensor->dono) {
+        responder(conexao, "ERRO nao e possivel atacar um territorio da mesma cor\n");
+        return;
+    }
+    if (!sao_vizinhos(partida, id_atacante - 1, id_defensor - 1)) {
+        responder(conexao, "ERRO %s nao faz fronteira com %s\n", atacante->nome, defensor->nome);
+        return;
+    }
+
+    Jogador* jogador = &mesa->jogadores[j];
+    int cor_defensor = defensor->dono;
+    int conquista = blitz ? atacar_blitz(partida, atacante, defensor, jogador, NULL)
+                          : atacar(partida, atacante, defensor, jogador);
+    registrar_ataque_mesa(mesa, partida, cor_defensor);
+    sessao->vencedor = verificarMissao(jogador, partida) ? j
+                     : avaliar_missoes_afetadas(partida, mesa, j, atacante->dono, cor_defensor);
+    responder(conexao, "OK conquista=%d atacante=%d defensor=%d vencedor=%d\n", conquista, atacante->tropas,
+              defensor->tropas, sessao->vencedor + 1);
+}
+
+/**
+ * @brief ATACAR <id> <atacante> <defensor> [blitz]: ver atacar_na_sessao.
+ */
+void comando_atacar(Servidor* servidor, ConexaoServidor* conexao, char** args, int num_args) {
+    SessaoServidor* sessao = num_args > 3 ? buscar_sessao(servidor, args[1], NULL) : NULL;
+
+    if (num_args < 4 || (num_args > 4 && strcasecmp(args[4], "blitz") != 0)) {
+        responder(conexao, "ERRO uso: ATACAR <id> <atacante> <defensor> [blitz]\n");
+        return;
+    }
+    if (sessao == NULL) {
+        responder(conexao, "ERRO partida inexistente\n");
+        return;
+    }
+    if (sessao->vencedor >= 0) {
+        responder(conexao, "ERRO partida encerrada: o jogador %d cumpriu a missao\n", sessao->vencedor + 1);
+        return;
+    }
+    int id_atacante = resolver_territorio_sessao(conexao, &sessao->partida, args[2]) + 1;
+    int id_defensor = id_atacante > 0 ? resolver_territorio_sessao(conexao, &sessao->partida, args[3]) + 1 : 0;
+    if (id_atacante <= 0 || id_defensor <= 0) return;
+    atacar_na_sessao(sessao, conexao, id_atacante, id_defensor, num_args > 4);
+}
+
+/**
+ * @brief Resposta do ESTADO (servidor) e do MOSTRAR (--script): resumo da partida e os territorios
+ * inicio .. inicio + quantidade - 1 (no maximo MAX_TERRITORIOS_ESTADO).
+ */
+void responder_estado(const SessaoServidor* sessao, ConexaoServidor* conexao, int inicio, int quantidade) {
+    const Partida* partida = &sessao->partida;
+    if (quantidade > MAX_TERRITORIOS_ESTADO) quantidade = MAX_TERRITORIOS_ESTADO;
+    int fim = inicio - 1 + quantidade < partida->num_territorios ? inicio - 1 + quantidade : partida->num_territorios;
+
+    responder(conexao, "OK territorios=%d jogadores=%d vivos=%d vencedor=%d", partida->num_territorios,
+              sessao->mesa.num_jogadores, sessao->mesa.vivos, sessao->vencedor + 1);
+    for (int i = inicio - 1; i < fim; i++) {
+        const Territorio* t = partida->mapa + i;
+        responder(conexao, " | %d;%s;%s;%d", i + 1, t->nome, nome_cor(&partida->cores, t->dono), t->tropas);
+    }
+    responder(conexao, "\n");
+}
+
+/**
+ * @brief ESTADO <id> [inicio] [quantidade]: resumo da partida e uma pagina de territorios.
+ */
+void comando_estado(Servidor* servidor, ConexaoServidor* conexao, char** args, int num_args) {
+    SessaoServidor* sessao = num_args > 1 ? buscar_sessao(servidor, args[1], NULL) : NULL;
+    int inicio = 1, quantidade = MAX_TERRITORIOS_ESTADO;
+
+    if (num_args < 2 || (num_args > 2 && !ler_inteiro_argumento(args[2], &inicio)) ||
+        (num_args > 3 && !ler_inteiro_argumento(args[3], &quantidade)) || inicio < 1 || quantidade < 0) {
+        responder(conexao, "ERRO uso: ESTADO <id> [inicio] [quantidade]\n");
+        return;
+    }
+    if (sessao == NULL) {
+        responder(conexao, "ERRO partida inexistente\n");
+        return;
+    }
+    responder_estado(sessao, conexao, inicio, quantidade);
+}
+
+/**
+ * @brief TERRITORIO <id> <territorio>: um territorio pelo numero ou pelo nome, com o tamanho da
+ * sequencia de territorios seguidos do mesmo dono que passa por ele.
+ */
+void comando_territorio(Servidor* servidor, ConexaoServidor* conexao, char** args, int num_args) {
+    SessaoServidor* sessao = num_args > 2 ? buscar_sessao(servidor, args[1], NULL) : NULL;
+
+    if (num_args < 3) {
+        responder(conexao, "ERRO uso: TERRITORIO <id> <territorio>\n");
+        return;
+    }
+    if (sessao == NULL) {
+        responder(conexao, "ERRO partida inexistente\n");
+        return;
+    }
+    const Partida* partida = &sessao->partida;
+    int i = resolver_territorio_sessao(conexao, partida, args[2]);
+    if (i < 0) return;
+    const Territorio* t = partida->mapa + i;
+    responder(conexao, "OK %d;%s;%s;%d;%d\n", i + 1, t->nome, nome_cor(&partida->cores, t->dono), t->tropas,
+              sequencia_do_territorio(partida, i));
+}
+
+/**
+ * @brief MISSAO <id> <jogador>: confere a missao de um jogador com verificarMissao (uma missao
+ * cumprida encerra a partida).
+ */
+void comando_missao(Servidor* servidor, ConexaoServidor* conexao, char** args, int num_args) {
+    SessaoServidor* sessao = num_args > 2 ? buscar_sessao(servidor, args[1], NULL) : NULL;
+    int j;
+
+    if (num_args < 3 || !ler_inteiro_argumento(args[2], &j)) {
+        responder(conexao, "ERRO uso: MISSAO <id> <jogador>\n");
+        return;
+    }
+    if (sessao == NULL) {
+        responder(conexao, "ERRO partida inexistente\n");
+        return;
+    }
+    if (j < 1 || j > sessao->mesa.num_jogadores) {
+        responder(conexao, "ERRO jogador invalido (1 a %d)\n", sessao->mesa.num_jogadores);
+        return;
+    }
+    Jogador* jogador = &sessao->mesa.jogadores[j - 1];
+    int cumprida = verificarMissao(jogador, &sessao->partida);
+    if (cumprida && sessao->vencedor < 0) sessao->vencedor = j - 1;
+    responder(conexao, "OK cumprida=%d cor=%s vivo=%d missao=%s\n", cumprida, jogador->cor,
+              sessao->mesa.anterior[j - 1] >= 0, g_missoes.missoes[jogador->id_missao].descricao);
+}
+
+/**
+ * @brief Executa uma linha do protocolo (ja sem o '\n') e acrescenta a resposta na conexao.
+ */
+void executar_comando_servidor(Servidor* servidor, ConexaoServidor* conexao, char* linha) {
+    char* args[MAX_ARGUMENTOS_SERVIDOR];
+    int num_args = 0;
+    char* contexto;
+
+    for (char* p = strtok_r(linha, " \t\r", &contexto); p != NULL; p = strtok_r(NULL, " \t\r", &contexto)) {
+        if (num_args == MAX_ARGUMENTOS_SERVIDOR) {
+            responder(conexao, "ERRO argumentos demais\n");
+            return;
+        }
+        args[num_args++] = p;
+    }
+    if (num_args == 0) return; // Linha vazia.
+    servidor->comandos++;
+
+    if (strcasecmp(args[0], "NOVA") == 0) {
+        comando_nova(servidor, conexao, args, num_args);
+    } else if (strcasecmp(args[0], "MAPA") == 0) {
+        comando_mapa(servidor, conexao, args, num_args);
+    } else if (strcasecmp(args[0], "ATACAR") == 0) {
+        comando_atacar(servidor, conexao, args, num_args);
+    } else if (strcasecmp(args[0], "ESTADO") == 0) {
+        comando_estado(servidor, conexao, args, num_args);
+    } else if (strcasecmp(args[0], "TERRITORIO") == 0) {
+        comando_territorio(servidor, conexao, args, num_args);
+    } else if (strcasecmp(args[0], "MISSAO") == 0) {
+        comando_missao(servidor, conexao, args, num_args);
+    } else if (strcasecmp(args[0], "FIM") == 0) {
+        int id;
+        if (num_args < 2 || buscar_sessao(servidor, args[1], &id) == NULL) {
+            responder(conexao, "ERRO partida inexistente\n");
+        } else {
+            encerrar_sessao(servidor, id);
+            responder(conexao, "OK\n");
+        }
+    } else if (strcasecmp(args[0], "SAIR") == 0) {
+        responder(conexao, "OK\n");
+        conexao->fechar = 1;
+    } else {
+        responder(conexao, "ERRO comando desconhecido: %s\n", args[0]);
+    }
+}
+
+/**
+ * @brief Fecha a conexao e a tira do epoll e da lista de conexoes abertas.
+ */
+void fechar_conexao(Servidor* servidor, ConexaoServidor* conexao) {
+    epoll_ctl(servidor->epoll, EPOLL_CTL_DEL, conexao->fd, NULL);
+    close(conexao->fd);
+    if (conexao->anterior != NULL) conexao->anterior->proxima = conexao->proxima;
+    else servidor->conexoes = conexao->proxima;
+    if (conexao->proxima != NULL) conexao->proxima->anterior = conexao->anterior;
+    free(conexao->saida);
+    free(conexao);
+}
+
+/**
+ * @brief Executa as linhas completas do buffer de entrada, enquanto as respostas pendentes
+ * couberem no limite (o resto fica para quando a saida esvaziar).
+ */
+void processar_linhas(Servidor* servidor, ConexaoServidor* conexao) {
+    size_t inicio = 0;
+
+    while (!conexao->fechar && conexao->tamanho_saida - conexao->enviado_saida < LIMITE_SAIDA_SERVIDOR) {
+        char* fim = (char*)memchr(conexao->entrada + inicio, '\n', conexao->usado_entrada - inicio);
+        if (fim == NULL) break;
+        *fim = '\0';
+        executar_comando_servidor(servidor, conexao, conexao->entrada + inicio);
+        inicio = (size_t)(fim - conexao->entrada) + 1;
+    }
+    memmove(conexao->entrada, conexao->entrada + inicio, conexao->usado_entrada - inicio);
+    conexao->usado_entrada -= inicio;
+    if (conexao->usado_entrada == sizeof(conexao->entrada)) {
+        responder(conexao, "ERRO linha maior que %d bytes\n", TAMANHO_LINHA_SERVIDOR - 1);
+        conexao->fechar = 1;
+    }
+}
+
+/**
+ * @brief Envia o que der das respostas pendentes, sem bloquear.
+ * @return int: 0 em caso de sucesso (mesmo que parte fique pendente), 1 se a conexao caiu.
+ */
+int enviar_respostas(ConexaoServidor* conexao) {
+    while (conexao->enviado_saida < conexao->tamanho_saida) {
+        ssize_t n = send(conexao->fd, conexao->saida + conexao->enviado_saida,
+                         conexao->tamanho_saida - conexao->enviado_saida, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno != EAGAIN && errno != EWOULDBLOCK;
+        }
+        conexao->enviado_saida += (size_t)n;
+    }
+    conexao->tamanho_saida = 0;
+    conexao->enviado_saida = 0;
+    return 0;
+}
+
+/**
+ * @brief Trata os eventos de uma conexao: le (uma vez por evento, para que nenhum cliente monopolize
+ * o laco), executa as linhas completas, envia as respostas e ajusta os eventos pedidos ao epoll.
+ */
+void tratar_conexao(Servidor* servidor, ConexaoServidor* conexao, uint32_t eventos) {
+    if (eventos & EPOLLIN) {
+        ssize_t n = recv(conexao->fd, conexao->entrada + conexao->usado_entrada,
+                         sizeof(conexao->entrada) - conexao->usado_entrada, 0);
+        if (n > 0) conexao->usado_entrada += (size_t)n;
+        else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) conexao->fechar = 1;
+        processar_linhas(servidor, conexao);
+    } else if (eventos & (EPOLLERR | EPOLLHUP)) {
+        conexao->fechar = 1;
+    }
+
+    if (enviar_respostas(conexao) != 0) {
+        fechar_conexao(servidor, conexao);
+        return;
+    }
+    if (!conexao->fechar && conexao->tamanho_saida == 0 && conexao->usado_entrada > 0) {
+        processar_linhas(servidor, conexao); // Linhas que esperavam a saida esvaziar.
+        if (enviar_respostas(conexao) != 0) {
+            fechar_conexao(servidor, conexao);
+            return;
+        }
+    }
+    int pendente = conexao->tamanho_saida > conexao->enviado_saida;
+    if (conexao->fechar && !pendente) {
+        fechar_conexao(servidor, conexao);
+        return;
+    }
+    uint32_t desejados = (pendente ? EPOLLOUT : 0) |
+                         (!conexao->fechar && conexao->tamanho_saida - conexao->enviado_saida < LIMITE_SAIDA_SERVIDOR ? EPOLLIN : 0);
+    if (desejados != conexao->eventos) {
+        struct epoll_event ev = { .events = desejados, .data.ptr = conexao };
+        epoll_ctl(servidor->epoll, EPOLL_CTL_MOD, conexao->fd, &ev);
+        conexao->eventos = desejados;
+    }
+}
+
+/**
+ * @brief Aceita todas as conexoes pendentes no socket de escuta.
+ */
+void aceitar_conexoes(Servidor* servidor) {
+    for (;;) {
+        int fd = accept4(servidor->escuta, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Erro ao aceitar conexao");
+            return;
+        }
+        if (servidor->tcp) {
+            int um = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &um, sizeof(um)); // Respostas curtas saem sem esperar.
+        }
+
+        ConexaoServidor* conexao = (ConexaoServidor*)calloc(1, sizeof(ConexaoServidor));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conexao };
+        if (conexao == NULL || epoll_ctl(servidor->epoll, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            perror("Erro ao registrar conexao");
+            free(conexao);
+            close(fd);
+            continue;
+        }
+        conexao->fd = fd;
+        conexao->eventos = EPOLLIN;
+        conexao->proxima = servidor->conexoes;
+        if (servidor->conexoes != NULL) servidor->conexoes->anterior = conexao;
+        servidor->conexoes = conexao;
+        servidor->total_conexoes++;
+    }
+}
+
+/**
+ * @brief Abre o socket de escuta: uma porta TCP em 127.0.0.1 ou um socket Unix (um socket antigo
+ * no mesmo caminho e substituido).
+ * @return int: O descritor, ou -1 em caso de erro (mensagem ja impressa).
+ */
+int abrir_escuta_servidor(const char* endereco) {
+    int porta_tcp = endereco_tcp(endereco);
+    int fd = socket(porta_tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int erro;
+
+    if (fd < 0) {
+        perror("Erro ao criar o socket do servidor");
+        return -1;
+    }
+    if (porta_tcp) {
+        long porta = strtol(endereco, NULL, 10);
+        struct sockaddr_in local = {0};
+        int um = 1;
+        if (porta < 1 || porta > 65535) {
+            printf("Erro: --servidor exige uma porta de 1 a 65535 ou o caminho de um socket Unix.\n");
+            close(fd);
+            return -1;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &um, sizeof(um));
+        local.sin_family = AF_INET;
+        local.sin_port = htons((uint16_t)porta);
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // So conexoes locais.
+        erro = bind(fd, (struct sockaddr*)&local, sizeof(local));
+    } else {
+        struct sockaddr_un local = {0};
+        struct stat info;
+        if (strlen(endereco) >= sizeof(local.sun_path)) {
+            printf("Erro: caminho de socket longo demais: %s\n", endereco);
+            close(fd);
+            return -1;
+        }
+        if (lstat(endereco, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(endereco);
+        local.sun_family = AF_UNIX;
+        strcpy(local.sun_path, endereco);
+        erro = bind(fd, (struct sockaddr*)&local, sizeof(local));
+    }
+    if (erro != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror("Erro ao abrir o servidor");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Modo servidor (--servidor): hospeda partidas independentes para bots e testes de carga,
+ * num unico laco de eventos. As mensagens e pausas do jogo ficam desligadas (modo silencioso);
+ * termina com SIGINT ou SIGTERM.
+ * @return int: codigo de saida do programa.
+ */
+int executar_servidor(const Configuracao* config) {
+    Servidor servidor;
+    struct epoll_event eventos[MAX_EVENTOS_SERVIDOR];
+    struct sigaction acao = {0};
+    int falhou = 0;
+
+    memset(&servidor, 0, sizeof(servidor));
+    servidor.config = config;
+    servidor.tcp = endereco_tcp(config->endereco_servidor);
+    pthread_mutex_init(&servidor.arenas.trava, NULL);
+    servidor.escuta = abrir_escuta_servidor(config->endereco_servidor);
+    if (servidor.escuta < 0) {
+        liberar_pool_arenas(&servidor.arenas);
+        return 1;
+    }
+    servidor.epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL }; // data.ptr NULL = socket de escuta.
+    if (servidor.epoll < 0 || epoll_ctl(servidor.epoll, EPOLL_CTL_ADD, servidor.escuta, &ev) != 0) {
+        perror("Erro ao iniciar o laco de eventos");
+        falhou = 1;
+    }
+
+    // Sem SA_RESTART: o sinal interrompe o epoll_wait e o laco termina.
+    acao.sa_handler = sinal_encerrar_servidor;
+    sigemptyset(&acao.sa_mask);
+    sigaction(SIGINT, &acao, NULL);
+    sigaction(SIGTERM, &acao, NULL);
+
+    g_modo_silencioso = 1;
+    if (!falhou) {
+        printf("Servidor ouvindo em %s%s (SIGINT/SIGTERM encerra).\n",
+               servidor.tcp ? "127.0.0.1:" : "",
+               config->endereco_servidor);
+        fflush(stdout);
+    }
+    while (!falhou && !g_encerrar_servidor) {
+        int n = epoll_wait(servidor.epoll, eventos, MAX_EVENTOS_SERVIDOR, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Erro no laco de eventos");
+            falhou = 1;
+            break;
+        }
+        for (int k = 0; k < n; k++) {
+            if (eventos[k].data.ptr == NULL) aceitar_conexoes(&servidor);
+            else tratar_conexao(&servidor, (ConexaoServidor*)eventos[k].data.ptr, eventos[k].events);
+        }
+    }
+    g_modo_silencioso = 0;
+
+    printf("Servidor encerrado: %lld conexoes, %lld comandos, %d partidas criadas (%d ainda ativas, %d arenas no pool).\n",
+           servidor.total_conexoes, servidor.comandos, servidor.num_sessoes, servidor.sessoes_ativas,
+           servidor.arenas.criadas);
+    while (servidor.conexoes != NULL) fechar_conexao(&servidor, servidor.conexoes);
+    for (int id = 1; id <= servidor.num_sessoes; id++) encerrar_sessao(&servidor, id);
+    free(servidor.sessoes);
+    liberar_pool_arenas(&servidor.arenas);
+    if (servidor.epoll >= 0) close(servidor.epoll);
+    close(servidor.escuta);
+    if (!servidor.tcp) unlink(config->endereco_servidor);
+    return falhou;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Modo Script (--script): uma partida inteira lida de um arquivo de comandos ---
+// ------------------------------------------------------------------------------------------------
+// O arquivo e mapeado em memoria (mmap) e lido uma unica vez: cada linha e separada em palavras que
+// apontam para o proprio texto mapeado, sem copia, sem scanf e sem limpar_buffer. Nao ha menus,
+// pausas nem mensagens passo a passo; cada comando responde uma linha no formato do --servidor.
+//   CADASTRAR <nome> <cor> <tropas>       -> OK <territorio>  (so antes do primeiro outro comando e sem --map)
+//   ATACAR <atacante> <defensor> [blitz]  -> como no servidor (territorio pelo numero ou pelo nome)
+//   MOSTRAR [inicio] [quantidade]         -> como o ESTADO do servidor
+//   SAIR                                  -> encerra (o resto do arquivo e ignorado)
+// Linhas vazias e iniciadas por '#' sao ignoradas. Com --map, a partida comeca no mapa (ou no jogo
+// salvo) do arquivo; sem --jogadores, cada cor do mapa e um jogador com a sua missao.
+
+#define MAX_PALAVRAS_SCRIPT 5
+
+// Palavra de uma linha do script: aponta para o texto mapeado (nao termina em '\0').
+typedef struct {
+    const char* texto;
+    size_t tamanho;
+} PalavraScript;
+
+/**
+ * @brief Separa uma linha (sem o '\n') em palavras (espacos, tabs e '\r' separam).
+ * @return int: Quantidade de palavras, ou MAX_PALAVRAS_SCRIPT + 1 se a linha tiver palavras demais.
+ */
+static int separar_palavras_script(const char* p, const char* fim, PalavraScript* palavras) {
+    int num_palavras = 0;
+
+    for (;;) {
+        while (p < fim && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p == fim) return num_palavras;
+        if (num_palavras == MAX_PALAVRAS_SCRIPT) return MAX_PALAVRAS_SCRIPT + 1;
+        palavras[num_palavras].texto = p;
+        while (p < fim && *p != ' ' && *p != '\t' && *p != '\r') p++;
+        palavras[num_palavras].tamanho = (size_t)(p - palavras[num_palavras].texto);
+        num_palavras++;
+    }
+}
+
+/**
+ * @brief Compara uma palavra com um comando (sem diferenciar maiusculas).
+ */
+static inline int palavra_e(PalavraScript palavra, const char* comando) {
+    return strlen(comando) == palavra.tamanho && strncasecmp(palavra.texto, comando, palavra.tamanho) == 0;
+}
+
+/**
+ * @brief Le um inteiro nao negativo de uma palavra (a palavra inteira precisa ser o numero).
+ * @return int: 1 se a palavra e um inteiro valido, 0 caso contrario.
+ */
+static int ler_inteiro_palavra(PalavraScript palavra, int* valor) {
+    long long numero = 0;
+
+    if (palavra.tamanho == 0 || palavra.tamanho > 10) return 0;
+    for (size_t k = 0; k < palavra.tamanho; k++) {
+        if (palavra.texto[k] < '0' || palavra.texto[k] > '9') return 0;
+        numero = numero * 10 + (palavra.texto[k] - '0');
+    }
+    if (numero > 2147483647LL) return 0;
+    *valor = (int)numero;
+    return 1;
+}
+
+/**
+ * @brief Copia uma palavra para um texto terminado em '\0' (nomes de territorio e de cor).
+ * @return int: 1 se coube no destino, 0 caso contrario.
+ */
+static int copiar_palavra(PalavraScript palavra, char* destino, size_t capacidade) {
+    if (palavra.tamanho >= capacidade) return 0;
+    memcpy(destino, palavra.texto, palavra.tamanho);
+    destino[palavra.tamanho] = '\0';
+    return 1;
+}
+
+/**
+ * @brief Resolve o territorio de um comando do script (numero ou nome) e responde o erro, se houver.
+ * @return int: Numero do territorio (1 a n), ou 0 (erro ja respondido).
+ */
+static int territorio_do_script(ConexaoServidor* saida, const Partida* partida, PalavraScript palavra) {
+    char nome[TAMANHO_NOME];
+
+    if (!copiar_palavra(palavra, nome, sizeof(nome))) {
+        responder(saida, "ERRO territorio invalido: %.*s\n", (int)palavra.tamanho, palavra.texto);
+        return 0;
+    }
+    int i = resolver_territorio_sessao(saida, partida, nome);
+    return i < 0 ? 0 : i + 1;
+}
+
+/**
+ * @brief CADASTRAR <nome> <cor> <tropas>: grava o proximo territorio do mapa (o mapa ja foi alocado
+ * com um lugar para cada CADASTRAR do arquivo).
+ * @param capacidade Territorios alocados (contar_cadastros_script).
+ */
+static void cadastrar_do_script(SessaoServidor* sessao, ConexaoServidor* saida, const PalavraScript* palavras,
+                                int num_palavras, int capacidade) {
+    Partida* partida = &sessao->partida;
+    Territorio* t = partida->mapa + partida->num_territorios;
+    char cor[TAMANHO_COR];
+    int tropas;
+
+    if (partida->num_territorios >= capacidade) {
+        responder(saida, "ERRO mapa cheio (%d territorios)\n", capacidade);
+        return;
+    }
+    if (num_palavras != 4 || !ler_inteiro_palavra(palavras[3], &tropas) || tropas < 1) {
+        responder(saida, "ERRO uso: CADASTRAR <nome> <cor> <tropas >= 1>\n");
+        return;
+    }
+    if (!copiar_palavra(palavras[1], t->nome, TAMANHO_NOME) || !copiar_palavra(palavras[2], cor, sizeof(cor))) {
+        memset(t->nome, 0, TAMANHO_NOME);
+        responder(saida, "ERRO nome com mais de %d ou cor com mais de %d caracteres\n", TAMANHO_NOME - 1, TAMANHO_COR - 1);
+        return;
+    }
+    int dono = registrar_cor(&partida->cores, cor);
+    if (dono < 0 || registrar_territorio(partida, t, dono, tropas) != 0) {
+        responder(saida, "ERRO memoria insuficiente\n");
+        return;
+    }
+    partida->num_territorios++;
+    responder(saida, "OK %d\n", partida->num_territorios);
+}
+
+/**
+ * @brief Conta as linhas CADASTRAR do script (para alocar o mapa de uma vez), com o mesmo separador
+ * de palavras da execucao.
+ */
+static int contar_cadastros_script(const char* dados, size_t tamanho) {
+    const char* fim = dados + tamanho;
+    int total = 0;
+
+    for (const char* linha = dados; linha < fim && total < INT_MAX;) {
+        PalavraScript palavras[MAX_PALAVRAS_SCRIPT];
+        const char* fim_linha = (const char*)memchr(linha, '\n', (size_t)(fim - linha));
+        if (fim_linha == NULL) fim_linha = fim;
+        total += separar_palavras_script(linha, fim_linha, palavras) > 0 && palavra_e(palavras[0], "CADASTRAR");
+        linha = fim_linha + 1;
+    }
+    return total;
+}
+
+/**
+ * @brief Executa um arquivo de comandos (--script) como uma partida sem interface e imprime uma
+ * resposta por comando. No fim, um resumo (comandos, erros e vencedor) e o tempo.
+ * @return int: 0 se todos os comandos deram certo, 1 se algum falhou ou o arquivo nao pode ser lido.
+ */
+int executar_script(const Configuracao* config) {
+    const char* caminho = config->arquivo_script;
+    const char* arquivo_mapa = config->num_mapas > 0 ? config->arquivos_mapa[config->num_mapas - 1] : NULL;
+    SessaoServidor sessao = {0};
+    ConexaoServidor saida = {0}; // So o buffer de respostas (responder), descarregado no stdout.
+    EstadoSalvo estado = {0};
+    Arena arena = {0};
+    Partida* partida = &sessao.partida;
+    struct stat info;
+    struct timespec inicio, fim_tempo;
+    long long comandos = 0, erros = 0, linha_erro = 0, num_linha = 0;
+    int em_jogo = 0, erro = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) {
+        perror("Erro ao abrir o script");
+        return 1;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        printf("Erro: o script %s esta vazio ou nao pode ser lido.\n", caminho);
+        close(fd);
+        return 1;
+    }
+    size_t tamanho = (size_t)info.st_size;
+    const char* dados = (const char*)mmap(NULL, tamanho, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (dados == MAP_FAILED) {
+        perror("Erro ao mapear o script");
+        return 1;
+    }
+    madvise((void*)dados, tamanho, MADV_SEQUENTIAL);
+
+    g_modo_silencioso = 1;
+    sessao.arena = &arena;
+    sessao.mesa.arena = &arena;
+    sessao.vencedor = -1;
+    partida->arena = &arena;
+    iniciar_dados_partida(partida, config->semente, 0);
+
+    // Mapa de arquivo (--map) ou um lugar para cada CADASTRAR do script.
+    int cadastros = contar_cadastros_script(dados, tamanho);
+    if (arquivo_mapa != NULL && cadastros > 0) {
+        printf("Erro: o script %s cadastra territorios e nao pode ser usado com --map.\n", caminho);
+        erro = 1;
+    } else if (arquivo_mapa != NULL) {
+        erro = carregar_estado(partida, &estado, arquivo_mapa);
+    } else if (cadastros > 0) {
+        erro = alocar_mapa(partida, cadastros);
+        partida->num_territorios = 0;
+    }
+
+    const char* fim = dados + tamanho;
+    for (const char* linha = dados; !erro && linha < fim;) {
+        PalavraScript palavras[MAX_PALAVRAS_SCRIPT];
+        const char* fim_linha = (const char*)memchr(linha, '\n', (size_t)(fim - linha));
+        if (fim_linha == NULL) fim_linha = fim;
+        int num_palavras = separar_palavras_script(linha, fim_linha, palavras);
+        linha = fim_linha + 1;
+        num_linha++;
+        if (num_palavras == 0 || palavras[0].texto[0] == '#') continue;
+
+        size_t antes = saida.tamanho_saida;
+        comandos++;
+        if (num_palavras > MAX_PALAVRAS_SCRIPT) {
+            responder(&saida, "ERRO argumentos demais\n");
+        } else if (palavra_e(palavras[0], "CADASTRAR")) {
+            if (em_jogo) responder(&saida, "ERRO CADASTRAR so antes do primeiro ATACAR ou MOSTRAR\n");
+            else cadastrar_do_script(&sessao, &saida, palavras, num_palavras, cadastros);
+        } else if (palavra_e(palavras[0], "SAIR")) {
+            responder(&saida, "OK\n");
+            break;
+        } else if (!palavra_e(palavras[0], "ATACAR") && !palavra_e(palavras[0], "MOSTRAR")) {
+            responder(&saida, "ERRO comando desconhecido: %.*s\n", (int)palavras[0].tamanho, palavras[0].texto);
+        } else if (!em_jogo && partida->num_territorios == 0) {
+            responder(&saida, "ERRO o mapa nao tem territorios (use CADASTRAR ou --map)\n");
+        } else {
+            // Primeiro comando de jogo: o mapa esta pronto, entao entram o indice de nomes e os jogadores.
+            if (!em_jogo) {
+                if (saida.tamanho_saida > 0) fwrite(saida.saida, 1, saida.tamanho_saida, stdout); // Avisos do indice saem na ordem.
+                saida.tamanho_saida = antes = 0;
+                int num_jogadores = config->jogadores_informados ? config->num_jogadores : partida->cores.total;
+                if ((arquivo_mapa == NULL && indexar_nomes_do_mapa(partida) != 0) ||
+                    preparar_jogadores_sessao(&sessao, &estado, num_jogadores) != 0) {
+                    erro = 1;
+                    break;
+                }
+                em_jogo = 1;
+            }
+            if (palavra_e(palavras[0], "MOSTRAR")) {
+                int primeiro = 1, quantidade = MAX_TERRITORIOS_ESTADO;
+                if (num_palavras > 3 || (num_palavras > 1 && !ler_inteiro_palavra(palavras[1], &primeiro)) ||
+                    (num_palavras > 2 && !ler_inteiro_palavra(palavras[2], &quantidade)) || primeiro < 1) {
+                    responder(&saida, "ERRO uso: MOSTRAR [inicio] [quantidade]\n");
+                } else {
+                    responder_estado(&sessao, &saida, primeiro, quantidade);
+                }
+            } else if (num_palavras < 3 || num_palavras > 4 || (num_palavras == 4 && !palavra_e(palavras[3], "blitz"))) {
+                responder(&saida, "ERRO uso: ATACAR <atacante> <defensor> [blitz]\n");
+            } else if (sessao.vencedor >= 0) {
+                responder(&saida, "ERRO partida encerrada: o jogador %d cumpriu a missao\n", sessao.vencedor + 1);
+            } else {
+                int id_atacante = territorio_do_script(&saida, partida, palavras[1]);
+                int id_defensor = id_atacante > 0 ? territorio_do_script(&saida, partida, palavras[2]) : 0;
+                if (id_atacante > 0 && id_defensor > 0) atacar_na_sessao(&sessao, &saida, id_atacante, id_defensor, num_palavras == 4);
+            }
+        }
+
+        if (saida.fechar) {
+            erro = 1; // Sem memoria para as respostas.
+            break;
+        }
+        if (saida.tamanho_saida - antes >= 4 && memcmp(saida.saida + antes, "ERRO", 4) == 0 && erros++ == 0) {
+            linha_erro = num_linha;
+        }
+        if (saida.tamanho_saida >= LIMITE_SAIDA_SERVIDOR) {
+            fwrite(saida.saida, 1, saida.tamanho_saida, stdout);
+            saida.tamanho_saida = 0;
+        }
+    }
+    if (saida.tamanho_saida > 0) fwrite(saida.saida, 1, saida.tamanho_saida, stdout);
+    munmap((void*)dados, tamanho);
+
+    clock_gettime(CLOCK_MONOTONIC, &fim_tempo);
+    double segundos = (fim_tempo.tv_sec - inicio.tv_sec) + (fim_tempo.tv_nsec - inicio.tv_nsec) / 1e9;
+    if (!erro) {
+        printf("Script '%s': %lld comandos, %lld erros", caminho, comandos, erros);
+        if (erros > 0) printf(" (o primeiro na linha %lld)", linha_erro);
+        if (sessao.vencedor >= 0) {
+            printf(" | vencedor: jogador %d (%s)\n", sessao.vencedor + 1, sessao.mesa.jogadores[sessao.vencedor].cor);
+        } else {
+            printf(" | sem vencedor\n");
+        }
+        printf("Tempo: %.3f s | %.0f comandos/s\n", segundos, segundos > 0 ? comandos / segundos : 0.0);
+    }
+
+    free(saida.saida);
+    descartar_partida(partida);
+    liberar_mesa(&sessao.mesa);
+    liberar_arena(&arena);
+    g_modo_silencioso = 0;
+    return erro || erros > 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// --- Benchmark (--bench) ---
+// ------------------------------------------------------------------------------------------------
+
+// Tamanhos de mapa da varredura padrao do --bench (10^2 a 10^7 territorios).
+const int TAMANHOS_BENCHMARK[] = { 100, 1000, 10000, 100000, 1000000, 10000000 };
+#define NUM_TAMANHOS_BENCHMARK 6
+
+#define OPERACOES_DADOS 50000000 // Dados rolados na medida de rolar_dado.
+#define OPERACOES_ATAQUE 2000000 // Batalhas por tamanho de mapa.
+#define OPERACOES_MISSAO 5000000 // Verificacoes por missao e por tamanho de mapa.
+#define TAMANHO_LOTE_BENCHMARK 65536 // Batalhas por lote em resolver_lote_batalhas.
+#define REPETICOES_LOTE 500          // Lotes resolvidos (TAMANHO_LOTE_BENCHMARK * REPETICOES_LOTE batalhas).
+#define TERRITORIOS_VARREDURA 100000000 // Territorios lidos por medida de varredura (mapas menores repetem a passada).
+#define CICLOS_VERSOES 200000  // Bifurcacoes com ataque e volta por tamanho de mapa.
+#define RAMOS_BENCHMARK 10000  // Ramos vivos ao mesmo tempo na medida de memoria das versoes.
+
+volatile long long g_sumidouro_benchmark; // Impede o compilador de descartar os resultados medidos.
+
+/**
+ * @brief Segundos desde um instante anterior (CLOCK_MONOTONIC).
+ */
+double segundos_desde(const struct timespec* inicio) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (agora.tv_sec - inicio->tv_sec) + (agora.tv_nsec - inicio->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Imprime uma medida como uma linha JSON (JSON Lines): um objeto por linha, facil de
+ * comparar entre versoes. pico_memoria_kb e o pico do processo ate aqui (getrusage).
+ */
+void imprimir_medida(const char* nome, int territorios, long long operacoes, double segundos) {
+    struct rusage uso;
+    getrusage(RUSAGE_SELF, &uso);
+    printf("{\"bench\":\"%s\",\"territorios\":%d,\"operacoes\":%lld,\"ns_por_op\":%.3f,"
+           "\"ops_por_s\":%.0f,\"pico_memoria_kb\":%ld}\n",
+           nome, territorios, operacoes, operacoes > 0 ? segundos * 1e9 / operacoes : 0.0,
+           segundos > 0 ? operacoes / segundos : 0.0, uso.ru_maxrss);
+    fflush(stdout);
+}
+
+/**
+ * @brief Mede o grafo de vizinhanca num mapa em grade: construir_grafo, ligar_grafo (marcas de
+ * fronteira), sao_vizinhos, territorio_na_fronteira e regioes_do_dono.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int medir_grafo(Partida* partida, int n) {
+    struct timespec inicio;
+    long long soma = 0;
+    int largura = 1;
+    while ((long long)largura * largura < n) largura++;
+
+    uint32_t* arestas = (uint32_t*)malloc(4 * (size_t)n * sizeof(uint32_t));
+    if (arestas == NULL) return 1;
+    size_t num_arestas = 0;
+    for (int i = 0; i < n; i++) {
+        if ((i + 1) % largura != 0 && i + 1 < n) {
+            arestas[2 * num_arestas] = (uint32_t)i;
+            arestas[2 * num_arestas++ + 1] = (uint32_t)(i + 1);
+        }
+        if (i + largura < n) {
+            arestas[2 * num_arestas] = (uint32_t)i;
+            arestas[2 * num_arestas++ + 1] = (uint32_t)(i + largura);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    GrafoMapa* grafo = construir_grafo(n, arestas, num_arestas);
+    free(arestas);
+    if (grafo == NULL) return 1;
+    imprimir_medida("construir_grafo", n, (long long)num_arestas, segundos_desde(&inicio));
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    if (ligar_grafo(partida, grafo, 0) != 0) return 1;
+    imprimir_medida("ligar_grafo", n, n, segundos_desde(&inicio));
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int k = 0; k < OPERACOES_ATAQUE; k++) {
+        int a = (int)gerador_intervalo(&partida->gerador, (uint32_t)n);
+        soma += sao_vizinhos(partida, a, a + 1 < n ? a + 1 : 0) + territorio_na_fronteira(partida, a);
+    }
+    imprimir_medida("sao_vizinhos+territorio_na_fronteira", n, OPERACOES_ATAQUE, segundos_desde(&inicio));
+
+    int maior;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    soma += regioes_do_dono(partida, partida->mapa[0].dono, &maior);
+    imprimir_medida("regioes_do_dono", n, n, segundos_desde(&inicio));
+
+    g_sumidouro_benchmark += soma + maior;
+    return 0;
+}
+
+/**
+ * @brief Mede o indice de sequencias: montagem, o custo que ele acrescenta a transferir_territorio
+ * e alterar_tropas (o mesmo laco com e sem o indice) e as consultas (maior_sequencia e
+ * tropas_no_intervalo), comparadas com a varredura do mapa que elas substituem. O indice fica
+ * montado para as medidas seguintes.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int medir_sequencias(Partida* partida, int n, const int* ids) {
+    struct timespec inicio;
+    long long soma = 0;
+    int varreduras = n >= 1000000 ? 10 : 1000;
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int k = 0; k < varreduras; k++) {
+        soma += maior_sequencia(partida, ids[k % NUM_LADOS_SIMULACAO]) +
+                tropas_no_intervalo(partida, k % n, n - 1 - k % n);
+    }
+    imprimir_medida("maior_sequencia+tropas_no_intervalo_varredura", n, varreduras, segundos_desde(&inicio));
+
+    for (int com_indice = 0; com_indice < 2; com_indice++) {
+        if (com_indice) {
+            clock_gettime(CLOCK_MONOTONIC, &inicio);
+            if (construir_indice_sequencias(partida) != 0) return 1;
+            imprimir_medida("construir_indice_sequencias", n, n, segundos_desde(&inicio));
+        }
+        GeradorDados gerador = partida->gerador; // Mesma sequencia de trocas nas duas medidas.
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        for (int k = 0; k < OPERACOES_ATAQUE; k++) {
+            Territorio* t = partida->mapa + gerador_intervalo(&gerador, (uint32_t)n);
+            transferir_territorio(partida, t, ids[gerador_intervalo(&gerador, NUM_LADOS_SIMULACAO)]);
+            alterar_tropas(partida, t, 1 + (int)gerador_intervalo(&gerador, 9));
+        }
+        imprimir_medida(com_indice ? "transferir+alterar_tropas_com_indice" : "transferir+alterar_tropas",
+                        n, OPERACOES_ATAQUE, segundos_desde(&inicio));
+    }
+    if (partida->sequencias == NULL) return 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int k = 0; k < OPERACOES_ATAQUE; k++) {
+        int a = (int)gerador_intervalo(&partida->gerador, (uint32_t)n);
+        soma += maior_sequencia(partida, ids[k % NUM_LADOS_SIMULACAO]) +
+                tropas_no_intervalo(partida, a, a + (int)gerador_intervalo(&partida->gerador, (uint32_t)n));
+    }
+    imprimir_medida("maior_sequencia+tropas_no_intervalo", n, OPERACOES_ATAQUE, segundos_desde(&inicio));
+
+    g_sumidouro_benchmark += soma;
+    return 0;
+}
+
+/**
+ * @brief Mede as versoes do mapa (copia na escrita): a versao inicial, o ciclo da analise e do desfazer
+ * (bifurcar, mudar dois territorios, voltar e soltar), a mesma bifurcacao feita com uma copia do mapa
+ * inteiro, e a memoria de RAMOS_BENCHMARK ramos vivos ao mesmo tempo.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int medir_versoes(Partida* partida, int n, const int* ids) {
+    struct timespec inicio;
+    long long soma = 0;
+    int copias = n >= 1000000 ? 20 : 2000;
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    if (iniciar_versoes(partida) != 0) return 1;
+    imprimir_medida("iniciar_versoes", n, n, segundos_desde(&inicio));
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int k = 0; k < CICLOS_VERSOES; k++) {
+        NoVersao* versao = bifurcar_versao(partida);
+        for (int m = 0; m < 2; m++) {
+            Territorio* t = partida->mapa + gerador_intervalo(&partida->gerador, (uint32_t)n);
+            transferir_territorio(partida, t, ids[gerador_intervalo(&partida->gerador, NUM_LADOS_SIMULACAO)]);
+            alterar_tropas(partida, t, 1 + (int)gerador_intervalo(&partida->gerador, 9));
+        }
+        soma += voltar_para_versao(partida, versao);
+        soltar_versao(partida, versao);
+    }
+    imprimir_medida("bifurcar+ataque+voltar_versao", n, CICLOS_VERSOES, segundos_desde(&inicio));
+
+    Territorio* copia = (Territorio*)malloc((size_t)n * sizeof(Territorio));
+    if (copia == NULL) return 1;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int k = 0; k < copias; k++) {
+        memcpy(copia, partida->mapa, (size_t)n * sizeof(Territorio));
+        soma += copia[k % n].tropas;
+    }
+    imprimir_medida("bifurcar_copiando_o_mapa", n, copias, segundos_desde(&inicio));
+    free(copia);
+
+    // Ramos vivos: cada um parte da mesma versao e muda dois territorios.
+    NoVersao** ramos = (NoVersao**)malloc(RAMOS_BENCHMARK * sizeof(NoVersao*));
+    if (ramos == NULL) return 1;
+    NoVersao* raiz = bifurcar_versao(partida);
+    long long nos_antes = partida->versoes->nos_em_uso;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int k = 0; k < RAMOS_BENCHMARK; k++) {
+        voltar_para_versao(partida, raiz);
+        for (int m = 0; m < 2; m++) {
+            Territorio* t = partida->mapa + gerador_intervalo(&partida->gerador, (uint32_t)n);
+            alterar_tropas(partida, t, t->tropas + 1);
+        }
+        ramos[k] = bifurcar_versao(partida);
+    }
+    imprimir_medida("criar_ramo_vivo", n, RAMOS_BENCHMARK, segundos_desde(&inicio));
+    printf("{\"bench\":\"memoria_versoes\",\"territorios\":%d,\"ramos_vivos\":%d,\"bytes_por_ramo\":%.0f,"
+           "\"bytes_copia_do_mapa\":%zu}\n",
+           n, RAMOS_BENCHMARK, (double)(partida->versoes->nos_em_uso - nos_antes) * sizeof(NoVersao) / RAMOS_BENCHMARK,
+           (size_t)n * sizeof(Territorio));
+    fflush(stdout);
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    voltar_para_versao(partida, raiz);
+    for (int k = 0; k < RAMOS_BENCHMARK; k++) soltar_versao(partida, ramos[k]);
+    soltar_versao(partida, raiz);
+    imprimir_medida("soltar_ramo", n, RAMOS_BENCHMARK, segundos_desde(&inicio));
+    free(ramos);
+
+    g_sumidouro_benchmark += soma;
+    liberar_versoes(partida);
+    return 0;
+}
+
+/**
+ * @brief Mede o mapa compacto: montagem, varredura completa (recontar os totais dos donos) e a mesma
+ * varredura sobre o vetor de Territorio, e a memoria por territorio de cada formato.
+ * @param partida Mapa ja montado por medir_tamanho_mapa (compactado aqui), ou NULL para gerar o mapa
+ * direto no formato compacto, sem o vetor de Territorio (--mapa-compacto, para 10^8 territorios).
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int medir_mapa_compacto(const Partida* partida, int n, uint64_t semente) {
+    MapaCompacto mapa;
+    GeradorDados gerador;
+    AgregadoDono agregados[NUM_LADOS_SIMULACAO];
+    struct timespec inicio;
+    long long soma = 0;
+    int repeticoes = n >= TERRITORIOS_VARREDURA ? 1 : TERRITORIOS_VARREDURA / n;
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    if (partida != NULL) {
+        if (compactar_mapa(partida, &mapa) != 0) return 1;
+        imprimir_medida("compactar_mapa", n, n, segundos_desde(&inicio));
+    } else {
+        gerador_iniciar(&gerador, semente, (uint64_t)n);
+        if (gerar_mapa_compacto(&mapa, n, NUM_LADOS_SIMULACAO, &gerador) != 0) return 1;
+        imprimir_medida("gerar_mapa_compacto", n, n, segundos_desde(&inicio));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int r = 0; r < repeticoes; r++) {
+        recontar_donos_compacto(&mapa, agregados, NUM_LADOS_SIMULACAO);
+        soma += agregados[r % NUM_LADOS_SIMULACAO].tropas;
+    }
+    imprimir_medida("varredura_soa", n, (long long)n * repeticoes, segundos_desde(&inicio));
+
+    if (partida != NULL) {
+        // A mesma passada sobre o vetor de Territorio, que arrasta os nomes pelo cache.
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        for (int r = 0; r < repeticoes; r++) {
+            memset(agregados, 0, sizeof(agregados));
+            for (int i = 0; i < n; i++) {
+                const Territorio* t = partida->mapa + i;
+                AgregadoDono* a = &agregados[t->dono];
+                a->territorios++;
+                a->tropas += t->tropas;
+                a->territorios_fortes += t->tropas > LIMIAR_TERRITORIO_FORTE;
+            }
+            soma += agregados[r % NUM_LADOS_SIMULACAO].tropas;
+        }
+        imprimir_medida("varredura_aos", n, (long long)n * repeticoes, segundos_desde(&inicio));
+    }
+
+    printf("{\"bench\":\"memoria_mapa\",\"territorios\":%d,\"bytes_por_territorio_aos\":%.2f,"
+           "\"bytes_por_territorio_soa\":%.2f,\"nomes_no_pool\":%zu,\"paginas_enormes\":%d}\n",
+           n, (double)sizeof(Territorio), (double)bytes_mapa_compacto(&mapa) / n, mapa.nomes.num_nomes,
+           g_paginas_enormes);
+    fflush(stdout);
+
+    g_sumidouro_benchmark += soma;
+    liberar_mapa_compacto(&mapa);
+    return 0;
+}
+
+/**
+ * @brief Mede um tamanho de mapa: alocacao, registro dos territorios, atacar, grafo, indice de
+ * sequencias, versoes do mapa e cada missao.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int medir_tamanho_mapa(int n, uint64_t semente) {
+    Partida partida = {0};
+    struct timespec inicio;
+    int ids[NUM_LADOS_SIMULACAO];
+    long long soma = 0;
+
+    iniciar_dados_partida(&partida, semente, (uint64_t)n);
+    for (int j = 0; j < NUM_LADOS_SIMULACAO; j++) ids[j] = registrar_cor(&partida.cores, CORES_SIMULACAO[j]);
+
+    // 1. Alocacao do mapa (calloc), registro dos territorios (nome, dono, tropas e agregados) e
+    //    indice de nomes.
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    if (alocar_mapa(&partida, n) != 0) return 1;
+    imprimir_medida("alocar_mapa", n, n, segundos_desde(&inicio));
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int i = 0; i < n; i++) {
+        Territorio* t = partida.mapa + i;
+        snprintf(t->nome, TAMANHO_NOME, "Territorio-%d", i + 1);
+        if (registrar_territorio(&partida, t, ids[i % NUM_LADOS_SIMULACAO], 1 + i % 9) != 0) {
+            descartar_partida(&partida);
+            return 1;
+        }
+    }
+    imprimir_medida("registrar_territorio", n, n, segundos_desde(&inicio));
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    if (construir_indice_nomes(&partida, NULL) != 0) {
+        descartar_partida(&partida);
+        return 1;
+    }
+    imprimir_medida("construir_indice_nomes", n, n, segundos_desde(&inicio));
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int k = 0; k < OPERACOES_ATAQUE; k++) {
+        soma += buscar_territorio(&partida, partida.mapa[gerador_intervalo(&partida.gerador, (uint32_t)n)].nome);
+    }
+    imprimir_medida("buscar_territorio", n, OPERACOES_ATAQUE, segundos_desde(&inicio));
+
+    // 2. Resolucao de atacar (modo silencioso) entre pares aleatorios de territorios.
+    uint32_t* pares = (uint32_t*)malloc(2 * OPERACOES_ATAQUE * sizeof(uint32_t));
+    if (pares == NULL) {
+        descartar_partida(&partida);
+        return 1;
+    }
+    for (int k = 0; k < 2 * OPERACOES_ATAQUE; k += 2) {
+        pares[k] = gerador_intervalo(&partida.gerador, (uint32_t)n);
+        pares[k + 1] = (pares[k] + 1 + gerador_intervalo(&partida.gerador, (uint32_t)n - 1)) % (uint32_t)n;
+    }
+    Jogador jogador = {0};
+    strcpy(jogador.cor, CORES_SIMULACAO[0]);
+    jogador.id_cor = ids[0];
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int k = 0; k < 2 * OPERACOES_ATAQUE; k += 2) {
+        soma += atacar(&partida, partida.mapa + pares[k], partida.mapa + pares[k + 1], &jogador);
+    }
+    imprimir_medida("atacar", n, OPERACOES_ATAQUE, segundos_desde(&inicio));
+    free(pares);
+
+    // 3. Grafo em grade (largura ~ raiz de n): montagem do CSR, fronteiras e regioes.
+    if (medir_grafo(&partida, n) != 0) {
+        descartar_partida(&partida);
+        return 1;
+    }
+
+    // 4. Indice de sequencias (territorios seguidos e tropas por intervalo).
+    if (medir_sequencias(&partida, n, ids) != 0) {
+        descartar_partida(&partida);
+        return 1;
+    }
+
+    // 5. Versoes do mapa com copia na escrita (desfazer e analise de jogadas).
+    if (medir_versoes(&partida, n, ids) != 0) {
+        descartar_partida(&partida);
+        return 1;
+    }
+
+    // 6. verificarMissao para cada missao da tabela (uma medida por tipo de metrica).
+    for (int m = 0; m < g_missoes.total; m++) {
+        char nome[64];
+        const Missao* missao = &g_missoes.missoes[m];
+
+        jogador.id_missao = m;
+        jogador.alvo_missao = missao->alvo[0] == '\0' ? jogador.id_cor : buscar_cor(&partida.cores, missao->alvo);
+        snprintf(nome, sizeof(nome), "verificarMissao_%d_%s", m, NOMES_METRICAS[missao->tipo]);
+
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        for (int k = 0; k < OPERACOES_MISSAO; k++) {
+            soma += verificarMissao(&jogador, &partida);
+            jogador.territorios_conquistados ^= k & 1; // Evita que o laco seja reduzido a uma chamada.
+        }
+        imprimir_medida(nome, n, OPERACOES_MISSAO, segundos_desde(&inicio));
+    }
+
+    // 7. Mapa compacto (estrutura de arrays) do mesmo mapa: conversao, varredura e memoria.
+    if (medir_mapa_compacto(&partida, n, semente) != 0) {
+        descartar_partida(&partida);
+        return 1;
+    }
+
+    g_sumidouro_benchmark += soma;
+    descartar_partida(&partida);
+    return 0;
+}
+
+/**
+ * @brief Mede o nucleo de combate: resolver_batalha (uma batalha por chamada) e
+ * resolver_lote_batalhas (SoA, vetorizado) sobre o mesmo lote de entradas aleatorias.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
+ */
+int medir_nucleo_combate(Partida* partida) {
+    struct timespec inicio;
+    long long soma = 0;
+    long long operacoes = (long long)TAMANHO_LOTE_BENCHMARK * REPETICOES_LOTE;
+    int32_t* dados = (int32_t*)malloc(7 * TAMANHO_LOTE_BENCHMARK * sizeof(int32_t));
+    if (dados == NULL) return 1;
+
+    LoteBatalhas lote = {
+        .tropas_atacante = dados,
+        .tropas_defensor = dados + TAMANHO_LOTE_BENCHMARK,
+        .dado_ataque = dados + 2 * TAMANHO_LOTE_BENCHMARK,
+        .dado_defesa = dados + 3 * TAMANHO_LOTE_BENCHMARK,
+        .conquista = dados + 4 * TAMANHO_LOTE_BENCHMARK,
+        .delta_atacante = dados + 5 * TAMANHO_LOTE_BENCHMARK,
+        .delta_defensor = dados + 6 * TAMANHO_LOTE_BENCHMARK,
+    };
+    for (int i = 0; i < TAMANHO_LOTE_BENCHMARK; i++) {
+        dados[i] = 1 + (int32_t)gerador_intervalo(&partida->gerador, 20);
+        dados[TAMANHO_LOTE_BENCHMARK + i] = 1 + (int32_t)gerador_intervalo(&partida->gerador, 20);
+        dados[2 * TAMANHO_LOTE_BENCHMARK + i] = rolar_dado(partida);
+        dados[3 * TAMANHO_LOTE_BENCHMARK + i] = rolar_dado(partida);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int r = 0; r < REPETICOES_LOTE; r++) {
+        for (int i = 0; i < TAMANHO_LOTE_BENCHMARK; i++) {
+            ResultadoBatalha b = resolver_batalha(lote.tropas_atacante[i], lote.tropas_defensor[i],
+                                                  lote.dado_ataque[i], lote.dado_defesa[i]);
+            lote.conquista[i] = b.conquista;
+            lote.delta_atacante[i] = b.delta_atacante;
+            lote.delta_defensor[i] = b.delta_defensor;
+        }
+        soma += lote.delta_atacante[r % TAMANHO_LOTE_BENCHMARK];
+    }
+    imprimir_medida("resolver_batalha", 0, operacoes, segundos_desde(&inicio));
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int r = 0; r < REPETICOES_LOTE; r++) soma += resolver_lote_batalhas(&lote, TAMANHO_LOTE_BENCHMARK);
+    imprimir_medida("resolver_lote_batalhas", 0, operacoes, segundos_desde(&inicio));
+
+    g_sumidouro_benchmark += soma;
+    free(dados);
+    return 0;
+}
+
+/**
+ * @brief Benchmark (--bench): rolar_dado, nucleo de combate, atacar, verificarMissao (por missao), alocacao/registro
+ * do mapa e mapa compacto, variando o mapa de 10^2 a 10^7 territorios (ou os tamanhos de --territorios).
+ * Com --mapa-compacto, so o mapa compacto (sem o vetor de Territorio), o que permite 10^8 territorios.
+ * A saida e uma linha JSON por medida.
+ * @return int: codigo de saida do programa.
+ */
+int executar_benchmark(const Configuracao* config) {
+    Partida partida = {0};
+    struct timespec inicio;
+    long long soma = 0;
+
+    g_modo_silencioso = 1;
+
+    // rolar_dado nao depende do mapa: uma unica medida.
+    iniciar_dados_partida(&partida, config->semente, 0);
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (int k = 0; k < OPERACOES_DADOS; k++) soma += rolar_dado(&partida);
+    imprimir_medida("rolar_dado", 0, OPERACOES_DADOS, segundos_desde(&inicio));
+    g_sumidouro_benchmark += soma;
+
+    // Nucleo de combate (tambem independente do mapa): escalar e em lote, sobre as mesmas entradas.
+    if (medir_nucleo_combate(&partida) != 0) {
+        fprintf(stderr, "Erro: memoria insuficiente para o benchmark do nucleo de combate.\n");
+        g_modo_silencioso = 0;
+        return 1;
+    }
+
+    int num_tamanhos = config->tamanhos_informados ? config->num_mapas : NUM_TAMANHOS_BENCHMARK;
+    for (int t = 0; t < num_tamanhos; t++) {
+        int n = config->tamanhos_informados ? config->tamanhos_mapa[t] : TAMANHOS_BENCHMARK[t];
+        int erro = config->mapa_compacto ? medir_mapa_compacto(NULL, n, config->semente)
+                                         : medir_tamanho_mapa(n, config->semente);
+        if (erro != 0) {
+            fprintf(stderr, "Erro: memoria insuficiente para o benchmark com %d territorios.\n", n);
+            g_modo_silencioso = 0;
+            return 1;
+        }
+    }
+
+    g_modo_silencioso = 0;
+    return 0;
+}
+
+
+/**
+ * @brief Le uma lista de tamanhos de mapa separados por virgula (ex: "10,20,40").
+ * @return int: Quantidade de mapas lidos, ou -1 se a lista e invalida.
+ */
+int ler_lista_mapas(const char* texto, int* tamanhos) {
+    int n = 0;
+    const char* p = texto;
+
+    while (*p != '\0') {
+        char* fim_numero;
+        long valor = strtol(p, &fim_numero, 10);
+        if (fim_numero == p || valor < 2 || n == MAX_MAPAS_SIMULACAO) return -1;
+        tamanhos[n++] = (int)valor;
+        p = fim_numero;
+        if (*p == ',') p++;
+        else if (*p != '\0') return -1;
+    }
+    return n;
+}
+
+/**
+ * @brief Converte o mapa de --map para o formato binario (--exportar-mapa).
+ * @return int: codigo de saida do programa.
+ */
+int exportar_mapa(const Configuracao* config) {
+    Partida partida = {0};
+    struct timespec inicio, fim;
+
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    if (carregar_mapa(&partida, config->arquivos_mapa[config->num_mapas - 1]) != 0) return 1;
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+
+    int falhou = salvar_mapa_binario(&partida, config->exportar_mapa);
+    if (!falhou) {
+        double segundos = (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+        printf("Mapa exportado para '%s': %d territorios, %d cores (leitura em %.3f s).\n",
+               config->exportar_mapa, partida.num_territorios, partida.cores.total, segundos);
+    }
+    descartar_partida(&partida);
+    return falhou;
+}
+
+/**
+ * @brief Le os argumentos de linha de comando.
+ * @return int: 1 se o modo simulacao foi pedido, 0 caso contrario, -1 em caso de erro.
+ */
+int ler_argumentos(int argc, char* argv[], Configuracao* config) {
+    int pedido = 0;
+    int territorios_informados = 0;
+    const char* arquivos[MAX_MAPAS_SIMULACAO];
+    int num_arquivos = 0;
+    long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+
+    memset(config, 0, sizeof(*config));
+    config->num_threads = nucleos > 0 ? (int)nucleos : 1;
+    config->max_rodadas = 500;
+    config->semente = (uint64_t)time(NULL);
+    config->num_mapas = 1;
+    config->tamanhos_mapa[0] = 10;
+    config->arquivo_estado = "war.estado";
+    config->num_jogadores = NUM_LADOS_SIMULACAO;
+    config->ia_ms = 100;
+
+    for (int i = 1; i < argc; i++) {
+        int tem_valor = (i + 1 < argc);
+
+        if (strcmp(argv[i], "--simulate") == 0 && tem_valor) {
+            config->num_partidas = atoi(argv[++i]);
+            pedido = 1;
+        } else if (strcmp(argv[i], "--territorios") == 0 && tem_valor) {
+            config->num_mapas = ler_lista_mapas(argv[++i], config->tamanhos_mapa);
+            territorios_informados = 1;
+            config->tamanhos_informados = 1;
+        } else if (strcmp(argv[i], "--map") == 0 && tem_valor) {
+            if (num_arquivos == MAX_MAPAS_SIMULACAO) {
+                printf("Erro: no maximo %d mapas por execucao.\n", MAX_MAPAS_SIMULACAO);
+                return -1;
+            }
+            arquivos[num_arquivos++] = argv[++i];
+        } else if (strcmp(argv[i], "--exportar-mapa") == 0 && tem_valor) {
+            config->exportar_mapa = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && tem_valor) {
+            config->intervalo_checkpoint = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--arquivo-estado") == 0 && tem_valor) {
+            config->arquivo_estado = argv[++i];
+        } else if (strcmp(argv[i], "--diario") == 0 && tem_valor) {
+            config->arquivo_diario = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && tem_valor) {
+            config->arquivo_replay = argv[++i];
+        } else if (strcmp(argv[i], "--script") == 0 && tem_valor) {
+            config->arquivo_script = argv[++i];
+        } else if (strcmp(argv[i], "--autoteste") == 0) {
+            config->autoteste = 1;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            config->benchmark = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            // Formato opcional: --stats json | --stats texto (padrao).
+            config->estatisticas = 1;
+            if (tem_valor && strcmp(argv[i + 1], "json") == 0) {
+                config->estatisticas_json = 1;
+                i++;
+            } else if (tem_valor && strcmp(argv[i + 1], "texto") == 0) {
+                i++;
+            }
+        } else if (strcmp(argv[i], "--blitz") == 0) {
+            config->blitz = 1;
+        } else if (strcmp(argv[i], "--ia") == 0 && tem_valor) {
+            i++;
+            if (strcmp(argv[i], "mcts") == 0) {
+                config->ia_mcts = 1;
+            } else if (strcmp(argv[i], "script") != 0) {
+                printf("Erro: --ia aceita 'mcts' ou 'script'.\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--ia-ms") == 0 && tem_valor) {
+            config->ia_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ia-threads") == 0 && tem_valor) {
+            config->ia_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ia-iteracoes") == 0 && tem_valor) {
+            config->ia_iteracoes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--jogadores") == 0 && tem_valor) {
+            config->num_jogadores = atoi(argv[++i]);
+            config->jogadores_informados = 1;
+        } else if (strcmp(argv[i], "--max-rodadas") == 0 && tem_valor) {
+            config->max_rodadas = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && tem_valor) {
+            config->num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && tem_valor) {
+            config->semente = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--missoes") == 0 && tem_valor) {
+            config->arquivo_missoes = argv[++i];
+        } else if (strcmp(argv[i], "--servidor") == 0 && tem_valor) {
+            config->endereco_servidor = argv[++i];
+        } else if (strcmp(argv[i], "--mapa-compacto") == 0) {
+            config->mapa_compacto = 1;
+        } else if (strcmp(argv[i], "--paginas-enormes") == 0) {
+            config->paginas_enormes = 1;
+        } else {
+            printf("Argumento invalido: %s\n", argv[i]);
+            printf("Uso: %s [--simulate N] [--threads T] [--seed S] [--territorios T1,T2,...] [--max-rodadas R] [--missoes ARQUIVO] [--blitz] [--jogadores N]"
+                   " [--ia mcts|script] [--ia-ms MS] [--ia-threads T] [--ia-iteracoes N]"
+                   " [--map ARQUIVO]... [--mapa-compacto] [--exportar-mapa ARQUIVO]"
+                   " [--checkpoint K] [--arquivo-estado ARQUIVO]"
+                   " [--diario ARQUIVO] [--replay DIARIO --map MAPA_INICIAL] [--script ARQUIVO [--map MAPA]]"
+                   " [--bench [--territorios T1,T2,...] [--mapa-compacto]] [--autoteste] [--paginas-enormes] [--stats [json|texto]]"
+                   " [--servidor PORTA|SOCKET_UNIX]\n", argv[0]);
+            return -1;
         }
-    } while (num <= 0);
-    
-    limpar_buffer();
-    g_num_territorios = num;
-
-    // calloc aloca e inicializa com zero.
-    mapa = (Territorio*)calloc(g_num_territorios, sizeof(Territorio));
+    }
 
-    if (mapa == NULL) {
-        perror("Erro ao alocar memoria para o mapa de territorios");
-        g_num_territorios = 0; 
-        return NULL;
+    // Os mapas de arquivo entram depois dos gerados; sem --territorios, so os arquivos sao usados.
+    if (num_arquivos > 0) {
+        if (!territorios_informados) config->num_mapas = 0;
+        if (config->num_mapas >= 0 && config->num_mapas + num_arquivos > MAX_MAPAS_SIMULACAO) {
+            printf("Erro: no maximo %d mapas por execucao.\n", MAX_MAPAS_SIMULACAO);
+            return -1;
+        }
+        for (int k = 0; k < num_arquivos && config->num_mapas >= 0; k++) {
+            config->arquivos_mapa[config->num_mapas++] = arquivos[k];
+        }
+    }
+    if (config->intervalo_checkpoint < 0) {
+        printf("Erro: --checkpoint exige K >= 0.\n");
+        return -1;
+    }
+    if (config->num_jogadores < 1 || config->num_jogadores > MAX_JOGADORES_SIMULACAO) {
+        printf("Erro: --jogadores exige 1 <= N <= %d.\n", MAX_JOGADORES_SIMULACAO);
+        return -1;
+    }
+    if (config->ia_ms < 0 || config->ia_threads < 0 || config->ia_iteracoes < 0) {
+        printf("Erro: --ia-ms, --ia-threads e --ia-iteracoes exigem valores >= 0.\n");
+        return -1;
+    }
+    if (config->ia_ms == 0 && config->ia_iteracoes == 0) {
+        // Sem prazo e sem limite de iteracoes, a busca nunca terminaria.
+        printf("Erro: --ia-ms 0 (sem limite de tempo) exige --ia-iteracoes N > 0.\n");
+        return -1;
+    }
+    if (config->arquivo_replay != NULL && num_arquivos != 1) {
+        printf("Erro: --replay exige o mapa inicial do diario (um --map).\n");
+        return -1;
+    }
+    if (config->exportar_mapa != NULL && num_arquivos != 1) {
+        printf("Erro: --exportar-mapa exige exatamente um --map.\n");
+        return -1;
     }
 
-    printf("Memoria alocada com sucesso para %d territorios.\n\n", g_num_territorios);
-    return mapa; 
+    if (pedido && (config->num_partidas <= 0 || config->num_mapas <= 0 ||
+                   config->max_rodadas <= 0 || config->num_threads <= 0)) {
+        printf("Erro: --simulate exige N > 0, --threads > 0, --max-rodadas > 0 e mapas com pelo menos 2 territorios.\n");
+        return -1;
+    }
+    return pedido;
 }
 
+
 // ------------------------------------------------------------------------------------------------
-// --- Funcoes de Missao e Jogador ---
+// --- Autoteste (--autoteste): caminhos rapidos conferidos contra os caminhos diretos ---
 // ------------------------------------------------------------------------------------------------
+// Cada verificacao roda a versao otimizada e a versao direta sobre as mesmas entradas aleatorias
+// (semente de --seed) e conta as divergencias.
+
+#define BATALHAS_AUTOTESTE 100003      // Batalhas do lote (nao multiplo de 4: o resto passa pelo escalar).
+#define DADOS_AUTOTESTE 6000000        // Dados rolados em lote e um a um.
+#define ATAQUES_BLITZ_AUTOTESTE 200000 // Ataques relampago por numero de tropas.
+#define TERRITORIOS_AUTOTESTE 5003     // Territorios do mapa das verificacoes sobre o mapa.
+#define PASSOS_AUTOTESTE 20000         // Mudancas aleatorias no mapa por verificacao.
+#define COPIAS_AUTOTESTE 64            // Versoes (e copias do mapa) guardadas ao mesmo tempo.
+#define CORES_AUTOTESTE 4
+#define DESVIOS_AUTOTESTE 5.0          // Tolerancia das verificacoes estatisticas, em desvios padrao.
 
 /**
- * @brief Sorteia uma missão do vetor de MISSOES e aloca-a dinamicamente para o jogador.
- * * Uso de PONTEIRO e alocação dinâmica (requisito).
- * @param jogador Ponteiro para a struct do Jogador (passagem por referência).
+ * @brief Imprime o resultado de uma verificacao.
+ * @return int: 1 se houve divergencia, 0 caso contrario.
  */
-void atribuirMissao(Jogador* jogador) {
-    // Sorteia um índice no intervalo [0, TOTAL_MISSOES - 1].
-    int indice_sorteado = rand() % TOTAL_MISSOES;
-    char* missao_base = MISSOES[indice_sorteado];
-    
-    // Armazenamento Dinâmico (malloc) da Missão (requisito)
-    // +1 para o caractere nulo '\0'.
-    jogador->missao = (char*)malloc(strlen(missao_base) + 1); 
+int relatar_autoteste(const char* nome, long long casos, long long divergencias) {
+    printf("  %-40s %10lld casos: %s", nome, casos, divergencias == 0 ? "OK\n" : "FALHOU");
+    if (divergencias != 0) printf(" (%lld divergencias)\n", divergencias);
+    return divergencias != 0;
+}
 
-    if (jogador->missao == NULL) {
-        perror("Erro ao alocar memoria para a missao do jogador");
-        return;
+/**
+ * @brief resolver_lote_batalhas (vetorial) contra resolver_batalha, batalha a batalha.
+ * @return int: 1 se houve divergencia ou falta de memoria, 0 caso contrario.
+ */
+int autoteste_lote_batalhas(GeradorDados* gerador) {
+    int32_t* dados = (int32_t*)malloc(7 * (size_t)BATALHAS_AUTOTESTE * sizeof(int32_t));
+    long long divergencias = 0;
+    if (dados == NULL) return relatar_autoteste("lote de batalhas (sem memoria)", 0, 1);
+
+    LoteBatalhas lote = {
+        .tropas_atacante = dados,
+        .tropas_defensor = dados + BATALHAS_AUTOTESTE,
+        .dado_ataque = dados + 2 * BATALHAS_AUTOTESTE,
+        .dado_defesa = dados + 3 * BATALHAS_AUTOTESTE,
+        .conquista = dados + 4 * BATALHAS_AUTOTESTE,
+        .delta_atacante = dados + 5 * BATALHAS_AUTOTESTE,
+        .delta_defensor = dados + 6 * BATALHAS_AUTOTESTE,
+    };
+    for (int i = 0; i < BATALHAS_AUTOTESTE; i++) {
+        dados[i] = 1 + (int32_t)gerador_intervalo(gerador, 40); // Inclui 1 tropa (nada a perder).
+        dados[BATALHAS_AUTOTESTE + i] = 1 + (int32_t)gerador_intervalo(gerador, 40);
+        dados[2 * BATALHAS_AUTOTESTE + i] = gerador_d6(gerador);
+        dados[3 * BATALHAS_AUTOTESTE + i] = gerador_d6(gerador);
     }
 
-    // Copia a missão sorteada para a memória alocada dinamicamente.
-    strcpy(jogador->missao, missao_base);
+    long long conquistas = resolver_lote_batalhas(&lote, BATALHAS_AUTOTESTE);
+    for (int i = 0; i < BATALHAS_AUTOTESTE; i++) {
+        ResultadoBatalha r = resolver_batalha(lote.tropas_atacante[i], lote.tropas_defensor[i],
+                                              lote.dado_ataque[i], lote.dado_defesa[i]);
+        divergencias += r.conquista != lote.conquista[i] || r.delta_atacante != lote.delta_atacante[i] ||
+                        r.delta_defensor != lote.delta_defensor[i];
+        conquistas -= r.conquista;
+    }
+    divergencias += conquistas != 0; // O total devolvido pelo lote tambem tem de conferir.
+    free(dados);
+    return relatar_autoteste("lote de batalhas = nucleo escalar", BATALHAS_AUTOTESTE, divergencias);
 }
 
 /**
- * @brief Exibe a missão do jogador (apenas uma vez, no início).
- * @param jogador Ponteiro constante para a struct do Jogador (passagem por valor conceitual).
+ * @brief gerador_preencher_d6 (lote vetorial) contra gerador_d6: os dois so podem dar 1 a 6 e, como
+ * vem de fluxos diferentes, sao comparados pela frequencia de cada face.
+ * @return int: 1 se houve divergencia ou falta de memoria, 0 caso contrario.
  */
-void exibirMissao(const Jogador* jogador) {
-    printf("\n==========================================\n");
-    printf("             SUA MISSAO  \n");
-    printf("==========================================\n");
-    printf("Cor do Exercito: %s\n", jogador->cor);
-    printf("Objetivo: %s\n", jogador->missao);
-    printf("==========================================\n");
-    sleep(3);
+int autoteste_dados(GeradorDados* gerador) {
+    unsigned char* lote = (unsigned char*)malloc(DADOS_AUTOTESTE);
+    long long faces_lote[FACES_DADO + 1] = {0}, faces_escalar[FACES_DADO + 1] = {0};
+    long long divergencias = 0;
+    if (lote == NULL) return relatar_autoteste("dados em lote (sem memoria)", 0, 1);
+
+    gerador_preencher_d6(gerador, lote, DADOS_AUTOTESTE);
+    for (int i = 0; i < DADOS_AUTOTESTE; i++) {
+        int escalar = gerador_d6(gerador);
+        if (lote[i] < 1 || lote[i] > FACES_DADO) divergencias++;
+        else faces_lote[lote[i]]++;
+        faces_escalar[escalar]++;
+    }
+    // Contagem de cada face: binomial(n, 1/6); a diferenca entre os dois fluxos tem o dobro da variancia.
+    double desvio = sqrt(2.0 * DADOS_AUTOTESTE * (1.0 / FACES_DADO) * (1.0 - 1.0 / FACES_DADO));
+    for (int f = 1; f <= FACES_DADO; f++) {
+        divergencias += fabs((double)(faces_lote[f] - faces_escalar[f])) > DESVIOS_AUTOTESTE * desvio;
+    }
+    free(lote);
+    return relatar_autoteste("dados em lote ~ dado escalar", DADOS_AUTOTESTE, divergencias);
 }
 
 /**
- * @brief Verifica se a missão do jogador foi cumprida.
- * * (Lógica Simples Inicial - requisito)
- * @param jogador Ponteiro para a struct do Jogador (passagem por referência).
- * @param mapa Ponteiro para o array de territórios.
- * @return int: 1 se a missão foi cumprida, 0 caso contrário.
+ * @brief Indica se uma media amostral esta a ate DESVIOS_AUTOTESTE erros padrao do valor esperado.
+ * @param soma Soma das amostras.
+ * @param soma_quadrados Soma dos quadrados das amostras.
  */
-int verificarMissao(Jogador* jogador, Territorio* mapa) {
-    // Lógica 1: Controlar pelo menos 5 territórios.
-    if (strcmp(jogador->missao, MISSOES[2]) == 0) { 
-        int contagem = 0;
-        for (int i = 0; i < g_num_territorios; i++) {
-            if (strcmp((mapa + i)->cor, jogador->cor) == 0) {
-                contagem++;
-            }
-        }
-        if (contagem >= 5) {
-            printf("\nPARABENS! O jogador %s cumpriu sua missao de 'Controlar pelo menos 5 territorios'!\n", jogador->cor);
-            return 1;
-        }
-    }
-    
-    // Lógica 2: Conquistar 3 territórios seguidos. (Baseado em um contador simples)
-    if (strcmp(jogador->missao, MISSOES[0]) == 0) {
-         if (jogador->territorios_conquistados >= 3) {
-            printf("\nPARABENS! O jogador %s cumpriu sua missao de 'Conquistar 3 territorios seguidos'!\n", jogador->cor);
-            return 1;
-        }
+int media_confere(double soma, double soma_quadrados, long long n, double esperado) {
+    double media = soma / n;
+    double variancia = soma_quadrados / n - media * media;
+    double erro_padrao = sqrt((variancia > 0 ? variancia : 0) / n);
+    return fabs(media - esperado) <= DESVIOS_AUTOTESTE * erro_padrao + 1e-9;
+}
+
+/**
+ * @brief atacar_blitz (sorteio O(1)) contra a cadeia exata "atacar ate conquistar ou restar 1 tropa"
+ * (calcular_probabilidades, montada com resolver_batalha): chance de conquista, batalhas e tropas
+ * finais do atacante, para varios numeros de tropas.
+ * @return int: 1 se houve divergencia ou falta de memoria, 0 caso contrario.
+ */
+int autoteste_blitz(uint64_t semente) {
+    static const int TROPAS[] = { 2, 3, 5, 10, 40 };
+    Partida partida = {0};
+    Jogador jogador = {0};
+    long long divergencias = 0, casos = 0;
+
+    iniciar_dados_partida(&partida, semente, 1);
+    int atacante = registrar_cor(&partida.cores, CORES_SIMULACAO[0]);
+    int defensor = registrar_cor(&partida.cores, CORES_SIMULACAO[1]);
+    if (atacante < 0 || defensor < 0 || alocar_mapa(&partida, 2) != 0 ||
+        registrar_territorio(&partida, &partida.mapa[0], atacante, 2) != 0 ||
+        registrar_territorio(&partida, &partida.mapa[1], defensor, 3) != 0) {
+        descartar_partida(&partida);
+        return relatar_autoteste("blitz (sem memoria)", 0, 1);
     }
-    
-    // Lógica 3: Eliminar todas as tropas de uma cor (Ex: Vermelha).
-    if (strcmp(jogador->missao, MISSOES[1]) == 0) {
-        // Encontra a cor a ser eliminada (neste caso, "Vermelha" pela descrição da missão)
-        int tropas_restantes = 0;
-        for (int i = 0; i < g_num_territorios; i++) {
-            if (strcmp((mapa + i)->cor, "Vermelha") == 0) {
-                tropas_restantes += (mapa + i)->tropas;
-            }
+
+    for (size_t k = 0; k < sizeof(TROPAS) / sizeof(TROPAS[0]); k++) {
+        ProbabilidadesAtaque exata;
+        double conquistas = 0, batalhas = 0, batalhas2 = 0, tropas = 0, tropas2 = 0;
+        if (calcular_probabilidades(TROPAS[k], 3, &exata) != 0) {
+            divergencias++;
+            continue;
         }
-        if (tropas_restantes == 0) {
-            printf("\nPARABENS! O jogador %s cumpriu sua missao de 'Eliminar todas as tropas da cor Vermelha'!\n", jogador->cor);
-            return 1;
+        for (int a = 0; a < ATAQUES_BLITZ_AUTOTESTE; a++) {
+            int num_batalhas;
+            transferir_territorio(&partida, &partida.mapa[1], defensor);
+            alterar_tropas(&partida, &partida.mapa[1], 3);
+            alterar_tropas(&partida, &partida.mapa[0], TROPAS[k]);
+            conquistas += atacar_blitz(&partida, &partida.mapa[0], &partida.mapa[1], &jogador, &num_batalhas);
+            batalhas += num_batalhas;
+            batalhas2 += (double)num_batalhas * num_batalhas;
+            tropas += partida.mapa[0].tropas;
+            tropas2 += (double)partida.mapa[0].tropas * partida.mapa[0].tropas;
         }
+        divergencias += !media_confere(conquistas, conquistas, ATAQUES_BLITZ_AUTOTESTE, exata.p_conquista_sequencia);
+        divergencias += !media_confere(batalhas, batalhas2, ATAQUES_BLITZ_AUTOTESTE, exata.batalhas_esperadas);
+        divergencias += !media_confere(tropas, tropas2, ATAQUES_BLITZ_AUTOTESTE, exata.tropas_atacante_esperadas);
+        casos += ATAQUES_BLITZ_AUTOTESTE;
     }
-    
-    // Adicione a lógica para as outras missões aqui.
-    
-    return 0; // Missão não cumprida.
+    descartar_partida(&partida);
+    return relatar_autoteste("blitz ~ cadeia exata de batalhas", casos, divergencias);
 }
 
-
-// ------------------------------------------------------------------------------------------------
-// --- Funcoes de Manipulacao de Dados (Exibir, Cadastrar) ---
-// ------------------------------------------------------------------------------------------------
-
 /**
- * @brief Realiza o cadastro de todos os territórios.
- * @param mapa Ponteiro para o array dinâmico de territórios.
+ * @brief Monta o mapa das verificacoes sobre o mapa: CORES_AUTOTESTE cores em faixas de tamanho
+ * aleatorio (para haver faixas longas de uma mesma cor). Os nomes "Territorio-1" a
+ * "Territorio-<n / 4>" se repetem, os seguintes ate n / 2 sao unicos e os de n / 2 + 1 em diante
+ * nao existem.
+ * @return int: 0 em caso de sucesso, 1 em caso de falha de alocacao.
  */
-void cadastrar_territorios(Territorio* mapa) {
-    int i;
-    
-    printf("==========================================\n");
-    printf("  SISTEMA DE CADASTRO DE TERRITORIOS \n");
-    printf("==========================================\n");
-    sleep(1); 
-    printf("Iniciando o cadastro de %d territorios.\n\n", g_num_territorios);
-
-    for (i = 0; i < g_num_territorios; i++) {
-        Territorio* t = mapa + i; 
-
-        printf("--- Cadastro do Territorio %d de %d ---\n", i + 1, g_num_territorios);
-
-        // 1. Leitura do NOME
-        printf("Digite o nome do territorio (max 29 caracteres): ");
-        if (fgets(t->nome, sizeof(t->nome), stdin) == NULL) return; 
-        t->nome[strcspn(t->nome, "\n")] = '\0'; 
+int montar_mapa_autoteste(Partida* partida, uint64_t semente, int* ids) {
+    int n = TERRITORIOS_AUTOTESTE;
+    int cor = 0;
 
-        // 2. Leitura da COR
-        printf("Digite a cor do exercito (max 9 caracteres): ");
-        if (fgets(t->cor, sizeof(t->cor), stdin) == NULL) return; 
-        t->cor[strcspn(t->cor, "\n")] = '\0'; 
-
-        // 3. Leitura da QUANTIDADE DE TROPAS
-        do {
-            printf("Digite a quantidade de tropas (minimo 1): ");
-            if (scanf("%d", &(t->tropas)) != 1 || t->tropas <= 0) {
-                printf("Erro: Entrada invalida. A quantidade de tropas deve ser um inteiro maior que 0.\n");
-                limpar_buffer(); 
-                t->tropas = 0; 
-            }
-        } while (t->tropas <= 0);
+    iniciar_dados_partida(partida, semente, 2);
+    for (int c = 0; c < CORES_AUTOTESTE; c++) {
+        ids[c] = registrar_cor(&partida->cores, CORES_SIMULACAO[c]);
+        if (ids[c] < 0) return 1;
+    }
+    // Agregados de todas as cores desde o inicio: uma cor pode ficar sem territorio no sorteio.
+    if (garantir_agregados(partida, ids[CORES_AUTOTESTE - 1]) != 0 || alocar_mapa(partida, n) != 0) return 1;
+    for (int i = 0; i < n; i++) {
+        Territorio* t = partida->mapa + i;
+        if (gerador_intervalo(&partida->gerador, 8) == 0) cor = (int)gerador_intervalo(&partida->gerador, CORES_AUTOTESTE);
+        int numero = i < n / 2 ? i + 1 : (i - n / 2) % (n / 4) + 1;
+        snprintf(t->nome, sizeof(t->nome), "Territorio-%d", numero);
+        if (registrar_territorio(partida, t, ids[cor], 1 + (int)gerador_intervalo(&partida->gerador, 9)) != 0) return 1;
+    }
+    return 0;
+}
 
-        limpar_buffer(); 
-        printf("\n");
+/**
+ * @brief Muda um territorio aleatorio do mapa: novo dono e novas tropas (pelos ganchos de
+ * transferir_territorio e alterar_tropas, que mantem versoes e indices).
+ */
+void mudar_mapa_autoteste(Partida* partida, const int* ids) {
+    Territorio* t = partida->mapa + gerador_intervalo(&partida->gerador, (uint32_t)partida->num_territorios);
+    if (gerador_intervalo(&partida->gerador, 2) == 0) {
+        transferir_territorio(partida, t, ids[gerador_intervalo(&partida->gerador, CORES_AUTOTESTE)]);
     }
+    alterar_tropas(partida, t, 1 + (int)gerador_intervalo(&partida->gerador, 30));
 }
 
 /**
- * @brief Exibe todos os territórios cadastrados e seus dados atuais.
- * @param mapa Ponteiro para o array dinâmico de territórios.
+ * @brief Versoes do mapa (copia na escrita) contra copias completas do mapa: bifurca e copia em
+ * pontos aleatorios, muda o mapa e volta a versoes aleatorias; o mapa e os agregados restaurados
+ * tem de ser iguais a copia feita no momento da bifurcacao.
+ * @return int: 1 se houve divergencia ou falta de memoria, 0 caso contrario.
  */
-void exibir_territorios(Territorio* mapa) {
-    int i;
-    
-    sleep(1);
-    printf("\n==========================================\n");
-    printf("  DADOS DOS TERRITORIOS ATUAIS \n");
-    printf("==========================================\n");
-    sleep(1); 
+int autoteste_versoes(uint64_t semente) {
+    Partida partida = {0};
+    int ids[CORES_AUTOTESTE];
+    NoVersao* versoes[COPIAS_AUTOTESTE] = {0};
+    Territorio* copias = NULL;
+    AgregadoDono* agregados = NULL;
+    long long divergencias = 0, restauracoes = 0;
+    int n = TERRITORIOS_AUTOTESTE;
 
-    for (i = 0; i < g_num_territorios; i++) {
-        Territorio* t = mapa + i; 
+    int erro = montar_mapa_autoteste(&partida, semente, ids) != 0 || iniciar_versoes(&partida) != 0;
+    if (!erro) {
+        copias = (Territorio*)malloc((size_t)COPIAS_AUTOTESTE * n * sizeof(Territorio));
+        agregados = (AgregadoDono*)malloc((size_t)COPIAS_AUTOTESTE * partida.capacidade_agregados * sizeof(AgregadoDono));
+        erro = copias == NULL || agregados == NULL;
+    }
+    size_t bytes_agregados = (size_t)partida.capacidade_agregados * sizeof(AgregadoDono);
 
-        printf("Territorio %d:\n", i + 1);
-        printf("  Nome: %s\n", t->nome);
-        printf("  Cor do Exercito: %s\n", t->cor);
-        printf("  Tropas: %d\n", t->tropas);
-        printf("---\n");
-        sleep(0.3); 
+    for (int passo = 0; passo < PASSOS_AUTOTESTE && !erro; passo++) {
+        int s = (int)gerador_intervalo(&partida.gerador, COPIAS_AUTOTESTE);
+        uint32_t operacao = gerador_intervalo(&partida.gerador, 8);
+
+        if (operacao == 0) {
+            if (versoes[s] != NULL) soltar_versao(&partida, versoes[s]);
+            versoes[s] = bifurcar_versao(&partida);
+            memcpy(copias + (size_t)s * n, partida.mapa, (size_t)n * sizeof(Territorio));
+            memcpy((char*)agregados + s * bytes_agregados, partida.agregados, bytes_agregados);
+        } else if (operacao == 1 && versoes[s] != NULL) {
+            voltar_para_versao(&partida, versoes[s]);
+            const Territorio* copia = copias + (size_t)s * n;
+            for (int i = 0; i < n; i++) {
+                divergencias += partida.mapa[i].dono != copia[i].dono || partida.mapa[i].tropas != copia[i].tropas;
+            }
+            divergencias += memcmp((char*)agregados + s * bytes_agregados, partida.agregados, bytes_agregados) != 0;
+            restauracoes++;
+        } else {
+            mudar_mapa_autoteste(&partida, ids);
+        }
     }
+    if (!erro && !versoes_validas(&partida)) erro = 1; // Uma copia ficou sem memoria no caminho.
+    for (int s = 0; s < COPIAS_AUTOTESTE; s++) {
+        if (versoes[s] != NULL) soltar_versao(&partida, versoes[s]);
+    }
+    free(copias);
+    free(agregados);
+    descartar_partida(&partida);
+    if (erro) return relatar_autoteste("versoes do mapa (sem memoria)", 0, 1);
+    return relatar_autoteste("versao restaurada = copia do mapa", restauracoes, divergencias);
 }
 
-// ------------------------------------------------------------------------------------------------
-// --- Funcao de Batalha/Ataque ---
-// ------------------------------------------------------------------------------------------------
-
 /**
- * @brief Simula um ataque entre dois territórios.
- * @param atacante Ponteiro para a struct do território atacante.
- * @param defensor Ponteiro para a struct do território defensor.
- * @param jogador Ponteiro para a struct do jogador (para atualizar o contador de conquistas).
- * @return int: 1 se o ataque resultou em uma CONQUISTA, 0 caso contrário.
+ * @brief Indice de sequencias contra a varredura do mapa (as mesmas funcoes, com o indice
+ * desligado): maior sequencia de cada cor, sequencia de um territorio e soma de tropas num
+ * intervalo, com o mapa mudando entre consultas.
+ * @return int: 1 se houve divergencia ou falta de memoria, 0 caso contrario.
  */
-int atacar(Territorio* atacante, Territorio* defensor, Jogador* jogador) {
-    int dado_ataque, dado_defesa;
-    int houve_conquista = 0;
-    
-    printf("\n--- SIMULACAO DE ATAQUE ---\n");
-    printf("Atacante: %s (%s) vs Defensor: %s (%s)\n", 
-           atacante->nome, atacante->cor, defensor->nome, defensor->cor);
+int autoteste_sequencias(uint64_t semente) {
+    Partida partida = {0};
+    int ids[CORES_AUTOTESTE];
+    long long divergencias = 0, consultas = 0;
+    int n = TERRITORIOS_AUTOTESTE;
 
-    printf("Rodando os dados...");
-    fflush(stdout); 
-    sleep(1); 
+    if (montar_mapa_autoteste(&partida, semente, ids) != 0 || construir_indice_sequencias(&partida) != 0) {
+        descartar_partida(&partida);
+        return relatar_autoteste("indice de sequencias (sem memoria)", 0, 1);
+    }
+    IndiceSequencias* sequencias = partida.sequencias;
 
-    // 1. Rolagem dos Dados
-    dado_ataque = rolar_dado(); 
-    dado_defesa = rolar_dado(); 
+    for (int passo = 0; passo < PASSOS_AUTOTESTE; passo++) {
+        mudar_mapa_autoteste(&partida, ids);
 
-    printf("\nRolagem de Dados:\n");
-    printf("  Dado do Ataque: %d\n", dado_ataque);
-    printf("  Dado da Defesa: %d\n", dado_defesa);
-    
-    sleep(2); 
+        int c = ids[gerador_intervalo(&partida.gerador, CORES_AUTOTESTE)];
+        int i = (int)gerador_intervalo(&partida.gerador, (uint32_t)n);
+        int a = (int)gerador_intervalo(&partida.gerador, (uint32_t)n);
+        int b = a + (int)gerador_intervalo(&partida.gerador, (uint32_t)(n - a));
 
-    // 2. Resolucao do Combate
-    if (dado_ataque > dado_defesa) {
-        // ATACANTE VENCEU!
-        
-        printf("\nRESULTADO: O ataque foi VITORIOSO! %s conquistou %s!\n", atacante->nome, defensor->nome);
-        
-        // Atualiza a cor (Conquista de Território)
-        strcpy(defensor->cor, atacante->cor);
-        
-        // Atualiza o contador de conquistas do jogador.
-        jogador->territorios_conquistados++;
-        houve_conquista = 1;
-        
-        // Transfere metade das tropas.
-        int tropas_transferidas = atacante->tropas / 2;
-        defensor->tropas += tropas_transferidas; 
-        atacante->tropas -= tropas_transferidas;
-        
-        printf("  > %s mudou de cor para %s.\n", defensor->nome, defensor->cor);
-        printf("  > %d tropas foram transferidas de %s para %s.\n", 
-               tropas_transferidas, atacante->nome, defensor->nome);
-        
-    } else { // DEFENSOR VENCEU!
-        
-        printf("\nRESULTADO: A defesa foi bem-sucedida! %s manteve o controle de %s.\n", defensor->nome, defensor->nome);
-        
-        // Zera o contador de conquistas seguidas se o atacante falhar.
-        if (jogador->territorios_conquistados > 0) {
-            printf("  > Sequencia de conquistas reiniciada para 0.\n");
-            jogador->territorios_conquistados = 0;
-        }
+        int maior = maior_sequencia(&partida, c), seguidos = sequencia_do_territorio(&partida, i);
+        long long tropas = tropas_no_intervalo(&partida, a, b);
 
-        // Penalidade: Atacante perde 1 tropa.
-        if (atacante->tropas > 1) { 
-            atacante->tropas--;
-            printf("  > %s perdeu 1 tropa no ataque.\n", atacante->nome);
-        } else {
-            printf("  > %s ficou com tropas insuficientes para perder mais tropas (1 tropa restante).\n", atacante->nome);
-        }
+        partida.sequencias = NULL;
+        divergencias += maior != maior_sequencia(&partida, c) || seguidos != sequencia_do_territorio(&partida, i) ||
+                        tropas != tropas_no_intervalo(&partida, a, b);
+        partida.sequencias = sequencias;
+        consultas++;
     }
-    sleep(1.5); 
-    return houve_conquista;
+    descartar_partida(&partida);
+    return relatar_autoteste("indice de sequencias = varredura", consultas, divergencias);
 }
 
 /**
- * @brief Gerencia a seleção dos territórios e executa o ataque.
- * @param mapa Ponteiro para o array dinâmico de territórios.
- * @param jogador Ponteiro para o jogador atual.
+ * @brief Indice de nomes contra a varredura do mapa (buscar_territorio com a tabela desligada):
+ * nomes existentes, repetidos e inexistentes, com o mapa mudando entre consultas.
+ * @return int: 1 se houve divergencia ou falta de memoria, 0 caso contrario.
  */
-void menu_ataque_rodada(Territorio* mapa, Jogador* jogador) {
-    int id_atacante, id_defensor;
-    Territorio *p_atacante, *p_defensor; 
-    int ataque_bem_sucedido = 0; 
+int autoteste_nomes(uint64_t semente) {
+    Partida partida = {0};
+    int ids[CORES_AUTOTESTE];
+    long long divergencias = 0, consultas = 0;
+    int n = TERRITORIOS_AUTOTESTE;
+    char nome[TAMANHO_NOME];
 
-    sleep(1.5); 
-    printf("\n==========================================\n");
-    printf("              MENU DE ATAQUE \n");
-    printf("==========================================\n");
-    sleep(1.5); 
-    
-    while (!ataque_bem_sucedido) {
-        exibir_territorios(mapa);
-        
-        // 1. Escolha do Atacante
-        printf("\nEscolha o numero do TERRITORIO ATACANTE (1 a %d, ou 0 para CANCELAR): ", g_num_territorios);
-        if (scanf("%d", &id_atacante) != 1) {
-            printf("Entrada invalida. Tente novamente.\n");
-            limpar_buffer();
-            continue; 
-        }
-        limpar_buffer();
-        
-        if (id_atacante == 0) return; 
-        
-        if (id_atacante < 1 || id_atacante > g_num_territorios) {
-            printf("ID de territorio atacante invalido.\n");
-            continue;
-        }
+    if (montar_mapa_autoteste(&partida, semente, ids) != 0 || construir_indice_nomes(&partida, NULL) != 0) {
+        descartar_partida(&partida);
+        return relatar_autoteste("indice de nomes (sem memoria)", 0, 1);
+    }
+    int32_t* nomes = partida.tabela_nomes;
 
-        p_atacante = mapa + (id_atacante - 1); 
-        
-        // VALIDACAO: O atacante DEVE ser da cor do jogador.
-        if (strcmp(p_atacante->cor, jogador->cor) != 0) {
-             printf("Erro: O territorio selecionado (%s) nao pertence ao seu exercito (%s).\n", 
-                    p_atacante->cor, jogador->cor);
-             continue;
-        }
+    for (int passo = 0; passo < PASSOS_AUTOTESTE; passo++) {
+        mudar_mapa_autoteste(&partida, ids);
 
-        // Validacao: Tropas mínimas.
-        if (p_atacante->tropas < 2) {
-             printf("Erro: E necessario no minimo 2 tropas para atacar. Tente novamente.\n");
-             continue;
-        }
-        
-        // 2. Escolha do Defensor
-        printf("Escolha o numero do TERRITORIO DEFENSOR (1 a %d): ", g_num_territorios);
-        if (scanf("%d", &id_defensor) != 1) {
-            printf("Entrada invalida. Tente novamente.\n");
-            limpar_buffer();
-            continue;
-        }
-        limpar_buffer();
-        
-        if (id_defensor < 1 || id_defensor > g_num_territorios) {
-            printf("ID de territorio defensor invalido.\n");
-            continue;
-        }
-        
-        p_defensor = mapa + (id_defensor - 1); 
-        
-        // 3. Validacoes de Regras do Jogo
-        
-        // Regra 1: Não pode atacar a si mesmo.
-        if (p_atacante == p_defensor) {
-            printf("Erro: Um territorio nao pode atacar a si mesmo.\n");
-            continue;
-        }
-        
-        // Regra 2: Não pode atacar territórios da mesma cor.
-        if (strcmp(p_atacante->cor, p_defensor->cor) == 0) {
-            printf("Erro: Nao e possivel atacar um territorio da mesma cor (%s).\n", p_atacante->cor);
-            continue;
-        }
+        // Nome repetido, unico ou inexistente (ver montar_mapa_autoteste).
+        snprintf(nome, sizeof(nome), "Territorio-%d", 1 + (int)gerador_intervalo(&partida.gerador, (uint32_t)n));
+        int encontrado = buscar_territorio(&partida, nome);
 
-        // 4. Execucao do Ataque
-        atacar(p_atacante, p_defensor, jogador);
-        ataque_bem_sucedido = 1; 
+        partida.tabela_nomes = NULL;
+        divergencias += encontrado != buscar_territorio(&partida, nome);
+        partida.tabela_nomes = nomes;
+        consultas++;
     }
+    descartar_partida(&partida);
+    return relatar_autoteste("indice de nomes = varredura", consultas, divergencias);
 }
 
+/**
+ * @brief Autoteste (--autoteste): roda todas as verificacoes e imprime uma linha por verificacao.
+ * @return int: codigo de saida do programa (0 se todas conferem).
+ */
+int executar_autoteste(const Configuracao* config) {
+    GeradorDados gerador;
+    struct timespec inicio;
+    int falhas = 0;
+
+    g_modo_silencioso = 1;
+    gerador_iniciar(&gerador, config->semente, 0);
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    printf("==========================================\n");
+    printf("         AUTOTESTE \n");
+    printf("==========================================\n");
+    printf("Semente: %llu\n", (unsigned long long)config->semente);
+    falhas += autoteste_lote_batalhas(&gerador);
+    falhas += autoteste_dados(&gerador);
+    falhas += autoteste_blitz(config->semente);
+    falhas += autoteste_versoes(config->semente);
+    falhas += autoteste_sequencias(config->semente);
+    falhas += autoteste_nomes(config->semente);
+    printf("Tempo: %.3f s\n", segundos_desde(&inicio));
+    printf("Resultado: %s\n", falhas == 0 ? "todas as verificacoes conferem" : "DIVERGENCIA encontrada");
+    printf("==========================================\n");
+    g_modo_silencioso = 0;
+    return falhas != 0;
+}
 
 // ------------------------------------------------------------------------------------------------
 // --- Funcao Principal (main) ---
 // ------------------------------------------------------------------------------------------------
-int main() {
-    // Inicializa o gerador de números aleatórios.
-    srand(time(NULL)); 
+int main(int argc, char* argv[]) {
+    // Modo sem interface: joga N partidas e imprime as estatisticas.
+    Configuracao config;
+    int modo_simulacao = ler_argumentos(argc, argv, &config);
+    if (modo_simulacao < 0) return 1;
+    g_paginas_enormes = config.paginas_enormes;
+    if (config.estatisticas) {
+        // Instrumentacao ligada antes de qualquer thread; o relatorio sai no fim do programa.
+        g_estatisticas_ativas = 1;
+        g_estatisticas_json = config.estatisticas_json;
+        atexit(imprimir_estatisticas_execucao);
+    }
+    if (config.arquivo_missoes != NULL && carregar_missoes(config.arquivo_missoes, &g_missoes) != 0) return 1;
+    if (config.exportar_mapa != NULL) return exportar_mapa(&config);
+    if (config.benchmark) return executar_benchmark(&config);
+    if (config.autoteste) return executar_autoteste(&config);
+    if (config.arquivo_replay != NULL) {
+        return reproduzir_diario(config.arquivo_replay, config.arquivos_mapa[config.num_mapas - 1]);
+    }
+    if (config.arquivo_script != NULL) return executar_script(&config);
+    if (config.endereco_servidor != NULL) return executar_servidor(&config);
+    if (modo_simulacao == 1) return simular_partidas(&config);
+    if (config.jogadores_informados && config.num_jogadores > MAX_JOGADORES_ESTADO) {
+        // O jogo salvo (e os checkpoints) guarda no maximo MAX_JOGADORES_ESTADO jogadores.
+        printf("Erro: no modo interativo, --jogadores aceita no maximo %d (limite do jogo salvo).\n", MAX_JOGADORES_ESTADO);
+        return 1;
+    }
     
+    Partida partida = {0}; // Estado da partida interativa.
+    Arena arena_sessao = {0}; // Memoria da partida cadastrada pelo teclado (mapa, agregados, jogadores).
     Territorio* mapa_territorios = NULL; 
     Jogador jogador_principal = {0}; // Inicializa a struct do jogador.
+
+    // Inicializa o gerador de números aleatórios da partida (--seed ou o relógio).
+    iniciar_dados_partida(&partida, config.semente, 0);
     int opcao = 0; 
 
     // Define a cor do jogador principal (para fins de missao/lógica).
     strcpy(jogador_principal.cor, "Vermelha");
-    
-    // 1. ALOCACAO DE MEMORIA E DEFINICAO DO TAMANHO
-    mapa_territorios = alocar_territorios();
-    
-    if (mapa_territorios == NULL) {
-        printf("Falha critica na alocacao de memoria. Encerrando o programa.\n");
-        return 1;
+
+    // O modo interativo usa o ultimo --map informado (os mapas de arquivo ficam no fim da lista).
+    const char* arquivo_mapa = config.num_mapas > 0 ? config.arquivos_mapa[config.num_mapas - 1] : NULL;
+    EstadoSalvo estado = {0};
+    long long rodada = 0;
+    if (arquivo_mapa != NULL) {
+        // 1/2. MAPA CARREGADO DE ARQUIVO (--map): dispensa a alocacao e o cadastro manuais.
+        // Se o arquivo for um jogo salvo, a partida continua de onde parou.
+        if (carregar_estado(&partida, &estado, arquivo_mapa) != 0) return 1;
+        printf("Mapa '%s' carregado: %d territorios.\n", arquivo_mapa, partida.num_territorios);
+    } else {
+        // 1. ALOCACAO DE MEMORIA E DEFINICAO DO TAMANHO
+        partida.arena = &arena_sessao;
+        mapa_territorios = alocar_territorios(&partida);
+
+        if (mapa_territorios == NULL) {
+            printf("Falha critica na alocacao de memoria. Encerrando o programa.\n");
+            liberar_arena(&arena_sessao);
+            return 1;
+        }
+
+        // 2. CADASTRO DOS TERRITORIOS
+        cadastrar_territorios(&partida);
+    }
+    if (estado.num_jogadores > 0) {
+        jogador_principal = estado.jogadores[0];
+        rodada = estado.rodada;
+        printf("Jogo salvo retomado na rodada %lld.\n", rodada);
+    } else {
+        jogador_principal.id_cor = registrar_cor(&partida.cores, jogador_principal.cor);
+
+        // 3. ATRIBUICAO E EXIBICAO DA MISSAO (NOVO REQUISITO)
+        atribuirMissao(&jogador_principal, &partida);
     }
-    
-    // 2. CADASTRO DOS TERRITORIOS
-    cadastrar_territorios(mapa_territorios);
-    
-    // 3. ATRIBUICAO E EXIBICAO DA MISSAO (NOVO REQUISITO)
-    atribuirMissao(&jogador_principal);
     exibirMissao(&jogador_principal);
 
+    // --jogadores N: a IA joga com outras N - 1 cores do mapa depois de cada ataque do humano
+    // (--ia mcts sozinho vale por --jogadores 2).
+    MesaJogadores oponentes = {0};
+    BuscaMCTS ia = {0};
+    int tem_oponentes = config.jogadores_informados || config.ia_mcts;
+    oponentes.arena = partida.arena;
+    if (tem_oponentes &&
+        preparar_oponentes(&partida, &oponentes, &jogador_principal, config.num_jogadores, &estado) != 0) {
+        return 1;
+    }
+    if (config.ia_mcts) {
+        long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+        ParametrosMCTS parametros = { config.ia_ms, config.ia_threads > 0 ? config.ia_threads : (nucleos > 0 ? (int)nucleos : 1),
+                                      config.ia_iteracoes, config.blitz };
+        if (iniciar_busca_mcts(&ia, &parametros) != 0) return 1;
+    }
+
+    // Diario de batalhas (--diario): o replay precisa do mapa inicial; se ele foi cadastrado
+    // no teclado, e salvo ao lado do diario.
+    Visualizacao vis = {0}; // Tela: o primeiro quadro mostra a primeira pagina do mapa.
+    vis.filtro_dono = -1;
+
+    Diario diario = {0};
+    if (config.arquivo_diario != NULL) {
+        char mapa_inicial[4096];
+        snprintf(mapa_inicial, sizeof(mapa_inicial), "%s.mapa", config.arquivo_diario);
+        if (arquivo_mapa == NULL && salvar_mapa_binario(&partida, mapa_inicial) != 0) return 1;
+        if (abrir_diario(&diario, config.arquivo_diario, &partida) != 0) return 1;
+        partida.diario = &diario;
+        diario_iniciar_partida(&diario, 0);
+        printf("Diario de batalhas: '%s' (mapa inicial: '%s').\n", config.arquivo_diario,
+               arquivo_mapa != NULL ? arquivo_mapa : mapa_inicial);
+    }
+
     // 4. LOOP PRINCIPAL DO JOGO
     do {
-        // Exibe o estado atual do jogo.
-        exibir_territorios(mapa_territorios);
+        // Exibe o estado atual do jogo (so o que mudou desde a ultima exibicao).
+        exibir_territorios(&partida, &vis);
 
         printf("\n==========================================\n");
         printf("                RODADA (%s) \n", jogador_principal.cor);
@@ -501,9 +8987,13 @@ int main() {
         printf("O que voce gostaria de fazer?\n");
         printf(" 1. Realizar um ataque\n");
         printf(" 2. Sair do Jogo\n");
+        printf(" 3. Salvar o jogo\n");
+        printf(" 4. Carregar um jogo salvo\n");
+        printf(" 5. Ver o mapa (paginas e filtros)\n");
+        printf(" 6. Desfazer a ultima rodada\n");
         printf("Opcao: ");
 
-        if (scanf("%d", &opcao) != 1) {
+        if (ler_inteiro_teclado(&opcao) != 1) {
             printf("Entrada invalida. Tente novamente.\n");
             limpar_buffer();
             opcao = 0; 
@@ -513,30 +9003,123 @@ int main() {
 
         switch (opcao) {
             case 1:
-                menu_ataque_rodada(mapa_territorios, &jogador_principal); 
+                // Guarda o inicio da rodada para o "Desfazer" (com --diario, que so acrescenta, nao ha desfazer).
+                if (oponentes.num_jogadores > 1) oponentes.jogadores[0] = jogador_principal;
+                if (partida.diario == NULL &&
+                    guardar_rodada_desfazer(&partida, oponentes.num_jogadores > 1 ? oponentes.jogadores : &jogador_principal,
+                                            oponentes.num_jogadores > 1 ? oponentes.num_jogadores : 1, rodada) != 0) {
+                    printf("Aviso: sem memoria para guardar a rodada; ela nao podera ser desfeita.\n");
+                }
+                menu_ataque_rodada(&partida, &jogador_principal, &vis); 
+                if (oponentes.num_jogadores > 1) {
+                    jogar_turno_oponentes(&partida, &oponentes, &jogador_principal, config.blitz,
+                                          config.ia_mcts ? &ia : NULL);
+                }
+                rodada++;
+                if (partida.diario != NULL) descarregar_diario(partida.diario);
+
+                // Checkpoint automatico a cada K rodadas (--checkpoint K).
+                if (oponentes.num_jogadores > 1) oponentes.jogadores[0] = jogador_principal;
+                if (config.intervalo_checkpoint > 0 && rodada % config.intervalo_checkpoint == 0 &&
+                    salvar_estado(&partida, oponentes.num_jogadores > 1 ? oponentes.jogadores : &jogador_principal,
+                                  oponentes.num_jogadores > 1 ? oponentes.num_jogadores : 1, rodada,
+                                  config.arquivo_estado) == 0) {
+                    printf("\n[Checkpoint da rodada %lld salvo em '%s']\n", rodada, config.arquivo_estado);
+                }
                 break;
             case 2:
                 printf("\nOpcao 'Sair' selecionada. Encerrando o jogo...\n");
                 sleep(1);
                 break;
+            case 3:
+                if (oponentes.num_jogadores > 1) {
+                    oponentes.jogadores[0] = jogador_principal;
+                    menu_salvar_jogo(&partida, oponentes.jogadores, oponentes.num_jogadores, rodada, config.arquivo_estado);
+                } else {
+                    menu_salvar_jogo(&partida, &jogador_principal, 1, rodada, config.arquivo_estado);
+                }
+                break;
+            case 4: {
+                uint64_t hash_antes = partida.diario != NULL ? hash_mapa(&partida) : 0;
+                if (menu_carregar_jogo(&partida, &jogador_principal, &estado, &rodada, config.arquivo_estado) &&
+                    tem_oponentes &&
+                    preparar_oponentes(&partida, &oponentes, &jogador_principal, config.num_jogadores, &estado) != 0) {
+                    opcao = 2; // Sem memoria para os oponentes: encerra.
+                }
+
+                // O jogo carregado nao parte do mapa inicial do diario: o diario termina aqui.
+                if (diario.arquivo != NULL && partida.diario == NULL) {
+                    diario_finalizar_partida(&diario, hash_antes);
+                    fechar_diario(&diario);
+                    printf("Diario de batalhas encerrado (%lld batalhas).\n", diario.eventos);
+                }
+                break;
+            }
+            case 5:
+                menu_visualizar_mapa(&partida, &vis);
+                break;
+            case 6: {
+                // O mapa volta a versao guardada no inicio da rodada: so os territorios que mudaram
+                // (no ataque e nos turnos da IA) sao reescritos.
+                int restaurados = -1;
+                if (partida.diario != NULL) {
+                    printf("\nO desfazer nao esta disponivel com --diario (o diario so acrescenta batalhas).\n");
+                    break;
+                }
+                if (oponentes.num_jogadores > 1) {
+                    restaurados = desfazer_rodada(&partida, oponentes.jogadores, oponentes.num_jogadores, &rodada);
+                    if (restaurados >= 0) {
+                        jogador_principal = oponentes.jogadores[0];
+                        preparar_turnos(&oponentes, &partida, oponentes.num_cores); // Eliminados voltam a roda.
+                    }
+                } else {
+                    restaurados = desfazer_rodada(&partida, &jogador_principal, 1, &rodada);
+                }
+                if (restaurados < 0) printf("\nNao ha rodada para desfazer.\n");
+                else printf("\nRodada desfeita: %d territorio(s) restaurado(s); de volta a rodada %lld.\n", restaurados, rodada);
+                break;
+            }
             default:
-                printf("\nOpcao invalida. Por favor, escolha 1 ou 2.\n");
+                printf("\nOpcao invalida. Por favor, escolha de 1 a 6.\n");
                 sleep(1);
                 break;
         }
         
         // 5. VERIFICACAO DE VITORIA POR MISSAO (NOVO REQUISITO)
-        if (verificarMissao(&jogador_principal, mapa_territorios) == 1) {
+        // Com oponentes, as missoes da IA tambem sao verificadas (o humano tem prioridade).
+        const Jogador* campeao = NULL;
+        if (verificarMissao(&jogador_principal, &partida) == 1) {
+            campeao = &jogador_principal;
+        } else if (oponentes.num_jogadores > 1) {
+            int vencedor = avaliar_missoes(&partida, oponentes.jogadores, oponentes.num_jogadores, 1);
+            if (vencedor > 0) {
+                campeao = &oponentes.jogadores[vencedor];
+                printf("\nO jogador %s (IA) cumpriu sua missao de '%s'.\n", campeao->cor,
+                       g_missoes.missoes[campeao->id_missao].descricao);
+            }
+        }
+        if (campeao != NULL) {
             printf("\n\n##################################################\n");
-            printf("#          O JOGADOR %s VENCEU O JOGO!        #\n", jogador_principal.cor);
+            printf("#          O JOGADOR %s VENCEU O JOGO!        #\n", campeao->cor);
             printf("##################################################\n\n");
             opcao = 2; // Força a saída do loop do jogo.
         }
 
     } while (opcao != 2);
 
-    // 6. LIBERACAO DE MEMORIA (Atualizada para incluir a missão)
-    liberar_memoria(mapa_territorios, &jogador_principal);
+    if (partida.diario != NULL) {
+        diario_finalizar_partida(&diario, hash_mapa(&partida));
+        if (fechar_diario(&diario) == 0) {
+            printf("\nDiario de batalhas gravado: %lld batalhas em '%s'.\n", diario.eventos, config.arquivo_diario);
+        }
+    }
+
+    // 6. LIBERACAO DE MEMORIA
+    liberar_mesa(&oponentes);
+    liberar_busca_mcts(&ia);
+    liberar_visualizacao(&vis);
+    liberar_memoria(&partida);
+    liberar_arena(&arena_sessao);
 
     // Mensagem de Encerramento final.
     sleep(1.5);